@@ -29,6 +29,13 @@
 #  error Platform not supported
 #endif
 
+#if defined(__i386__)   || \
+    defined(__x86_64__) || \
+    defined(_M_IX86)    || \
+    defined(_M_X64)
+#  define SPHERE_X86
+#endif
+
 #if defined(_WIN32)
 #  if defined(BUILDING_SPHERE)
 #    define SPHEREAPI __declspec(dllexport)
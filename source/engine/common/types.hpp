@@ -18,6 +18,10 @@
 #ifndef SPHERE_TYPES_HPP
 #define SPHERE_TYPES_HPP
 
+#ifndef _MSC_VER
+#  include <stdint.h>
+#endif
+
 
 namespace sphere {
 
@@ -31,7 +35,6 @@ namespace sphere {
     typedef unsigned __int32 u32;
     typedef unsigned __int64 u64;
 #else
-#include <stdint.h>
     typedef int8_t   i8;
     typedef int16_t  i16;
     typedef int32_t  i32;
@@ -74,15 +74,16 @@ namespace sphere {
 
         bool intersects(const Rect& that) const
         {
-            return (lr.y > that.ul.y &&
-                    ul.y < that.lr.y &&
-                    lr.x > that.ul.x &&
-                    ul.x < that.lr.x);
+            return (lr.y >= that.ul.y &&
+                    ul.y <= that.lr.y &&
+                    lr.x >= that.ul.x &&
+                    ul.x <= that.lr.x);
         }
 
+        // returns an invalid rectangle if there is no intersection
         Rect getIntersection(const Rect& that) const {
             if (!isValid() || !that.isValid()) {
-                return Rect();
+                return Rect(0, 0, -1, -1);
             }
             if (this == &that) {
                 return *this;
@@ -92,7 +93,7 @@ namespace sphere {
                 lr.x < that.ul.x ||
                 lr.y < that.ul.y)
             {
-                return Rect();
+                return Rect(0, 0, -1, -1);
             }
             T x1 = ul.x;
             T y1 = ul.y;
@@ -0,0 +1,341 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <vector>
+#include "../common/platform.hpp"
+#include "ThreadPool.hpp"
+
+#if defined(SPHERE_WINDOWS)
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    struct ThreadPool::Impl {
+#if defined(SPHERE_WINDOWS)
+        CRITICAL_SECTION   mutex;
+        CONDITION_VARIABLE work_cond;
+        CONDITION_VARIABLE done_cond;
+        std::vector<HANDLE> threads;
+#else
+        pthread_mutex_t    mutex;
+        pthread_cond_t     work_cond;
+        pthread_cond_t     done_cond;
+        std::vector<pthread_t> threads;
+#endif
+        Job* job;
+        int  count;
+        int  next;
+        int  remaining;
+        bool busy;
+        bool quit;
+
+        Impl();
+        ~Impl();
+
+        bool start(int numThreads);
+        void stop();
+
+        void lock();
+        void unlock();
+        void waitWork();
+        void waitDone();
+        void signalWork();
+        void signalDone();
+
+        void work();
+
+#if defined(SPHERE_WINDOWS)
+        static DWORD WINAPI ThreadMain(LPVOID arg);
+#else
+        static void* ThreadMain(void* arg);
+#endif
+    };
+
+    //-----------------------------------------------------------------
+    ThreadPool::Impl::Impl()
+        : job(0)
+        , count(0)
+        , next(0)
+        , remaining(0)
+        , busy(false)
+        , quit(false)
+    {
+#if defined(SPHERE_WINDOWS)
+        InitializeCriticalSection(&mutex);
+        InitializeConditionVariable(&work_cond);
+        InitializeConditionVariable(&done_cond);
+#else
+        pthread_mutex_init(&mutex, 0);
+        pthread_cond_init(&work_cond, 0);
+        pthread_cond_init(&done_cond, 0);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    ThreadPool::Impl::~Impl()
+    {
+        stop();
+#if defined(SPHERE_WINDOWS)
+        DeleteCriticalSection(&mutex);
+#else
+        pthread_cond_destroy(&done_cond);
+        pthread_cond_destroy(&work_cond);
+        pthread_mutex_destroy(&mutex);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    ThreadPool::Impl::start(int numThreads)
+    {
+        for (int i = 0; i < numThreads; ++i) {
+#if defined(SPHERE_WINDOWS)
+            HANDLE thread = CreateThread(0, 0, ThreadMain, this, 0, 0);
+            if (!thread) {
+                return false;
+            }
+#else
+            pthread_t thread;
+            if (pthread_create(&thread, 0, ThreadMain, this) != 0) {
+                return false;
+            }
+#endif
+            threads.push_back(thread);
+        }
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ThreadPool::Impl::stop()
+    {
+        lock();
+        quit = true;
+        unlock();
+        signalWork();
+
+        for (int i = 0; i < (int)threads.size(); ++i) {
+#if defined(SPHERE_WINDOWS)
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+#else
+            pthread_join(threads[i], 0);
+#endif
+        }
+        threads.clear();
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ThreadPool::Impl::lock()
+    {
+#if defined(SPHERE_WINDOWS)
+        EnterCriticalSection(&mutex);
+#else
+        pthread_mutex_lock(&mutex);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ThreadPool::Impl::unlock()
+    {
+#if defined(SPHERE_WINDOWS)
+        LeaveCriticalSection(&mutex);
+#else
+        pthread_mutex_unlock(&mutex);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ThreadPool::Impl::waitWork()
+    {
+#if defined(SPHERE_WINDOWS)
+        SleepConditionVariableCS(&work_cond, &mutex, INFINITE);
+#else
+        pthread_cond_wait(&work_cond, &mutex);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ThreadPool::Impl::waitDone()
+    {
+#if defined(SPHERE_WINDOWS)
+        SleepConditionVariableCS(&done_cond, &mutex, INFINITE);
+#else
+        pthread_cond_wait(&done_cond, &mutex);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ThreadPool::Impl::signalWork()
+    {
+#if defined(SPHERE_WINDOWS)
+        WakeAllConditionVariable(&work_cond);
+#else
+        pthread_cond_broadcast(&work_cond);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ThreadPool::Impl::signalDone()
+    {
+#if defined(SPHERE_WINDOWS)
+        WakeAllConditionVariable(&done_cond);
+#else
+        pthread_cond_broadcast(&done_cond);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ThreadPool::Impl::work()
+    {
+        // called with the mutex held, returns with the mutex held
+        while (job && next < count) {
+            Job* j = job;
+            int index = next++;
+            unlock();
+
+            j->run(index);
+
+            lock();
+            if (--remaining == 0) {
+                signalDone();
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+#if defined(SPHERE_WINDOWS)
+    DWORD WINAPI
+    ThreadPool::Impl::ThreadMain(LPVOID arg)
+#else
+    void*
+    ThreadPool::Impl::ThreadMain(void* arg)
+#endif
+    {
+        Impl* impl = (Impl*)arg;
+        impl->lock();
+        while (!impl->quit) {
+            impl->work();
+            if (!impl->quit) {
+                impl->waitWork();
+            }
+        }
+        impl->unlock();
+        return 0;
+    }
+
+    //-----------------------------------------------------------------
+    int
+    ThreadPool::GetNumProcessors()
+    {
+#if defined(SPHERE_WINDOWS)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        return n > 0 ? (int)n : 1;
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    ThreadPool*
+    ThreadPool::GetDefault()
+    {
+        static ThreadPoolPtr pool = Create();
+        return pool.get();
+    }
+
+    //-----------------------------------------------------------------
+    ThreadPool*
+    ThreadPool::Create(int numThreads)
+    {
+        assert(numThreads >= 0);
+        if (numThreads == 0) {
+            // the thread calling run() is the last worker
+            numThreads = GetNumProcessors() - 1;
+        }
+        return new ThreadPool(numThreads);
+    }
+
+    //-----------------------------------------------------------------
+    ThreadPool::ThreadPool(int numThreads)
+        : _impl(new Impl())
+        , _numThreads(0)
+    {
+        _impl->start(numThreads);
+        _numThreads = (int)_impl->threads.size();
+    }
+
+    //-----------------------------------------------------------------
+    ThreadPool::~ThreadPool()
+    {
+        delete _impl;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ThreadPool::run(Job* job, int count)
+    {
+        assert(job);
+        if (count <= 0) {
+            return;
+        }
+
+        bool serial = (_numThreads == 0 || count == 1);
+        if (!serial) {
+            _impl->lock();
+            serial = _impl->busy;
+            if (!serial) {
+                _impl->busy      = true;
+                _impl->job       = job;
+                _impl->count     = count;
+                _impl->next      = 0;
+                _impl->remaining = count;
+                _impl->signalWork();
+                _impl->work();
+                while (_impl->remaining > 0) {
+                    _impl->waitDone();
+                }
+                _impl->job  = 0;
+                _impl->busy = false;
+            }
+            _impl->unlock();
+        }
+
+        if (serial) {
+            for (int i = 0; i < count; ++i) {
+                job->run(i);
+            }
+        }
+    }
+
+} // namespace sphere
@@ -0,0 +1,71 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_THREADPOOL_HPP
+#define SPHERE_THREADPOOL_HPP
+
+#include "../common/RefPtr.hpp"
+#include "../common/RefImpl.hpp"
+#include "../common/IRefCounted.hpp"
+
+
+namespace sphere {
+
+    // Runs the indices of a job across a fixed set of worker threads.
+    // The thread calling run() executes jobs as well and returns once
+    // every index has completed. A run() issued while the pool is busy
+    // (e.g. from inside a job) executes serially on the calling thread.
+    class ThreadPool : public RefImpl<IRefCounted> {
+    public:
+        class Job {
+        public:
+            virtual ~Job() { }
+            virtual void run(int index) = 0;
+        };
+
+        static int GetNumProcessors();
+        static ThreadPool* GetDefault();
+
+        static ThreadPool* Create(int numThreads = 0);
+
+        int   getNumThreads() const;
+        void  run(Job* job, int count);
+
+    private:
+        struct Impl;
+
+        ThreadPool(int numThreads);
+        virtual ~ThreadPool();
+
+    private:
+        Impl* _impl;
+        int   _numThreads;
+    };
+
+    typedef RefPtr<ThreadPool> ThreadPoolPtr;
+
+    //-----------------------------------------------------------------
+    inline int
+    ThreadPool::getNumThreads() const
+    {
+        return _numThreads;
+    }
+
+} // namespace sphere
+
+
+#endif
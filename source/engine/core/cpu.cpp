@@ -0,0 +1,135 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/platform.hpp"
+#include "../common/types.hpp"
+#include "cpu.hpp"
+
+#if defined(SPHERE_X86)
+#  if defined(_MSC_VER)
+#    include <intrin.h>
+#  else
+#    include <cpuid.h>
+#  endif
+#endif
+
+
+namespace sphere {
+    namespace cpu {
+
+        //-----------------------------------------------------------------
+        struct Features {
+            bool sse2;
+            bool ssse3;
+            bool avx2;
+        };
+
+#if defined(SPHERE_X86)
+
+        //-----------------------------------------------------------------
+        static void cpuid(int leaf, int subleaf, u32 regs[4])
+        {
+#  if defined(_MSC_VER)
+            int r[4];
+            __cpuidex(r, leaf, subleaf);
+            regs[0] = r[0];
+            regs[1] = r[1];
+            regs[2] = r[2];
+            regs[3] = r[3];
+#  else
+            __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#  endif
+        }
+
+        //-----------------------------------------------------------------
+        static u64 xgetbv(u32 index)
+        {
+#  if defined(_MSC_VER)
+            return _xgetbv(index);
+#  else
+            u32 eax, edx;
+            __asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+            return ((u64)edx << 32) | eax;
+#  endif
+        }
+
+        //-----------------------------------------------------------------
+        static Features detect()
+        {
+            Features f = {false, false, false};
+            u32 regs[4];
+
+            cpuid(0, 0, regs);
+            u32 max_leaf = regs[0];
+            if (max_leaf < 1) {
+                return f;
+            }
+
+            cpuid(1, 0, regs);
+            f.sse2  = (regs[3] & (1 << 26)) != 0;
+            f.ssse3 = (regs[2] & (1 <<  9)) != 0;
+
+            // AVX2 additionally needs the OS to save the YMM registers
+            bool osxsave = (regs[2] & (1 << 27)) != 0;
+            bool avx     = (regs[2] & (1 << 28)) != 0;
+            if (osxsave && avx && max_leaf >= 7) {
+                bool ymm_enabled = (xgetbv(0) & 0x6) == 0x6;
+                cpuid(7, 0, regs);
+                f.avx2 = ymm_enabled && (regs[1] & (1 << 5)) != 0;
+            }
+
+            return f;
+        }
+
+#else
+
+        //-----------------------------------------------------------------
+        static Features detect()
+        {
+            Features f = {false, false, false};
+            return f;
+        }
+
+#endif
+
+        //-----------------------------------------------------------------
+        static const Features& features()
+        {
+            static const Features f = detect();
+            return f;
+        }
+
+        //-----------------------------------------------------------------
+        bool HasSSE2()
+        {
+            return features().sse2;
+        }
+
+        //-----------------------------------------------------------------
+        bool HasSSSE3()
+        {
+            return features().ssse3;
+        }
+
+        //-----------------------------------------------------------------
+        bool HasAVX2()
+        {
+            return features().avx2;
+        }
+
+    } // namespace cpu
+} // namespace sphere
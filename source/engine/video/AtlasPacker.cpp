@@ -0,0 +1,146 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <cassert>
+#include <climits>
+#include "AtlasPacker.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    AtlasPacker::AtlasPacker(int width, int height)
+        : _width(width)
+        , _height(height)
+    {
+        assert(width > 0);
+        assert(height > 0);
+        clear();
+    }
+
+    //-----------------------------------------------------------------
+    void
+    AtlasPacker::clear()
+    {
+        _usedArea = 0;
+        _deadArea = 0;
+        _skyline.clear();
+        Segment s = { 0, 0, _width };
+        _skyline.push_back(s);
+    }
+
+    //-----------------------------------------------------------------
+    // Finds the lowest y a rectangle starting at segment index can be
+    // placed at, and the area it would leave unusable below itself
+    bool
+    AtlasPacker::fit(int index, int width, int height, int& y, int& waste) const
+    {
+        int x = _skyline[index].x;
+        if (x + width > _width) {
+            return false;
+        }
+        y = 0;
+        int left = width;
+        for (int i = index; left > 0; ++i) {
+            if (_skyline[i].y > y) {
+                y = _skyline[i].y;
+            }
+            left -= _skyline[i].width;
+        }
+        if (y + height > _height) {
+            return false;
+        }
+        waste = 0;
+        left = width;
+        for (int i = index; left > 0; ++i) {
+            int w = (_skyline[i].width < left ? _skyline[i].width : left);
+            waste += (y - _skyline[i].y) * w;
+            left -= w;
+        }
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    AtlasPacker::insert(int width, int height, Recti& rect)
+    {
+        assert(width > 0);
+        assert(height > 0);
+
+        int best = -1;
+        int best_y = INT_MAX;
+        int best_waste = INT_MAX;
+        for (int i = 0; i < (int)_skyline.size(); ++i) {
+            int y;
+            int waste;
+            if (fit(i, width, height, y, waste) &&
+                (y + height < best_y || (y + height == best_y && waste < best_waste)))
+            {
+                best = i;
+                best_y = y + height;
+                best_waste = waste;
+            }
+        }
+        if (best < 0) {
+            return false;
+        }
+
+        int x = _skyline[best].x;
+        rect = Recti(x, best_y - height, x + width - 1, best_y - 1);
+
+        // the new segment replaces the parts of those it covers
+        Segment s = { x, best_y, width };
+        _skyline.insert(_skyline.begin() + best, s);
+        int i = best + 1;
+        while (i < (int)_skyline.size() && _skyline[i].x < x + width) {
+            int shrink = x + width - _skyline[i].x;
+            if (shrink >= _skyline[i].width) {
+                _skyline.erase(_skyline.begin() + i);
+            } else {
+                _skyline[i].x += shrink;
+                _skyline[i].width -= shrink;
+                break;
+            }
+        }
+
+        // merge neighbours of the same height
+        for (i = 0; i + 1 < (int)_skyline.size(); ) {
+            if (_skyline[i].y == _skyline[i + 1].y) {
+                _skyline[i].width += _skyline[i + 1].width;
+                _skyline.erase(_skyline.begin() + i + 1);
+            } else {
+                ++i;
+            }
+        }
+
+        _usedArea += width * height;
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    AtlasPacker::release(const Recti& rect)
+    {
+        int area = rect.getWidth() * rect.getHeight();
+        assert(area <= _usedArea);
+        _usedArea -= area;
+        _deadArea += area;
+        if (_usedArea == 0) {
+            clear();
+        }
+    }
+
+} // namespace sphere
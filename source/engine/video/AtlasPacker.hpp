@@ -0,0 +1,92 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SPHERE_ATLASPACKER_HPP
+#define SPHERE_ATLASPACKER_HPP
+
+#include <vector>
+#include "../base/Rect.hpp"
+
+
+namespace sphere {
+
+    // Allocates rectangles of an atlas page with the skyline bottom-left
+    // heuristic: the page is filled from the top, each rectangle goes
+    // where its bottom edge ends up highest, ties go to the one wasting
+    // the least area below it. Released rectangles only count as dead
+    // area, it can't be reused before the page is cleared, so a page
+    // with a lot of dead area should be repacked.
+    class AtlasPacker {
+    public:
+        AtlasPacker(int width, int height);
+
+        int   getWidth() const;
+        int   getHeight() const;
+        int   getUsedArea() const;
+        int   getDeadArea() const;
+        bool  insert(int width, int height, Recti& rect);
+        void  release(const Recti& rect);
+        void  clear();
+
+    private:
+        struct Segment {
+            int x;
+            int y;       // the skyline height over [x, x + width)
+            int width;
+        };
+
+        bool fit(int index, int width, int height, int& y, int& waste) const;
+
+    private:
+        int _width;
+        int _height;
+        int _usedArea;
+        int _deadArea;
+        std::vector<Segment> _skyline;
+    };
+
+    //-----------------------------------------------------------------
+    inline int
+    AtlasPacker::getWidth() const
+    {
+        return _width;
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    AtlasPacker::getHeight() const
+    {
+        return _height;
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    AtlasPacker::getUsedArea() const
+    {
+        return _usedArea;
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    AtlasPacker::getDeadArea() const
+    {
+        return _deadArea;
+    }
+
+} // namespace sphere
+
+
+#endif
@@ -16,12 +16,46 @@
 */
 
 #include <cstring>
+#include <cmath>
+#include <new>
 #include <algorithm>
+#include <vector>
+#include "../common/platform.hpp"
+#include "blend.hpp"
+#include "sample.hpp"
+#include "transform.hpp"
+#include "resample.hpp"
+#include "srgb.hpp"
+#include "blur.hpp"
+#include "trim.hpp"
+#include "convert.hpp"
+#include "raster.hpp"
+#include "PixelPool.hpp"
+#include "ColorTransform.hpp"
 #include "Canvas.hpp"
+#include "CanvasCommandList.hpp"
 
 
 namespace sphere {
 
+    //-----------------------------------------------------------------
+    static IPixelAllocator* g_DefaultAllocator = 0;
+
+    //-----------------------------------------------------------------
+    IPixelAllocator*
+    Canvas::GetDefaultAllocator()
+    {
+        return g_DefaultAllocator ? g_DefaultAllocator : PixelPool::GetDefault();
+    }
+
+    //-----------------------------------------------------------------
+    // New canvases keep the allocator they were created with
+    void
+    Canvas::SetDefaultAllocator(IPixelAllocator* allocator)
+    {
+        g_DefaultAllocator = allocator;
+    }
+
     //-----------------------------------------------------------------
     Canvas*
     Canvas::Create(int width, int height, const RGBA* pixels)
@@ -35,23 +69,165 @@ namespace sphere {
         return canvas.release();
     }
 
+    //-----------------------------------------------------------------
+    // The pixel memory of a canvas and the views sharing it
+    struct Canvas::PixelBuffer {
+        IPixelAllocator* allocator;
+        RGBA* pixels;
+        int   numPixels;
+        int   refCount;
+
+        void grab() {
+            ++refCount;
+        }
+
+        void drop() {
+            if (--refCount == 0) {
+                allocator->deallocate(pixels, numPixels);
+                delete this;
+            }
+        }
+    };
+
     //-----------------------------------------------------------------
     Canvas::Canvas(int width, int height)
         : _width(width)
         , _height(height)
+        , _stride(width)
         , _pixels(0)
+        , _buffer(0)
+        , _allocator(GetDefaultAllocator())
         , _blendMode(BM_ALPHA)
+        , _pixelFormat(PF_STRAIGHT_ALPHA)
+        , _deferred(false)
+        , _linearLight(false)
+        , _spanEncoded(false)
+        , _spansValid(false)
+        , _trimValid(false)
     {
         assert(width > 0);
         assert(height > 0);
-        _pixels = new RGBA[width * height];
+        RGBA* pixels = allocatePixels(width * height);
+        std::fill(pixels, pixels + width * height, RGBA());
+        setPixels(pixels, width, height);
         _scissor = Recti(0, 0, width - 1, height - 1);
+        _dirtyRegion.add(_scissor);
+    }
+
+    //-----------------------------------------------------------------
+    Canvas::Canvas(Canvas* canvas, const Recti& section)
+        : _width(section.getWidth())
+        , _height(section.getHeight())
+        , _stride(canvas->_stride)
+        , _pixels(canvas->_pixels + section.ul.y * canvas->_stride + section.ul.x)
+        , _buffer(canvas->_buffer)
+        , _allocator(canvas->_allocator)
+        , _blendMode(BM_ALPHA)
+        , _pixelFormat(canvas->_pixelFormat)
+        , _deferred(false)
+        , _linearLight(false)
+        , _spanEncoded(false)
+        , _spansValid(false)
+        , _trimValid(false)
+    {
+        _buffer->grab();
+        _scissor = Recti(0, 0, _width - 1, _height - 1);
+        _dirtyRegion.add(_scissor);
     }
 
     //-----------------------------------------------------------------
     Canvas::~Canvas()
     {
-        delete[] _pixels;
+        _buffer->drop();
+    }
+
+    //-----------------------------------------------------------------
+    RGBA*
+    Canvas::allocatePixels(int numPixels)
+    {
+        RGBA* pixels = _allocator->allocate(numPixels);
+        if (!pixels) {
+            throw std::bad_alloc();
+        }
+        return pixels;
+    }
+
+    //-----------------------------------------------------------------
+    // Replaces the pixels with a packed array of allocatePixels()
+    void
+    Canvas::setPixels(RGBA* pixels, int width, int height)
+    {
+        PixelBuffer* buffer = new (std::nothrow) PixelBuffer;
+        if (!buffer) {
+            _allocator->deallocate(pixels, width * height);
+            throw std::bad_alloc();
+        }
+        buffer->allocator = _allocator;
+        buffer->pixels    = pixels;
+        buffer->numPixels = width * height;
+        buffer->refCount  = 1;
+
+        if (_buffer) {
+            _buffer->drop();
+        }
+        _buffer = buffer;
+        _pixels = pixels;
+        _width  = width;
+        _height = height;
+        _stride = width;
+    }
+
+    //-----------------------------------------------------------------
+    // Called after the size changed, the old scissor and dirty
+    // rectangles may lie outside of the new size
+    void
+    Canvas::resetBounds()
+    {
+        _scissor = Recti(0, 0, _width - 1, _height - 1);
+        _dirtyRegion.clear();
+        _dirtyRegion.add(_scissor);
+    }
+
+    //-----------------------------------------------------------------
+    // Called before the pixels get written, copies them if they are
+    // shared or not packed, which the writers rely on
+    void
+    Canvas::detach()
+    {
+        // the pixels are about to change, a snapshot keeps the old ones
+        _snapshot = 0;
+        if (_buffer->refCount == 1 && _stride == _width) {
+            return;
+        }
+        RGBA* pixels = allocatePixels(_width * _height);
+        for (int iy = 0; iy < _height; ++iy) {
+            memcpy(pixels + iy * _width, _pixels + iy * _stride, _width * sizeof(RGBA));
+        }
+        setPixels(pixels, _width, _height);
+    }
+
+    //-----------------------------------------------------------------
+    // Returns a view of the whole canvas which keeps its current pixels,
+    // spans and trim, for deferred draw calls. It is shared until the
+    // canvas is written to, or rebuilt once spans or trim become valid.
+    Canvas*
+    Canvas::getSnapshot()
+    {
+        if (!_snapshot ||
+            (_spansValid && !_snapshot->_spansValid) ||
+            (_trimValid  && !_snapshot->_trimValid))
+        {
+            Canvas* snapshot = new Canvas(this, Recti(0, 0, _width - 1, _height - 1));
+            snapshot->_spanEncoded = _spanEncoded;
+            snapshot->_spansValid  = _spansValid;
+            if (_spansValid) {
+                snapshot->_spanTable = _spanTable;
+            }
+            snapshot->_trimValid = _trimValid;
+            snapshot->_trimRect  = _trimRect;
+            _snapshot = snapshot;
+        }
+        return _snapshot.get();
     }
 
     //-----------------------------------------------------------------
@@ -61,22 +237,37 @@ namespace sphere {
         if (!rect.isValid() || !rect.isInside(0, 0, _width - 1, _height - 1)) {
             return 0;
         }
+        flush();
         CanvasPtr section = Create(rect.getWidth(), rect.getHeight());
+        section->_pixelFormat = _pixelFormat;
         for (int iy = 0; iy < rect.getHeight(); ++iy) {
-            memcpy(section->getPixels() + (iy * section->getWidth()),
-                   _pixels + ((rect.ul.y + iy) * _width) + rect.ul.x,
+            memcpy(section->_pixels + (iy * section->_stride),
+                   _pixels + ((rect.ul.y + iy) * _stride) + rect.ul.x,
                    rect.getWidth() * sizeof(RGBA));
         }
         return section.release();
     }
 
+    //-----------------------------------------------------------------
+    // The view shares the pixels until either canvas is written to
+    Canvas*
+    Canvas::createView(const Recti& rect)
+    {
+        if (!rect.isValid() || !rect.isInside(0, 0, _width - 1, _height - 1)) {
+            return 0;
+        }
+        // the pending draw calls have to land before the pixels are shared
+        flush();
+        return new Canvas(this, rect);
+    }
+
     //-----------------------------------------------------------------
     const RGBA&
     Canvas::getPixel(int x, int y) const
     {
         assert(x >= 0 && x < _width);
         assert(y >= 0 && y < _height);
-        return _pixels[_width * y + x];
+        return _pixels[_stride * y + x];
     }
 
     //-----------------------------------------------------------------
@@ -85,7 +276,8 @@ namespace sphere {
     {
         assert(x >= 0 && x < _width);
         assert(y >= 0 && y < _height);
-        _pixels[_width * y + x] = color;
+        touch(Recti(x, y, x, y));
+        _pixels[_stride * y + x] = color;
     }
 
     //-----------------------------------------------------------------
@@ -93,7 +285,7 @@ namespace sphere {
     Canvas::getPixelByIndex(int index) const
     {
         assert(index >= 0 && index < _width * _height);
-        return _pixels[index];
+        return _pixels[_stride * (index / _width) + index % _width];
     }
 
     //-----------------------------------------------------------------
@@ -101,7 +293,80 @@ namespace sphere {
     Canvas::setPixelByIndex(int index, const RGBA& color)
     {
         assert(index >= 0 && index < _width * _height);
-        _pixels[index] = color;
+        int x = index % _width;
+        int y = index / _width;
+        touch(Recti(x, y, x, y));
+        _pixels[_stride * y + x] = color;
+    }
+
+    //-----------------------------------------------------------------
+    // The row may be written through, so it is marked dirty
+    RGBA*
+    Canvas::getRow(int y)
+    {
+        assert(y >= 0 && y < _height);
+        touch(Recti(0, y, _width - 1, y));
+        return _pixels + y * _stride;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::copyRowTo(int y, RGBA* dst) const
+    {
+        assert(y >= 0 && y < _height);
+        memcpy(dst, _pixels + y * _stride, _width * sizeof(RGBA));
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::copyRowFrom(int y, const RGBA* src)
+    {
+        assert(y >= 0 && y < _height);
+        touch(Recti(0, y, _width - 1, y));
+        memcpy(_pixels + y * _stride, src, _width * sizeof(RGBA));
+    }
+
+    //-----------------------------------------------------------------
+    // Pixels are passed as stored, so premultiplied if the canvas is.
+    // Like getPixel(), this doesn't flush a deferred canvas.
+    bool
+    Canvas::readPixels(const Recti& rect, void* dst, int pitch, int format) const
+    {
+        if (format < BF_RGBA || format > BF_A8 || !rect.isValid() || !Recti(0, 0, _width - 1, _height - 1).contains(rect)) {
+            return false;
+        }
+
+        PACKSPANFUNC_T pack = GetPackSpanFunc(format);
+        const RGBA* s = _pixels + rect.ul.y * _stride + rect.ul.x;
+        u8* d = (u8*)dst;
+        for (int iy = rect.getHeight(); iy > 0; --iy) {
+            pack(s, d, rect.getWidth());
+            s += _stride;
+            d += pitch;
+        }
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    // A8 values become white pixels of that alpha
+    bool
+    Canvas::writePixels(const Recti& rect, const void* src, int pitch, int format)
+    {
+        if (format < BF_RGBA || format > BF_A8 || !rect.isValid() || !Recti(0, 0, _width - 1, _height - 1).contains(rect)) {
+            return false;
+        }
+
+        touch(rect);
+
+        UNPACKSPANFUNC_T unpack = GetUnpackSpanFunc(format, _pixelFormat == PF_PREMULTIPLIED_ALPHA);
+        const u8* s = (const u8*)src;
+        RGBA* d = _pixels + rect.ul.y * _stride + rect.ul.x;
+        for (int iy = rect.getHeight(); iy > 0; --iy) {
+            unpack(s, d, rect.getWidth());
+            s += pitch;
+            d += _stride;
+        }
+        return true;
     }
 
     //-----------------------------------------------------------------
@@ -110,47 +375,260 @@ namespace sphere {
     {
         assert(width > 0);
         assert(height > 0);
+        touch();
         if (width == _width && height == _height) {
             return;
         }
-        RGBA* new_pixels = new RGBA[width * height];
+        RGBA* new_pixels = allocatePixels(width * height);
+        std::fill(new_pixels, new_pixels + width * height, RGBA());
         for (int i = 0; i < std::min(_height, height); ++i) {
-            memcpy(new_pixels + (i * width), _pixels + (i * _width), std::min(_width, width) * sizeof(RGBA));
+            memcpy(new_pixels + (i * width), _pixels + (i * _stride), std::min(_width, width) * sizeof(RGBA));
+        }
+        setPixels(new_pixels, width, height);
+        resetBounds();
+    }
+
+    //-----------------------------------------------------------------
+    // Rows per job of the resampling passes
+    static const int RESAMPLE_BAND_SIZE = 16;
+
+    //-----------------------------------------------------------------
+    // One pass of scale(): horizontal passes resample each row on its
+    // own, vertical ones the rows selected by the weights. Straight
+    // alpha images are filtered premultiplied, so the colors of
+    // transparent pixels don't bleed into their neighbors.
+    struct ResampleJob : public ThreadPool::Job {
+        const RGBA* src;
+        int   srcWidth;
+        RGBA* dst;
+        int   dstWidth;
+        int   dstHeight;
+        const ResampleWeights* weights;
+        bool  vertical;
+        bool  premultiplySource;
+        bool  unpremultiplyResult;
+        bool  premultipliedResult;
+
+        virtual void run(int index) {
+            RESAMPLEROWFUNC_T    resample_row    = GetResampleRowFunc();
+            RESAMPLECOLUMNFUNC_T resample_column = GetResampleColumnFunc();
+
+            int num_taps = weights->numTaps;
+            std::vector<RGBA> row;
+            if (premultiplySource) {
+                row.resize(srcWidth);
+            }
+
+            int y1 = index * RESAMPLE_BAND_SIZE;
+            int y2 = std::min(y1 + RESAMPLE_BAND_SIZE, dstHeight);
+            for (int y = y1; y < y2; ++y) {
+                RGBA* d = dst + y * dstWidth;
+                if (vertical) {
+                    resample_column(src + weights->start[y] * srcWidth, srcWidth, d, dstWidth, &weights->weights[y * num_taps], num_taps);
+                } else {
+                    const RGBA* s = src + y * srcWidth;
+                    if (premultiplySource) {
+                        for (int x = 0; x < srcWidth; ++x) {
+                            row[x] = rgba_premultiply(s[x]);
+                        }
+                        s = &row[0];
+                    }
+                    resample_row(s, d, dstWidth, &weights->start[0], &weights->weights[0], num_taps);
+                }
+
+                if (unpremultiplyResult) {
+                    for (int x = 0; x < dstWidth; ++x) {
+                        d[x] = rgba_unpremultiply(d[x]);
+                    }
+                } else if (premultipliedResult) {
+                    // negative filter lobes may overshoot the alpha
+                    for (int x = 0; x < dstWidth; ++x) {
+                        d[x].red   = std::min(d[x].red,   d[x].alpha);
+                        d[x].green = std::min(d[x].green, d[x].alpha);
+                        d[x].blue  = std::min(d[x].blue,  d[x].alpha);
+                    }
+                }
+            }
+        }
+    };
+
+    //-----------------------------------------------------------------
+    // One pass of a linear light scale(): the horizontal pass decodes
+    // each row and writes linearDst if a vertical pass follows, which
+    // reads linearSrc, otherwise both passes encode their result to dst
+    struct LinearResampleJob : public ThreadPool::Job {
+        const RGBA*       src;
+        const LinearRGBA* linearSrc;
+        int   srcWidth;
+        RGBA* dst;
+        LinearRGBA* linearDst;
+        int   dstWidth;
+        int   dstHeight;
+        const ResampleWeights* weights;
+        bool  vertical;
+
+        virtual void run(int index) {
+            RESAMPLELINEARROWFUNC_T    resample_row    = GetResampleLinearRowFunc();
+            RESAMPLELINEARCOLUMNFUNC_T resample_column = GetResampleLinearColumnFunc();
+
+            int num_taps = weights->numTaps;
+            std::vector<LinearRGBA> row(vertical ? 0 : srcWidth);
+            std::vector<LinearRGBA> result(dstWidth);
+
+            int y1 = index * RESAMPLE_BAND_SIZE;
+            int y2 = std::min(y1 + RESAMPLE_BAND_SIZE, dstHeight);
+            for (int y = y1; y < y2; ++y) {
+                if (vertical) {
+                    resample_column(linearSrc + weights->start[y] * srcWidth, srcWidth, &result[0], dstWidth, &weights->weights[y * num_taps], num_taps);
+                    EncodeLinearSpan(&result[0], dst + y * dstWidth, dstWidth, false);
+                } else {
+                    DecodeLinearSpan(src + y * srcWidth, &row[0], srcWidth, false);
+                    if (linearDst) {
+                        resample_row(&row[0], linearDst + y * dstWidth, dstWidth, &weights->start[0], &weights->weights[0], num_taps);
+                    } else {
+                        resample_row(&row[0], &result[0], dstWidth, &weights->start[0], &weights->weights[0], num_taps);
+                        EncodeLinearSpan(&result[0], dst + y * dstWidth, dstWidth, false);
+                    }
+                }
+            }
+        }
+    };
+
+    //-----------------------------------------------------------------
+    // Like scale(), but filters in linear light, which is premultiplied
+    // and has more precision, so it always takes the horizontal pass
+    static void scale_linear(ThreadPool* pool, const RGBA* src, int width, int height, RGBA* dst, int newWidth, int newHeight, int filter)
+    {
+        LinearResampleJob job;
+        ResampleWeights weights;
+        std::vector<LinearRGBA> temp;
+        bool scale_y = (newHeight != height);
+
+        BuildResampleWeights(newWidth != width ? filter : (int)Canvas::FILTER_NEAREST, width, newWidth, weights);
+        if (scale_y) {
+            temp.resize(newWidth * height);
+        }
+        job.src       = src;
+        job.linearSrc = 0;
+        job.srcWidth  = width;
+        job.dst       = dst;
+        job.linearDst = scale_y ? &temp[0] : 0;
+        job.dstWidth  = newWidth;
+        job.dstHeight = height;
+        job.weights   = &weights;
+        job.vertical  = false;
+        pool->run(&job, (height + RESAMPLE_BAND_SIZE - 1) / RESAMPLE_BAND_SIZE);
+
+        if (scale_y) {
+            BuildResampleWeights(filter, height, newHeight, weights);
+            job.src       = 0;
+            job.linearSrc = &temp[0];
+            job.srcWidth  = newWidth;
+            job.linearDst = 0;
+            job.dstHeight = newHeight;
+            job.vertical  = true;
+            pool->run(&job, (newHeight + RESAMPLE_BAND_SIZE - 1) / RESAMPLE_BAND_SIZE);
         }
-        delete[] _pixels;
-        _pixels  = new_pixels;
-        _width   = width;
-        _height  = height;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::scale(int width, int height, int filter)
+    {
+        assert(width > 0);
+        assert(height > 0);
+        if (filter < FILTER_NEAREST || filter > FILTER_LANCZOS) {
+            return;
+        }
+        touch();
+        if (width == _width && height == _height) {
+            return;
+        }
+
+        bool straight = (_pixelFormat == PF_STRAIGHT_ALPHA);
+
+        // nearest neighbor doesn't mix colors, so it needs no decoding
+        if (_linearLight && straight && filter != FILTER_NEAREST) {
+            RGBA* new_pixels = allocatePixels(width * height);
+            scale_linear(getThreadPool(), _pixels, _width, _height, new_pixels, width, height, filter);
+            setPixels(new_pixels, width, height);
+            resetBounds();
+            return;
+        }
+
+        ResampleJob job;
+        job.premultiplySource   = false;
+        job.unpremultiplyResult = false;
+        job.premultipliedResult = false;
+
+        // the horizontal pass also premultiplies straight alpha images,
+        // so it can only be left out if they are scaled vertically
+        bool scale_x = (width  != _width || straight);
+        bool scale_y = (height != _height);
+
+        RGBA* pixels = _pixels;
+        ResampleWeights weights;
+        if (scale_x) {
+            BuildResampleWeights(width != _width ? filter : (int)FILTER_NEAREST, _width, width, weights);
+            RGBA* new_pixels = allocatePixels(width * _height);
+            job.src        = pixels;
+            job.srcWidth   = _width;
+            job.dst        = new_pixels;
+            job.dstWidth   = width;
+            job.dstHeight  = _height;
+            job.weights    = &weights;
+            job.vertical   = false;
+            job.premultiplySource   = straight;
+            job.unpremultiplyResult = straight && !scale_y;
+            job.premultipliedResult = !straight && !scale_y;
+            getThreadPool()->run(&job, (_height + RESAMPLE_BAND_SIZE - 1) / RESAMPLE_BAND_SIZE);
+            pixels = new_pixels;
+        }
+        if (scale_y) {
+            BuildResampleWeights(filter, _height, height, weights);
+            RGBA* new_pixels = allocatePixels(width * height);
+            job.src        = pixels;
+            job.srcWidth   = width;
+            job.dst        = new_pixels;
+            job.dstWidth   = width;
+            job.dstHeight  = height;
+            job.weights    = &weights;
+            job.vertical   = true;
+            job.premultiplySource   = false;
+            job.unpremultiplyResult = straight;
+            job.premultipliedResult = !straight;
+            getThreadPool()->run(&job, (height + RESAMPLE_BAND_SIZE - 1) / RESAMPLE_BAND_SIZE);
+            if (pixels != _pixels) {
+                _allocator->deallocate(pixels, width * _height);
+            }
+            pixels = new_pixels;
+        }
+
+        setPixels(pixels, width, height);
+        resetBounds();
     }
 
     //-----------------------------------------------------------------
     void
     Canvas::setAlpha(int alpha)
     {
-        RGBA* p = _pixels;
-        int   i = _width * _height;
-        while (i > 0) {
-            p->alpha = (u8)alpha;
-            p++;
-            i--;
+        ColorTransform transform;
+        if (_pixelFormat == PF_PREMULTIPLIED_ALPHA) {
+            // the color channels have to be rescaled to the new alpha
+            transform.unpremultiply().setAlpha(alpha).premultiply();
+        } else {
+            transform.setAlpha(alpha);
         }
+        transformColors(transform);
     }
 
     //-----------------------------------------------------------------
     void
     Canvas::replaceColor(const RGBA& color, const RGBA& newColor)
     {
-        u32  c = *(u32*)&color;
-        u32  n = *(u32*)&newColor;
-        u32* p =  (u32*)_pixels;
-        int  i = _width * _height;
-        while (i > 0) {
-            if (*p == c) {
-                *p = n;
-            }
-            p++;
-            i--;
-        }
+        ColorTransform transform;
+        transform.replaceColor(color, newColor);
+        transformColors(transform);
     }
 
     //-----------------------------------------------------------------
@@ -158,6 +636,7 @@ namespace sphere {
     Canvas::fill(const RGBA& color)
     {
         assert(sizeof(RGBA) == sizeof(u32));
+        touch();
         u32* p = (u32*)_pixels;
         u32  q = *((u32*)&color);
         for (int i = 0, j = _width * _height; i < j; ++i) {
@@ -170,284 +649,551 @@ namespace sphere {
     void
     Canvas::grey()
     {
-        RGBA* p = _pixels;
-        int   i = _width * _height;
-        while (i > 0) {
-            u8 greyed = (p->red + p->green + p->blue) / 3;
-            p->red   = greyed;
-            p->green = greyed;
-            p->blue  = greyed;
-            i--;
-            p++;
-        }
+        ColorTransform transform;
+        transform.grey();
+        transformColors(transform);
     }
 
     //-----------------------------------------------------------------
-    void
-    Canvas::flipHorizontally()
-    {
-        assert(sizeof(RGBA) == sizeof(u32));
+    // Pixels per job of transformColors(), smaller images are done on
+    // the calling thread
+    static const int COLOR_TRANSFORM_BAND_SIZE = 64 * 1024;
 
-        u32* l = (u32*)_pixels;
-        u32* r = (u32*)_pixels + _width - 1;
-
-        int iy = _height;
-        while (iy > 0) {
-            u32* a = l;
-            u32* b = r;
-            int ix = _width / 2;
-            while (ix > 0) {
-                u32 c = *a;
-                *a = *b;
-                *b = c;
-                a++;
-                b--;
-                ix--;
-            }
-            l += _width;
-            r += _width;
-            iy--;
+    //-----------------------------------------------------------------
+    struct ColorTransformJob : public ThreadPool::Job {
+        const ColorTransform* transform;
+        RGBA* pixels;
+        int   numPixels;
+
+        virtual void run(int index) {
+            int offset = index * COLOR_TRANSFORM_BAND_SIZE;
+            transform->apply(pixels + offset, std::min(COLOR_TRANSFORM_BAND_SIZE, numPixels - offset));
         }
-    }
+    };
 
     //-----------------------------------------------------------------
     void
-    Canvas::flipVertically()
+    Canvas::transformColors(const ColorTransform& transform)
     {
-        assert(sizeof(RGBA) == sizeof(u32));
+        touch();
+        if (transform.isIdentity()) {
+            return;
+        }
 
-        u32* u = (u32*)_pixels;
-        u32* d = (u32*)_pixels + _width * (_height - 1);
+        ColorTransformJob job;
+        job.transform = &transform;
+        job.pixels    = _pixels;
+        job.numPixels = _width * _height;
 
-        int iy = _height / 2;
-        while (iy > 0) {
-            u32* a = u;
-            u32* b = d;
-            int ix = _width;
-            while (ix > 0) {
-                u32 c = *a;
-                *a = *b;
-                *b = c;
-                a++;
-                b++;
-                ix--;
-            }
-            u += _width;
-            d -= _width;
-            iy--;
+        int num_bands = (job.numPixels + COLOR_TRANSFORM_BAND_SIZE - 1) / COLOR_TRANSFORM_BAND_SIZE;
+        if (num_bands > 1) {
+            getThreadPool()->run(&job, num_bands);
+        } else {
+            transform.apply(_pixels, job.numPixels);
         }
     }
 
     //-----------------------------------------------------------------
-    void
-    Canvas::rotateCW()
-    {
-        RGBA* new_p = new RGBA[_width * _height];
-        int   new_w = _height;
-        int   new_h = _width;
+    // Rows per job of the horizontal filter passes, and columns per job
+    // of the vertical ones, which copy their strip to a scratch buffer
+    static const int FILTER_BAND_SIZE   = 16;
+    static const int FILTER_STRIP_WIDTH = BLUR_MAX_LINES;
 
-        for (int iy = 0; iy < _height; ++iy) {
-            for (int ix = 0; ix < _width; ++ix) {
-                new_p[new_w * ix + (new_w - (iy + 1))] = _pixels[iy * _width + ix];
-            }
+    //-----------------------------------------------------------------
+    // Radii of three box blurs which together approximate a gaussian
+    // blur with the standard deviation sigma
+    static void get_gaussian_box_radii(float sigma, int radii[3])
+    {
+        double ideal = sqrt(12.0 * sigma * sigma / 3 + 1);
+        int lower = (int)floor(ideal);
+        if (lower % 2 == 0) {
+            lower--;
+        }
+        int upper = lower + 2;
+        double m = (12.0 * sigma * sigma - 3.0 * lower * lower - 12.0 * lower - 9.0) / (-4.0 * lower - 4.0);
+        int num_lower = (int)floor(m + 0.5);
+        for (int i = 0; i < 3; ++i) {
+            radii[i] = ((i < num_lower ? lower : upper) - 1) / 2;
         }
-
-        delete[] _pixels;
-        _pixels = new_p;
-        _width  = new_w;
-        _height = new_h;
     }
 
     //-----------------------------------------------------------------
-    void
-    Canvas::rotateCCW()
-    {
-        RGBA* new_p = new RGBA[_width * _height];
-        int   new_w = _height;
-        int   new_h = _width;
+    // One direction of a filter, either up to three box blurs or a
+    // convolution. Each pass reads the original pixels from a copy in
+    // the scratch buffer and writes back to the canvas.
+    struct FilterJob : public ThreadPool::Job {
+        RGBA* pixels;
+        int   width;
+        int   height;
+        bool  vertical;
+        int   numBoxes;
+        int   radii[3];
+        const ResampleWeights* weights;
+        bool  alphaOnly;
+        bool  premultiplySource;
+        bool  unpremultiplyResult;
+
+        virtual void run(int index) {
+            if (vertical) {
+                int x = index * FILTER_STRIP_WIDTH;
+                int n = std::min(FILTER_STRIP_WIDTH, width - x);
+                std::vector<RGBA> scratch(height * n * 2);
+                for (int y = 0; y < height; ++y) {
+                    memcpy(&scratch[y * n], pixels + y * width + x, n * sizeof(RGBA));
+                }
+                filter(&scratch[0], &scratch[height * n], n, pixels + x, width, height, n);
+                if (unpremultiplyResult) {
+                    for (int y = 0; y < height; ++y) {
+                        UnpremultiplySpan(pixels + y * width + x, n);
+                    }
+                }
+            } else {
+                int y1 = index * FILTER_BAND_SIZE;
+                int y2 = std::min(y1 + FILTER_BAND_SIZE, height);
+                std::vector<RGBA> scratch(width * 2);
+                for (int y = y1; y < y2; ++y) {
+                    RGBA* row = pixels + y * width;
+                    memcpy(&scratch[0], row, width * sizeof(RGBA));
+                    if (premultiplySource) {
+                        PremultiplySpan(&scratch[0], width);
+                    }
+                    filter(&scratch[0], &scratch[width], 1, row, 1, width, 1);
+                    if (unpremultiplyResult) {
+                        UnpremultiplySpan(row, width);
+                    }
+                }
+            }
+        }
 
-        for (int iy = 0; iy < _height; ++iy) {
-            for (int ix = 0; ix < _width; ++ix) {
-                new_p[new_w * (_width - ix - 1) + iy] = _pixels[iy * _width + ix];
+        // src holds numLines lines of length pixels, stride apart,
+        // tmp has room for as many
+        void filter(RGBA* src, RGBA* tmp, int stride, RGBA* dst, int dstStride, int length, int numLines) {
+            if (weights) {
+                convolve(src, stride, dst, dstStride, length, numLines);
+                return;
+            }
+            BOXBLURFUNC_T box_blur = GetBoxBlurFunc();
+            for (int i = 0; i < numBoxes; ++i) {
+                if (i == numBoxes - 1) {
+                    box_blur(src, stride, dst, dstStride, length, numLines, radii[i], alphaOnly);
+                } else {
+                    box_blur(src, stride, tmp, stride, length, numLines, radii[i], alphaOnly);
+                    std::swap(src, tmp);
+                }
             }
         }
 
-        delete[] _pixels;
-        _pixels = new_p;
-        _width  = new_w;
-        _height = new_h;
-    }
+        void convolve(const RGBA* src, int stride, RGBA* dst, int dstStride, int length, int numLines) {
+            int num_taps = weights->numTaps;
+            if (vertical) {
+                RESAMPLECOLUMNFUNC_T resample_column = GetResampleColumnFunc();
+                for (int i = 0; i < length; ++i) {
+                    resample_column(src + weights->start[i] * stride, stride, dst + i * dstStride, numLines, &weights->weights[i * num_taps], num_taps);
+                }
+            } else {
+                GetResampleRowFunc()(src, dst, length, &weights->start[0], &weights->weights[0], num_taps);
+            }
+            if (alphaOnly) {
+                for (int i = 0; i < length; ++i) {
+                    const RGBA* s = src + i * stride;
+                    RGBA* d = dst + i * dstStride;
+                    for (int l = 0; l < numLines; ++l) {
+                        u8 alpha = d[l].alpha;
+                        d[l] = s[l];
+                        d[l].alpha = alpha;
+                    }
+                }
+            }
+        }
+    };
 
     //-----------------------------------------------------------------
-    bool
-    Canvas::setScissor(const Recti& scissor)
+    // Runs the horizontal and vertical halves of a filter, the weights
+    // are 0 for box blurs
+    static void run_filter(ThreadPool* pool, FilterJob& job, const ResampleWeights* weightsX, const ResampleWeights* weightsY, bool straight)
     {
-        Recti scissorMax(0, 0, _width - 1, _height - 1);
-        if (scissorMax.contains(scissor)) {
-            _scissor = scissor;
-            return true;
-        }
-        return false;
+        bool convert = straight && !job.alphaOnly;
+
+        job.vertical            = false;
+        job.weights             = weightsX;
+        job.premultiplySource   = convert;
+        job.unpremultiplyResult = false;
+        pool->run(&job, (job.height + FILTER_BAND_SIZE - 1) / FILTER_BAND_SIZE);
+
+        job.vertical            = true;
+        job.weights             = weightsY;
+        job.premultiplySource   = false;
+        job.unpremultiplyResult = convert;
+        pool->run(&job, (job.width + FILTER_STRIP_WIDTH - 1) / FILTER_STRIP_WIDTH);
     }
 
     //-----------------------------------------------------------------
-    bool
-    Canvas::setBlendMode(int blendMode)
+    // The filters repeat the edge pixels beyond the canvas and work on
+    // premultiplied colors, alphaOnly filters only the alpha channel
+    void
+    Canvas::boxBlur(int radius, bool alphaOnly)
     {
-        switch (blendMode) {
-            case BM_REPLACE:
-            case BM_ALPHA:
-            case BM_ADD:
-            case BM_SUBTRACT:
-            case BM_MULTIPLY:
-                _blendMode = blendMode;
-                return true;
-            default:
-                return false;
+        touch();
+        if (radius <= 0) {
+            return;
         }
+
+        FilterJob job;
+        job.pixels    = _pixels;
+        job.width     = _width;
+        job.height    = _height;
+        job.numBoxes  = 1;
+        job.radii[0]  = radius;
+        job.alphaOnly = alphaOnly;
+        run_filter(getThreadPool(), job, 0, 0, _pixelFormat == PF_STRAIGHT_ALPHA);
     }
 
     //-----------------------------------------------------------------
-    typedef void (*BLENDFUNC_T)(RGBA*, const RGBA&);
-
-    static inline void rgba_replace(RGBA* dst, const RGBA& src)
+    void
+    Canvas::gaussianBlur(float sigma, bool alphaOnly)
     {
-        dst->red   = src.red;
-        dst->green = src.green;
-        dst->blue  = src.blue;
-        dst->alpha = src.alpha;
+        touch();
+        if (!(sigma > 0.0f)) {
+            return;
+        }
+
+        FilterJob job;
+        job.pixels    = _pixels;
+        job.width     = _width;
+        job.height    = _height;
+        job.numBoxes  = 3;
+        job.alphaOnly = alphaOnly;
+        get_gaussian_box_radii(sigma, job.radii);
+        run_filter(getThreadPool(), job, 0, 0, _pixelFormat == PF_STRAIGHT_ALPHA);
     }
 
-    static inline void rgba_alpha(RGBA* dst, const RGBA& src)
+    //-----------------------------------------------------------------
+    // The kernels are centered on kernel[size / 2]
+    void
+    Canvas::convolve(const float* kernelX, int sizeX, const float* kernelY, int sizeY, bool alphaOnly)
     {
-        int sa =        src.alpha  + 1;
-        int da = (255 - src.alpha) + 1;
-        dst->red   = (dst->red   * da + src.red   * sa) >> 8;
-        dst->green = (dst->green * da + src.green * sa) >> 8;
-        dst->blue  = (dst->blue  * da + src.blue  * sa) >> 8;
+        assert(kernelX && sizeX > 0);
+        assert(kernelY && sizeY > 0);
+        touch();
+
+        ResampleWeights weights_x;
+        ResampleWeights weights_y;
+        BuildConvolutionWeights(kernelX, sizeX, _width,  weights_x);
+        BuildConvolutionWeights(kernelY, sizeY, _height, weights_y);
+
+        FilterJob job;
+        job.pixels    = _pixels;
+        job.width     = _width;
+        job.height    = _height;
+        job.numBoxes  = 0;
+        job.alphaOnly = alphaOnly;
+        run_filter(getThreadPool(), job, &weights_x, &weights_y, _pixelFormat == PF_STRAIGHT_ALPHA);
     }
 
-    static inline void rgba_add(RGBA* dst, const RGBA& src)
+    //-----------------------------------------------------------------
+    static void reverse_rows(RGBA* pixels, int width, int height)
     {
-        dst->red   = std::min(dst->red   + src.red,   255);
-        dst->green = std::min(dst->green + src.green, 255);
-        dst->blue  = std::min(dst->blue  + src.blue,  255);
+        REVERSESPANFUNC_T reverseSpan = GetReverseSpanFunc();
+        for (int iy = 0; iy < height; ++iy) {
+            reverseSpan(pixels + iy * width, width);
+        }
     }
 
-    static inline void rgba_subtract(RGBA* dst, const RGBA& src)
+    //-----------------------------------------------------------------
+    static void reverse_row_order(RGBA* pixels, int width, int height)
     {
-        dst->red   = std::max(dst->red   - src.red,   0);
-        dst->green = std::max(dst->green - src.green, 0);
-        dst->blue  = std::max(dst->blue  - src.blue,  0);
+        // swap the rows through a small buffer, piece by piece
+        RGBA buffer[256];
+        RGBA* u = pixels;
+        RGBA* d = pixels + width * (height - 1);
+        while (u < d) {
+            for (int ix = 0; ix < width; ix += 256) {
+                int n = std::min(width - ix, 256);
+                memcpy(buffer, u + ix, n * sizeof(RGBA));
+                memcpy(u + ix, d + ix, n * sizeof(RGBA));
+                memcpy(d + ix, buffer, n * sizeof(RGBA));
+            }
+            u += width;
+            d -= width;
+        }
     }
 
-    static inline void rgba_multiply(RGBA* dst, const RGBA& src)
+    //-----------------------------------------------------------------
+    void
+    Canvas::flipHorizontally()
     {
-        dst->red   = dst->red   * (src.red   + 1) >> 8;
-        dst->green = dst->green * (src.green + 1) >> 8;
-        dst->blue  = dst->blue  * (src.blue  + 1) >> 8;
+        touch();
+        reverse_rows(_pixels, _width, _height);
     }
 
     //-----------------------------------------------------------------
-    typedef void (*BLENDFUNCFIX_T)(RGBA*, u32, u32, u32, u32);
-
-    static inline void rgba_replace_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    void
+    Canvas::flipVertically()
     {
-        dst->red   = r >> 12;
-        dst->green = g >> 12;
-        dst->blue  = b >> 12;
-        dst->alpha = a >> 12;
+        touch();
+        reverse_row_order(_pixels, _width, _height);
     }
 
-    static inline void rgba_alpha_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    //-----------------------------------------------------------------
+    void
+    Canvas::rotateCW()
     {
-        int sa =        (a >> 12)  + 1;
-        int da = (255 - (a >> 12)) + 1;
-        dst->red   = (dst->red   * da + (r >> 12) * sa) >> 8;
-        dst->green = (dst->green * da + (g >> 12) * sa) >> 8;
-        dst->blue  = (dst->blue  * da + (b >> 12) * sa) >> 8;
+        touch();
+
+        // square canvases are rotated in place: the transpose followed
+        // by a horizontal flip
+        if (_width == _height) {
+            GetTransposeSquareFunc()(_pixels, _width);
+            reverse_rows(_pixels, _width, _height);
+            return;
+        }
+
+        RGBA* new_p = allocatePixels(_width * _height);
+        int   new_w = _height;
+        int   new_h = _width;
+
+        // the transpose of the source read bottom to top
+        GetTransposeFunc()(_pixels + _width * (_height - 1), -_width, new_p, new_w, _width, _height);
+
+        setPixels(new_p, new_w, new_h);
+        resetBounds();
     }
 
-    static inline void rgba_add_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    //-----------------------------------------------------------------
+    void
+    Canvas::rotateCCW()
     {
-        dst->red   = std::min(dst->red   + (u8)(r >> 12), 255);
-        dst->green = std::min(dst->green + (u8)(g >> 12), 255);
-        dst->blue  = std::min(dst->blue  + (u8)(b >> 12), 255);
+        touch();
+
+        // square canvases are rotated in place: the transpose followed
+        // by a vertical flip
+        if (_width == _height) {
+            GetTransposeSquareFunc()(_pixels, _width);
+            reverse_row_order(_pixels, _width, _height);
+            return;
+        }
+
+        RGBA* new_p = allocatePixels(_width * _height);
+        int   new_w = _height;
+        int   new_h = _width;
+
+        // the transpose written bottom to top
+        GetTransposeFunc()(_pixels, _width, new_p + new_w * (new_h - 1), -new_w, _width, _height);
+
+        setPixels(new_p, new_w, new_h);
+        resetBounds();
     }
 
-    static inline void rgba_subtract_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    //-----------------------------------------------------------------
+    bool
+    Canvas::setScissor(const Recti& scissor)
     {
-        dst->red   = std::max(dst->red   - (u8)(r >> 12), 0);
-        dst->green = std::max(dst->green - (u8)(g >> 12), 0);
-        dst->blue  = std::max(dst->blue  - (u8)(b >> 12), 0);
+        Recti scissorMax(0, 0, _width - 1, _height - 1);
+        if (scissorMax.contains(scissor)) {
+            _scissor = scissor;
+            return true;
+        }
+        return false;
     }
 
-    static inline void rgba_multiply_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    //-----------------------------------------------------------------
+    bool
+    Canvas::setPixelFormat(int pixelFormat)
     {
-        dst->red   = dst->red   * ((r >> 12) + 1) >> 8;
-        dst->green = dst->green * ((g >> 12) + 1) >> 8;
-        dst->blue  = dst->blue  * ((b >> 12) + 1) >> 8;
+        if (pixelFormat != PF_STRAIGHT_ALPHA && pixelFormat != PF_PREMULTIPLIED_ALPHA) {
+            return false;
+        }
+        if (pixelFormat == _pixelFormat) {
+            return true;
+        }
+
+        touch();
+
+        RGBA* p = _pixels;
+        int   i = _width * _height;
+        if (pixelFormat == PF_PREMULTIPLIED_ALPHA) {
+            while (i > 0) {
+                *p = rgba_premultiply(*p);
+                p++;
+                i--;
+            }
+        } else {
+            while (i > 0) {
+                *p = rgba_unpremultiply(*p);
+                p++;
+                i--;
+            }
+        }
+
+        _pixelFormat = pixelFormat;
+        return true;
     }
 
     //-----------------------------------------------------------------
-    // Liang-Barsky line clipping algorithm
-    static inline bool clip_line_test(const float& p, const float& q, float& u1, float& u2)
+    bool
+    Canvas::setBlendMode(int blendMode)
     {
-        float r;
+        switch (blendMode) {
+            case BM_REPLACE:
+            case BM_ALPHA:
+            case BM_ADD:
+            case BM_SUBTRACT:
+            case BM_MULTIPLY:
+                _blendMode = blendMode;
+                return true;
+            default:
+                return false;
+        }
+    }
 
-        if (p < 0.0)
-        {
-            r = q / p;
+    //-----------------------------------------------------------------
+    ThreadPool*
+    Canvas::getThreadPool() const
+    {
+        return _threadPool ? _threadPool.get() : ThreadPool::GetDefault();
+    }
 
-            if (r > u2)
-                return false;
-            else if (r > u1)
-                u1 = r;
+    //-----------------------------------------------------------------
+    void
+    Canvas::setThreadPool(ThreadPool* threadPool)
+    {
+        if (threadPool == _threadPool.get()) {
+            return;
         }
-        else if (p > 0.0)
-        {
-            r = q / p;
+        if (threadPool) {
+            threadPool->grab();
+        }
+        _threadPool = threadPool;
+    }
 
-            if (r < u1)
-                return false;
-            else if (r < u2)
-                u2 = r;
+    //-----------------------------------------------------------------
+    // A deferred canvas records draw calls until flush(), other
+    // modifications flush implicitly
+    void
+    Canvas::setDeferred(bool deferred)
+    {
+        if (!deferred) {
+            flush();
         }
+        _deferred = deferred;
+    }
 
-        return true;
+    //-----------------------------------------------------------------
+    // Image blits, rectangles and scale() of straight alpha canvases
+    // blend and interpolate in linear light instead of on sRGB values
+    void
+    Canvas::setLinearLight(bool linearLight)
+    {
+        // recorded commands are drawn with the setting they were made with
+        flush();
+        _linearLight = linearLight;
     }
 
-    template<typename clipT>
-    static bool clip_line(int& x1, int& y1, int& x2, int& y2, float& u1, float& u2, clipT clip)
+    //-----------------------------------------------------------------
+    // The span table lets BM_ALPHA blits of the canvas skip transparent
+    // and copy opaque runs, it is rebuilt on demand after modifications
+    void
+    Canvas::setSpanEncoded(bool spanEncoded)
     {
-        float dx = (float)(x2 - x1);
-        float dy;
+        _spanEncoded = spanEncoded;
+        if (!spanEncoded) {
+            _spanTable.clear();
+            _spansValid = false;
+        }
+    }
 
-        if(clip_line_test(-dx, (float)(x1 - clip.ul.x), u1, u2)) {
-            if(clip_line_test(dx, (float)(clip.lr.x - x1), u1, u2)) {
-                dy = (float)(y2 - y1);
+    //-----------------------------------------------------------------
+    void
+    Canvas::updateSpanTable()
+    {
+        flush();
+        if (_spanEncoded && !_spansValid) {
+            _spanTable.build(_pixels, _width, _height, _stride, _pixelFormat == PF_PREMULTIPLIED_ALPHA);
+            _spansValid = true;
+        }
+    }
 
-                if(clip_line_test(-dy, (float)(y1 - clip.ul.y), u1, u2)) {
-                    if(clip_line_test(dy, (float)(clip.lr.y - y1), u1, u2)) {
-                        if (u2 < 1.0) {
-                            x2 = (int)(x1 + u2 * dx + 0.5);
-                            y2 = (int)(y1 + u2 * dy + 0.5);
-                        }
+    //-----------------------------------------------------------------
+    // Finds the bounds of the pixels which aren't transparent, outside
+    // of which BM_ALPHA blits skip the canvas until it is modified
+    void
+    Canvas::trim()
+    {
+        flush();
+        if (_trimValid) {
+            return;
+        }
 
-                        if (u1 > 0.0) {
-                            x1 = (int)(x1 + u1 * dx + 0.5);
-                            y1 = (int)(y1 + u1 * dy + 0.5);
-                        }
+        // the bits of the pixels which aren't transparent when set
+        RGBA visible = (_pixelFormat == PF_PREMULTIPLIED_ALPHA) ? RGBA(255, 255, 255, 255) : RGBA(0, 0, 0, 255);
+        u32  mask = *((u32*)&visible);
+        FINDPIXELFUNC_T find_first = GetFindFirstPixelFunc();
+        FINDPIXELFUNC_T find_last  = GetFindLastPixelFunc();
+
+        // the rows above and below, then the columns left and right of
+        // what has been found so far in the rows in between
+        int y1 = 0;
+        while (y1 < _height && find_first(_pixels + y1 * _stride, _width, mask) == _width) {
+            y1++;
+        }
+        if (y1 == _height) {
+            _trimRect  = Recti(0, 0, -1, -1);
+            _trimValid = true;
+            return;
+        }
+        int y2 = _height - 1;
+        while (find_first(_pixels + y2 * _stride, _width, mask) == _width) {
+            y2--;
+        }
 
-                        return true;
-                    }
-                }
-            }
+        int x1 = _width;
+        int x2 = -1;
+        for (int y = y1; y <= y2; ++y) {
+            const RGBA* row = _pixels + y * _stride;
+            x1 = find_first(row, x1, mask);
+            x2 += find_last(row + x2 + 1, _width - x2 - 1, mask) + 1;
         }
 
-        return false;
+        _trimRect  = Recti(x1, y1, x2, y2);
+        _trimValid = true;
+    }
+
+    //-----------------------------------------------------------------
+    // Called before the pixels get modified directly
+    void
+    Canvas::touch()
+    {
+        touch(Recti(0, 0, _width - 1, _height - 1));
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::touch(const Recti& rect)
+    {
+        flush();
+        detach();
+        _spansValid = false;
+        _trimValid  = false;
+        _dirtyRegion.add(rect);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::clearDirtyRegion()
+    {
+        _dirtyRegion.clear();
     }
 
+    //-----------------------------------------------------------------
+    // The pixels a draw call may touch, in canvas coordinates
+    struct DrawTarget {
+        RGBA* pixels;
+        int   pitch;
+        Recti scissor;
+        bool  premultiplied;
+        bool  linear;
+    };
+
     //-----------------------------------------------------------------
     template<typename T>
     static inline T bracket(T x, T min, T max)
@@ -471,9 +1217,83 @@ namespace sphere {
                 y1 > scissor.lr.y || y2 > scissor.lr.y);
     }
 
+    //-----------------------------------------------------------------
+    static inline bool is_line_culled(int x1, int y1, int x2, int y2, const Recti& scissor)
+    {
+        // return true if both endpoints lie on the outside of the same edge
+        return ((x1 > scissor.lr.x && x2 > scissor.lr.x) ||
+                (y1 > scissor.lr.y && y2 > scissor.lr.y) ||
+                (x1 < scissor.ul.x && x2 < scissor.ul.x) ||
+                (y1 < scissor.ul.y && y2 < scissor.ul.y));
+    }
+
+    //-----------------------------------------------------------------
+    // First step of a line at which the minor axis offset
+    // (den / 2 + step * numadd) / den reaches k
+    static inline i64 first_line_step(i64 k, int den, int numadd)
+    {
+        if (k <= 0) {
+            return 0;
+        }
+        return (k * den - den / 2 + numadd - 1) / numadd;
+    }
+
+    //-----------------------------------------------------------------
+    // Clips the steps [first, last] of a sloped line against the scissor.
+    // The steps stay those of the unclipped line, so the pixels drawn do
+    // not depend on the clipping. On success x1, y1 and num are advanced
+    // to the first step.
+    static bool clip_line_steps(int& x1, int& y1, int x2, int y2, int den, int numadd, const Recti& scissor, int& first, int& last, int& num)
+    {
+        bool xmajor = (abs(x2 - x1) >= abs(y2 - y1));
+        int  sx = (x2 >= x1) ? 1 : -1;
+        int  sy = (y2 >= y1) ? 1 : -1;
+
+        int major     = xmajor ? x1 : y1;
+        int minor     = xmajor ? y1 : x1;
+        int major_inc = xmajor ? sx : sy;
+        int minor_inc = xmajor ? sy : sx;
+        int major_min = xmajor ? scissor.ul.x : scissor.ul.y;
+        int major_max = xmajor ? scissor.lr.x : scissor.lr.y;
+        int minor_min = xmajor ? scissor.ul.y : scissor.ul.x;
+        int minor_max = xmajor ? scissor.lr.y : scissor.lr.x;
+
+        // the major axis advances by one every step
+        i64 lo = first;
+        i64 hi = last;
+        if (major_inc > 0) {
+            lo = std::max(lo, (i64)major_min - major);
+            hi = std::min(hi, (i64)major_max - major);
+        } else {
+            lo = std::max(lo, (i64)major - major_max);
+            hi = std::min(hi, (i64)major - major_min);
+        }
+
+        // the minor axis offset is monotonic in the step
+        i64 minor_lo = (minor_inc > 0) ? (i64)minor_min - minor : (i64)minor - minor_max;
+        i64 minor_hi = (minor_inc > 0) ? (i64)minor_max - minor : (i64)minor - minor_min;
+        lo = std::max(lo, first_line_step(minor_lo, den, numadd));
+        hi = std::min(hi, first_line_step(minor_hi + 1, den, numadd) - 1);
+
+        if (lo > hi) {
+            return false;
+        }
+
+        i64 n = lo * numadd + den / 2;
+        major += (int)lo * major_inc;
+        minor += (int)(n / den) * minor_inc;
+
+        x1    = xmajor ? major : minor;
+        y1    = xmajor ? minor : major;
+        first = (int)lo;
+        last  = (int)hi;
+        num   = (int)(n % den);
+        return true;
+    }
+
     //-----------------------------------------------------------------
     template<BLENDFUNC_T blenderT>
-    static void draw_line(Canvas& d, int x1, int y1, int x2, int y2, const RGBA& c)
+    static void draw_line(const DrawTarget& d, int x1, int y1, int x2, int y2, const RGBA& c)
     {
         RGBA* dst = NULL;
 
@@ -483,15 +1303,15 @@ namespace sphere {
             int dst_inc;
 
             if (y1 == y2) {
-                i1 = bracket(x1, d.getScissor().ul.x, d.getScissor().lr.x);
-                i2 = bracket(x2, d.getScissor().ul.x, d.getScissor().lr.x);
-                dst     = d.getPixels() + y1 * d.getWidth() + i1;
+                i1 = bracket(x1, d.scissor.ul.x, d.scissor.lr.x);
+                i2 = bracket(x2, d.scissor.ul.x, d.scissor.lr.x);
+                dst     = d.pixels + y1 * d.pitch + i1;
                 dst_inc = 1;
             } else {
-                i1 = bracket(y1, d.getScissor().ul.y, d.getScissor().lr.y);
-                i2 = bracket(y2, d.getScissor().ul.y, d.getScissor().lr.y);
-                dst     = d.getPixels() + i1 * d.getWidth() + x1;
-                dst_inc = d.getWidth();
+                i1 = bracket(y1, d.scissor.ul.y, d.scissor.lr.y);
+                i2 = bracket(y2, d.scissor.ul.y, d.scissor.lr.y);
+                dst     = d.pixels + i1 * d.pitch + x1;
+                dst_inc = d.pitch;
             }
 
             int ix = 2;
@@ -508,17 +1328,6 @@ namespace sphere {
                 dst += dst_inc;
             }
         } else { // other lines (expensive clipping)
-            // check if we need to clip
-            if (is_line_clipped(x1, y1, x2, y2, d.getScissor())) {
-                float u1 = 0.0, u2 = 1.0;
-                if (!clip_line(x1, y1, x2, y2, u1, u2, d.getScissor())) {
-                    // nothing to draw
-                    return;
-                }
-            }
-
-            dst = d.getPixels() + y1 * d.getWidth() + x1;
-
             int dx = abs(x2 - x1);
             int dy = abs(y2 - y1);
             int xinc1, xinc2, yinc1, yinc2;
@@ -533,11 +1342,11 @@ namespace sphere {
             }
 
             if (y2 >= y1) {
-                yinc1 = d.getWidth();
-                yinc2 = d.getWidth();
+                yinc1 = d.pitch;
+                yinc2 = d.pitch;
             } else {
-                yinc1 = -d.getWidth();
-                yinc2 = -d.getWidth();
+                yinc1 = -d.pitch;
+                yinc2 = -d.pitch;
             }
 
             if (dx >= dy) {
@@ -556,7 +1365,18 @@ namespace sphere {
                 numpix = dy;
             }
 
-            for (int i = 0; i <= numpix; ++i) {
+            int first = 0;
+            int last  = numpix;
+            if (is_line_clipped(x1, y1, x2, y2, d.scissor)) {
+                if (!clip_line_steps(x1, y1, x2, y2, den, numadd, d.scissor, first, last, num)) {
+                    // nothing to draw
+                    return;
+                }
+            }
+
+            dst = d.pixels + y1 * d.pitch + x1;
+
+            for (int i = first; i <= last; ++i) {
                 blenderT(dst, c);
                 num += numadd;
                 if (num >= den) {
@@ -570,46 +1390,28 @@ namespace sphere {
         }
     }
 
-    //-----------------------------------------------------------------
-    template<typename T>
-    static inline void clip_color2_parametric(float u1, float u2, T& c1, T& c2)
-    {
-        RGBA ct = c1;
-
-        c1.red   = (u8)(c1.red   + u1 * (c2.red   - c1.red));
-        c1.green = (u8)(c1.green + u1 * (c2.green - c1.green));
-        c1.blue  = (u8)(c1.blue  + u1 * (c2.blue  - c1.blue));
-        c1.alpha = (u8)(c1.alpha + u1 * (c2.alpha - c1.alpha));
-
-        c2.red   = (u8)(ct.red   + u2 * (c2.red   - ct.red));
-        c2.green = (u8)(ct.green + u2 * (c2.green - ct.green));
-        c2.blue  = (u8)(ct.blue  + u2 * (c2.blue  - ct.blue));
-        c2.alpha = (u8)(ct.alpha + u2 * (c2.alpha - ct.alpha));
-    }
-
     //-----------------------------------------------------------------
     template<BLENDFUNCFIX_T blenderT>
-    static void draw_gradient_line(Canvas& d, int x1, int y1, int x2, int y2, RGBA c[2])
+    static void draw_gradient_line(const DrawTarget& d, int x1, int y1, int x2, int y2, RGBA c[2])
     {
         RGBA* dst = NULL;
-        RGBA  tc[2] = {c[0], c[1]};
 
         if (y1 == y2 || x1 == x2) { // horizontal or vertical lines (simplified clipping)
             int itemp, idelta, i1, i2, dst_inc;
             if (y1 == y2) {
-                i1 = bracket(x1, d.getScissor().ul.x, d.getScissor().lr.x);
-                i2 = bracket(x2, d.getScissor().ul.x, d.getScissor().lr.x);
+                i1 = bracket(x1, d.scissor.ul.x, d.scissor.lr.x);
+                i2 = bracket(x2, d.scissor.ul.x, d.scissor.lr.x);
                 itemp   = x1;
                 idelta  = x2 - x1;
-                dst     = d.getPixels() + y1 * d.getWidth() + i1;
+                dst     = d.pixels + y1 * d.pitch + i1;
                 dst_inc = 1;
             } else {
-                i1 = bracket(y1, d.getScissor().ul.y, d.getScissor().lr.y);
-                i2 = bracket(y2, d.getScissor().ul.y, d.getScissor().lr.y);
+                i1 = bracket(y1, d.scissor.ul.y, d.scissor.lr.y);
+                i2 = bracket(y2, d.scissor.ul.y, d.scissor.lr.y);
                 itemp   = y1;
                 idelta  = y2 - y1;
-                dst     = d.getPixels() + i1 * d.getWidth() + x1;
-                dst_inc = d.getWidth();
+                dst     = d.pixels + i1 * d.pitch + x1;
+                dst_inc = d.pitch;
             }
 
             int ix = 2 + abs(i2 - i1);
@@ -618,23 +1420,19 @@ namespace sphere {
                 dst_inc = -dst_inc;
             }
 
-            if (is_line_clipped(x1, y1, x2, y2, d.getScissor())) {
-                float u1 = (idelta == 0) ? 0.0f : (i1 - itemp) / (float)idelta;
-                float u2 = (idelta == 0) ? 0.0f : (i2 - itemp) / (float)idelta;
-                clip_color2_parametric(u1, u2, tc[0], tc[1]);
-            }
+            // the color steps are those of the unclipped line
+            int numpix = abs(idelta) + 1;
+            i32 step_r = (i32)(((c[1].red   - c[0].red)   / (float)numpix) * 4096.0);
+            i32 step_g = (i32)(((c[1].green - c[0].green) / (float)numpix) * 4096.0);
+            i32 step_b = (i32)(((c[1].blue  - c[0].blue)  / (float)numpix) * 4096.0);
+            i32 step_a = (i32)(((c[1].alpha - c[0].alpha) / (float)numpix) * 4096.0);
 
             // fixed-point variables for color interpolation (20.12 notation)
-            u32 cur_r = tc[0].red   << 12;
-            u32 cur_g = tc[0].green << 12;
-            u32 cur_b = tc[0].blue  << 12;
-            u32 cur_a = tc[0].alpha << 12;
-
-            // (ix - 1) is always > 0
-            i32 step_r = (i32)(((tc[1].red   - tc[0].red)   / (float)(ix - 1)) * 4096.0);
-            i32 step_g = (i32)(((tc[1].green - tc[0].green) / (float)(ix - 1)) * 4096.0);
-            i32 step_b = (i32)(((tc[1].blue  - tc[0].blue)  / (float)(ix - 1)) * 4096.0);
-            i32 step_a = (i32)(((tc[1].alpha - tc[0].alpha) / (float)(ix - 1)) * 4096.0);
+            u32 first = abs(i1 - itemp);
+            u32 cur_r = (c[0].red   << 12) + first * step_r;
+            u32 cur_g = (c[0].green << 12) + first * step_g;
+            u32 cur_b = (c[0].blue  << 12) + first * step_b;
+            u32 cur_a = (c[0].alpha << 12) + first * step_a;
 
             while (--ix) {
                 blenderT(dst, cur_r, cur_g, cur_b, cur_a);
@@ -647,17 +1445,6 @@ namespace sphere {
                 cur_a += step_a;
             }
         } else { // other lines (expensive clipping)
-            // check if we need to clip
-            if (is_line_clipped(x1, y1, x2, y2, d.getScissor())) {
-                float u1 = 0.0, u2 = 1.0;
-                if (!clip_line(x1, y1, x2, y2, u1, u2, d.getScissor())) {
-                    return; // nothing to draw
-                }
-                clip_color2_parametric(u1, u2, tc[0], tc[1]);
-            }
-
-            dst = d.getPixels() + y1 * d.getWidth() + x1;
-
             int dx = abs(x2 - x1);
             int dy = abs(y2 - y1);
             int xinc1, xinc2, yinc1, yinc2;
@@ -672,11 +1459,11 @@ namespace sphere {
             }
 
             if (y2 >= y1) {
-                yinc1 = d.getWidth();
-                yinc2 = d.getWidth();
+                yinc1 = d.pitch;
+                yinc2 = d.pitch;
             } else {
-                yinc1 = -d.getWidth();
-                yinc2 = -d.getWidth();
+                yinc1 = -d.pitch;
+                yinc2 = -d.pitch;
             }
 
             if (dx >= dy) {
@@ -695,19 +1482,29 @@ namespace sphere {
                 numpix = dy + 1;
             }
 
-            // fixed-point variables for color interpolation (20.12 notation)
-            u32 cur_r = tc[0].red   << 12;
-            u32 cur_g = tc[0].green << 12;
-            u32 cur_b = tc[0].blue  << 12;
-            u32 cur_a = tc[0].alpha << 12;
-
             // numpix is always > 0
-            i32 step_r = (i32)(((tc[1].red   - tc[0].red)   / (float)numpix) * 4096.0);
-            i32 step_g = (i32)(((tc[1].green - tc[0].green) / (float)numpix) * 4096.0);
-            i32 step_b = (i32)(((tc[1].blue  - tc[0].blue)  / (float)numpix) * 4096.0);
-            i32 step_a = (i32)(((tc[1].alpha - tc[0].alpha) / (float)numpix) * 4096.0);
+            i32 step_r = (i32)(((c[1].red   - c[0].red)   / (float)numpix) * 4096.0);
+            i32 step_g = (i32)(((c[1].green - c[0].green) / (float)numpix) * 4096.0);
+            i32 step_b = (i32)(((c[1].blue  - c[0].blue)  / (float)numpix) * 4096.0);
+            i32 step_a = (i32)(((c[1].alpha - c[0].alpha) / (float)numpix) * 4096.0);
+
+            int first = 0;
+            int last  = numpix - 1;
+            if (is_line_clipped(x1, y1, x2, y2, d.scissor)) {
+                if (!clip_line_steps(x1, y1, x2, y2, den, numadd, d.scissor, first, last, num)) {
+                    return; // nothing to draw
+                }
+            }
+
+            dst = d.pixels + y1 * d.pitch + x1;
+
+            // fixed-point variables for color interpolation (20.12 notation)
+            u32 cur_r = (c[0].red   << 12) + (u32)first * step_r;
+            u32 cur_g = (c[0].green << 12) + (u32)first * step_g;
+            u32 cur_b = (c[0].blue  << 12) + (u32)first * step_b;
+            u32 cur_a = (c[0].alpha << 12) + (u32)first * step_a;
 
-            for (int i = 0; i < numpix; ++i) {
+            for (int i = first; i <= last; ++i) {
                 blenderT(dst, cur_r, cur_g, cur_b, cur_a);
                 num += numadd;
                 if (num >= den) {
@@ -728,166 +1525,404 @@ namespace sphere {
     }
 
     //-----------------------------------------------------------------
-    void
-    Canvas::drawLine(Vec2i pos[2], RGBA col[2])
+    // Gradient color from the factor f, c[0] at 255 and c[1] at 0
+    static inline RGBA get_gradient_color(const RGBA c[2], int f)
     {
-        if ((pos[0].x > _scissor.lr.x && pos[1].x > _scissor.lr.x) ||
-            (pos[0].y > _scissor.lr.y && pos[1].y > _scissor.lr.y) ||
-            (pos[0].x < _scissor.ul.x && pos[1].x < _scissor.ul.x) ||
-            (pos[0].y < _scissor.ul.y && pos[1].y < _scissor.ul.y))
-        {
-            return;
-        }
+        int w1 = f + (f >> 7);
+        int w2 = 256 - w1;
+        return RGBA((c[0].red   * w1 + c[1].red   * w2 + 128) >> 8,
+                    (c[0].green * w1 + c[1].green * w2 + 128) >> 8,
+                    (c[0].blue  * w1 + c[1].blue  * w2 + 128) >> 8,
+                    (c[0].alpha * w1 + c[1].alpha * w2 + 128) >> 8);
+    }
 
-        if (col[0] == col[1]) {
-            switch (_blendMode) {
-            case BM_REPLACE:
-                draw_line<rgba_replace>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
-                break;
-            case BM_ALPHA:
-                draw_line<rgba_alpha>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
-                break;
-            case BM_ADD:
-                draw_line<rgba_add>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
-                break;
-            case BM_SUBTRACT:
-                draw_line<rgba_subtract>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
-                break;
-            case BM_MULTIPLY:
-                draw_line<rgba_multiply>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col[0]);
-                break;
-            default:
-                break;
-            }
+    //-----------------------------------------------------------------
+    static inline RGBA get_covered_color(const RGBA& c, int coverage, bool premultiplied)
+    {
+        int w = coverage + (coverage >> 7);
+        if (premultiplied) {
+            return RGBA((c.red   * w + 128) >> 8,
+                        (c.green * w + 128) >> 8,
+                        (c.blue  * w + 128) >> 8,
+                        (c.alpha * w + 128) >> 8);
         } else {
-            switch (_blendMode) {
-            case BM_REPLACE:
-                draw_gradient_line<rgba_replace_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
-                break;
-            case BM_ALPHA:
-                draw_gradient_line<rgba_alpha_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
-                break;
-            case BM_ADD:
-                draw_gradient_line<rgba_add_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
-                break;
-            case BM_SUBTRACT:
-                draw_gradient_line<rgba_subtract_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
-                break;
-            case BM_MULTIPLY:
-                draw_gradient_line<rgba_multiply_fix>(*this, pos[0].x, pos[0].y, pos[1].x, pos[1].y, col);
-                break;
-            default:
-                break;
-            }
+            return RGBA(c.red, c.green, c.blue, (c.alpha * w + 128) >> 8);
         }
     }
 
     //-----------------------------------------------------------------
-    template<BLENDFUNC_T blenderT>
-    static void draw_rect(Canvas& d, const Recti& rect, const RGBA& col)
+    // Strokes are rasterized in 32.32 fixed point line coordinates.
+    // Anti-aliased strokes cover a pixel by the overlap of its box with
+    // the stroke, aliased ones fully if its center lies inside.
+    static const i64 STROKE_ONE  = (i64)1 << 32;
+    static const i64 STROKE_HALF = (i64)1 << 31;
+
+    //-----------------------------------------------------------------
+    // How far the pixels of a stroke may lie beyond its outline
+    static inline int get_stroke_padding(float width)
     {
-        Recti intersection = d.getScissor().getIntersection(rect);
-        if (!intersection.isValid()) {
-            return;
-        }
+        return (int)ceil(width * 0.5f) + 1;
+    }
 
-        RGBA* dst = d.getPixels() + intersection.getY() * d.getWidth() + intersection.getX();
-        int iy = intersection.getHeight();
-        while (iy > 0) {
-            int ix = intersection.getWidth();
-            while (ix > 0) {
-                blenderT(dst, col);
-                dst++;
-                ix--;
-            }
-            dst += d.getWidth() - intersection.getWidth();
-            iy--;
+    //-----------------------------------------------------------------
+    static inline i64 to_stroke_fixed(double x)
+    {
+        double v = x * (double)STROKE_ONE;
+        return (i64)(v < 0.0 ? v - 0.5 : v + 0.5);
+    }
+
+    //-----------------------------------------------------------------
+    // Coverage (0 - 256) of a pixel at p along one axis of the stroke,
+    // which spans [lo, hi) on it
+    static inline int get_stroke_coverage(i64 p, i64 lo, i64 hi, bool antialias)
+    {
+        if (!antialias) {
+            return (p >= lo && p < hi) ? 256 : 0;
         }
+        i64 a = std::max(p - STROKE_HALF, lo);
+        i64 b = std::min(p + STROKE_HALF, hi);
+        return (b > a) ? (int)((b - a) >> 24) : 0;
     }
 
     //-----------------------------------------------------------------
-    static inline void clip_color2(float u, RGBA& ul, const RGBA& ur, RGBA& ll, const RGBA& lr)
+    static inline RGBA get_stroke_color(const RGBA& c, int coverage, bool premultiplied)
     {
-        ul.red   = (u8)(ul.red   + u * (ur.red   - ul.red));
-        ul.green = (u8)(ul.green + u * (ur.green - ul.green));
-        ul.blue  = (u8)(ul.blue  + u * (ur.blue  - ul.blue));
-        ul.alpha = (u8)(ul.alpha + u * (ur.alpha - ul.alpha));
+        return (coverage >= 256) ? c : get_covered_color(c, coverage, premultiplied);
+    }
 
-        ll.red   = (u8)(ll.red   + u * (lr.red   - ll.red));
-        ll.green = (u8)(ll.green + u * (lr.green - ll.green));
-        ll.blue  = (u8)(ll.blue  + u * (lr.blue  - ll.blue));
-        ll.alpha = (u8)(ll.alpha + u * (lr.alpha - ll.alpha));
+    //-----------------------------------------------------------------
+    // Narrows [xa, xb] to the x for which lo < a * x + b < hi, with
+    // inv_a = 1 / a
+    static inline void clip_stroke_slab(double a, double inv_a, double b, double lo, double hi, double& xa, double& xb)
+    {
+        if (fabs(a) < 1e-12) {
+            if (b <= lo || b >= hi) {
+                xa = 1.0;
+                xb = 0.0;
+            }
+            return;
+        }
+        double u = (lo - b) * inv_a;
+        double v = (hi - b) * inv_a;
+        xa = std::max(xa, std::min(u, v));
+        xb = std::min(xb, std::max(u, v));
     }
 
     //-----------------------------------------------------------------
-    template<BLENDFUNCFIX_T blenderT>
-    static void draw_gradient_rect(Canvas& d, const Recti& rect, RGBA col[4])
+    // floor() for values within the int range
+    static inline int floor_to_int(double x)
     {
-        RGBA tc[4] = {col[0], col[1], col[2], col[3]};
-        int x = rect.getX();
-        int y = rect.getY();
-        int w = rect.getWidth();
-        int h = rect.getHeight();
+        int i = (int)x;
+        return i - (x < i ? 1 : 0);
+    }
 
-        // clip the rectangle and its corner colors
-        if (x < d.getScissor().ul.x) {
-            clip_color2((float)(d.getScissor().ul.x - x) / w, tc[0], tc[1], tc[3], tc[2]);
-            w -= d.getScissor().ul.x - x;
-            x  = d.getScissor().ul.x;
+    //-----------------------------------------------------------------
+    // Line of any width with butt ends half a pixel beyond the end
+    // points, so a line of width 1 covers as many pixels as the aliased
+    // one. Every pixel center is put into line coordinates: across the
+    // line (s) from its axis, along it (t) from the first end point.
+    template<BLENDFUNC_T blenderT>
+    static void draw_wide_line(const DrawTarget& d, int x1, int y1, int x2, int y2, RGBA c[2], float width, bool antialias)
+    {
+        double dx  = (double)x2 - x1;
+        double dy  = (double)y2 - y1;
+        double len = sqrt(dx * dx + dy * dy);
+        double ux  = (len > 0.0) ? dx / len : 1.0;
+        double uy  = (len > 0.0) ? dy / len : 0.0;
+        double hw  = width * 0.5;
+
+        // the area in which pixel centers may be covered
+        double pad    = antialias ? 0.5 : 0.0;
+        double across = hw + pad;
+        double along1 = -0.5 - pad;
+        double along2 = len + 0.5 + pad;
+
+        const Recti& clip = d.scissor;
+
+        double ymin = y1;
+        double ymax = y1;
+        for (int i = 0; i < 4; ++i) {
+            double t = (i & 1) ? along2 : along1;
+            double s = (i & 2) ? across : -across;
+            double cy = y1 + t * uy + s * ux;
+            ymin = std::min(ymin, cy);
+            ymax = std::max(ymax, cy);
         }
-
-        if (y < d.getScissor().ul.y) {
-            clip_color2((float)(d.getScissor().ul.y - y) / h, tc[0], tc[3], tc[1], tc[2]);
-            h -= d.getScissor().ul.y - y;
-            y  = d.getScissor().ul.y;
+        int row1 = (int)std::max(floor(ymin), (double)clip.ul.y);
+        int row2 = (int)std::min(ceil(ymax),  (double)clip.lr.y);
+
+        i64 s_lo = to_stroke_fixed(-hw);
+        i64 s_hi = to_stroke_fixed(hw);
+        i64 t_lo = -STROKE_HALF;
+        i64 t_hi = to_stroke_fixed(len) + STROKE_HALF;
+        i64 s_step = to_stroke_fixed(-uy);
+        i64 t_step = to_stroke_fixed(ux);
+        double inv_len = (len > 0.0) ? 1.0 / len : 0.0;
+        double inv_s   = (uy != 0.0) ? -1.0 / uy : 0.0;
+        double inv_t   = (ux != 0.0) ?  1.0 / ux : 0.0;
+        i64 g_step = to_stroke_fixed(ux * inv_len);
+
+        bool gradient = (c[0] != c[1]);
+
+        for (int y = row1; y <= row2; ++y) {
+            double ry = y - y1;
+
+            // columns relative to x1 where both s and t are in range
+            double xa = clip.ul.x - x1 - 1.0;
+            double xb = clip.lr.x - x1 + 1.0;
+            clip_stroke_slab(-uy, inv_s, ux * ry, -across, across, xa, xb);
+            clip_stroke_slab( ux, inv_t, uy * ry,  along1, along2, xa, xb);
+            if (xa > xb) {
+                continue;
+            }
+            int col1 = std::max(floor_to_int(xa) + x1,     clip.ul.x);
+            int col2 = std::min(floor_to_int(xb) + x1 + 1, clip.lr.x);
+
+            // anchored at x1, so the result doesn't depend on the clipping
+            i64 s = to_stroke_fixed(ux * ry) + (col1 - x1) * s_step;
+            i64 t = to_stroke_fixed(uy * ry) + (col1 - x1) * t_step;
+            i64 g = to_stroke_fixed(uy * ry * inv_len) + (col1 - x1) * g_step;
+
+            RGBA* dst = d.pixels + y * d.pitch + col1;
+            for (int x = col1; x <= col2; ++x) {
+                int coverage = get_stroke_coverage(s, s_lo, s_hi, antialias) *
+                               get_stroke_coverage(t, t_lo, t_hi, antialias) >> 8;
+                if (coverage > 0) {
+                    if (gradient) {
+                        int f = 256 - (int)(bracket<i64>(g, 0, STROKE_ONE) >> 24);
+                        RGBA col = get_gradient_color(c, f - (f >> 8));
+                        blenderT(dst, get_stroke_color(col, coverage, d.premultiplied));
+                    } else {
+                        blenderT(dst, get_stroke_color(c[0], coverage, d.premultiplied));
+                    }
+                }
+                s += s_step;
+                t += t_step;
+                g += g_step;
+                dst++;
+            }
         }
+    }
 
-        if (x + w - 1 > d.getScissor().lr.x) {
-            clip_color2((float)((x + w - 1) - d.getScissor().lr.x) / w, tc[1], tc[0], tc[2], tc[3]);
-            w = (d.getScissor().lr.x - x) + 1;
+    //-----------------------------------------------------------------
+    static void execute_line(const DrawTarget& d, const CanvasCommand& cmd)
+    {
+        int x1 = cmd.pos[0].x;
+        int y1 = cmd.pos[0].y;
+        int x2 = cmd.pos[1].x;
+        int y2 = cmd.pos[1].y;
+
+        bool premultiplied = d.premultiplied;
+        RGBA c[2] = {cmd.col[0], cmd.col[1]};
+        if (premultiplied) {
+            c[0] = rgba_premultiply(c[0]);
+            c[1] = rgba_premultiply(c[1]);
         }
 
-        if (y + h - 1 > d.getScissor().lr.y) {
-            clip_color2((float)((y + h - 1) - d.getScissor().lr.y) / h, tc[3], tc[0], tc[2], tc[1]);
-            h = (d.getScissor().lr.y - y) + 1;
+        if (cmd.antialias || cmd.width != 1.0f) {
+            float w = cmd.width;
+            bool aa = cmd.antialias;
+            switch (cmd.blendMode) {
+            case Canvas::BM_REPLACE:
+                draw_wide_line<rgba_replace>(d, x1, y1, x2, y2, c, w, aa);
+                break;
+            case Canvas::BM_ALPHA:
+                if (premultiplied) {
+                    draw_wide_line<rgba_alpha_pre>(d, x1, y1, x2, y2, c, w, aa);
+                } else {
+                    draw_wide_line<rgba_alpha>(d, x1, y1, x2, y2, c, w, aa);
+                }
+                break;
+            case Canvas::BM_ADD:
+                if (premultiplied) {
+                    draw_wide_line<rgba_add_pre>(d, x1, y1, x2, y2, c, w, aa);
+                } else {
+                    draw_wide_line<rgba_add>(d, x1, y1, x2, y2, c, w, aa);
+                }
+                break;
+            case Canvas::BM_SUBTRACT:
+                draw_wide_line<rgba_subtract>(d, x1, y1, x2, y2, c, w, aa);
+                break;
+            case Canvas::BM_MULTIPLY:
+                draw_wide_line<rgba_multiply>(d, x1, y1, x2, y2, c, w, aa);
+                break;
+            default:
+                break;
+            }
+            return;
+        }
+
+        if (is_line_culled(x1, y1, x2, y2, d.scissor)) {
+            return;
         }
 
-        i32 l_r = tc[0].red   << 12;
-        i32 l_g = tc[0].green << 12;
-        i32 l_b = tc[0].blue  << 12;
-        i32 l_a = tc[0].alpha << 12;
+        if (c[0] == c[1]) {
+            switch (cmd.blendMode) {
+            case Canvas::BM_REPLACE:
+                draw_line<rgba_replace>(d, x1, y1, x2, y2, c[0]);
+                break;
+            case Canvas::BM_ALPHA:
+                if (premultiplied) {
+                    draw_line<rgba_alpha_pre>(d, x1, y1, x2, y2, c[0]);
+                } else {
+                    draw_line<rgba_alpha>(d, x1, y1, x2, y2, c[0]);
+                }
+                break;
+            case Canvas::BM_ADD:
+                if (premultiplied) {
+                    draw_line<rgba_add_pre>(d, x1, y1, x2, y2, c[0]);
+                } else {
+                    draw_line<rgba_add>(d, x1, y1, x2, y2, c[0]);
+                }
+                break;
+            case Canvas::BM_SUBTRACT:
+                draw_line<rgba_subtract>(d, x1, y1, x2, y2, c[0]);
+                break;
+            case Canvas::BM_MULTIPLY:
+                draw_line<rgba_multiply>(d, x1, y1, x2, y2, c[0]);
+                break;
+            default:
+                break;
+            }
+        } else {
+            switch (cmd.blendMode) {
+            case Canvas::BM_REPLACE:
+                draw_gradient_line<rgba_replace_fix>(d, x1, y1, x2, y2, c);
+                break;
+            case Canvas::BM_ALPHA:
+                if (premultiplied) {
+                    draw_gradient_line<rgba_alpha_pre_fix>(d, x1, y1, x2, y2, c);
+                } else {
+                    draw_gradient_line<rgba_alpha_fix>(d, x1, y1, x2, y2, c);
+                }
+                break;
+            case Canvas::BM_ADD:
+                if (premultiplied) {
+                    draw_gradient_line<rgba_add_pre_fix>(d, x1, y1, x2, y2, c);
+                } else {
+                    draw_gradient_line<rgba_add_fix>(d, x1, y1, x2, y2, c);
+                }
+                break;
+            case Canvas::BM_SUBTRACT:
+                draw_gradient_line<rgba_subtract_fix>(d, x1, y1, x2, y2, c);
+                break;
+            case Canvas::BM_MULTIPLY:
+                draw_gradient_line<rgba_multiply_fix>(d, x1, y1, x2, y2, c);
+                break;
+            default:
+                break;
+            }
+        }
+    }
 
-        i32 r_r = tc[1].red   << 12;
-        i32 r_g = tc[1].green << 12;
-        i32 r_b = tc[1].blue  << 12;
-        i32 r_a = tc[1].alpha << 12;
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawLine(Vec2i pos[2], RGBA col[2], bool antialias, float width)
+    {
+        if (!(width > 0.0f)) {
+            return;
+        }
 
-        i32 step_l_r = ((tc[3].red   - tc[0].red)   << 12) / h;
-        i32 step_l_g = ((tc[3].green - tc[0].green) << 12) / h;
-        i32 step_l_b = ((tc[3].blue  - tc[0].blue)  << 12) / h;
-        i32 step_l_a = ((tc[3].alpha - tc[0].alpha) << 12) / h;
+        CanvasCommand cmd;
+        cmd.type      = CanvasCommand::CT_LINE;
+        cmd.pos[0]    = pos[0];
+        cmd.pos[1]    = pos[1];
+        cmd.col[0]    = col[0];
+        cmd.col[1]    = col[1];
+        cmd.antialias = antialias;
+        cmd.width     = width;
+
+        if (antialias || width != 1.0f) {
+            int pad = get_stroke_padding(width);
+            Recti bounds(std::min(pos[0].x, pos[1].x) - pad, std::min(pos[0].y, pos[1].y) - pad,
+                         std::max(pos[0].x, pos[1].x) + pad, std::max(pos[0].y, pos[1].y) + pad);
+            if (!_scissor.intersects(bounds)) {
+                return;
+            }
+        } else if (is_line_culled(pos[0].x, pos[0].y, pos[1].x, pos[1].y, _scissor)) {
+            return;
+        }
 
-        i32 step_r_r = ((tc[2].red   - tc[1].red)   << 12) / h;
-        i32 step_r_g = ((tc[2].green - tc[1].green) << 12) / h;
-        i32 step_r_b = ((tc[2].blue  - tc[1].blue)  << 12) / h;
-        i32 step_r_a = ((tc[2].alpha - tc[1].alpha) << 12) / h;
+        submit(cmd);
+    }
 
-        RGBA* dst = d.getPixels() + y * d.getWidth() + x;
+    //-----------------------------------------------------------------
+    template<BLENDFUNC_T blenderT>
+    static void draw_rect(const DrawTarget& d, const Recti& rect, const RGBA& col)
+    {
+        Recti intersection = d.scissor.getIntersection(rect);
+        if (!intersection.isValid()) {
+            return;
+        }
 
-        for (int iy = 0; iy < h; ++iy)
-        {
-            // temporary interpolation variables
-            i32 cur_r = l_r;
-            i32 cur_g = l_g;
-            i32 cur_b = l_b;
-            i32 cur_a = l_a;
+        RGBA* dst = d.pixels + intersection.getY() * d.pitch + intersection.getX();
+        int iy = intersection.getHeight();
+        while (iy > 0) {
+            int ix = intersection.getWidth();
+            while (ix > 0) {
+                blenderT(dst, col);
+                dst++;
+                ix--;
+            }
+            dst += d.pitch - intersection.getWidth();
+            iy--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNCFIX_T blenderT>
+    static void draw_gradient_rect(const DrawTarget& d, const Recti& rect, RGBA col[4])
+    {
+        Recti intersection = d.scissor.getIntersection(rect);
+        if (!intersection.isValid()) {
+            return;
+        }
 
+        // the color steps are those of the unclipped rectangle, the clipped
+        // part starts off at an offset into them
+        int w  = rect.getWidth();
+        int h  = rect.getHeight();
+        int ox = intersection.getX() - rect.getX();
+        int oy = intersection.getY() - rect.getY();
+
+        i32 step_l_r = ((col[3].red   - col[0].red)   << 12) / h;
+        i32 step_l_g = ((col[3].green - col[0].green) << 12) / h;
+        i32 step_l_b = ((col[3].blue  - col[0].blue)  << 12) / h;
+        i32 step_l_a = ((col[3].alpha - col[0].alpha) << 12) / h;
+
+        i32 step_r_r = ((col[2].red   - col[1].red)   << 12) / h;
+        i32 step_r_g = ((col[2].green - col[1].green) << 12) / h;
+        i32 step_r_b = ((col[2].blue  - col[1].blue)  << 12) / h;
+        i32 step_r_a = ((col[2].alpha - col[1].alpha) << 12) / h;
+
+        i32 l_r = (col[0].red   << 12) + oy * step_l_r;
+        i32 l_g = (col[0].green << 12) + oy * step_l_g;
+        i32 l_b = (col[0].blue  << 12) + oy * step_l_b;
+        i32 l_a = (col[0].alpha << 12) + oy * step_l_a;
+
+        i32 r_r = (col[1].red   << 12) + oy * step_r_r;
+        i32 r_g = (col[1].green << 12) + oy * step_r_g;
+        i32 r_b = (col[1].blue  << 12) + oy * step_r_b;
+        i32 r_a = (col[1].alpha << 12) + oy * step_r_a;
+
+        int cw = intersection.getWidth();
+        int ch = intersection.getHeight();
+        RGBA* dst = d.pixels + intersection.getY() * d.pitch + intersection.getX();
+
+        for (int iy = 0; iy < ch; ++iy)
+        {
             i32 step_r = (r_r - l_r) / w;
             i32 step_g = (r_g - l_g) / w;
             i32 step_b = (r_b - l_b) / w;
             i32 step_a = (r_a - l_a) / w;
 
-            for (int ix = 0; ix < w; ++ix) {
+            // temporary interpolation variables
+            i32 cur_r = l_r + ox * step_r;
+            i32 cur_g = l_g + ox * step_g;
+            i32 cur_b = l_b + ox * step_b;
+            i32 cur_a = l_a + ox * step_a;
+
+            for (int ix = 0; ix < cw; ++ix) {
                 blenderT(dst, cur_r, cur_g, cur_b, cur_a);
                 dst++;
 
@@ -898,7 +1933,7 @@ namespace sphere {
                 cur_a += step_a;
             }
 
-            dst += d.getWidth() - w;
+            dst += d.pitch - cw;
 
             // interpolate left and right colors
             l_r += step_l_r;
@@ -914,52 +1949,162 @@ namespace sphere {
     }
 
     //-----------------------------------------------------------------
-    void
-    Canvas::drawRect(const Recti& rect, RGBA col[4])
+    static const int LINEAR_RECT_CHUNK_SIZE = 256;
+
+    //-----------------------------------------------------------------
+    // Linear light rectangles interpolate their gradients in linear
+    // light, with alpha as it is, and blend a chunk of a row at a time
+    static void draw_linear_rect(const DrawTarget& d, const Recti& rect, const RGBA col[4], bool gradient, BLENDSPANFUNC_T blendSpan)
     {
-        if (!rect.isValid() || !_scissor.intersects(rect)) {
+        Recti intersection = d.scissor.getIntersection(rect);
+        if (!intersection.isValid()) {
+            return;
+        }
+
+        const u16* to_linear = GetSrgbToLinearTable();
+        const u8*  to_srgb   = GetLinearToSrgbTable();
+
+        int w  = rect.getWidth();
+        int h  = rect.getHeight();
+        int ox = intersection.getX() - rect.getX();
+        int oy = intersection.getY() - rect.getY();
+
+        // the corners in linear light
+        i32 c[4][4];
+        for (int i = 0; i < 4; ++i) {
+            c[i][0] = to_linear[col[i].red];
+            c[i][1] = to_linear[col[i].green];
+            c[i][2] = to_linear[col[i].blue];
+            c[i][3] = col[i].alpha;
+        }
+
+        // the channels of the left and right edge, 12 bit fractions
+        i32 step_l[4];
+        i32 step_r[4];
+        i32 l[4];
+        i32 r[4];
+        for (int k = 0; k < 4; ++k) {
+            step_l[k] = ((c[3][k] - c[0][k]) << 12) / h;
+            step_r[k] = ((c[2][k] - c[1][k]) << 12) / h;
+            l[k] = (c[0][k] << 12) + oy * step_l[k];
+            r[k] = (c[1][k] << 12) + oy * step_r[k];
+        }
+
+        RGBA buffer[LINEAR_RECT_CHUNK_SIZE];
+        if (!gradient) {
+            std::fill(buffer, buffer + LINEAR_RECT_CHUNK_SIZE, col[0]);
+        }
+
+        int cw = intersection.getWidth();
+        int ch = intersection.getHeight();
+        RGBA* dst = d.pixels + intersection.getY() * d.pitch + intersection.getX();
+
+        for (int iy = 0; iy < ch; ++iy) {
+            i32 step[4];
+            i32 cur[4];
+            for (int k = 0; k < 4; ++k) {
+                step[k] = (r[k] - l[k]) / w;
+                cur[k]  = l[k] + ox * step[k];
+            }
+
+            for (int x = 0; x < cw; x += LINEAR_RECT_CHUNK_SIZE) {
+                int n = std::min(cw - x, LINEAR_RECT_CHUNK_SIZE);
+                if (gradient) {
+                    for (int i = 0; i < n; ++i) {
+                        buffer[i].red   = to_srgb[cur[0] >> 12];
+                        buffer[i].green = to_srgb[cur[1] >> 12];
+                        buffer[i].blue  = to_srgb[cur[2] >> 12];
+                        buffer[i].alpha = (u8)(cur[3] >> 12);
+                        for (int k = 0; k < 4; ++k) {
+                            cur[k] += step[k];
+                        }
+                    }
+                }
+                blendSpan(dst + x, buffer, n);
+            }
+
+            dst += d.pitch;
+            for (int k = 0; k < 4; ++k) {
+                l[k] += step_l[k];
+                r[k] += step_r[k];
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void execute_rect(const DrawTarget& d, const CanvasCommand& cmd)
+    {
+        if (d.linear) {
+            bool gradient = (RGBA(cmd.col[0]) != cmd.col[1] ||
+                             RGBA(cmd.col[0]) != cmd.col[2] ||
+                             RGBA(cmd.col[0]) != cmd.col[3]);
+            draw_linear_rect(d, cmd.rect, cmd.col, gradient, GetLinearBlendSpanFunc(cmd.blendMode));
             return;
         }
 
-        if (col[0] == col[1] &&
-            col[0] == col[2] &&
-            col[0] == col[3])
+        bool premultiplied = d.premultiplied;
+        RGBA c[4] = {cmd.col[0], cmd.col[1], cmd.col[2], cmd.col[3]};
+        if (premultiplied) {
+            for (int i = 0; i < 4; ++i) {
+                c[i] = rgba_premultiply(c[i]);
+            }
+        }
+
+        if (c[0] == c[1] &&
+            c[0] == c[2] &&
+            c[0] == c[3])
         {
-            switch (_blendMode) {
-            case BM_REPLACE:
-                draw_rect<rgba_replace>(*this, rect, col[0]);
+            switch (cmd.blendMode) {
+            case Canvas::BM_REPLACE:
+                draw_rect<rgba_replace>(d, cmd.rect, c[0]);
                 break;
-            case BM_ALPHA:
-                draw_rect<rgba_alpha>(*this, rect, col[0]);
+            case Canvas::BM_ALPHA:
+                if (premultiplied) {
+                    draw_rect<rgba_alpha_pre>(d, cmd.rect, c[0]);
+                } else {
+                    draw_rect<rgba_alpha>(d, cmd.rect, c[0]);
+                }
                 break;
-            case BM_ADD:
-                draw_rect<rgba_add>(*this, rect, col[0]);
+            case Canvas::BM_ADD:
+                if (premultiplied) {
+                    draw_rect<rgba_add_pre>(d, cmd.rect, c[0]);
+                } else {
+                    draw_rect<rgba_add>(d, cmd.rect, c[0]);
+                }
                 break;
-            case BM_SUBTRACT:
-                draw_rect<rgba_subtract>(*this, rect, col[0]);
+            case Canvas::BM_SUBTRACT:
+                draw_rect<rgba_subtract>(d, cmd.rect, c[0]);
                 break;
-            case BM_MULTIPLY:
-                draw_rect<rgba_multiply>(*this, rect, col[0]);
+            case Canvas::BM_MULTIPLY:
+                draw_rect<rgba_multiply>(d, cmd.rect, c[0]);
                 break;
             default:
                 break;
             }
         } else {
-            switch (_blendMode) {
-            case BM_REPLACE:
-                draw_gradient_rect<rgba_replace_fix>(*this, rect, col);
+            switch (cmd.blendMode) {
+            case Canvas::BM_REPLACE:
+                draw_gradient_rect<rgba_replace_fix>(d, cmd.rect, c);
                 break;
-            case BM_ALPHA:
-                draw_gradient_rect<rgba_alpha_fix>(*this, rect, col);
+            case Canvas::BM_ALPHA:
+                if (premultiplied) {
+                    draw_gradient_rect<rgba_alpha_pre_fix>(d, cmd.rect, c);
+                } else {
+                    draw_gradient_rect<rgba_alpha_fix>(d, cmd.rect, c);
+                }
                 break;
-            case BM_ADD:
-                draw_gradient_rect<rgba_add_fix>(*this, rect, col);
+            case Canvas::BM_ADD:
+                if (premultiplied) {
+                    draw_gradient_rect<rgba_add_pre_fix>(d, cmd.rect, c);
+                } else {
+                    draw_gradient_rect<rgba_add_fix>(d, cmd.rect, c);
+                }
                 break;
-            case BM_SUBTRACT:
-                draw_gradient_rect<rgba_subtract_fix>(*this, rect, col);
+            case Canvas::BM_SUBTRACT:
+                draw_gradient_rect<rgba_subtract_fix>(d, cmd.rect, c);
                 break;
-            case BM_MULTIPLY:
-                draw_gradient_rect<rgba_multiply_fix>(*this, rect, col);
+            case Canvas::BM_MULTIPLY:
+                draw_gradient_rect<rgba_multiply_fix>(d, cmd.rect, c);
                 break;
             default:
                 break;
@@ -967,6 +2112,149 @@ namespace sphere {
         }
     }
 
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawRect(const Recti& rect, RGBA col[4])
+    {
+        if (!rect.isValid() || !_scissor.intersects(rect)) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type = CanvasCommand::CT_RECT;
+        cmd.rect = rect;
+        for (int i = 0; i < 4; ++i) {
+            cmd.col[i] = col[i];
+        }
+        submit(cmd);
+    }
+    //-----------------------------------------------------------------
+    // Coverage of the columns (or rows) first to last by a stroke from
+    // lo to hi, in pixel coordinates with pixel centers on integers
+    static void get_box_coverage(double lo, double hi, int first, int last, bool antialias, std::vector<int>& coverage)
+    {
+        i64 a = to_stroke_fixed(lo);
+        i64 b = to_stroke_fixed(hi);
+        coverage.resize(last - first + 1);
+        for (int i = first; i <= last; ++i) {
+            coverage[i - first] = (a < b) ? get_stroke_coverage((i64)i << 32, a, b, antialias) : 0;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // The rectangle stroked along the centers of its border pixels: the
+    // coverage of the outer box minus that of the inner one
+    template<BLENDFUNC_T blenderT>
+    static void draw_rect_outline(const DrawTarget& d, const Recti& rect, const RGBA& c, float width, bool antialias)
+    {
+        double hw  = width * 0.5;
+        int    pad = get_stroke_padding(width);
+
+        Recti bounds(rect.ul.x - pad, rect.ul.y - pad, rect.lr.x + pad, rect.lr.y + pad);
+        Recti area = d.scissor.getIntersection(bounds);
+        if (!area.isValid()) {
+            return;
+        }
+
+        std::vector<int> outer_x, inner_x, outer_y, inner_y;
+        get_box_coverage(rect.ul.x - hw, rect.lr.x + hw, area.ul.x, area.lr.x, antialias, outer_x);
+        get_box_coverage(rect.ul.x + hw, rect.lr.x - hw, area.ul.x, area.lr.x, antialias, inner_x);
+        get_box_coverage(rect.ul.y - hw, rect.lr.y + hw, area.ul.y, area.lr.y, antialias, outer_y);
+        get_box_coverage(rect.ul.y + hw, rect.lr.y - hw, area.ul.y, area.lr.y, antialias, inner_y);
+
+        // the columns fully inside of the inner box
+        int mid1 = area.lr.x + 1;
+        int mid2 = area.lr.x;
+        for (int i = 0; i < (int)inner_x.size(); ++i) {
+            if (inner_x[i] == 256) {
+                mid1 = std::min(mid1, area.ul.x + i);
+                mid2 = area.ul.x + i;
+            }
+        }
+
+        for (int y = area.ul.y; y <= area.lr.y; ++y) {
+            int oy = outer_y[y - area.ul.y];
+            int iy = inner_y[y - area.ul.y];
+            if (oy == 0) {
+                continue;
+            }
+            RGBA* row = d.pixels + y * d.pitch;
+            for (int x = area.ul.x; x <= area.lr.x; ++x) {
+                if (x == mid1 && oy == iy) {
+                    // nothing covered between the inner columns
+                    x = mid2;
+                    continue;
+                }
+                int coverage = (outer_x[x - area.ul.x] * oy - inner_x[x - area.ul.x] * iy) >> 8;
+                if (coverage > 0) {
+                    blenderT(row + x, get_stroke_color(c, coverage, d.premultiplied));
+                }
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void execute_rect_outline(const DrawTarget& d, const CanvasCommand& cmd)
+    {
+        bool premultiplied = d.premultiplied;
+        RGBA c = cmd.col[0];
+        if (premultiplied) {
+            c = rgba_premultiply(c);
+        }
+
+        float w = cmd.width;
+        bool aa = cmd.antialias;
+        switch (cmd.blendMode) {
+        case Canvas::BM_REPLACE:
+            draw_rect_outline<rgba_replace>(d, cmd.rect, c, w, aa);
+            break;
+        case Canvas::BM_ALPHA:
+            if (premultiplied) {
+                draw_rect_outline<rgba_alpha_pre>(d, cmd.rect, c, w, aa);
+            } else {
+                draw_rect_outline<rgba_alpha>(d, cmd.rect, c, w, aa);
+            }
+            break;
+        case Canvas::BM_ADD:
+            if (premultiplied) {
+                draw_rect_outline<rgba_add_pre>(d, cmd.rect, c, w, aa);
+            } else {
+                draw_rect_outline<rgba_add>(d, cmd.rect, c, w, aa);
+            }
+            break;
+        case Canvas::BM_SUBTRACT:
+            draw_rect_outline<rgba_subtract>(d, cmd.rect, c, w, aa);
+            break;
+        case Canvas::BM_MULTIPLY:
+            draw_rect_outline<rgba_multiply>(d, cmd.rect, c, w, aa);
+            break;
+        default:
+            break;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawRectOutline(const Recti& rect, const RGBA& color, bool antialias, float width)
+    {
+        if (!rect.isValid() || !(width > 0.0f)) {
+            return;
+        }
+
+        int pad = get_stroke_padding(width);
+        if (!_scissor.intersects(Recti(rect.ul.x - pad, rect.ul.y - pad, rect.lr.x + pad, rect.lr.y + pad))) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type      = CanvasCommand::CT_RECT_OUTLINE;
+        cmd.rect      = rect;
+        cmd.col[0]    = color;
+        cmd.antialias = antialias;
+        cmd.width     = width;
+        submit(cmd);
+    }
+
     //-----------------------------------------------------------------
     static inline bool is_point_clipped(int x, int y, const Recti& scissor)
     {
@@ -979,7 +2267,7 @@ namespace sphere {
 
     //-----------------------------------------------------------------
     template<BLENDFUNC_T blenderT>
-    static void draw_circle_outline(Canvas& d, int x, int y, int r, const RGBA& c)
+    static void draw_circle_outline(const DrawTarget& d, int x, int y, int r, const RGBA& c)
     {
         int f     = 1 - r;
         int ddF_x = 0;
@@ -987,18 +2275,18 @@ namespace sphere {
 
         int ix = 0;
         int iy = r;
-        int pitch = d.getWidth();
+        int pitch = d.pitch;
 
-        const Recti& clip = d.getScissor();
+        const Recti& clip = d.scissor;
 
-        RGBA* tl = d.getPixels() + (y - r)     * pitch + (x);
-        RGBA* tr = d.getPixels() + (y - r)     * pitch + (x - 1);
-        RGBA* bl = d.getPixels() + (y + r - 1) * pitch + (x);
-        RGBA* br = d.getPixels() + (y + r - 1) * pitch + (x - 1);
-        RGBA* lt = d.getPixels() + (y)         * pitch + (x - r);
-        RGBA* lb = d.getPixels() + (y - 1)     * pitch + (x - r);
-        RGBA* rt = d.getPixels() + (y)         * pitch + (x + r - 1);
-        RGBA* rb = d.getPixels() + (y - 1)     * pitch + (x + r - 1);
+        RGBA* tl = d.pixels + (y - r)     * pitch + (x);
+        RGBA* tr = d.pixels + (y - r)     * pitch + (x - 1);
+        RGBA* bl = d.pixels + (y + r - 1) * pitch + (x);
+        RGBA* br = d.pixels + (y + r - 1) * pitch + (x - 1);
+        RGBA* lt = d.pixels + (y)         * pitch + (x - r);
+        RGBA* lb = d.pixels + (y - 1)     * pitch + (x - r);
+        RGBA* rt = d.pixels + (y)         * pitch + (x + r - 1);
+        RGBA* rb = d.pixels + (y - 1)     * pitch + (x + r - 1);
 
         while (ix < iy) {
             ix++; tl--; tr++; bl--; br++;
@@ -1038,225 +2326,408 @@ namespace sphere {
     }
 
     //-----------------------------------------------------------------
-    template<BLENDFUNC_T blenderT>
-    static void draw_circle(Canvas& d, int x, int y, int r, const RGBA& c)
+    // Column offsets [i1, i2) of a row of a table which lie in the clip
+    // rectangle, right of the center and mirrored to the left of it
+    static inline void clip_ellipse_row(int x, int w, const Recti& clip, int& r1, int& r2, int& l1, int& l2)
     {
-        int f     = 1 - r;
-        int ddF_x = 0;
-        int ddF_y = -2 * r;
-
-        int ix = 0;
-        int iy = r;
-        int clip_l, clip_r;
-        int pitch = d.getWidth();
-
-        const Recti& clip = d.getScissor();
-        RGBA* dst         = d.getPixels();
-        RGBA* tmp_dst     = NULL;
-
-        while (ix < iy) {
-            ix++;
-            ddF_x += 2;
-            f     += ddF_x + 1;
-
-            clip_l = std::max(x - iy,     clip.ul.x);
-            clip_r = std::min(x + iy - 1, clip.lr.x);
+        r1 = std::max(clip.ul.x - x, 0);
+        r2 = std::min(clip.lr.x - x + 1, w);
+        l1 = std::max(x - 1 - clip.lr.x, 0);
+        l2 = std::min(x - clip.ul.x, w);
+    }
 
-            // top half - bottom
-            if (y - ix >= clip.ul.y && y - ix <= clip.lr.y) {
-                tmp_dst = dst + (y - ix) * pitch + clip_l;
-                for (int i = 0, j = clip_r + 1 - clip_l; i < j; ++i, ++tmp_dst) {
-                    blenderT(tmp_dst, c);
+    //-----------------------------------------------------------------
+    // Outline of any width centered on the rim, from the distance of
+    // the pixel centers of a quadrant to it
+    template<BLENDFUNC_T blenderT>
+    static void draw_wide_ellipse_outline(const DrawTarget& d, int x, int y, int rx, int ry, const RGBA& c, float width, bool antialias)
+    {
+        const Recti& clip = d.scissor;
+
+        double hw     = width * 0.5;
+        double across = hw + (antialias ? 0.5 : 0.0);
+        int    kmax   = ry + (int)ceil(across) + 1;
+        int    imax   = rx + (int)ceil(across) + 1;
+
+        int k1 = std::max(std::min(y - clip.lr.y - 1, clip.ul.y - y), 0);
+        int k2 = std::min(std::max(y - clip.ul.y, clip.lr.y - y + 1), kmax);
+        for (int k = k1; k < k2; ++k) {
+            double py = k + 0.5;
+
+            // the distance grows along a row, so search the columns
+            // between -across and across
+            int lo = 0;
+            int hi = imax;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (EllipseTable::GetDistance(rx, ry, mid + 0.5, py) <= -across) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
                 }
             }
-
-            // bottom half - top
-            if (y + ix - 1 >= clip.ul.y && y + ix - 1 <= clip.lr.y) {
-                tmp_dst = dst + (y + ix - 1) * pitch + clip_l;
-                for (int i = 0, j = clip_r + 1 - clip_l; i < j; ++i, ++tmp_dst) {
-                    blenderT(tmp_dst, c);
+            int i1 = lo;
+            hi = imax;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (EllipseTable::GetDistance(rx, ry, mid + 0.5, py) < across) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
                 }
             }
+            int i2 = lo;
 
-            if (f >= 0) {
-                if (ix != iy) {
-                    clip_l = std::max(x - ix,     clip.ul.x);
-                    clip_r = std::min(x + ix - 1, clip.lr.x);
-
-                    // top half - top
-                    if (y - iy >= clip.ul.y && y - iy <= clip.lr.y) {
-                        tmp_dst = dst + (y - iy) * pitch + clip_l;
-                        for (int i = 0, j = clip_r + 1 - clip_l; i < j; ++i, ++tmp_dst) {
-                            blenderT(tmp_dst, c);
-                        }
-                    }
+            int r1, r2, l1, l2;
+            clip_ellipse_row(x, i2, clip, r1, r2, l1, l2);
+            r1 = std::max(r1, i1);
+            l1 = std::max(l1, i1);
 
-                    // bottom half - bottom
-                    if (y + iy - 1 >= clip.ul.y && y + iy - 1 <= clip.lr.y) {
-                        tmp_dst = dst + (y + iy - 1) * pitch + clip_l;
-                        for (int i = 0, j = clip_r + 1 - clip_l; i < j; ++i, ++tmp_dst) {
-                            blenderT(tmp_dst, c);
-                        }
+            for (int half = 0; half < 2; ++half) {
+                int row = half ? y + k : y - 1 - k;
+                if (row < clip.ul.y || row > clip.lr.y) {
+                    continue;
+                }
+                RGBA* dst = d.pixels + row * d.pitch;
+                for (int i = std::min(r1, l1); i < std::max(r2, l2); ++i) {
+                    i64 dist = to_stroke_fixed(EllipseTable::GetDistance(rx, ry, i + 0.5, py));
+                    int coverage = get_stroke_coverage(dist, to_stroke_fixed(-hw), to_stroke_fixed(hw), antialias);
+                    if (coverage == 0) {
+                        continue;
+                    }
+                    RGBA col = get_stroke_color(c, coverage, d.premultiplied);
+                    if (i >= r1 && i < r2) {
+                        blenderT(dst + x + i, col);
+                    }
+                    if (i >= l1 && i < l2) {
+                        blenderT(dst + x - 1 - i, col);
                     }
                 }
-
-                iy--;
-                ddF_y += 2;
-                f     += ddF_y;
             }
         }
     }
 
     //-----------------------------------------------------------------
     template<BLENDFUNC_T blenderT>
-    static void draw_gradient_circle(Canvas& d, int x, int y, int r, RGBA col[2])
+    static void draw_ellipse_outline(const DrawTarget& d, int x, int y, const EllipseTable& table, const RGBA& c, float width, bool antialias)
     {
-        RGBA tc[2] = {col[0], col[1]};
-
-        int ix = 1;
-        int iy = r;
-        int n;
-
-        // channel differences
-        float fdr = (float)(tc[1].red   - tc[0].red);
-        float fdg = (float)(tc[1].green - tc[0].green);
-        float fdb = (float)(tc[1].blue  - tc[0].blue);
-        float fda = (float)(tc[1].alpha - tc[0].alpha);
-
-        float dist;
-        float factor;
-        float fr = (float)r;
-        const float PI_H = 3.1415927f / 2.0f;
-        const float RR   = (float)(r * r);
-
-        const Recti& clip = d.getScissor();
-        int pitch = d.getWidth();
-        RGBA* pixels = d.getPixels();
-
-        // draw gradient circle (goes through all points in an octant)
-        while (ix <= iy) {
-            n = iy + 1;
-            while (--n >= ix) {
-                dist = sqrt((float)(ix*ix + n*n));
+        int rx = table.getRadiusX();
+        int ry = table.getRadiusY();
+        if (antialias || width != 1.0f) {
+            draw_wide_ellipse_outline<blenderT>(d, x, y, rx, ry, c, width, antialias);
+            return;
+        }
+        if (rx == ry) {
+            draw_circle_outline<blenderT>(d, x, y, rx, c);
+            return;
+        }
 
-                if (dist > r) {
-                    dist = fr;
+        // the pixels of the filled ellipse next to one outside of it
+        const Recti& clip = d.scissor;
+        for (int k = 0; k < ry; ++k) {
+            int w = table.getSpan(k);
+            int n = (k + 1 < ry) ? table.getSpan(k + 1) : 0;
+            int i1 = std::min(n, w - 1);
+            for (int half = 0; half < 2; ++half) {
+                int py = half ? y + k : y - 1 - k;
+                if (w == 0 || py < clip.ul.y || py > clip.lr.y) {
+                    continue;
                 }
-
-                // set correct color
-                factor = sin((float(1) - dist / fr) * PI_H);
-                tc[0].red   = (u8)(tc[1].red   - fdr * factor);
-                tc[0].green = (u8)(tc[1].green - fdg * factor);
-                tc[0].blue  = (u8)(tc[1].blue  - fdb * factor);
-                tc[0].alpha = (u8)(tc[1].alpha - fda * factor);
-
-                // draw the point and reflect it seven times
-                if (!is_point_clipped(x + ix - 1, y - n, clip))
-                    blenderT(pixels + ((y - n) * pitch + (x + ix - 1)), tc[0]);
-
-                if (!is_point_clipped(x - ix, y - n, clip))
-                    blenderT(pixels + ((y - n) * pitch + (x - ix)), tc[0]);
-
-                if (!is_point_clipped(x + ix - 1, y + n - 1, clip))
-                    blenderT(pixels + ((y + n - 1) * pitch + (x + ix - 1)), tc[0]);
-
-                if (!is_point_clipped(x - ix, y + n - 1, clip))
-                    blenderT(pixels + ((y + n - 1) * pitch + (x - ix)), tc[0]);
-
-                if (ix != n) {
-                    if (!is_point_clipped(x + n - 1, y - ix, clip))
-                        blenderT(pixels + ((y - ix) * pitch + (x + n - 1)), tc[0]);
-
-                    if (!is_point_clipped(x - n, y - ix, clip))
-                        blenderT(pixels + ((y - ix) * pitch + (x - n)), tc[0]);
-
-                    if (!is_point_clipped(x + n - 1, y + ix - 1, clip))
-                        blenderT(pixels + ((y + ix - 1) * pitch + (x + n - 1)), tc[0]);
-
-                    if (!is_point_clipped(x - n, y + ix - 1, clip))
-                        blenderT(pixels + ((y + ix - 1) * pitch + (x - n)), tc[0]);
+                RGBA* row = d.pixels + py * d.pitch;
+                for (int i = i1; i < w; ++i) {
+                    if (x + i >= clip.ul.x && x + i <= clip.lr.x) {
+                        blenderT(row + x + i, c);
+                    }
+                    if (x - 1 - i >= clip.ul.x && x - 1 - i <= clip.lr.x) {
+                        blenderT(row + x - 1 - i, c);
+                    }
                 }
             }
+        }
+    }
 
-            // go always rightwards
-            ix++;
+    //-----------------------------------------------------------------
+    template<BLENDFUNC_T blenderT>
+    static void draw_ellipse(const DrawTarget& d, int x, int y, const EllipseTable& table, const RGBA& c)
+    {
+        const Recti& clip = d.scissor;
+        int ry = table.getRadiusY();
+
+        int k1 = std::max(std::min(y - clip.lr.y - 1, clip.ul.y - y), 0);
+        int k2 = std::min(std::max(y - clip.ul.y, clip.lr.y - y + 1), ry);
+        for (int k = k1; k < k2; ++k) {
+            int w = table.getSpan(k);
+            int clip_l = std::max(x - w,     clip.ul.x);
+            int clip_r = std::min(x + w - 1, clip.lr.x);
+            if (clip_l > clip_r) {
+                continue;
+            }
+            for (int half = 0; half < 2; ++half) {
+                int py = half ? y + k : y - 1 - k;
+                if (py < clip.ul.y || py > clip.lr.y) {
+                    continue;
+                }
+                RGBA* dst = d.pixels + py * d.pitch + clip_l;
+                for (int i = clip_r + 1 - clip_l; i > 0; --i, ++dst) {
+                    blenderT(dst, c);
+                }
+            }
+        }
+    }
 
-            // but check whether to go down
-            if (fabs(ix*ix + iy*iy - RR) > fabs(ix*ix + (iy-1)*(iy-1) - RR)) iy--;
+    //-----------------------------------------------------------------
+    // Returns the gradient factors of a row, which are computed into
+    // buffer for the columns [r1, r2) and [l1, l2) if the table has none
+    static inline const u8* get_gradient_row(const EllipseTable& table, int k, int r1, int r2, int l1, int l2, std::vector<u8>& buffer)
+    {
+        if (table.hasGradient()) {
+            return table.getGradient(k);
         }
+        buffer.resize(table.getRadiusX() + 1);
+        table.computeGradient(k, r1, r2, &buffer[0]);
+        table.computeGradient(k, l1, l2, &buffer[0]);
+        return &buffer[0];
     }
 
     //-----------------------------------------------------------------
-    void
-    Canvas::drawCircle(int x, int y, int radius, bool fill, RGBA col[2])
+    template<BLENDFUNC_T blenderT>
+    static void draw_gradient_ellipse(const DrawTarget& d, int x, int y, const EllipseTable& table, RGBA col[2])
     {
-        if (radius <= 0 ||
-            x + radius < _scissor.ul.x ||
-            x - radius > _scissor.lr.x ||
-            y + radius < _scissor.ul.y ||
-            y - radius > _scissor.lr.y)
-        {
+        const Recti& clip = d.scissor;
+        int rx = table.getRadiusX();
+        int ry = table.getRadiusY();
+        std::vector<u8> buffer;
+
+        // the four mirrored pixels share their color
+        if (clip.contains(Recti(x - rx, y - ry, x + rx - 1, y + ry - 1))) {
+            for (int k = 0; k < ry; ++k) {
+                int w = table.getGradientSpan(k);
+                const u8* factors = get_gradient_row(table, k, 0, w, 0, 0, buffer);
+                RGBA* top = d.pixels + (y - 1 - k) * d.pitch + x;
+                RGBA* bot = d.pixels + (y + k) * d.pitch + x;
+                for (int i = 0; i < w; ++i) {
+                    RGBA c = get_gradient_color(col, factors[i]);
+                    blenderT(top + i,     c);
+                    blenderT(top - 1 - i, c);
+                    blenderT(bot + i,     c);
+                    blenderT(bot - 1 - i, c);
+                }
+            }
             return;
         }
 
-        if (col[0] == col[1]) {
-            if (fill) {
-                switch (_blendMode) {
-                case BM_REPLACE:
-                    draw_circle<rgba_replace>(*this, x, y, radius, col[0]);
-                    break;
-                case BM_ALPHA:
-                    draw_circle<rgba_alpha>(*this, x, y, radius, col[0]);
-                    break;
-                case BM_ADD:
-                    draw_circle<rgba_add>(*this, x, y, radius, col[0]);
-                    break;
-                case BM_SUBTRACT:
-                    draw_circle<rgba_subtract>(*this, x, y, radius, col[0]);
-                    break;
-                case BM_MULTIPLY:
-                    draw_circle<rgba_multiply>(*this, x, y, radius, col[0]);
-                    break;
-                default:
-                    break;
+        int k1 = std::max(std::min(y - clip.lr.y - 1, clip.ul.y - y), 0);
+        int k2 = std::min(std::max(y - clip.ul.y, clip.lr.y - y + 1), ry);
+        for (int k = k1; k < k2; ++k) {
+            int r1, r2, l1, l2;
+            clip_ellipse_row(x, table.getGradientSpan(k), clip, r1, r2, l1, l2);
+            const u8* factors = get_gradient_row(table, k, r1, r2, l1, l2, buffer);
+            for (int half = 0; half < 2; ++half) {
+                int py = half ? y + k : y - 1 - k;
+                if (py < clip.ul.y || py > clip.lr.y) {
+                    continue;
+                }
+                RGBA* row = d.pixels + py * d.pitch;
+                for (int i = r1; i < r2; ++i) {
+                    blenderT(row + x + i, get_gradient_color(col, factors[i]));
+                }
+                for (int i = l1; i < l2; ++i) {
+                    blenderT(row + x - 1 - i, get_gradient_color(col, factors[i]));
+                }
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNC_T blenderT>
+    static void draw_antialiased_ellipse(const DrawTarget& d, int x, int y, const EllipseTable& table, RGBA col[2], bool gradient)
+    {
+        const Recti& clip = d.scissor;
+        int ry = table.getRadiusY();
+        std::vector<u8> buffer;
+
+        int k1 = std::max(std::min(y - clip.lr.y - 1, clip.ul.y - y), 0);
+        int k2 = std::min(std::max(y - clip.ul.y, clip.lr.y - y + 1), ry);
+        for (int k = k1; k < k2; ++k) {
+            int inner = table.getInnerSpan(k);
+            const u8* coverage = table.getCoverage(k) - inner;
+
+            int r1, r2, l1, l2;
+            clip_ellipse_row(x, table.getOuterSpan(k), clip, r1, r2, l1, l2);
+            const u8* factors = gradient ? get_gradient_row(table, k, r1, r2, l1, l2, buffer) : 0;
+            for (int half = 0; half < 2; ++half) {
+                int py = half ? y + k : y - 1 - k;
+                if (py < clip.ul.y || py > clip.lr.y) {
+                    continue;
+                }
+                RGBA* row = d.pixels + py * d.pitch;
+
+                // fully covered columns first
+                if (!gradient) {
+                    int clip_l = std::max(x - inner,     clip.ul.x);
+                    int clip_r = std::min(x + inner - 1, clip.lr.x);
+                    RGBA* dst = row + clip_l;
+                    for (int i = clip_r + 1 - clip_l; i > 0; --i, ++dst) {
+                        blenderT(dst, col[0]);
+                    }
+                }
+
+                for (int i = gradient ? r1 : std::max(r1, inner); i < r2; ++i) {
+                    RGBA c = gradient ? get_gradient_color(col, factors[i]) : col[0];
+                    if (i >= inner) {
+                        c = get_covered_color(c, coverage[i], d.premultiplied);
+                    }
+                    blenderT(row + x + i, c);
+                }
+                for (int i = gradient ? l1 : std::max(l1, inner); i < l2; ++i) {
+                    RGBA c = gradient ? get_gradient_color(col, factors[i]) : col[0];
+                    if (i >= inner) {
+                        c = get_covered_color(c, coverage[i], d.premultiplied);
+                    }
+                    blenderT(row + x - 1 - i, c);
+                }
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void execute_circle(const DrawTarget& d, const CanvasCommand& cmd)
+    {
+        int x  = cmd.pos[0].x;
+        int y  = cmd.pos[0].y;
+        int rx = cmd.radius;
+        int ry = cmd.radiusY;
+
+        int pad = (!cmd.fill && (cmd.antialias || cmd.width != 1.0f)) ? get_stroke_padding(cmd.width) : 0;
+        if (rx <= 0 || ry <= 0 ||
+            x + rx + pad < d.scissor.ul.x ||
+            x - rx - pad > d.scissor.lr.x ||
+            y + ry + pad < d.scissor.ul.y ||
+            y - ry - pad > d.scissor.lr.y)
+        {
+            return;
+        }
+
+        const EllipseTable& table = *cmd.ellipse.get();
+
+        bool premultiplied = d.premultiplied;
+        RGBA c[2] = {cmd.col[0], cmd.col[1]};
+        if (premultiplied) {
+            c[0] = rgba_premultiply(c[0]);
+            c[1] = rgba_premultiply(c[1]);
+        }
+
+        if (cmd.antialias && cmd.fill) {
+            bool gradient = (c[0] != c[1]);
+            switch (cmd.blendMode) {
+            case Canvas::BM_REPLACE:
+                draw_antialiased_ellipse<rgba_replace>(d, x, y, table, c, gradient);
+                break;
+            case Canvas::BM_ALPHA:
+                if (premultiplied) {
+                    draw_antialiased_ellipse<rgba_alpha_pre>(d, x, y, table, c, gradient);
+                } else {
+                    draw_antialiased_ellipse<rgba_alpha>(d, x, y, table, c, gradient);
+                }
+                break;
+            case Canvas::BM_ADD:
+                if (premultiplied) {
+                    draw_antialiased_ellipse<rgba_add_pre>(d, x, y, table, c, gradient);
+                } else {
+                    draw_antialiased_ellipse<rgba_add>(d, x, y, table, c, gradient);
+                }
+                break;
+            case Canvas::BM_SUBTRACT:
+                draw_antialiased_ellipse<rgba_subtract>(d, x, y, table, c, gradient);
+                break;
+            case Canvas::BM_MULTIPLY:
+                draw_antialiased_ellipse<rgba_multiply>(d, x, y, table, c, gradient);
+                break;
+            default:
+                break;
+            }
+        } else if (c[0] == c[1]) {
+            if (cmd.fill) {
+                switch (cmd.blendMode) {
+                case Canvas::BM_REPLACE:
+                    draw_ellipse<rgba_replace>(d, x, y, table, c[0]);
+                    break;
+                case Canvas::BM_ALPHA:
+                    if (premultiplied) {
+                        draw_ellipse<rgba_alpha_pre>(d, x, y, table, c[0]);
+                    } else {
+                        draw_ellipse<rgba_alpha>(d, x, y, table, c[0]);
+                    }
+                    break;
+                case Canvas::BM_ADD:
+                    if (premultiplied) {
+                        draw_ellipse<rgba_add_pre>(d, x, y, table, c[0]);
+                    } else {
+                        draw_ellipse<rgba_add>(d, x, y, table, c[0]);
+                    }
+                    break;
+                case Canvas::BM_SUBTRACT:
+                    draw_ellipse<rgba_subtract>(d, x, y, table, c[0]);
+                    break;
+                case Canvas::BM_MULTIPLY:
+                    draw_ellipse<rgba_multiply>(d, x, y, table, c[0]);
+                    break;
+                default:
+                    break;
                 }
             } else {
-                switch (_blendMode) {
-                case BM_REPLACE:
-                    draw_circle_outline<rgba_replace>(*this, x, y, radius, col[0]);
+                switch (cmd.blendMode) {
+                case Canvas::BM_REPLACE:
+                    draw_ellipse_outline<rgba_replace>(d, x, y, table, c[0], cmd.width, cmd.antialias);
                     break;
-                case BM_ALPHA:
-                    draw_circle_outline<rgba_alpha>(*this, x, y, radius, col[0]);
+                case Canvas::BM_ALPHA:
+                    if (premultiplied) {
+                        draw_ellipse_outline<rgba_alpha_pre>(d, x, y, table, c[0], cmd.width, cmd.antialias);
+                    } else {
+                        draw_ellipse_outline<rgba_alpha>(d, x, y, table, c[0], cmd.width, cmd.antialias);
+                    }
                     break;
-                case BM_ADD:
-                    draw_circle_outline<rgba_add>(*this, x, y, radius, col[0]);
+                case Canvas::BM_ADD:
+                    if (premultiplied) {
+                        draw_ellipse_outline<rgba_add_pre>(d, x, y, table, c[0], cmd.width, cmd.antialias);
+                    } else {
+                        draw_ellipse_outline<rgba_add>(d, x, y, table, c[0], cmd.width, cmd.antialias);
+                    }
                     break;
-                case BM_SUBTRACT:
-                    draw_circle_outline<rgba_subtract>(*this, x, y, radius, col[0]);
+                case Canvas::BM_SUBTRACT:
+                    draw_ellipse_outline<rgba_subtract>(d, x, y, table, c[0], cmd.width, cmd.antialias);
                     break;
-                case BM_MULTIPLY:
-                    draw_circle_outline<rgba_multiply>(*this, x, y, radius, col[0]);
+                case Canvas::BM_MULTIPLY:
+                    draw_ellipse_outline<rgba_multiply>(d, x, y, table, c[0], cmd.width, cmd.antialias);
                     break;
                 default:
                     break;
                 }
             }
         } else {
-            switch (_blendMode) {
-            case BM_REPLACE:
-                draw_gradient_circle<rgba_replace>(*this, x, y, radius, col);
+            switch (cmd.blendMode) {
+            case Canvas::BM_REPLACE:
+                draw_gradient_ellipse<rgba_replace>(d, x, y, table, c);
                 break;
-            case BM_ALPHA:
-                draw_gradient_circle<rgba_alpha>(*this, x, y, radius, col);
+            case Canvas::BM_ALPHA:
+                if (premultiplied) {
+                    draw_gradient_ellipse<rgba_alpha_pre>(d, x, y, table, c);
+                } else {
+                    draw_gradient_ellipse<rgba_alpha>(d, x, y, table, c);
+                }
                 break;
-            case BM_ADD:
-                draw_gradient_circle<rgba_add>(*this, x, y, radius, col);
+            case Canvas::BM_ADD:
+                if (premultiplied) {
+                    draw_gradient_ellipse<rgba_add_pre>(d, x, y, table, c);
+                } else {
+                    draw_gradient_ellipse<rgba_add>(d, x, y, table, c);
+                }
                 break;
-            case BM_SUBTRACT:
-                draw_gradient_circle<rgba_subtract>(*this, x, y, radius, col);
+            case Canvas::BM_SUBTRACT:
+                draw_gradient_ellipse<rgba_subtract>(d, x, y, table, c);
                 break;
-            case BM_MULTIPLY:
-                draw_gradient_circle<rgba_multiply>(*this, x, y, radius, col);
+            case Canvas::BM_MULTIPLY:
+                draw_gradient_ellipse<rgba_multiply>(d, x, y, table, c);
                 break;
             default:
                 break;
@@ -1264,11 +2735,680 @@ namespace sphere {
         }
     }
 
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawCircle(int x, int y, int radius, bool fill, RGBA col[2], bool antialias, float width)
+    {
+        drawEllipse(x, y, radius, radius, fill, col, antialias, width);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawEllipse(int x, int y, int radiusX, int radiusY, bool fill, RGBA col[2], bool antialias, float width)
+    {
+        int pad = (!fill && (antialias || width != 1.0f)) ? get_stroke_padding(width) : 0;
+        if (radiusX <= 0 || radiusY <= 0 || !(width > 0.0f) ||
+            x + radiusX + pad < _scissor.ul.x ||
+            x - radiusX - pad > _scissor.lr.x ||
+            y + radiusY + pad < _scissor.ul.y ||
+            y - radiusY - pad > _scissor.lr.y)
+        {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type      = CanvasCommand::CT_CIRCLE;
+        cmd.pos[0]    = Vec2i(x, y);
+        cmd.radius    = radiusX;
+        cmd.radiusY   = radiusY;
+        cmd.fill      = fill;
+        cmd.antialias = antialias;
+        cmd.width     = width;
+        cmd.col[0]    = col[0];
+        cmd.col[1]    = col[1];
+        cmd.ellipse   = EllipseTable::Get(radiusX, radiusY, col[0] != col[1]);
+        submit(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    // Triangles whose edges span this many pixels or more are not drawn,
+    // below it the edge functions of a block fit into 32 bits
+    static const i64 MAX_TRIANGLE_EXTENT = (i64)1 << 26;
+
+    //-----------------------------------------------------------------
+    // Edge function a * x + b * y + c of the edge p -> q, which is >= 0
+    // for the pixels inside of a triangle with a positive area
+    struct TriangleEdge {
+        i64 a;
+        i64 b;
+        i64 c;
+    };
+
+    //-----------------------------------------------------------------
+    static inline void setup_triangle_edge(TriangleEdge& edge, const Vec2i& p, const Vec2i& q)
+    {
+        edge.a = (i64)p.y - q.y;
+        edge.b = (i64)q.x - p.x;
+        edge.c = -(edge.a * p.x + edge.b * p.y);
+
+        // top-left fill rule: a pixel center right on the edge only
+        // belongs to the triangle if it is a top or a left edge, so
+        // triangles sharing an edge don't draw its pixels twice
+        if (!(edge.a > 0 || (edge.a == 0 && edge.b > 0))) {
+            edge.c -= 1;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static inline i64 get_triangle_area2(const Vec2i v[3])
+    {
+        return ((i64)v[1].x - v[0].x) * ((i64)v[2].y - v[0].y) -
+               ((i64)v[2].x - v[0].x) * ((i64)v[1].y - v[0].y);
+    }
+
+    //-----------------------------------------------------------------
+    // Calls shader(dst, x, y, n) for each run of covered pixels. The
+    // bounding box is walked in RASTER_BLOCK_SIZE blocks; blocks outside
+    // of an edge are skipped, and only the edges crossing a block are
+    // evaluated for its pixels. The vertices have to be in the order
+    // giving a positive area.
+    template<typename ShaderT>
+    static void rasterize_triangle(const DrawTarget& d, const Vec2i v[3], const ShaderT& shader)
+    {
+        TriangleEdge edges[3];
+        setup_triangle_edge(edges[0], v[0], v[1]);
+        setup_triangle_edge(edges[1], v[1], v[2]);
+        setup_triangle_edge(edges[2], v[2], v[0]);
+        for (int i = 0; i < 3; ++i) {
+            if (edges[i].a <= -MAX_TRIANGLE_EXTENT || edges[i].a >= MAX_TRIANGLE_EXTENT ||
+                edges[i].b <= -MAX_TRIANGLE_EXTENT || edges[i].b >= MAX_TRIANGLE_EXTENT)
+            {
+                return;
+            }
+        }
+
+        Recti bounds(std::min(v[0].x, std::min(v[1].x, v[2].x)), std::min(v[0].y, std::min(v[1].y, v[2].y)),
+                     std::max(v[0].x, std::max(v[1].x, v[2].x)), std::max(v[0].y, std::max(v[1].y, v[2].y)));
+        bounds = bounds.getIntersection(d.scissor);
+        if (!bounds.isValid()) {
+            return;
+        }
+
+        BLOCKCOVERAGEFUNC_T blockCoverage = GetBlockCoverageFunc();
+        const int bs = RASTER_BLOCK_SIZE;
+
+        // the coverage of a row of blocks, bit k of a mask byte is the
+        // pixel k of the block, so that runs can span several blocks
+        int bx0 = bounds.ul.x & ~(bs - 1);
+        int numBlocks = (bounds.lr.x - bx0) / bs + 1;
+        std::vector<u8> masks(numBlocks * bs);
+
+        for (int by = bounds.ul.y & ~(bs - 1); by <= bounds.lr.y; by += bs) {
+            int y1 = std::max(by, bounds.ul.y);
+            int y2 = std::min(by + bs - 1, bounds.lr.y);
+            int h  = y2 - y1 + 1;
+
+            for (int blk = 0; blk < numBlocks; ++blk) {
+                int bx = bx0 + blk * bs;
+                int x1 = std::max(bx, bounds.ul.x);
+                int x2 = std::min(bx + bs - 1, bounds.lr.x);
+                int w  = x2 - x1 + 1;
+
+                // classify the block by the edge values at its corners
+                i32  e[3];
+                i32  a[3];
+                i32  b[3];
+                int  numEdges = 0;
+                bool outside  = false;
+                for (int i = 0; i < 3; ++i) {
+                    const TriangleEdge& edge = edges[i];
+                    i64 e11 = edge.a * x1 + edge.b * y1 + edge.c;
+                    i64 ex  = edge.a * (x2 - x1);
+                    i64 ey  = edge.b * (y2 - y1);
+                    i64 min = e11 + std::min(ex, (i64)0) + std::min(ey, (i64)0);
+                    i64 max = e11 + std::max(ex, (i64)0) + std::max(ey, (i64)0);
+                    if (max < 0) {
+                        outside = true;
+                        break;
+                    }
+                    if (min < 0) {
+                        e[numEdges] = (i32)e11;
+                        a[numEdges] = (i32)edge.a;
+                        b[numEdges] = (i32)edge.b;
+                        numEdges++;
+                    }
+                }
+
+                u8 blockMasks[RASTER_BLOCK_SIZE];
+                if (outside) {
+                    for (int iy = 0; iy < h; ++iy) {
+                        blockMasks[iy] = 0;
+                    }
+                } else if (numEdges == 0) {
+                    for (int iy = 0; iy < h; ++iy) {
+                        blockMasks[iy] = (u8)((1 << w) - 1);
+                    }
+                } else {
+                    blockCoverage(e, a, b, numEdges, w, h, blockMasks);
+                }
+                for (int iy = 0; iy < h; ++iy) {
+                    masks[iy * numBlocks + blk] = (u8)(blockMasks[iy] << (x1 - bx));
+                }
+            }
+
+            for (int iy = 0; iy < h; ++iy) {
+                int   y   = y1 + iy;
+                RGBA* row = d.pixels + y * d.pitch;
+                const u8* m = &masks[iy * numBlocks];
+                int start = -1;
+                for (int blk = 0; blk < numBlocks; ++blk) {
+                    int bits = m[blk];
+                    if ((bits == 0xFF && start >= 0) || (bits == 0 && start < 0)) {
+                        continue;
+                    }
+                    for (int k = 0; k < bs; ++k) {
+                        int x = bx0 + blk * bs + k;
+                        if (bits & (1 << k)) {
+                            if (start < 0) {
+                                start = x;
+                            }
+                        } else if (start >= 0) {
+                            shader(row + start, start, y, x - start);
+                            start = -1;
+                        }
+                    }
+                }
+                if (start >= 0) {
+                    shader(row + start, start, y, bx0 + numBlocks * bs - start);
+                }
+            }
+        }
+    }
+
     //-----------------------------------------------------------------
     template<BLENDFUNC_T blenderT>
-    static void draw_image(Canvas& dstImage, const Canvas& srcImage, const Recti& rect, const Vec2i& pos)
+    struct SolidTriangleShader {
+        RGBA color;
+
+        SolidTriangleShader(const RGBA& c) : color(c) { }
+
+        void operator()(RGBA* dst, int, int, int n) const {
+            while (n > 0) {
+                blenderT(dst, color);
+                dst++;
+                n--;
+            }
+        }
+    };
+
+    //-----------------------------------------------------------------
+    // Each channel is a plane over the triangle in 12 bit fixed point,
+    // evaluated from the first vertex for every run, so that clipping
+    // doesn't change the colors of the pixels
+    template<BLENDFUNCFIX_T blenderT>
+    struct GradientTriangleShader {
+        int x0;
+        int y0;
+        i64 base[4];
+        i64 dx[4];
+        i64 dy[4];
+
+        GradientTriangleShader(const Vec2i v[3], const RGBA c[3]) : x0(v[0].x), y0(v[0].y) {
+            double area2 = (double)get_triangle_area2(v);
+            double x10 = (double)v[1].x - v[0].x;
+            double y10 = (double)v[1].y - v[0].y;
+            double x20 = (double)v[2].x - v[0].x;
+            double y20 = (double)v[2].y - v[0].y;
+            const u8* c0 = (const u8*)&c[0];
+            const u8* c1 = (const u8*)&c[1];
+            const u8* c2 = (const u8*)&c[2];
+            for (int i = 0; i < 4; ++i) {
+                double d10 = c1[i] - c0[i];
+                double d20 = c2[i] - c0[i];
+                base[i] = ((i64)c0[i] << 12) + 0x800;
+                dx[i]   = (i64)floor((d10 * y20 - d20 * y10) * 4096.0 / area2 + 0.5);
+                dy[i]   = (i64)floor((d20 * x10 - d10 * x20) * 4096.0 / area2 + 0.5);
+            }
+        }
+
+        void operator()(RGBA* dst, int x, int y, int n) const {
+            i64 first[4];
+            i64 last[4];
+            bool inside = true;
+            for (int i = 0; i < 4; ++i) {
+                first[i] = base[i] + (x - x0) * dx[i] + (y - y0) * dy[i];
+                last[i]  = first[i] + (n - 1) * dx[i];
+                inside = inside && is_in_range(first[i]) && is_in_range(last[i]);
+            }
+
+            if (inside) {
+                // the colors are linear along the run, no clamping needed
+                u32 r = (u32)first[0];
+                u32 g = (u32)first[1];
+                u32 b = (u32)first[2];
+                u32 a = (u32)first[3];
+                u32 dr = (u32)dx[0];
+                u32 dg = (u32)dx[1];
+                u32 db = (u32)dx[2];
+                u32 da = (u32)dx[3];
+                while (n > 0) {
+                    blenderT(dst, r, g, b, a);
+                    dst++;
+                    r += dr;
+                    g += dg;
+                    b += db;
+                    a += da;
+                    n--;
+                }
+            } else {
+                while (n > 0) {
+                    blenderT(dst, clamp_fix(first[0]), clamp_fix(first[1]), clamp_fix(first[2]), clamp_fix(first[3]));
+                    dst++;
+                    for (int i = 0; i < 4; ++i) {
+                        first[i] += dx[i];
+                    }
+                    n--;
+                }
+            }
+        }
+
+        static bool is_in_range(i64 c) {
+            return c >= 0 && c <= ((255 << 12) | 0xFFF);
+        }
+
+        static u32 clamp_fix(i64 c) {
+            return (u32)bracket<i64>(c, 0, (255 << 12) | 0xFFF);
+        }
+    };
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNC_T blenderT>
+    static void draw_triangle(const DrawTarget& d, const Vec2i v[3], const RGBA& col)
+    {
+        rasterize_triangle(d, v, SolidTriangleShader<blenderT>(col));
+    }
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNCFIX_T blenderT>
+    static void draw_gradient_triangle(const DrawTarget& d, const Vec2i v[3], RGBA col[3])
+    {
+        rasterize_triangle(d, v, GradientTriangleShader<blenderT>(v, col));
+    }
+
+    //-----------------------------------------------------------------
+    static void execute_triangle(const DrawTarget& d, const CanvasCommand& cmd)
+    {
+        bool premultiplied = d.premultiplied;
+        Vec2i v[3] = {cmd.pos[0], cmd.pos[1], cmd.pos[2]};
+        RGBA  c[3] = {cmd.col[0], cmd.col[1], cmd.col[2]};
+        if (premultiplied) {
+            for (int i = 0; i < 3; ++i) {
+                c[i] = rgba_premultiply(c[i]);
+            }
+        }
+
+        // the rasterizer wants a positive area
+        i64 area2 = get_triangle_area2(v);
+        if (area2 == 0) {
+            return;
+        }
+        if (area2 < 0) {
+            std::swap(v[1], v[2]);
+            std::swap(c[1], c[2]);
+        }
+
+        if (c[0] == c[1] &&
+            c[0] == c[2])
+        {
+            switch (cmd.blendMode) {
+            case Canvas::BM_REPLACE:
+                draw_triangle<rgba_replace>(d, v, c[0]);
+                break;
+            case Canvas::BM_ALPHA:
+                if (premultiplied) {
+                    draw_triangle<rgba_alpha_pre>(d, v, c[0]);
+                } else {
+                    draw_triangle<rgba_alpha>(d, v, c[0]);
+                }
+                break;
+            case Canvas::BM_ADD:
+                if (premultiplied) {
+                    draw_triangle<rgba_add_pre>(d, v, c[0]);
+                } else {
+                    draw_triangle<rgba_add>(d, v, c[0]);
+                }
+                break;
+            case Canvas::BM_SUBTRACT:
+                draw_triangle<rgba_subtract>(d, v, c[0]);
+                break;
+            case Canvas::BM_MULTIPLY:
+                draw_triangle<rgba_multiply>(d, v, c[0]);
+                break;
+            default:
+                break;
+            }
+        } else {
+            switch (cmd.blendMode) {
+            case Canvas::BM_REPLACE:
+                draw_gradient_triangle<rgba_replace_fix>(d, v, c);
+                break;
+            case Canvas::BM_ALPHA:
+                if (premultiplied) {
+                    draw_gradient_triangle<rgba_alpha_pre_fix>(d, v, c);
+                } else {
+                    draw_gradient_triangle<rgba_alpha_fix>(d, v, c);
+                }
+                break;
+            case Canvas::BM_ADD:
+                if (premultiplied) {
+                    draw_gradient_triangle<rgba_add_pre_fix>(d, v, c);
+                } else {
+                    draw_gradient_triangle<rgba_add_fix>(d, v, c);
+                }
+                break;
+            case Canvas::BM_SUBTRACT:
+                draw_gradient_triangle<rgba_subtract_fix>(d, v, c);
+                break;
+            case Canvas::BM_MULTIPLY:
+                draw_gradient_triangle<rgba_multiply_fix>(d, v, c);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawTriangle(Vec2i pos[3], RGBA col[3])
+    {
+        if (std::max(pos[0].x, std::max(pos[1].x, pos[2].x)) < _scissor.ul.x ||
+            std::min(pos[0].x, std::min(pos[1].x, pos[2].x)) > _scissor.lr.x ||
+            std::max(pos[0].y, std::max(pos[1].y, pos[2].y)) < _scissor.ul.y ||
+            std::min(pos[0].y, std::min(pos[1].y, pos[2].y)) > _scissor.lr.y)
+        {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type = CanvasCommand::CT_TRIANGLE;
+        for (int i = 0; i < 3; ++i) {
+            cmd.pos[i] = pos[i];
+            cmd.col[i] = col[i];
+        }
+        submit(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    // Polygon edge of the scanline polygon fill, from its top (x0, y0)
+    // down to the row ymax, which is not part of it
+    struct PolygonEdge {
+        int x0;
+        int y0;
+        int ymax;
+        i64 dx;
+        i64 dy;
+        int winding;  // +1 if the outline runs downwards, -1 if upwards
+        int x;        // first pixel right of the edge on the current row
+
+        bool operator<(const PolygonEdge& that) const {
+            return y0 < that.y0;
+        }
+    };
+
+    //-----------------------------------------------------------------
+    static inline i64 ceil_div(i64 num, i64 den)
+    {
+        // den > 0
+        return num >= 0 ? (num + den - 1) / den : -((-num) / den);
+    }
+
+    //-----------------------------------------------------------------
+    static inline bool is_left_of(const PolygonEdge* a, const PolygonEdge* b)
+    {
+        return a->x < b->x;
+    }
+
+    //-----------------------------------------------------------------
+    // Scanline fill with a sorted edge table and an active edge list.
+    // Pixel centers inside of the outline are filled, those on an edge
+    // only if it is a left or top one, like for triangles. The crossings
+    // are computed exactly for every row, so the result doesn't depend on
+    // the scissor.
+    template<BLENDFUNC_T blenderT>
+    static void draw_polygon(const DrawTarget& d, const std::vector<Vec2i>& points, int fillRule, const RGBA& col)
+    {
+        // the edge table, horizontal edges don't cross any row
+        std::vector<PolygonEdge> edges;
+        edges.reserve(points.size());
+        for (size_t i = 0; i < points.size(); ++i) {
+            const Vec2i& p = points[i];
+            const Vec2i& q = points[(i + 1) % points.size()];
+            if (p.y == q.y) {
+                continue;
+            }
+            const Vec2i& top = (p.y < q.y) ? p : q;
+            const Vec2i& bot = (p.y < q.y) ? q : p;
+            PolygonEdge edge;
+            edge.x0      = top.x;
+            edge.y0      = top.y;
+            edge.ymax    = bot.y;
+            edge.dx      = (i64)bot.x - top.x;
+            edge.dy      = (i64)bot.y - top.y;
+            edge.winding = (p.y < q.y) ? 1 : -1;
+            edge.x       = 0;
+            edges.push_back(edge);
+        }
+        if (edges.empty()) {
+            return;
+        }
+        std::sort(edges.begin(), edges.end());
+
+        int ymin = edges.front().y0;
+        int ymax = edges.front().ymax;
+        for (size_t i = 1; i < edges.size(); ++i) {
+            ymax = std::max(ymax, edges[i].ymax);
+        }
+        int y1 = std::max(ymin, d.scissor.ul.y);
+        int y2 = std::min(ymax - 1, d.scissor.lr.y);
+
+        std::vector<PolygonEdge*> active;
+        size_t next = 0;
+
+        for (int y = y1; y <= y2; ++y) {
+            // update the active edge list
+            while (next < edges.size() && edges[next].y0 <= y) {
+                active.push_back(&edges[next]);
+                next++;
+            }
+            size_t n = 0;
+            for (size_t i = 0; i < active.size(); ++i) {
+                if (active[i]->ymax > y) {
+                    active[n++] = active[i];
+                }
+            }
+            active.resize(n);
+
+            for (size_t i = 0; i < active.size(); ++i) {
+                PolygonEdge* e = active[i];
+                i64 x = e->x0 + ceil_div((y - e->y0) * e->dx, e->dy);
+                e->x = (int)bracket<i64>(x, d.scissor.ul.x, (i64)d.scissor.lr.x + 1);
+            }
+
+            // the list stays almost sorted from row to row
+            for (size_t i = 1; i < active.size(); ++i) {
+                PolygonEdge* e = active[i];
+                size_t j = i;
+                while (j > 0 && is_left_of(e, active[j - 1])) {
+                    active[j] = active[j - 1];
+                    j--;
+                }
+                active[j] = e;
+            }
+
+            RGBA* row = d.pixels + y * d.pitch;
+            int winding = 0;
+            for (size_t i = 0; i + 1 < active.size(); ++i) {
+                if (fillRule == Canvas::FILL_NON_ZERO) {
+                    winding += active[i]->winding;
+                } else {
+                    winding ^= 1;
+                }
+                if (winding == 0) {
+                    continue;
+                }
+                RGBA* dst = row + active[i]->x;
+                int ix = active[i + 1]->x - active[i]->x;
+                while (ix > 0) {
+                    blenderT(dst, col);
+                    dst++;
+                    ix--;
+                }
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void execute_polygon(const DrawTarget& d, const CanvasCommand& cmd)
+    {
+        RGBA c = cmd.col[0];
+        if (d.premultiplied) {
+            c = rgba_premultiply(c);
+        }
+
+        switch (cmd.blendMode) {
+        case Canvas::BM_REPLACE:
+            draw_polygon<rgba_replace>(d, cmd.points, cmd.fillRule, c);
+            break;
+        case Canvas::BM_ALPHA:
+            if (d.premultiplied) {
+                draw_polygon<rgba_alpha_pre>(d, cmd.points, cmd.fillRule, c);
+            } else {
+                draw_polygon<rgba_alpha>(d, cmd.points, cmd.fillRule, c);
+            }
+            break;
+        case Canvas::BM_ADD:
+            if (d.premultiplied) {
+                draw_polygon<rgba_add_pre>(d, cmd.points, cmd.fillRule, c);
+            } else {
+                draw_polygon<rgba_add>(d, cmd.points, cmd.fillRule, c);
+            }
+            break;
+        case Canvas::BM_SUBTRACT:
+            draw_polygon<rgba_subtract>(d, cmd.points, cmd.fillRule, c);
+            break;
+        case Canvas::BM_MULTIPLY:
+            draw_polygon<rgba_multiply>(d, cmd.points, cmd.fillRule, c);
+            break;
+        default:
+            break;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static Recti get_polygon_bounds(const std::vector<Vec2i>& points)
+    {
+        if (points.empty()) {
+            return Recti(0, 0, -1, -1);
+        }
+        Recti bounds(points[0], points[0]);
+        for (size_t i = 1; i < points.size(); ++i) {
+            bounds.ul.x = std::min(bounds.ul.x, points[i].x);
+            bounds.ul.y = std::min(bounds.ul.y, points[i].y);
+            bounds.lr.x = std::max(bounds.lr.x, points[i].x);
+            bounds.lr.y = std::max(bounds.lr.y, points[i].y);
+        }
+        return bounds;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawPolygon(const Vec2i* points, int numPoints, const RGBA& color, int fillRule)
     {
-        Recti dstRect = dstImage.getScissor().getIntersection(Recti(pos.x, pos.y, pos.x + rect.getWidth() - 1, pos.y + rect.getHeight() - 1));
+        assert(points || numPoints == 0);
+
+        if (numPoints < 3 || (fillRule != FILL_EVEN_ODD && fillRule != FILL_NON_ZERO)) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type     = CanvasCommand::CT_POLYGON;
+        cmd.points.assign(points, points + numPoints);
+        cmd.col[0]   = color;
+        cmd.fillRule = fillRule;
+        if (!_scissor.intersects(get_polygon_bounds(cmd.points))) {
+            return;
+        }
+        submit(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    static inline void copy_span_keep_alpha(RGBA* dst, const RGBA* src, int n)
+    {
+#if defined(LITTLE_ENDIAN)
+        const u32 alpha_mask = 0xFF000000;
+#else
+        const u32 alpha_mask = 0x000000FF;
+#endif
+        u32* d = (u32*)dst;
+        const u32* s = (const u32*)src;
+        for (int i = 0; i < n; ++i) {
+            d[i] = (d[i] & alpha_mask) | (s[i] & ~alpha_mask);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // BM_ALPHA blit of the section srcRect using the span table of the
+    // source: transparent runs are skipped, opaque runs copied (straight
+    // alpha destinations keep their alpha) and only the rest is blended
+    static void draw_image_spans(RGBA* dp, int dpitch, const RGBA* sp, int spitch, const SpanTable& spans, const Recti& srcRect, bool dstPremultiplied, BLENDSPANFUNC_T blendSpan)
+    {
+        int x1 = srcRect.ul.x;
+        int x2 = srcRect.lr.x + 1;
+
+        for (int sy = srcRect.ul.y; sy <= srcRect.lr.y; ++sy) {
+            const u32* span = spans.getSpans(sy);
+
+            // find the run the section starts in
+            int x = 0;
+            while (x + SpanTable::GetSpanLength(*span) <= x1) {
+                x += SpanTable::GetSpanLength(*span);
+                span++;
+            }
+
+            while (x < x2) {
+                int len = SpanTable::GetSpanLength(*span);
+                int a   = std::max(x, x1);
+                int n   = std::min(x + len, x2) - a;
+
+                switch (SpanTable::GetSpanType(*span)) {
+                case SpanTable::ST_OPAQUE:
+                    if (dstPremultiplied) {
+                        memcpy(dp + (a - x1), sp + (a - x1), n * sizeof(RGBA));
+                    } else {
+                        copy_span_keep_alpha(dp + (a - x1), sp + (a - x1), n);
+                    }
+                    break;
+                case SpanTable::ST_TRANSLUCENT:
+                    blendSpan(dp + (a - x1), sp + (a - x1), n);
+                    break;
+                default:
+                    break;
+                }
+
+                x += len;
+                span++;
+            }
+
+            dp += dpitch;
+            sp += spitch;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void draw_image(const DrawTarget& d, const Canvas& srcImage, const Recti& rect, const Vec2i& pos, int blendMode)
+    {
+        Recti dstRect = d.scissor.getIntersection(Recti(pos.x, pos.y, pos.x + rect.getWidth() - 1, pos.y + rect.getHeight() - 1));
 
         if (!dstRect.isValid()) {
             return;
@@ -1289,56 +3429,79 @@ namespace sphere {
             srcRect.lr.y = srcRect.ul.y + dstRect.getHeight() - 1;
         }
 
-        int dpitch = dstImage.getWidth();
-        int dinc   = dpitch - dstRect.getWidth();
-        RGBA* dp   = dstImage.getPixels() + (dstRect.ul.y * dpitch) + dstRect.ul.x;
+        // the vectorized kernels read ahead of what they write, so
+        // drawing a canvas onto itself has to go pixel by pixel, which
+        // the linear light ones do anyway
+        bool self = (d.pixels == srcImage.getPixels());
+        bool srcPremultiplied = (srcImage.getPixelFormat() == Canvas::PF_PREMULTIPLIED_ALPHA);
+        BLENDSPANFUNC_T blendSpan;
+        if (d.linear) {
+            blendSpan = GetLinearBlendSpanFunc(blendMode, srcPremultiplied);
+        } else if (self) {
+            blendSpan = GetScalarBlendSpanFunc(blendMode, srcPremultiplied, d.premultiplied);
+        } else {
+            blendSpan = GetBlendSpanFunc(blendMode, srcPremultiplied, d.premultiplied);
+        }
+
+        int dpitch = d.pitch;
+        RGBA* dp   = d.pixels + (dstRect.ul.y * dpitch) + dstRect.ul.x;
 
-        int spitch = srcImage.getWidth();
-        int sinc   = spitch - srcRect.getWidth();
+        int spitch = srcImage.getStride();
         const RGBA* sp = srcImage.getPixels() + (srcRect.ul.y * spitch) + srcRect.ul.x;
 
+        const SpanTable* spans = srcImage.getSpanTable();
+        if (spans && blendMode == Canvas::BM_ALPHA && !self) {
+            draw_image_spans(dp, dpitch, sp, spitch, *spans, srcRect, d.premultiplied, blendSpan);
+            return;
+        }
+
         int iy = dstRect.getHeight();
         while (iy > 0) {
-            int ix = dstRect.getWidth();
-            while (ix > 0) {
-                blenderT(dp, *sp);
-                dp++;
-                sp++;
-                ix--;
-            }
-            dp += dinc;
-            sp += sinc;
+            blendSpan(dp, sp, dstRect.getWidth());
+            dp += dpitch;
+            sp += spitch;
             iy--;
         }
     }
 
+    //-----------------------------------------------------------------
+    // BM_ALPHA blits leave the pixels under the transparent parts of the
+    // image alone, so they only need to cover its trim rect. Returns
+    // false if nothing of rect is left.
+    static bool trim_image_rect(const Canvas* image, Recti& rect, Vec2i& pos)
+    {
+        Recti trimmed = rect.getIntersection(image->getTrimRect());
+        if (!trimmed.isValid()) {
+            return false;
+        }
+        pos.x += trimmed.ul.x - rect.ul.x;
+        pos.y += trimmed.ul.y - rect.ul.y;
+        rect = trimmed;
+        return true;
+    }
+
     //-----------------------------------------------------------------
     void
     Canvas::drawImage(Canvas* image, const Vec2i& pos)
     {
         assert(image);
 
-        Recti rect(0, 0, image->getWidth() - 1, image->getHeight() - 1);
+        image->flush();
+        image->updateSpanTable();
 
-        switch (_blendMode) {
-        case BM_REPLACE:
-            draw_image<rgba_replace>(*this, *image, rect, pos);
-            break;
-        case BM_ALPHA:
-            draw_image<rgba_alpha>(*this, *image, rect, pos);
-            break;
-        case BM_ADD:
-            draw_image<rgba_add>(*this, *image, rect, pos);
-            break;
-        case BM_SUBTRACT:
-            draw_image<rgba_subtract>(*this, *image, rect, pos);
-            break;
-        case BM_MULTIPLY:
-            draw_image<rgba_multiply>(*this, *image, rect, pos);
-            break;
-        default:
-            break;
+        Recti rect(0, 0, image->getWidth() - 1, image->getHeight() - 1);
+        Vec2i dst = pos;
+        if (_blendMode == BM_ALPHA && !trim_image_rect(image, rect, dst)) {
+            return;
         }
+
+        CanvasCommand cmd;
+        cmd.type   = CanvasCommand::CT_IMAGE;
+        cmd.image  = image;
+        image->grab();
+        cmd.rect   = rect;
+        cmd.pos[0] = dst;
+        submit(cmd);
     }
 
     //-----------------------------------------------------------------
@@ -1351,25 +3514,539 @@ namespace sphere {
             return;
         }
 
-        switch (_blendMode) {
-        case BM_REPLACE:
-            draw_image<rgba_replace>(*this, *image, rect, pos);
+        image->flush();
+        image->updateSpanTable();
+
+        Recti src = rect;
+        Vec2i dst = pos;
+        if (_blendMode == BM_ALPHA && !trim_image_rect(image, src, dst)) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type   = CanvasCommand::CT_IMAGE;
+        cmd.image  = image;
+        image->grab();
+        cmd.rect   = src;
+        cmd.pos[0] = dst;
+        submit(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    // Keeps float coordinates far enough from the int limits to convert
+    static inline double clamp_coord(double x)
+    {
+        const double limit = (double)(1 << 30);
+        return std::max(-limit, std::min(x, limit));
+    }
+
+    //-----------------------------------------------------------------
+    static Recti get_quad_bounds(const Vec2f quad[4])
+    {
+        double x1 = quad[0].x;
+        double y1 = quad[0].y;
+        double x2 = quad[0].x;
+        double y2 = quad[0].y;
+        for (int i = 1; i < 4; ++i) {
+            x1 = std::min(x1, (double)quad[i].x);
+            y1 = std::min(y1, (double)quad[i].y);
+            x2 = std::max(x2, (double)quad[i].x);
+            y2 = std::max(y2, (double)quad[i].y);
+        }
+        return Recti((int)floor(clamp_coord(x1)), (int)floor(clamp_coord(y1)),
+                     (int)ceil(clamp_coord(x2)),  (int)ceil(clamp_coord(y2)));
+    }
+
+    //-----------------------------------------------------------------
+    // Maximum number of pixels sampled at once
+    static const int SAMPLE_CHUNK_SIZE = 256;
+
+    //-----------------------------------------------------------------
+    // Draws the triangle p, texture mapped with the texel coordinates t
+    // of the image section rect. A pixel is covered if its center lies
+    // inside, and of two triangles sharing an edge only one covers the
+    // pixels on it. The spans and texture coordinates only depend on the
+    // unclipped triangle, so clipping doesn't change the pixels drawn.
+    static void draw_textured_triangle(const DrawTarget& d, const Canvas& src, const Recti& rect, const Vec2f p[3], const Vec2f t[3], const RGBA& mask, int filter, int blendMode)
+    {
+        double x0 = p[0].x, y0 = p[0].y;
+        double x1 = p[1].x, y1 = p[1].y;
+        double x2 = p[2].x, y2 = p[2].y;
+
+        double det = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+        if (det == 0.0) {
+            return;
+        }
+
+        // the texture coordinates as affine functions of the position
+        double dudx = ((t[1].x - t[0].x) * (y2 - y0) - (t[2].x - t[0].x) * (y1 - y0)) / det;
+        double dudy = ((t[2].x - t[0].x) * (x1 - x0) - (t[1].x - t[0].x) * (x2 - x0)) / det;
+        double dvdx = ((t[1].y - t[0].y) * (y2 - y0) - (t[2].y - t[0].y) * (y1 - y0)) / det;
+        double dvdy = ((t[2].y - t[0].y) * (x1 - x0) - (t[1].y - t[0].y) * (x2 - x0)) / det;
+        double u0   = t[0].x - dudx * x0 - dudy * y0;
+        double v0   = t[0].y - dvdx * x0 - dvdy * y0;
+
+        // 16.16 fixed-point steps along the rows, which start off at the
+        // left edge of the bounding box
+        i32 du   = (i32)floor(dudx * 65536.0 + 0.5);
+        i32 dv   = (i32)floor(dvdx * 65536.0 + 0.5);
+        int xref = (int)floor(clamp_coord(std::min(x0, std::min(x1, x2))));
+
+        double ymin = clamp_coord(std::min(y0, std::min(y1, y2)));
+        double ymax = clamp_coord(std::max(y0, std::max(y1, y2)));
+        int iy1 = std::max((int)ceil(ymin - 0.5),     d.scissor.ul.y);
+        int iy2 = std::min((int)ceil(ymax - 0.5) - 1, d.scissor.lr.y);
+
+        bool srcPremultiplied = (src.getPixelFormat() == Canvas::PF_PREMULTIPLIED_ALPHA);
+        BLENDSPANFUNC_T  blendSpan  = d.linear
+            ? GetLinearBlendSpanFunc(blendMode, srcPremultiplied)
+            : GetBlendSpanFunc(blendMode, srcPremultiplied, d.premultiplied);
+        SAMPLESPANFUNC_T sampleSpan = GetSampleSpanFunc(filter);
+
+        RGBA m = srcPremultiplied ? rgba_premultiply(mask) : mask;
+        bool modulate = (mask.red != 255 || mask.green != 255 || mask.blue != 255 || mask.alpha != 255);
+
+        RGBA buffer[SAMPLE_CHUNK_SIZE];
+
+        for (int iy = iy1; iy <= iy2; ++iy) {
+            double yc = iy + 0.5;
+
+            // intersect the row with the edges, an edge covers [top, bottom)
+            double xl = 0.0;
+            double xr = 0.0;
+            int    numx = 0;
+            for (int i = 0; i < 3; ++i) {
+                const Vec2f* a = &p[i];
+                const Vec2f* b = &p[(i + 1) % 3];
+                if (a->y == b->y) {
+                    continue;
+                }
+                if (a->y > b->y) {
+                    std::swap(a, b);
+                }
+                if (yc < a->y || yc >= b->y) {
+                    continue;
+                }
+                double x = a->x + (yc - a->y) * (b->x - a->x) / (b->y - a->y);
+                xl = (numx == 0) ? x : std::min(xl, x);
+                xr = (numx == 0) ? x : std::max(xr, x);
+                numx++;
+            }
+            if (numx < 2) {
+                continue;
+            }
+
+            int xs = std::max((int)ceil(clamp_coord(xl) - 0.5),     d.scissor.ul.x);
+            int xe = std::min((int)ceil(clamp_coord(xr) - 0.5) - 1, d.scissor.lr.x);
+            if (xs > xe) {
+                continue;
+            }
+
+            i32 u = (i32)floor((u0 + dudx * (xref + 0.5) + dudy * yc) * 65536.0 + 0.5);
+            i32 v = (i32)floor((v0 + dvdx * (xref + 0.5) + dvdy * yc) * 65536.0 + 0.5);
+            u = (i32)((u32)u + (u32)(xs - xref) * (u32)du);
+            v = (i32)((u32)v + (u32)(xs - xref) * (u32)dv);
+
+            RGBA* dst = d.pixels + iy * d.pitch + xs;
+            int n = xe - xs + 1;
+            while (n > 0) {
+                int k = std::min(n, SAMPLE_CHUNK_SIZE);
+                sampleSpan(buffer, k, src.getPixels(), src.getStride(), rect, u, v, du, dv);
+                if (modulate) {
+                    ModulateSpan(buffer, k, m);
+                }
+                blendSpan(dst, buffer, k);
+                dst += k;
+                u = (i32)((u32)u + (u32)k * (u32)du);
+                v = (i32)((u32)v + (u32)k * (u32)dv);
+                n -= k;
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void draw_image_quad(const DrawTarget& d, const Canvas& src, const Recti& rect, const Vec2f quad[4], const RGBA& mask, int filter, int blendMode)
+    {
+        // texel coordinates of the corners of the section
+        Vec2f tex[4] = {
+            Vec2f(rect.ul.x,     rect.ul.y),
+            Vec2f(rect.lr.x + 1, rect.ul.y),
+            Vec2f(rect.lr.x + 1, rect.lr.y + 1),
+            Vec2f(rect.ul.x,     rect.lr.y + 1),
+        };
+
+        // split along the 0-2 diagonal, like GL does
+        Vec2f p1[3] = {quad[0], quad[1], quad[2]};
+        Vec2f t1[3] = {tex[0],  tex[1],  tex[2]};
+        Vec2f p2[3] = {quad[0], quad[2], quad[3]};
+        Vec2f t2[3] = {tex[0],  tex[2],  tex[3]};
+        draw_textured_triangle(d, src, rect, p1, t1, mask, filter, blendMode);
+        draw_textured_triangle(d, src, rect, p2, t2, mask, filter, blendMode);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawImageQuad(Canvas* image, Vec2i pos[4], const RGBA& mask, int filter)
+    {
+        assert(image);
+
+        Vec2f quad[4];
+        for (int i = 0; i < 4; ++i) {
+            quad[i] = Vec2f(pos[i].x, pos[i].y);
+        }
+        submitImageQuad(image, Recti(0, 0, image->getWidth() - 1, image->getHeight() - 1), quad, mask, filter);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawSubImageQuad(Canvas* image, const Recti& rect, Vec2i pos[4], const RGBA& mask, int filter)
+    {
+        assert(image);
+
+        if (!rect.isValid() || !Recti(0, 0, image->getWidth()-1, image->getHeight()-1).contains(rect)) {
+            return;
+        }
+
+        Vec2f quad[4];
+        for (int i = 0; i < 4; ++i) {
+            quad[i] = Vec2f(pos[i].x, pos[i].y);
+        }
+        submitImageQuad(image, rect, quad, mask, filter);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawTransformedImage(Canvas* image, const Vec2i& pos, float scaleX, float scaleY, float angle, const RGBA& mask, int filter)
+    {
+        assert(image);
+
+        Vec2f quad[4];
+        GetTransformedQuad(pos, image->getWidth(), image->getHeight(), scaleX, scaleY, angle, quad);
+        submitImageQuad(image, Recti(0, 0, image->getWidth() - 1, image->getHeight() - 1), quad, mask, filter);
+    }
+
+    //-----------------------------------------------------------------
+    // texcoord are the points of the image mapped to pos, in texels
+    // with the corners of the image at 0 and its size, like the corners
+    // of the image quads
+    void
+    Canvas::drawTexturedTriangle(Canvas* image, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask, int filter)
+    {
+        assert(image);
+
+        if ((filter != FILTER_NEAREST && filter != FILTER_BILINEAR) ||
+            std::max(pos[0].x, std::max(pos[1].x, pos[2].x)) < _scissor.ul.x ||
+            std::min(pos[0].x, std::min(pos[1].x, pos[2].x)) > _scissor.lr.x ||
+            std::max(pos[0].y, std::max(pos[1].y, pos[2].y)) < _scissor.ul.y ||
+            std::min(pos[0].y, std::min(pos[1].y, pos[2].y)) > _scissor.lr.y)
+        {
+            return;
+        }
+
+        image->flush();
+
+        CanvasCommand cmd;
+        cmd.type   = CanvasCommand::CT_TEXTURED_TRIANGLE;
+        cmd.image  = image;
+        image->grab();
+        cmd.rect   = Recti(0, 0, image->getWidth() - 1, image->getHeight() - 1);
+        cmd.col[0] = mask;
+        cmd.filter = filter;
+        for (int i = 0; i < 3; ++i) {
+            cmd.pos[i]  = pos[i];
+            cmd.quad[i] = Vec2f(texcoord[i].x, texcoord[i].y);
+        }
+        submit(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::submitImageQuad(Canvas* image, const Recti& rect, const Vec2f quad[4], const RGBA& mask, int filter)
+    {
+        if ((filter != FILTER_NEAREST && filter != FILTER_BILINEAR) ||
+            !_scissor.intersects(get_quad_bounds(quad)))
+        {
+            return;
+        }
+
+        image->flush();
+
+        CanvasCommand cmd;
+        cmd.type   = CanvasCommand::CT_IMAGE_QUAD;
+        cmd.image  = image;
+        image->grab();
+        cmd.rect   = rect;
+        cmd.col[0] = mask;
+        cmd.filter = filter;
+        for (int i = 0; i < 4; ++i) {
+            cmd.quad[i] = quad[i];
+        }
+        submit(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    static void execute_textured_triangle(const DrawTarget& d, const CanvasCommand& cmd)
+    {
+        Vec2f p[3];
+        for (int i = 0; i < 3; ++i) {
+            p[i] = Vec2f(cmd.pos[i].x, cmd.pos[i].y);
+        }
+        draw_textured_triangle(d, *cmd.image.get(), cmd.rect, p, cmd.quad, cmd.col[0], cmd.filter, cmd.blendMode);
+    }
+
+    //-----------------------------------------------------------------
+    static void execute_command(const DrawTarget& d, const CanvasCommand& cmd)
+    {
+        switch (cmd.type) {
+        case CanvasCommand::CT_LINE:
+            execute_line(d, cmd);
+            break;
+        case CanvasCommand::CT_RECT:
+            execute_rect(d, cmd);
+            break;
+        case CanvasCommand::CT_RECT_OUTLINE:
+            execute_rect_outline(d, cmd);
             break;
-        case BM_ALPHA:
-            draw_image<rgba_alpha>(*this, *image, rect, pos);
+        case CanvasCommand::CT_CIRCLE:
+            execute_circle(d, cmd);
             break;
-        case BM_ADD:
-            draw_image<rgba_add>(*this, *image, rect, pos);
+        case CanvasCommand::CT_TRIANGLE:
+            execute_triangle(d, cmd);
             break;
-        case BM_SUBTRACT:
-            draw_image<rgba_subtract>(*this, *image, rect, pos);
+        case CanvasCommand::CT_POLYGON:
+            execute_polygon(d, cmd);
             break;
-        case BM_MULTIPLY:
-            draw_image<rgba_multiply>(*this, *image, rect, pos);
+        case CanvasCommand::CT_IMAGE:
+            draw_image(d, *cmd.image.get(), cmd.rect, cmd.pos[0], cmd.blendMode);
+            break;
+        case CanvasCommand::CT_IMAGE_QUAD:
+            draw_image_quad(d, *cmd.image.get(), cmd.rect, cmd.quad, cmd.col[0], cmd.filter, cmd.blendMode);
+            break;
+        case CanvasCommand::CT_TEXTURED_TRIANGLE:
+            execute_textured_triangle(d, cmd);
             break;
         default:
             break;
         }
     }
 
+    //-----------------------------------------------------------------
+    // Returns the area a command may touch, before scissoring
+    static Recti get_command_bounds(const CanvasCommand& cmd)
+    {
+        const Vec2i* p = cmd.pos;
+        int pad;
+        switch (cmd.type) {
+        case CanvasCommand::CT_LINE:
+            pad = (cmd.antialias || cmd.width != 1.0f) ? get_stroke_padding(cmd.width) : 0;
+            return Recti(std::min(p[0].x, p[1].x) - pad, std::min(p[0].y, p[1].y) - pad,
+                         std::max(p[0].x, p[1].x) + pad, std::max(p[0].y, p[1].y) + pad);
+        case CanvasCommand::CT_RECT:
+            return cmd.rect;
+        case CanvasCommand::CT_RECT_OUTLINE:
+            pad = get_stroke_padding(cmd.width);
+            return Recti(cmd.rect.ul.x - pad, cmd.rect.ul.y - pad,
+                         cmd.rect.lr.x + pad, cmd.rect.lr.y + pad);
+        case CanvasCommand::CT_CIRCLE:
+            pad = (!cmd.fill && (cmd.antialias || cmd.width != 1.0f)) ? get_stroke_padding(cmd.width) : 0;
+            return Recti(p[0].x - cmd.radius - pad, p[0].y - cmd.radiusY - pad,
+                         p[0].x + cmd.radius + pad, p[0].y + cmd.radiusY + pad);
+        case CanvasCommand::CT_IMAGE:
+            return Recti(p[0].x, p[0].y,
+                         p[0].x + cmd.rect.getWidth()  - 1,
+                         p[0].y + cmd.rect.getHeight() - 1);
+        case CanvasCommand::CT_TRIANGLE:
+        case CanvasCommand::CT_TEXTURED_TRIANGLE:
+            return Recti(std::min(p[0].x, std::min(p[1].x, p[2].x)), std::min(p[0].y, std::min(p[1].y, p[2].y)),
+                         std::max(p[0].x, std::max(p[1].x, p[2].x)), std::max(p[0].y, std::max(p[1].y, p[2].y)));
+        case CanvasCommand::CT_POLYGON:
+            return get_polygon_bounds(cmd.points);
+        case CanvasCommand::CT_IMAGE_QUAD:
+            return get_quad_bounds(cmd.quad);
+        default:
+            return Recti(0, 0, -1, -1);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::drawCommandList(CanvasCommandList* list)
+    {
+        assert(list);
+
+        detach();
+
+        DrawTarget d;
+        d.pixels        = _pixels;
+        d.pitch         = _stride;
+        d.premultiplied = (_pixelFormat == PF_PREMULTIPLIED_ALPHA);
+        d.linear        = (_linearLight && _pixelFormat == PF_STRAIGHT_ALPHA);
+
+        CanvasCommand trimmed;
+        for (int i = 0; i < list->getNumCommands(); ++i) {
+            const CanvasCommand* cmd = &list->getCommand(i);
+
+            Recti scissor = _scissor.getIntersection(cmd->scissor);
+            if (!scissor.isValid()) {
+                continue;
+            }
+
+            Canvas* image = cmd->image.get();
+            if (image) {
+                image->flush();
+                image->updateSpanTable();
+            }
+
+            // the images may have been trimmed after the list was recorded
+            if (image && cmd->type == CanvasCommand::CT_IMAGE && cmd->blendMode == BM_ALPHA) {
+                Recti rect = cmd->rect;
+                Vec2i pos  = cmd->pos[0];
+                if (!trim_image_rect(image, rect, pos)) {
+                    continue;
+                }
+                if (rect != cmd->rect) {
+                    trimmed = *cmd;
+                    trimmed.rect   = rect;
+                    trimmed.pos[0] = pos;
+                    cmd = &trimmed;
+                }
+            }
+
+            _spansValid = false;
+            _trimValid  = false;
+            _dirtyRegion.add(get_command_bounds(*cmd).getIntersection(scissor));
+
+            if (_deferred && image != this) {
+                _commands.push_back(*cmd);
+                _commands.back().scissor = scissor;
+                if (image) {
+                    Canvas* snapshot = image->getSnapshot();
+                    snapshot->grab();
+                    _commands.back().image = snapshot;
+                }
+            } else {
+                flush();
+                d.scissor = scissor;
+                execute_command(d, *cmd);
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // Rasterizes the commands binned into one tile, in recording order
+    struct TileJob : public ThreadPool::Job {
+        const std::vector<CanvasCommand>*   commands;
+        const std::vector<std::vector<int> >* bins;
+        const std::vector<int>* tiles;
+        DrawTarget target;
+        int width;
+        int height;
+        int numTilesX;
+
+        virtual void run(int index) {
+            int tile = (*tiles)[index];
+            int x    = (tile % numTilesX) * Canvas::DEFERRED_TILE_SIZE;
+            int y    = (tile / numTilesX) * Canvas::DEFERRED_TILE_SIZE;
+
+            Recti bounds(x, y,
+                std::min(x + Canvas::DEFERRED_TILE_SIZE, width)  - 1,
+                std::min(y + Canvas::DEFERRED_TILE_SIZE, height) - 1);
+
+            DrawTarget d = target;
+            const std::vector<int>& bin = (*bins)[tile];
+            for (int i = 0; i < (int)bin.size(); ++i) {
+                const CanvasCommand& cmd = (*commands)[bin[i]];
+                d.scissor = cmd.scissor.getIntersection(bounds);
+                execute_command(d, cmd);
+            }
+        }
+    };
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::flush()
+    {
+        if (_commands.empty()) {
+            return;
+        }
+
+        int num_tiles_x = (_width  + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE;
+        int num_tiles_y = (_height + DEFERRED_TILE_SIZE - 1) / DEFERRED_TILE_SIZE;
+
+        std::vector<std::vector<int> > bins(num_tiles_x * num_tiles_y);
+        std::vector<int> tiles;
+
+        for (int i = 0; i < (int)_commands.size(); ++i) {
+            const CanvasCommand& cmd = _commands[i];
+            Recti bounds = cmd.scissor.getIntersection(get_command_bounds(cmd));
+            if (!bounds.isValid()) {
+                continue;
+            }
+            for (int ty = bounds.ul.y / DEFERRED_TILE_SIZE; ty <= bounds.lr.y / DEFERRED_TILE_SIZE; ++ty) {
+                for (int tx = bounds.ul.x / DEFERRED_TILE_SIZE; tx <= bounds.lr.x / DEFERRED_TILE_SIZE; ++tx) {
+                    int tile = ty * num_tiles_x + tx;
+                    if (bins[tile].empty()) {
+                        tiles.push_back(tile);
+                    }
+                    bins[tile].push_back(i);
+                }
+            }
+        }
+
+        detach();
+
+        TileJob job;
+        job.commands  = &_commands;
+        job.bins      = &bins;
+        job.tiles     = &tiles;
+        job.width     = _width;
+        job.height    = _height;
+        job.numTilesX = num_tiles_x;
+        job.target.pixels        = _pixels;
+        job.target.pitch         = _stride;
+        job.target.scissor       = _scissor;
+        job.target.premultiplied = (_pixelFormat == PF_PREMULTIPLIED_ALPHA);
+        job.target.linear        = (_linearLight && _pixelFormat == PF_STRAIGHT_ALPHA);
+
+        getThreadPool()->run(&job, (int)tiles.size());
+
+        _commands.clear();
+        _spansValid = false;
+        _trimValid  = false;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Canvas::submit(CanvasCommand& cmd)
+    {
+        cmd.blendMode = _blendMode;
+        cmd.scissor   = _scissor;
+        _dirtyRegion.add(get_command_bounds(cmd).getIntersection(_scissor));
+
+        // a deferred canvas drawn onto itself has to see the pixels
+        // of the commands before, so it can't be recorded
+        if (_deferred && cmd.image.get() != this) {
+            if (cmd.image) {
+                Canvas* snapshot = cmd.image->getSnapshot();
+                snapshot->grab();
+                cmd.image = snapshot;
+            }
+            _commands.push_back(cmd);
+            return;
+        }
+
+        flush();
+        detach();
+        _spansValid = false;
+        _trimValid  = false;
+
+        DrawTarget d;
+        d.pixels        = _pixels;
+        d.pitch         = _stride;
+        d.scissor       = _scissor;
+        d.premultiplied = (_pixelFormat == PF_PREMULTIPLIED_ALPHA);
+        d.linear        = (_linearLight && _pixelFormat == PF_STRAIGHT_ALPHA);
+        execute_command(d, cmd);
+    }
+
 } // namespace sphere
@@ -18,16 +18,26 @@
 #ifndef SPHERE_CANVAS_HPP
 #define SPHERE_CANVAS_HPP
 
+#include <cassert>
 #include <string>
+#include <vector>
 #include "../common/RefPtr.hpp"
 #include "../common/RefImpl.hpp"
 #include "../common/IRefCounted.hpp"
 #include "../base/Rect.hpp"
+#include "../core/ThreadPool.hpp"
+#include "CanvasCommand.hpp"
+#include "SpanTable.hpp"
+#include "DirtyRegion.hpp"
+#include "IPixelAllocator.hpp"
 #include "RGBA.hpp"
 
 
 namespace sphere {
 
+    class CanvasCommandList;
+    class ColorTransform;
+
     class Canvas : public RefImpl<IRefCounted> {
     public:
         enum BlendMode {
@@ -38,26 +48,85 @@ namespace sphere {
             BM_MULTIPLY,
         };
 
+        // Premultiplied canvases store color * alpha. Colors passed to
+        // the draw functions are always straight alpha and converted as
+        // needed, images of either format can be drawn onto each other.
+        enum PixelFormat {
+            PF_STRAIGHT_ALPHA = 0,
+            PF_PREMULTIPLIED_ALPHA,
+        };
+
+        // Sampling of the transformed image blits, which support nearest
+        // and bilinear, and of scale(), which supports all of them
+        enum Filter {
+            FILTER_NEAREST = 0,
+            FILTER_BILINEAR,
+            FILTER_BOX,
+            FILTER_BICUBIC,
+            FILTER_LANCZOS,
+        };
+
+        // Polygon fill rules: even-odd fills the points crossing an odd
+        // number of edges on their way out, non-zero the points around
+        // which the outline winds at all
+        enum FillRule {
+            FILL_EVEN_ODD = 0,
+            FILL_NON_ZERO,
+        };
+
+        // Pixel formats of the buffers of readPixels() and writePixels()
+        enum BufferFormat {
+            BF_RGBA = 0,
+            BF_BGRA,
+            BF_RGB,
+            BF_A8,
+        };
+
+        // Size of the tiles a deferred canvas is rasterized in
+        enum {
+            DEFERRED_TILE_SIZE = 64,
+        };
+
         static int GetNumBytesPerPixel();
+        static IPixelAllocator* GetDefaultAllocator();
+        static void SetDefaultAllocator(IPixelAllocator* allocator);
 
         static Canvas* Create(int width, int height, const RGBA* pixels = 0);
 
         int   getWidth() const;
         int   getHeight() const;
         int   getPitch() const;
+        int   getStride() const;
         int   getNumPixels() const;
+        IPixelAllocator* getAllocator() const;
         RGBA* getPixels();
         const RGBA* getPixels() const;
         Canvas* cloneSection(const Recti& section);
+        Canvas* createView(const Recti& section);
         const RGBA& getPixel(int x, int y) const;
         void  setPixel(int x, int y, const RGBA& color);
         const RGBA& getPixelByIndex(int index) const;
         void  setPixelByIndex(int index, const RGBA& color);
+        const RGBA* getRow(int y) const;
+        RGBA* getRow(int y);
+        void  copyRowTo(int y, RGBA* dst) const;
+        void  copyRowFrom(int y, const RGBA* src);
+        template<typename FuncT> FuncT forEachSpan(FuncT func) const;
+        template<typename FuncT> FuncT forEachSpan(FuncT func);
+        template<typename FuncT> FuncT forEachSpan(const Recti& rect, FuncT func) const;
+        template<typename FuncT> FuncT forEachSpan(const Recti& rect, FuncT func);
+        bool  readPixels(const Recti& rect, void* dst, int pitch, int format = BF_RGBA) const;
+        bool  writePixels(const Recti& rect, const void* src, int pitch, int format = BF_RGBA);
         void  resize(int width, int height);
+        void  scale(int width, int height, int filter = FILTER_BILINEAR);
         void  setAlpha(int alpha);
         void  replaceColor(const RGBA& color, const RGBA& newColor);
         void  fill(const RGBA& color);
         void  grey();
+        void  transformColors(const ColorTransform& transform);
+        void  boxBlur(int radius, bool alphaOnly = false);
+        void  gaussianBlur(float sigma, bool alphaOnly = false);
+        void  convolve(const float* kernelX, int sizeX, const float* kernelY, int sizeY, bool alphaOnly = false);
         void  flipHorizontally();
         void  flipVertically();
         void  rotateCW();
@@ -66,22 +135,76 @@ namespace sphere {
         bool  setScissor(const Recti& scissor);
         int   getBlendMode() const;
         bool  setBlendMode(int blendMode);
-        void  drawLine(Vec2i pos[2], RGBA col[2]);
+        int   getPixelFormat() const;
+        bool  setPixelFormat(int pixelFormat);
+        bool  isDeferred() const;
+        void  setDeferred(bool deferred);
+        bool  isLinearLight() const;
+        void  setLinearLight(bool linearLight);
+        ThreadPool* getThreadPool() const;
+        void  setThreadPool(ThreadPool* threadPool);
+        void  flush();
+        bool  isSpanEncoded() const;
+        void  setSpanEncoded(bool spanEncoded);
+        const SpanTable* getSpanTable() const;
+        void  trim();
+        Recti getTrimRect() const;
+        const DirtyRegion& getDirtyRegion() const;
+        void  clearDirtyRegion();
+        void  drawLine(Vec2i pos[2], RGBA col[2], bool antialias = false, float width = 1.0f);
         void  drawRect(const Recti& rect, RGBA col[4]);
-        void  drawCircle(int x, int y, int radius, bool fill, RGBA col[2]);
+        void  drawRectOutline(const Recti& rect, const RGBA& color, bool antialias = false, float width = 1.0f);
+        void  drawCircle(int x, int y, int radius, bool fill, RGBA col[2], bool antialias = false, float width = 1.0f);
+        void  drawEllipse(int x, int y, int radiusX, int radiusY, bool fill, RGBA col[2], bool antialias = false, float width = 1.0f);
+        void  drawTriangle(Vec2i pos[3], RGBA col[3]);
+        void  drawPolygon(const Vec2i* points, int numPoints, const RGBA& color, int fillRule = FILL_EVEN_ODD);
         void  drawImage(Canvas* image, const Vec2i& pos);
         void  drawSubImage(Canvas* image, const Recti& rect, const Vec2i& pos);
+        void  drawImageQuad(Canvas* image, Vec2i pos[4], const RGBA& mask, int filter = FILTER_NEAREST);
+        void  drawSubImageQuad(Canvas* image, const Recti& rect, Vec2i pos[4], const RGBA& mask, int filter = FILTER_NEAREST);
+        void  drawTransformedImage(Canvas* image, const Vec2i& pos, float scaleX, float scaleY, float angle, const RGBA& mask, int filter = FILTER_NEAREST);
+        void  drawTexturedTriangle(Canvas* image, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask, int filter = FILTER_NEAREST);
+        void  drawCommandList(CanvasCommandList* list);
 
     private:
+        struct PixelBuffer;
+
         Canvas(int width, int height);
+        Canvas(Canvas* canvas, const Recti& section);
         virtual ~Canvas();
 
+        RGBA* allocatePixels(int numPixels);
+        void  setPixels(RGBA* pixels, int width, int height);
+        void  resetBounds();
+        void  detach();
+        Canvas* getSnapshot();
+        void  touch();
+        void  touch(const Recti& rect);
+        void  updateSpanTable();
+        void  submit(CanvasCommand& cmd);
+        void  submitImageQuad(Canvas* image, const Recti& rect, const Vec2f quad[4], const RGBA& mask, int filter);
+
     private:
         int   _width;
         int   _height;
+        int   _stride;
         RGBA* _pixels;
+        PixelBuffer* _buffer;
+        IPixelAllocator* _allocator;
         Recti _scissor;
         int   _blendMode;
+        int   _pixelFormat;
+        bool  _deferred;
+        bool  _linearLight;
+        ThreadPoolPtr _threadPool;
+        std::vector<CanvasCommand> _commands;
+        bool  _spanEncoded;
+        bool  _spansValid;
+        SpanTable _spanTable;
+        bool  _trimValid;
+        Recti _trimRect;
+        DirtyRegion _dirtyRegion;
+        RefPtr<Canvas> _snapshot;
     };
 
     typedef RefPtr<Canvas> CanvasPtr;
@@ -111,7 +234,14 @@ namespace sphere {
     inline int
     Canvas::getPitch() const
     {
-        return _width * sizeof(RGBA);
+        return _stride * sizeof(RGBA);
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    Canvas::getStride() const
+    {
+        return _stride;
     }
 
     //-----------------------------------------------------------------
@@ -121,10 +251,19 @@ namespace sphere {
         return _width * _height;
     }
 
+    //-----------------------------------------------------------------
+    inline IPixelAllocator*
+    Canvas::getAllocator() const
+    {
+        return _allocator;
+    }
+
     //-----------------------------------------------------------------
     inline RGBA*
     Canvas::getPixels()
     {
+        // the pixels may be written through the returned pointer
+        touch();
         return _pixels;
     }
 
@@ -135,6 +274,66 @@ namespace sphere {
         return _pixels;
     }
 
+    //-----------------------------------------------------------------
+    inline const RGBA*
+    Canvas::getRow(int y) const
+    {
+        assert(y >= 0 && y < _height);
+        return _pixels + y * _stride;
+    }
+
+    //-----------------------------------------------------------------
+    // Calls func(x, y, span, n) for each row of the rectangle, clipped
+    // to the canvas. Through a non-const canvas the spans may be
+    // modified and are marked dirty.
+    template<typename FuncT>
+    inline FuncT
+    Canvas::forEachSpan(FuncT func) const
+    {
+        return forEachSpan(Recti(0, 0, _width - 1, _height - 1), func);
+    }
+
+    //-----------------------------------------------------------------
+    template<typename FuncT>
+    inline FuncT
+    Canvas::forEachSpan(FuncT func)
+    {
+        return forEachSpan(Recti(0, 0, _width - 1, _height - 1), func);
+    }
+
+    //-----------------------------------------------------------------
+    template<typename FuncT>
+    inline FuncT
+    Canvas::forEachSpan(const Recti& rect, FuncT func) const
+    {
+        Recti r = rect.getIntersection(Recti(0, 0, _width - 1, _height - 1));
+        if (r.isValid()) {
+            const RGBA* p = _pixels + r.ul.y * _stride + r.ul.x;
+            for (int y = r.ul.y; y <= r.lr.y; ++y) {
+                func(r.ul.x, y, p, r.getWidth());
+                p += _stride;
+            }
+        }
+        return func;
+    }
+
+    //-----------------------------------------------------------------
+    template<typename FuncT>
+    inline FuncT
+    Canvas::forEachSpan(const Recti& rect, FuncT func)
+    {
+        Recti r = rect.getIntersection(Recti(0, 0, _width - 1, _height - 1));
+        if (r.isValid()) {
+            touch(r);
+            RGBA* p = _pixels + r.ul.y * _stride + r.ul.x;
+            for (int y = r.ul.y; y <= r.lr.y; ++y) {
+                func(r.ul.x, y, p, r.getWidth());
+                p += _stride;
+            }
+        }
+        return func;
+    }
+
     //-----------------------------------------------------------------
     inline const Recti&
     Canvas::getScissor() const
@@ -149,6 +348,57 @@ namespace sphere {
         return _blendMode;
     }
 
+    //-----------------------------------------------------------------
+    inline int
+    Canvas::getPixelFormat() const
+    {
+        return _pixelFormat;
+    }
+
+    //-----------------------------------------------------------------
+    inline bool
+    Canvas::isDeferred() const
+    {
+        return _deferred;
+    }
+
+    //-----------------------------------------------------------------
+    inline bool
+    Canvas::isLinearLight() const
+    {
+        return _linearLight;
+    }
+
+    //-----------------------------------------------------------------
+    inline bool
+    Canvas::isSpanEncoded() const
+    {
+        return _spanEncoded;
+    }
+
+    //-----------------------------------------------------------------
+    inline const SpanTable*
+    Canvas::getSpanTable() const
+    {
+        return (_spanEncoded && _spansValid) ? &_spanTable : 0;
+    }
+
+    //-----------------------------------------------------------------
+    inline Recti
+    Canvas::getTrimRect() const
+    {
+        return _trimValid ? _trimRect : Recti(0, 0, _width - 1, _height - 1);
+    }
+
+    //-----------------------------------------------------------------
+    // The pixels changed since clearDirtyRegion(), new canvases are
+    // dirty as a whole
+    inline const DirtyRegion&
+    Canvas::getDirtyRegion() const
+    {
+        return _dirtyRegion;
+    }
+
 } // namespace sphere
 
 
@@ -0,0 +1,91 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_CANVASCOMMAND_HPP
+#define SPHERE_CANVASCOMMAND_HPP
+
+#include <cmath>
+#include <vector>
+#include "../common/RefPtr.hpp"
+#include "../base/Rect.hpp"
+#include "RGBA.hpp"
+#include "EllipseTable.hpp"
+
+
+namespace sphere {
+
+    class Canvas;
+
+    // A recorded Canvas draw call. The colors are straight alpha, they
+    // are converted to the pixel format of the canvas when executed.
+    struct CanvasCommand {
+        enum Type {
+            CT_LINE = 0,
+            CT_RECT,
+            CT_RECT_OUTLINE,
+            CT_CIRCLE,
+            CT_IMAGE,
+            CT_IMAGE_QUAD,
+            CT_TRIANGLE,
+            CT_POLYGON,
+            CT_TEXTURED_TRIANGLE,
+        };
+
+        int   type;
+        int   blendMode;
+        Recti scissor;
+        Vec2i pos[3];     // line end points, circle center, image position, triangle vertices
+        Recti rect;       // rectangle, image section
+        Vec2f quad[4];    // image quad corners, textured triangle texel coordinates
+        std::vector<Vec2i> points;  // polygon vertices
+        RGBA  col[4];     // colors, image quad and textured triangle mask
+        int   radius;     // circle radius, horizontal ellipse radius
+        int   radiusY;    // vertical ellipse radius
+        bool  fill;
+        bool  antialias;
+        float width;      // stroke width of lines and outlines
+        int   filter;
+        int   fillRule;
+        RefPtr<Canvas> image;
+        RefPtr<EllipseTable> ellipse;
+
+        CanvasCommand() : type(CT_LINE), blendMode(0), radius(0), radiusY(0), fill(false), antialias(false), width(1.0f), filter(0), fillRule(0) { }
+    };
+
+    //-----------------------------------------------------------------
+    // Corners of a w x h image at pos, scaled and then rotated by angle
+    // radians about its center, as drawn by drawTransformedImage
+    inline void GetTransformedQuad(const Vec2i& pos, int w, int h, float scaleX, float scaleY, float angle, Vec2f quad[4])
+    {
+        float hw = w * scaleX * 0.5f;
+        float hh = h * scaleY * 0.5f;
+        float cx = pos.x + hw;
+        float cy = pos.y + hh;
+        float cs = cos(angle);
+        float sn = sin(angle);
+
+        const float corners[4][2] = {{-hw, -hh}, {hw, -hh}, {hw, hh}, {-hw, hh}};
+        for (int i = 0; i < 4; ++i) {
+            quad[i].x = cx + corners[i][0] * cs - corners[i][1] * sn;
+            quad[i].y = cy + corners[i][0] * sn + corners[i][1] * cs;
+        }
+    }
+
+} // namespace sphere
+
+
+#endif
@@ -0,0 +1,406 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <algorithm>
+#include <limits>
+#include "Canvas.hpp"
+#include "CanvasCommandList.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    CanvasCommandList*
+    CanvasCommandList::Create()
+    {
+        return new CanvasCommandList();
+    }
+
+    //-----------------------------------------------------------------
+    CanvasCommandList::CanvasCommandList()
+        : _scissor(0, 0, std::numeric_limits<i32>::max(), std::numeric_limits<i32>::max())
+        , _blendMode(Canvas::BM_ALPHA)
+    {
+    }
+
+    //-----------------------------------------------------------------
+    CanvasCommandList::~CanvasCommandList()
+    {
+    }
+
+    //-----------------------------------------------------------------
+    const CanvasCommand&
+    CanvasCommandList::getCommand(int index) const
+    {
+        assert(index >= 0 && index < (int)_commands.size());
+        return _commands[index];
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::clear()
+    {
+        _commands.clear();
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    CanvasCommandList::setScissor(const Recti& scissor)
+    {
+        if (!scissor.isValid()) {
+            return false;
+        }
+        _scissor = scissor;
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    CanvasCommandList::setBlendMode(int blendMode)
+    {
+        switch (blendMode) {
+            case Canvas::BM_REPLACE:
+            case Canvas::BM_ALPHA:
+            case Canvas::BM_ADD:
+            case Canvas::BM_SUBTRACT:
+            case Canvas::BM_MULTIPLY:
+                _blendMode = blendMode;
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawLine(Vec2i pos[2], RGBA col[2], bool antialias, float width)
+    {
+        if (!(width > 0.0f)) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type      = CanvasCommand::CT_LINE;
+        cmd.pos[0]    = pos[0];
+        cmd.pos[1]    = pos[1];
+        cmd.col[0]    = col[0];
+        cmd.col[1]    = col[1];
+        cmd.antialias = antialias;
+        cmd.width     = width;
+        record(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawRect(const Recti& rect, RGBA col[4])
+    {
+        if (!rect.isValid() || !_scissor.intersects(rect)) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type = CanvasCommand::CT_RECT;
+        cmd.rect = rect;
+        for (int i = 0; i < 4; ++i) {
+            cmd.col[i] = col[i];
+        }
+        record(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawRectOutline(const Recti& rect, const RGBA& color, bool antialias, float width)
+    {
+        if (!rect.isValid() || !(width > 0.0f)) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type      = CanvasCommand::CT_RECT_OUTLINE;
+        cmd.rect      = rect;
+        cmd.col[0]    = color;
+        cmd.antialias = antialias;
+        cmd.width     = width;
+        record(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawCircle(int x, int y, int radius, bool fill, RGBA col[2], bool antialias, float width)
+    {
+        drawEllipse(x, y, radius, radius, fill, col, antialias, width);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawEllipse(int x, int y, int radiusX, int radiusY, bool fill, RGBA col[2], bool antialias, float width)
+    {
+        if (radiusX <= 0 || radiusY <= 0 || !(width > 0.0f)) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type      = CanvasCommand::CT_CIRCLE;
+        cmd.pos[0]    = Vec2i(x, y);
+        cmd.radius    = radiusX;
+        cmd.radiusY   = radiusY;
+        cmd.fill      = fill;
+        cmd.antialias = antialias;
+        cmd.width     = width;
+        cmd.col[0]    = col[0];
+        cmd.col[1]    = col[1];
+        cmd.ellipse   = EllipseTable::Get(radiusX, radiusY, col[0] != col[1]);
+        record(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawTriangle(Vec2i pos[3], RGBA col[3])
+    {
+        CanvasCommand cmd;
+        cmd.type = CanvasCommand::CT_TRIANGLE;
+        for (int i = 0; i < 3; ++i) {
+            cmd.pos[i] = pos[i];
+            cmd.col[i] = col[i];
+        }
+        record(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawPolygon(const Vec2i* points, int numPoints, const RGBA& color, int fillRule)
+    {
+        assert(points || numPoints == 0);
+
+        if (numPoints < 3 || (fillRule != Canvas::FILL_EVEN_ODD && fillRule != Canvas::FILL_NON_ZERO)) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type     = CanvasCommand::CT_POLYGON;
+        cmd.points.assign(points, points + numPoints);
+        cmd.col[0]   = color;
+        cmd.fillRule = fillRule;
+        record(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawImage(Canvas* image, const Vec2i& pos)
+    {
+        assert(image);
+
+        CanvasCommand cmd;
+        cmd.type   = CanvasCommand::CT_IMAGE;
+        cmd.image  = image;
+        image->grab();
+        cmd.rect   = Recti(0, 0, image->getWidth() - 1, image->getHeight() - 1);
+        cmd.pos[0] = pos;
+        record(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawSubImage(Canvas* image, const Recti& rect, const Vec2i& pos)
+    {
+        assert(image);
+
+        if (!rect.isValid() || !Recti(0, 0, image->getWidth()-1, image->getHeight()-1).contains(rect)) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type   = CanvasCommand::CT_IMAGE;
+        cmd.image  = image;
+        image->grab();
+        cmd.rect   = rect;
+        cmd.pos[0] = pos;
+        record(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawImageQuad(Canvas* image, Vec2i pos[4], const RGBA& mask, int filter)
+    {
+        assert(image);
+
+        Vec2f quad[4];
+        for (int i = 0; i < 4; ++i) {
+            quad[i] = Vec2f(pos[i].x, pos[i].y);
+        }
+        recordImageQuad(image, Recti(0, 0, image->getWidth() - 1, image->getHeight() - 1), quad, mask, filter);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawSubImageQuad(Canvas* image, const Recti& rect, Vec2i pos[4], const RGBA& mask, int filter)
+    {
+        assert(image);
+
+        if (!rect.isValid() || !Recti(0, 0, image->getWidth()-1, image->getHeight()-1).contains(rect)) {
+            return;
+        }
+
+        Vec2f quad[4];
+        for (int i = 0; i < 4; ++i) {
+            quad[i] = Vec2f(pos[i].x, pos[i].y);
+        }
+        recordImageQuad(image, rect, quad, mask, filter);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawTransformedImage(Canvas* image, const Vec2i& pos, float scaleX, float scaleY, float angle, const RGBA& mask, int filter)
+    {
+        assert(image);
+
+        Vec2f quad[4];
+        GetTransformedQuad(pos, image->getWidth(), image->getHeight(), scaleX, scaleY, angle, quad);
+        recordImageQuad(image, Recti(0, 0, image->getWidth() - 1, image->getHeight() - 1), quad, mask, filter);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::drawTexturedTriangle(Canvas* image, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask, int filter)
+    {
+        assert(image);
+
+        if (filter != Canvas::FILTER_NEAREST && filter != Canvas::FILTER_BILINEAR) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type   = CanvasCommand::CT_TEXTURED_TRIANGLE;
+        cmd.image  = image;
+        image->grab();
+        cmd.rect   = Recti(0, 0, image->getWidth() - 1, image->getHeight() - 1);
+        cmd.col[0] = mask;
+        cmd.filter = filter;
+        for (int i = 0; i < 3; ++i) {
+            cmd.pos[i]  = pos[i];
+            cmd.quad[i] = Vec2f(texcoord[i].x, texcoord[i].y);
+        }
+        record(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::recordImageQuad(Canvas* image, const Recti& rect, const Vec2f quad[4], const RGBA& mask, int filter)
+    {
+        if (filter != Canvas::FILTER_NEAREST && filter != Canvas::FILTER_BILINEAR) {
+            return;
+        }
+
+        CanvasCommand cmd;
+        cmd.type   = CanvasCommand::CT_IMAGE_QUAD;
+        cmd.image  = image;
+        image->grab();
+        cmd.rect   = rect;
+        cmd.col[0] = mask;
+        cmd.filter = filter;
+        for (int i = 0; i < 4; ++i) {
+            cmd.quad[i] = quad[i];
+        }
+        record(cmd);
+    }
+
+    //-----------------------------------------------------------------
+    // Returns true if the two rectangles share a full edge, without
+    // overlapping, and stores the rectangle they make up in u
+    static inline bool get_adjacent_union(const Recti& a, const Recti& b, Recti& u)
+    {
+        if (a.ul.y == b.ul.y && a.lr.y == b.lr.y &&
+            (b.ul.x == a.lr.x + 1 || a.ul.x == b.lr.x + 1))
+        {
+            u = Recti(std::min(a.ul.x, b.ul.x), a.ul.y, std::max(a.lr.x, b.lr.x), a.lr.y);
+            return true;
+        }
+        if (a.ul.x == b.ul.x && a.lr.x == b.lr.x &&
+            (b.ul.y == a.lr.y + 1 || a.ul.y == b.lr.y + 1))
+        {
+            u = Recti(a.ul.x, std::min(a.ul.y, b.ul.y), a.lr.x, std::max(a.lr.y, b.lr.y));
+            return true;
+        }
+        return false;
+    }
+
+    //-----------------------------------------------------------------
+    static inline bool is_solid(const CanvasCommand& cmd)
+    {
+        RGBA c = cmd.col[0];
+        return (c == cmd.col[1] && c == cmd.col[2] && c == cmd.col[3]);
+    }
+
+    //-----------------------------------------------------------------
+    // Merges cmd into last if drawing both is the same as drawing last
+    // with a larger area. Only commands touching disjoint pixels are
+    // merged, so this holds for every blend mode.
+    static bool merge_commands(CanvasCommand& last, const CanvasCommand& cmd)
+    {
+        if (last.type      != cmd.type      ||
+            last.blendMode != cmd.blendMode ||
+            last.scissor   != cmd.scissor)
+        {
+            return false;
+        }
+
+        Recti u;
+        switch (cmd.type) {
+        case CanvasCommand::CT_RECT:
+            if (!is_solid(last) || !is_solid(cmd) || last.col[0] != cmd.col[0] ||
+                !get_adjacent_union(last.rect, cmd.rect, u))
+            {
+                return false;
+            }
+            last.rect = u;
+            return true;
+
+        case CanvasCommand::CT_IMAGE:
+            // the image sections have to be laid out the same way on
+            // the canvas as they are in the image
+            if (last.image.get() != cmd.image.get() ||
+                cmd.pos[0].x - last.pos[0].x != cmd.rect.ul.x - last.rect.ul.x ||
+                cmd.pos[0].y - last.pos[0].y != cmd.rect.ul.y - last.rect.ul.y ||
+                !get_adjacent_union(last.rect, cmd.rect, u))
+            {
+                return false;
+            }
+            last.pos[0].x += u.ul.x - last.rect.ul.x;
+            last.pos[0].y += u.ul.y - last.rect.ul.y;
+            last.rect = u;
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    CanvasCommandList::record(CanvasCommand& cmd)
+    {
+        cmd.blendMode = _blendMode;
+        cmd.scissor   = _scissor;
+
+        if (!_commands.empty() && merge_commands(_commands.back(), cmd)) {
+            return;
+        }
+        _commands.push_back(cmd);
+    }
+
+} // namespace sphere
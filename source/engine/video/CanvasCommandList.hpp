@@ -0,0 +1,104 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_CANVASCOMMANDLIST_HPP
+#define SPHERE_CANVASCOMMANDLIST_HPP
+
+#include <vector>
+#include "../common/RefPtr.hpp"
+#include "../common/RefImpl.hpp"
+#include "../common/IRefCounted.hpp"
+#include "../base/Rect.hpp"
+#include "CanvasCommand.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    class Canvas;
+
+    // Records Canvas draw calls together with the blend mode and scissor
+    // in effect, for replaying them with Canvas::drawCommandList. Adjacent
+    // solid rectangles of the same color and adjacent sections of the
+    // same image are merged into a single command as they are recorded.
+    // The scissor is intersected with the one of the canvas on replay,
+    // by default it covers everything.
+    class CanvasCommandList : public RefImpl<IRefCounted> {
+    public:
+        static CanvasCommandList* Create();
+
+        int   getNumCommands() const;
+        const CanvasCommand& getCommand(int index) const;
+        void  clear();
+        const Recti& getScissor() const;
+        bool  setScissor(const Recti& scissor);
+        int   getBlendMode() const;
+        bool  setBlendMode(int blendMode);
+        void  drawLine(Vec2i pos[2], RGBA col[2], bool antialias = false, float width = 1.0f);
+        void  drawRect(const Recti& rect, RGBA col[4]);
+        void  drawRectOutline(const Recti& rect, const RGBA& color, bool antialias = false, float width = 1.0f);
+        void  drawCircle(int x, int y, int radius, bool fill, RGBA col[2], bool antialias = false, float width = 1.0f);
+        void  drawEllipse(int x, int y, int radiusX, int radiusY, bool fill, RGBA col[2], bool antialias = false, float width = 1.0f);
+        void  drawTriangle(Vec2i pos[3], RGBA col[3]);
+        void  drawPolygon(const Vec2i* points, int numPoints, const RGBA& color, int fillRule = 0);
+        void  drawImage(Canvas* image, const Vec2i& pos);
+        void  drawSubImage(Canvas* image, const Recti& rect, const Vec2i& pos);
+        void  drawImageQuad(Canvas* image, Vec2i pos[4], const RGBA& mask, int filter = 0);
+        void  drawSubImageQuad(Canvas* image, const Recti& rect, Vec2i pos[4], const RGBA& mask, int filter = 0);
+        void  drawTransformedImage(Canvas* image, const Vec2i& pos, float scaleX, float scaleY, float angle, const RGBA& mask, int filter = 0);
+        void  drawTexturedTriangle(Canvas* image, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask, int filter = 0);
+
+    private:
+        CanvasCommandList();
+        virtual ~CanvasCommandList();
+
+        void  record(CanvasCommand& cmd);
+        void  recordImageQuad(Canvas* image, const Recti& rect, const Vec2f quad[4], const RGBA& mask, int filter);
+
+    private:
+        Recti _scissor;
+        int   _blendMode;
+        std::vector<CanvasCommand> _commands;
+    };
+
+    typedef RefPtr<CanvasCommandList> CanvasCommandListPtr;
+
+    //-----------------------------------------------------------------
+    inline int
+    CanvasCommandList::getNumCommands() const
+    {
+        return (int)_commands.size();
+    }
+
+    //-----------------------------------------------------------------
+    inline const Recti&
+    CanvasCommandList::getScissor() const
+    {
+        return _scissor;
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    CanvasCommandList::getBlendMode() const
+    {
+        return _blendMode;
+    }
+
+} // namespace sphere
+
+
+#endif
@@ -0,0 +1,428 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <algorithm>
+#include <map>
+#include "blend.hpp"
+#include "colormatrix.hpp"
+#include "ColorTransform.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Pixels per chunk, all stages run over a chunk while it's in the
+    // L1 cache
+    static const int COLOR_TRANSFORM_CHUNK_SIZE = 256;
+
+    //-----------------------------------------------------------------
+    static inline u32 get_color_key(const RGBA& c)
+    {
+        return *(const u32*)&c;
+    }
+
+    //-----------------------------------------------------------------
+    static inline u32 hash_color_key(u32 key, int shift)
+    {
+        return (key * 0x9E3779B1u) >> shift;
+    }
+
+    //-----------------------------------------------------------------
+    // Returns the channels whose table isn't the identity as bits
+    static inline int get_lookup_channels(const u8 lut[4][256])
+    {
+        int channels = 0;
+        for (int c = 0; c < 4; ++c) {
+            for (int v = 0; v < 256; ++v) {
+                if (lut[c][v] != v) {
+                    channels |= 1 << c;
+                    break;
+                }
+            }
+        }
+        return channels;
+    }
+
+    //-----------------------------------------------------------------
+    static inline int get_constant_lookup_alpha(const u8 lut[4][256])
+    {
+        if (std::count(lut[3], lut[3] + 256, lut[3][0]) != 256) {
+            return -1;
+        }
+        return lut[3][0];
+    }
+
+    //-----------------------------------------------------------------
+    static inline void init_identity_lookup(u8 lut[4][256])
+    {
+        for (int c = 0; c < 4; ++c) {
+            for (int v = 0; v < 256; ++v) {
+                lut[c][v] = (u8)v;
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    ColorTransform::ColorTransform()
+    {
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ColorTransform::reset()
+    {
+        _stages.clear();
+    }
+
+    //-----------------------------------------------------------------
+    ColorTransform&
+    ColorTransform::multiply(const float matrix[20])
+    {
+        if (!_stages.empty() && _stages.back().type == ST_MATRIX) {
+            float* m = _stages.back().matrix;
+            float product[20];
+            for (int i = 0; i < 4; ++i) {
+                for (int j = 0; j < 5; ++j) {
+                    double x = (j == 4) ? matrix[i * 5 + 4] : 0.0;
+                    for (int k = 0; k < 4; ++k) {
+                        x += (double)matrix[i * 5 + k] * m[k * 5 + j];
+                    }
+                    product[i * 5 + j] = (float)x;
+                }
+            }
+            std::copy(product, product + 20, m);
+            return *this;
+        }
+
+        bool diagonal = true;
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                if (i != j && matrix[i * 5 + j] != 0.0f) {
+                    diagonal = false;
+                }
+            }
+        }
+
+        if (diagonal) {
+            // channels transformed on their own are tabulated, running
+            // the matrix kernel over the 256 grey levels produces them
+            RGBA levels[256];
+            for (int v = 0; v < 256; ++v) {
+                levels[v] = RGBA(v, v, v, v);
+            }
+            GetScalarColorMatrixSpanFunc()(levels, 256, matrix);
+            u8 lut[4][256];
+            for (int v = 0; v < 256; ++v) {
+                lut[0][v] = levels[v].red;
+                lut[1][v] = levels[v].green;
+                lut[2][v] = levels[v].blue;
+                lut[3][v] = levels[v].alpha;
+            }
+            addLookup(lut);
+        } else {
+            _stages.push_back(Stage(ST_MATRIX));
+            std::copy(matrix, matrix + 20, _stages.back().matrix);
+        }
+        return *this;
+    }
+
+    //-----------------------------------------------------------------
+    ColorTransform&
+    ColorTransform::lookup(const u8* red, const u8* green, const u8* blue, const u8* alpha)
+    {
+        const u8* tables[4] = { red, green, blue, alpha };
+        u8 lut[4][256];
+        init_identity_lookup(lut);
+        for (int c = 0; c < 4; ++c) {
+            if (tables[c]) {
+                std::copy(tables[c], tables[c] + 256, lut[c]);
+            }
+        }
+        addLookup(lut);
+        return *this;
+    }
+
+    //-----------------------------------------------------------------
+    ColorTransform&
+    ColorTransform::remap(const RGBA* colors, const RGBA* newColors, int numColors)
+    {
+        assert(numColors >= 0);
+
+        // the first entry of a color counts
+        std::map<u32, u32> entries;
+        for (int i = 0; i < numColors; ++i) {
+            entries.insert(std::make_pair(get_color_key(colors[i]), get_color_key(newColors[i])));
+        }
+
+        std::vector<u32> keys;
+        std::vector<u32> values;
+        for (std::map<u32, u32>::iterator it = entries.begin(); it != entries.end(); ++it) {
+            keys.push_back(it->first);
+            values.push_back(it->second);
+        }
+        addRemap(keys, values);
+        return *this;
+    }
+
+    //-----------------------------------------------------------------
+    ColorTransform&
+    ColorTransform::grey()
+    {
+        if (_stages.empty() || _stages.back().type != ST_GREY) {
+            _stages.push_back(Stage(ST_GREY));
+        }
+        return *this;
+    }
+
+    //-----------------------------------------------------------------
+    ColorTransform&
+    ColorTransform::tint(const RGBA& color)
+    {
+        // scales by (color + 1) / 256 like the blit masks do
+        const int scale[4] = { color.red + 1, color.green + 1, color.blue + 1, color.alpha + 1 };
+        u8 lut[4][256];
+        for (int c = 0; c < 4; ++c) {
+            for (int v = 0; v < 256; ++v) {
+                lut[c][v] = (u8)((v * scale[c]) >> 8);
+            }
+        }
+        addLookup(lut);
+        return *this;
+    }
+
+    //-----------------------------------------------------------------
+    ColorTransform&
+    ColorTransform::setAlpha(int alpha)
+    {
+        u8 lut[4][256];
+        init_identity_lookup(lut);
+        std::fill(lut[3], lut[3] + 256, (u8)alpha);
+        addLookup(lut);
+        return *this;
+    }
+
+    //-----------------------------------------------------------------
+    ColorTransform&
+    ColorTransform::replaceColor(const RGBA& color, const RGBA& newColor)
+    {
+        return remap(&color, &newColor, 1);
+    }
+
+    //-----------------------------------------------------------------
+    ColorTransform&
+    ColorTransform::premultiply()
+    {
+        _stages.push_back(Stage(ST_PREMULTIPLY));
+        return *this;
+    }
+
+    //-----------------------------------------------------------------
+    ColorTransform&
+    ColorTransform::unpremultiply()
+    {
+        _stages.push_back(Stage(ST_UNPREMULTIPLY));
+        return *this;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ColorTransform::addLookup(const u8 lut[4][256])
+    {
+        if (!_stages.empty() && _stages.back().type == ST_LOOKUP) {
+            Stage& last = _stages.back();
+            for (int c = 0; c < 4; ++c) {
+                for (int v = 0; v < 256; ++v) {
+                    last.lut[c][v] = lut[c][last.lut[c][v]];
+                }
+            }
+            last.lutChannels = get_lookup_channels(last.lut);
+            last.lutAlpha    = get_constant_lookup_alpha(last.lut);
+            if (last.lutChannels == 0) {
+                _stages.pop_back();
+            }
+        } else if (get_lookup_channels(lut) != 0) {
+            _stages.push_back(Stage(ST_LOOKUP));
+            std::copy(&lut[0][0], &lut[0][0] + 4 * 256, &_stages.back().lut[0][0]);
+            _stages.back().lutChannels = get_lookup_channels(lut);
+            _stages.back().lutAlpha    = get_constant_lookup_alpha(lut);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ColorTransform::addRemap(const std::vector<u32>& colors, const std::vector<u32>& newColors)
+    {
+        // a remap following another one maps the results of the first
+        // and the colors it leaves alone
+        std::map<u32, u32> entries;
+        if (!_stages.empty() && _stages.back().type == ST_REMAP) {
+            Stage& last = _stages.back();
+            for (size_t i = 0; i < last.colors.size(); ++i) {
+                u32 c = last.newColors[i];
+                std::vector<u32>::const_iterator it = std::lower_bound(colors.begin(), colors.end(), c);
+                if (it != colors.end() && *it == c) {
+                    c = newColors[it - colors.begin()];
+                }
+                entries[last.colors[i]] = c;
+            }
+            _stages.pop_back();
+        }
+        for (size_t i = 0; i < colors.size(); ++i) {
+            entries.insert(std::make_pair(colors[i], newColors[i]));
+        }
+
+        Stage stage(ST_REMAP);
+        for (std::map<u32, u32>::iterator it = entries.begin(); it != entries.end(); ++it) {
+            if (it->first != it->second) {
+                stage.colors.push_back(it->first);
+                stage.newColors.push_back(it->second);
+            }
+        }
+        if (stage.colors.empty()) {
+            return;
+        }
+
+        // at most a quarter full, so that most misses end at the first
+        // slot; the empty key is any color not in the table
+        int bits = 2;
+        while ((1 << bits) < (int)stage.colors.size() * 4) {
+            bits++;
+        }
+        stage.emptyKey = 0;
+        while (std::binary_search(stage.colors.begin(), stage.colors.end(), stage.emptyKey)) {
+            stage.emptyKey++;
+        }
+        stage.hashShift = 32 - bits;
+        stage.hashKeys.resize(1 << bits, stage.emptyKey);
+        stage.hashValues.resize(1 << bits, 0);
+        for (size_t i = 0; i < stage.colors.size(); ++i) {
+            u32 h = hash_color_key(stage.colors[i], stage.hashShift);
+            while (stage.hashKeys[h] != stage.emptyKey) {
+                h = (h + 1) & ((1 << bits) - 1);
+            }
+            stage.hashKeys[h]   = stage.colors[i];
+            stage.hashValues[h] = stage.newColors[i];
+        }
+        _stages.push_back(stage);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ColorTransform::ApplyStage(const Stage& stage, RGBA* pixels, int n)
+    {
+        switch (stage.type) {
+            case ST_MATRIX: {
+                GetColorMatrixSpanFunc()(pixels, n, stage.matrix);
+                break;
+            }
+
+            case ST_GREY: {
+                GetGreySpanFunc()(pixels, n);
+                break;
+            }
+
+            case ST_LOOKUP: {
+                if (stage.lutChannels == 8) {
+                    if (stage.lutAlpha >= 0) {
+                        // setAlpha()
+                        u8 alpha = (u8)stage.lutAlpha;
+                        for (int i = 0; i < n; ++i) {
+                            pixels[i].alpha = alpha;
+                        }
+                        break;
+                    }
+                    const u8* lut = stage.lut[3];
+                    for (int i = 0; i < n; ++i) {
+                        pixels[i].alpha = lut[pixels[i].alpha];
+                    }
+                    break;
+                }
+                for (int i = 0; i < n; ++i) {
+                    RGBA& p = pixels[i];
+                    p.red   = stage.lut[0][p.red];
+                    p.green = stage.lut[1][p.green];
+                    p.blue  = stage.lut[2][p.blue];
+                    p.alpha = stage.lut[3][p.alpha];
+                }
+                break;
+            }
+
+            case ST_REMAP: {
+                u32* p = (u32*)pixels;
+                if (stage.colors.size() == 1) {
+                    u32 c = stage.colors[0];
+                    u32 d = stage.newColors[0];
+                    for (int i = 0; i < n; ++i) {
+                        if (p[i] == c) {
+                            p[i] = d;
+                        }
+                    }
+                    break;
+                }
+                // neighboring pixels often have the same color
+                const u32* keys   = &stage.hashKeys[0];
+                const u32* values = &stage.hashValues[0];
+                u32 mask     = (u32)stage.hashKeys.size() - 1;
+                u32 last     = stage.emptyKey;
+                u32 last_new = stage.emptyKey;
+                for (int i = 0; i < n; ++i) {
+                    u32 c = p[i];
+                    if (c == last) {
+                        p[i] = last_new;
+                        continue;
+                    }
+                    last     = c;
+                    last_new = c;
+                    u32 h = hash_color_key(c, stage.hashShift);
+                    while (keys[h] != stage.emptyKey) {
+                        if (keys[h] == c) {
+                            last_new = values[h];
+                            p[i] = last_new;
+                            break;
+                        }
+                        h = (h + 1) & mask;
+                    }
+                }
+                break;
+            }
+
+            case ST_PREMULTIPLY: {
+                PremultiplySpan(pixels, n);
+                break;
+            }
+
+            case ST_UNPREMULTIPLY: {
+                UnpremultiplySpan(pixels, n);
+                break;
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ColorTransform::apply(RGBA* pixels, int n) const
+    {
+        for (int i = 0; i < n; i += COLOR_TRANSFORM_CHUNK_SIZE) {
+            int m = std::min(COLOR_TRANSFORM_CHUNK_SIZE, n - i);
+            for (size_t s = 0; s < _stages.size(); ++s) {
+                ApplyStage(_stages[s], pixels + i, m);
+            }
+        }
+    }
+
+} // namespace sphere
@@ -0,0 +1,113 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_COLORTRANSFORM_HPP
+#define SPHERE_COLORTRANSFORM_HPP
+
+#include <vector>
+#include "../common/types.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    // A sequence of per-pixel color operations, applied to an image in
+    // a single pass. Operations are fused as they are added where the
+    // result doesn't change: consecutive lookup tables are composed, so
+    // are consecutive remaps, and matrices which only scale and offset
+    // each channel are turned into lookup tables. Consecutive matrices
+    // are multiplied, which rounds once instead of after each of them.
+    // grey() has its own exact integer kernel.
+    //
+    // The operations see the stored pixel values, i.e. premultiplied
+    // colors on premultiplied canvases; enclose them in unpremultiply()
+    // and premultiply() to work on straight colors instead.
+    class ColorTransform {
+    public:
+        ColorTransform();
+
+        bool  isIdentity() const;
+        void  reset();
+
+        // 4x5 row major matrix, e.g. red = m[0] * r + m[1] * g + m[2] * b
+        // + m[3] * a + m[4], with channels from 0 to 255
+        ColorTransform& multiply(const float matrix[20]);
+
+        // 256 entry tables indexed by the channel values, 0 for none
+        ColorTransform& lookup(const u8* red, const u8* green, const u8* blue, const u8* alpha);
+
+        // replaces pixels equal to colors[i] with newColors[i]
+        ColorTransform& remap(const RGBA* colors, const RGBA* newColors, int numColors);
+
+        ColorTransform& grey();
+        ColorTransform& tint(const RGBA& color);
+        ColorTransform& setAlpha(int alpha);
+        ColorTransform& replaceColor(const RGBA& color, const RGBA& newColor);
+        ColorTransform& premultiply();
+        ColorTransform& unpremultiply();
+
+        void  apply(RGBA* pixels, int n) const;
+
+    private:
+        enum {
+            ST_MATRIX = 0,
+            ST_GREY,
+            ST_LOOKUP,
+            ST_REMAP,
+            ST_PREMULTIPLY,
+            ST_UNPREMULTIPLY,
+        };
+
+        struct Stage {
+            int   type;
+            float matrix[20];
+            u8    lut[4][256];
+            int   lutChannels;  // bit c is set if lut[c] isn't identity
+            int   lutAlpha;     // the alpha all values map to, or -1
+
+            // remap entries sorted by color, and an open addressing hash
+            // table of them, whose free slots hold emptyKey
+            std::vector<u32> colors;
+            std::vector<u32> newColors;
+            std::vector<u32> hashKeys;
+            std::vector<u32> hashValues;
+            u32   emptyKey;
+            int   hashShift;
+
+            explicit Stage(int type_) : type(type_) { }
+        };
+
+        void  addLookup(const u8 lut[4][256]);
+        void  addRemap(const std::vector<u32>& colors, const std::vector<u32>& newColors);
+
+        static void ApplyStage(const Stage& stage, RGBA* pixels, int n);
+
+    private:
+        std::vector<Stage> _stages;
+    };
+
+    //-----------------------------------------------------------------
+    inline bool
+    ColorTransform::isIdentity() const
+    {
+        return _stages.empty();
+    }
+
+} // namespace sphere
+
+
+#endif
@@ -0,0 +1,123 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <algorithm>
+#include "DirtyRegion.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    static inline int get_area(const Recti& r)
+    {
+        return r.getWidth() * r.getHeight();
+    }
+
+    //-----------------------------------------------------------------
+    static inline Recti get_bounding_box(const Recti& a, const Recti& b)
+    {
+        return Recti(std::min(a.ul.x, b.ul.x), std::min(a.ul.y, b.ul.y),
+                     std::max(a.lr.x, b.lr.x), std::max(a.lr.y, b.lr.y));
+    }
+
+    //-----------------------------------------------------------------
+    // Returns true if the bounding box of a and b covers nothing else
+    static inline bool is_exact_union(const Recti& a, const Recti& b)
+    {
+        return (a.ul.y == b.ul.y && a.lr.y == b.lr.y &&
+                (b.ul.x == a.lr.x + 1 || a.ul.x == b.lr.x + 1)) ||
+               (a.ul.x == b.ul.x && a.lr.x == b.lr.x &&
+                (b.ul.y == a.lr.y + 1 || a.ul.y == b.lr.y + 1));
+    }
+
+    //-----------------------------------------------------------------
+    DirtyRegion::DirtyRegion()
+    {
+    }
+
+    //-----------------------------------------------------------------
+    int
+    DirtyRegion::getArea() const
+    {
+        int area = 0;
+        for (size_t i = 0; i < _rects.size(); ++i) {
+            area += get_area(_rects[i]);
+        }
+        return area;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DirtyRegion::clear()
+    {
+        _rects.clear();
+    }
+
+    //-----------------------------------------------------------------
+    void
+    DirtyRegion::add(const Recti& rect)
+    {
+        if (!rect.isValid()) {
+            return;
+        }
+
+        // absorb the rectangles the new one overlaps or extends exactly,
+        // the bounding box may overlap further ones
+        Recti r = rect;
+        size_t i = 0;
+        while (i < _rects.size()) {
+            if (_rects[i].contains(r)) {
+                return;
+            }
+            if (_rects[i].intersects(r) || is_exact_union(_rects[i], r)) {
+                r = get_bounding_box(_rects[i], r);
+                _rects.erase(_rects.begin() + i);
+                i = 0;
+            } else {
+                i++;
+            }
+        }
+
+        if (_rects.size() < MAX_RECTS) {
+            _rects.push_back(r);
+            return;
+        }
+
+        // merge the pair that wastes the least area
+        _rects.push_back(r);
+        size_t best_a = 0;
+        size_t best_b = 1;
+        int    best_waste = -1;
+        for (size_t a = 0; a < _rects.size(); ++a) {
+            for (size_t b = a + 1; b < _rects.size(); ++b) {
+                int waste = get_area(get_bounding_box(_rects[a], _rects[b])) -
+                            get_area(_rects[a]) - get_area(_rects[b]);
+                if (best_waste < 0 || waste < best_waste) {
+                    best_a = a;
+                    best_b = b;
+                    best_waste = waste;
+                }
+            }
+        }
+        Recti merged = get_bounding_box(_rects[best_a], _rects[best_b]);
+        _rects.erase(_rects.begin() + best_b);
+        _rects.erase(_rects.begin() + best_a);
+        add(merged);
+    }
+
+} // namespace sphere
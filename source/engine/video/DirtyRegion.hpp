@@ -0,0 +1,76 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_DIRTYREGION_HPP
+#define SPHERE_DIRTYREGION_HPP
+
+#include <cassert>
+#include <vector>
+#include "../base/Rect.hpp"
+
+
+namespace sphere {
+
+    // A small set of disjoint rectangles covering everything added to
+    // it. Overlapping rectangles are replaced by their bounding box, and
+    // once there are more than MAX_RECTS, the two whose bounding box adds
+    // the least area are merged.
+    class DirtyRegion {
+    public:
+        enum {
+            MAX_RECTS = 8,
+        };
+
+        DirtyRegion();
+
+        bool  isEmpty() const;
+        int   getNumRects() const;
+        const Recti& getRect(int index) const;
+        int   getArea() const;
+        void  clear();
+        void  add(const Recti& rect);
+
+    private:
+        std::vector<Recti> _rects;
+    };
+
+    //-----------------------------------------------------------------
+    inline bool
+    DirtyRegion::isEmpty() const
+    {
+        return _rects.empty();
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    DirtyRegion::getNumRects() const
+    {
+        return (int)_rects.size();
+    }
+
+    //-----------------------------------------------------------------
+    inline const Recti&
+    DirtyRegion::getRect(int index) const
+    {
+        assert(index >= 0 && index < (int)_rects.size());
+        return _rects[index];
+    }
+
+} // namespace sphere
+
+
+#endif
@@ -0,0 +1,370 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include "../common/platform.hpp"
+#include "EllipseTable.hpp"
+
+#if defined(SPHERE_WINDOWS)
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // The cache, most recently used tables first. Reference counts of
+    // the tables are guarded by the same lock, as they are shared by
+    // canvases of different threads.
+    static std::vector<EllipseTable*> g_Cache;
+
+#if defined(SPHERE_WINDOWS)
+    static SRWLOCK g_Lock = SRWLOCK_INIT;
+#else
+    static pthread_mutex_t g_Lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+    //-----------------------------------------------------------------
+    static inline void lock_cache()
+    {
+#if defined(SPHERE_WINDOWS)
+        AcquireSRWLockExclusive(&g_Lock);
+#else
+        pthread_mutex_lock(&g_Lock);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    static inline void unlock_cache()
+    {
+#if defined(SPHERE_WINDOWS)
+        ReleaseSRWLockExclusive(&g_Lock);
+#else
+        pthread_mutex_unlock(&g_Lock);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    static inline u8 to_u8(double f)
+    {
+        return (u8)(std::min(std::max(f, 0.0), 1.0) * 255.0 + 0.5);
+    }
+
+    //-----------------------------------------------------------------
+    // Coverage of the pixel at (i, k) of the quadrant, from the
+    // distance of its center to the rim
+    static inline u8 get_coverage(double rx, double ry, int i, int k)
+    {
+        return to_u8(0.5 - EllipseTable::GetDistance(rx, ry, i + 0.5, k + 0.5));
+    }
+
+    //-----------------------------------------------------------------
+    // Gradient factor of the pixel at (i, k) of the quadrant
+    static inline u8 get_gradient(double rx, double ry, int i, int k)
+    {
+        const double PI_H = 3.14159265358979 / 2.0;
+
+        double x = (i + 1.0) / rx;
+        double y = (k + 1.0) / ry;
+        double dist = std::min(sqrt(x * x + y * y), 1.0);
+        return to_u8(sin((1.0 - dist) * PI_H));
+    }
+
+    //-----------------------------------------------------------------
+    double
+    EllipseTable::GetDistance(double rx, double ry, double x, double y)
+    {
+        // first order approximation from the implicit function
+        // sqrt((x/rx)^2 + (y/ry)^2) - 1 and its gradient
+        x /= rx;
+        y /= ry;
+        double g = sqrt(x * x + y * y);
+        if (g == 0.0) {
+            return -std::min(rx, ry);
+        }
+        double gx = x / rx;
+        double gy = y / ry;
+        return (g - 1.0) * g / sqrt(gx * gx + gy * gy);
+    }
+
+    //-----------------------------------------------------------------
+    EllipseTable*
+    EllipseTable::Get(int radiusX, int radiusY, bool gradient)
+    {
+        assert(radiusX > 0 && radiusY > 0);
+
+        lock_cache();
+
+        EllipseTable* table = 0;
+        for (size_t i = 0; i < g_Cache.size(); ++i) {
+            if (g_Cache[i]->_radiusX == radiusX && g_Cache[i]->_radiusY == radiusY) {
+                table = g_Cache[i];
+                g_Cache.erase(g_Cache.begin() + i);
+                break;
+            }
+        }
+        if (!table) {
+            table = new EllipseTable(radiusX, radiusY);
+        }
+        if (gradient && !table->hasGradient()) {
+            table->buildGradient();
+        }
+        g_Cache.insert(g_Cache.begin(), table);
+        table->_count++;  // for the caller
+
+        // evict the least recently used tables, which may be the new one
+        size_t size = 0;
+        for (size_t i = 0; i < g_Cache.size(); ++i) {
+            size += g_Cache[i]->getSize();
+        }
+        std::vector<EllipseTable*> evicted;
+        while (!g_Cache.empty() && (g_Cache.size() > MAX_CACHED_TABLES || size > MAX_CACHE_SIZE)) {
+            EllipseTable* last = g_Cache.back();
+            g_Cache.pop_back();
+            size -= last->getSize();
+            evicted.push_back(last);
+        }
+
+        unlock_cache();
+
+        for (size_t i = 0; i < evicted.size(); ++i) {
+            evicted[i]->drop();
+        }
+        return table;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    EllipseTable::ClearCache()
+    {
+        lock_cache();
+        std::vector<EllipseTable*> evicted;
+        evicted.swap(g_Cache);
+        unlock_cache();
+
+        for (size_t i = 0; i < evicted.size(); ++i) {
+            evicted[i]->drop();
+        }
+    }
+
+    //-----------------------------------------------------------------
+    EllipseTable::EllipseTable(int radiusX, int radiusY)
+        : _count(1)
+        , _radiusX(radiusX)
+        , _radiusY(radiusY)
+    {
+        buildSpans();
+        buildCoverage();
+    }
+
+    //-----------------------------------------------------------------
+    EllipseTable::~EllipseTable()
+    {
+    }
+
+    //-----------------------------------------------------------------
+    void
+    EllipseTable::grab()
+    {
+        lock_cache();
+        _count++;
+        unlock_cache();
+    }
+
+    //-----------------------------------------------------------------
+    void
+    EllipseTable::drop()
+    {
+        lock_cache();
+        bool last = (--_count == 0);
+        unlock_cache();
+
+        if (last) {
+            delete this;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    size_t
+    EllipseTable::getSize() const
+    {
+        return sizeof(*this) +
+            (_spans.size() + _gradientSpans.size() + _innerSpans.size() +
+             _outerSpans.size() + _coverageRows.size() + _gradientRows.size()) * sizeof(int) +
+            _coverage.size() + _gradient.size();
+    }
+
+    //-----------------------------------------------------------------
+    void
+    EllipseTable::buildSpans()
+    {
+        int rx = _radiusX;
+        int ry = _radiusY;
+
+        _spans.assign(ry, 0);
+        _gradientSpans.assign(ry, 0);
+
+        if (rx != ry) {
+            for (int k = 0; k < ry; ++k) {
+                double y = (k + 0.5) / ry;
+                int w = (int)(rx * sqrt(std::max(1.0 - y * y, 0.0)) + 0.5);
+                _spans[k] = std::min(w, rx);
+            }
+            _gradientSpans = _spans;
+            return;
+        }
+
+        // midpoint circle, every row is reached exactly once
+        int r     = rx;
+        int f     = 1 - r;
+        int ddF_x = 0;
+        int ddF_y = -2 * r;
+        int ix    = 0;
+        int iy    = r;
+
+        while (ix < iy) {
+            ix++;
+            ddF_x += 2;
+            f     += ddF_x + 1;
+
+            _spans[ix - 1] = iy;
+
+            if (f >= 0) {
+                if (ix != iy) {
+                    _spans[iy - 1] = ix;
+                }
+                iy--;
+                ddF_y += 2;
+                f     += ddF_y;
+            }
+        }
+
+        // the gradient circle goes through the points (ix, n) of an
+        // octant with ix <= n <= iy and mirrors them, iy being chosen
+        // for every ix to stay closest to the radius
+        std::vector<int> iys;
+        ix = 1;
+        iy = r;
+        while (ix <= iy) {
+            iys.push_back(iy);
+            ix++;
+            if (std::abs(ix*ix + iy*iy - r*r) > std::abs(ix*ix + (iy-1)*(iy-1) - r*r)) {
+                iy--;
+            }
+        }
+
+        int m = (int)iys.size();
+        int last = m;  // last ix with iys[ix - 1] >= n
+        for (int n = 1; n <= r; ++n) {
+            while (last > 0 && iys[last - 1] < n) {
+                last--;
+            }
+            int w = std::min(n, last);
+            if (n <= m) {
+                w = std::max(w, iys[n - 1]);
+            }
+            _gradientSpans[n - 1] = w;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    EllipseTable::buildCoverage()
+    {
+        int rx = _radiusX;
+        int ry = _radiusY;
+
+        _innerSpans.assign(ry, 0);
+        _outerSpans.assign(ry, 0);
+        _coverageRows.assign(ry, 0);
+        _coverage.clear();
+
+        for (int k = 0; k < ry; ++k) {
+            // the coverage falls off along a row, so search the
+            // first column not fully and the first one not at all covered
+            int lo = 0;
+            int hi = rx;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (get_coverage(rx, ry, mid, k) == 255) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            int inner = lo;
+            hi = rx;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (get_coverage(rx, ry, mid, k) != 0) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            _innerSpans[k]   = inner;
+            _outerSpans[k]   = lo;
+            _coverageRows[k] = (int)_coverage.size();
+            for (int i = inner; i < lo; ++i) {
+                _coverage.push_back(get_coverage(rx, ry, i, k));
+            }
+        }
+        _coverage.push_back(0);  // so getCoverage() is valid for empty rows
+    }
+
+    //-----------------------------------------------------------------
+    void
+    EllipseTable::computeGradient(int row, int begin, int end, u8* factors) const
+    {
+        for (int i = begin; i < end; ++i) {
+            factors[i] = get_gradient(_radiusX, _radiusY, i, row);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    EllipseTable::buildGradient()
+    {
+        int ry = _radiusY;
+
+        std::vector<int> rows(ry);
+        size_t size = 0;
+        for (int k = 0; k < ry; ++k) {
+            rows[k] = (int)size;
+            size += std::max(_gradientSpans[k], _outerSpans[k]);
+        }
+
+        // a table this large wouldn't stay cached, and a clipped
+        // shape only needs the factors of few of its pixels
+        if (size > MAX_CACHE_SIZE) {
+            return;
+        }
+        _gradient.resize(size + 1);
+
+        for (int k = 0; k < ry; ++k) {
+            computeGradient(k, 0, std::max(_gradientSpans[k], _outerSpans[k]), &_gradient[rows[k]]);
+        }
+        _gradient.back() = 0;
+        _gradientRows.swap(rows);
+    }
+
+} // namespace sphere
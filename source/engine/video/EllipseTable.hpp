@@ -0,0 +1,173 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_ELLIPSETABLE_HPP
+#define SPHERE_ELLIPSETABLE_HPP
+
+#include <cstddef>
+#include <vector>
+#include "../common/types.hpp"
+#include "../common/IRefCounted.hpp"
+
+
+namespace sphere {
+
+    // Row extents of a filled ellipse with the radii rx and ry around the
+    // pixel corner (x, y), which covers the columns x - rx to x + rx - 1
+    // and the rows y - ry to y + ry - 1. Only a quadrant is stored: row k
+    // stands for the rows y + k and y - 1 - k, column i for the columns
+    // x + i and x - 1 - i. Circles keep the spans of the midpoint
+    // algorithm they have always been drawn with.
+    //
+    // Tables are shared between canvases and kept in a small cache of
+    // the most recently used radii, so drawing many shapes of the same
+    // size only costs the span fills.
+    class EllipseTable : public IRefCounted {
+    public:
+        enum {
+            MAX_CACHED_TABLES = 64,
+            MAX_CACHE_SIZE    = 4 * 1024 * 1024,   // bytes
+        };
+
+        // returns a grabbed table, the gradient is only built on request
+        static EllipseTable* Get(int radiusX, int radiusY, bool gradient);
+        static void ClearCache();
+
+        // approximate signed distance of the point (x, y) from the rim
+        // of an ellipse around the origin, negative inside of it
+        static double GetDistance(double rx, double ry, double x, double y);
+
+        virtual void grab();
+        virtual void drop();
+
+        int getRadiusX() const;
+        int getRadiusY() const;
+        size_t getSize() const;
+
+        // filled columns of the aliased shape
+        int getSpan(int row) const;
+
+        // columns of the aliased gradient
+        int getGradientSpan(int row) const;
+
+        // fully and partially covered columns of the anti-aliased shape,
+        // with the coverage of the columns in between (0 - 255)
+        int getInnerSpan(int row) const;
+        int getOuterSpan(int row) const;
+        const u8* getCoverage(int row) const;
+
+        // gradient factors from 255 at the center to 0 at the rim, for
+        // the gradient span and the outer span of the row, whichever is
+        // longer. Tables whose factors would exceed MAX_CACHE_SIZE don't
+        // keep them, computeGradient() writes those of the columns begin
+        // to end - 1 of a row to factors[begin] and on instead.
+        bool hasGradient() const;
+        const u8* getGradient(int row) const;
+        void computeGradient(int row, int begin, int end, u8* factors) const;
+
+    private:
+        EllipseTable(int radiusX, int radiusY);
+        ~EllipseTable();
+
+        void buildSpans();
+        void buildCoverage();
+        void buildGradient();
+
+        EllipseTable(const EllipseTable&);
+        EllipseTable& operator=(const EllipseTable&);
+
+    private:
+        int _count;
+        int _radiusX;
+        int _radiusY;
+        std::vector<int> _spans;
+        std::vector<int> _gradientSpans;
+        std::vector<int> _innerSpans;
+        std::vector<int> _outerSpans;
+        std::vector<int> _coverageRows;
+        std::vector<u8>  _coverage;
+        std::vector<int> _gradientRows;
+        std::vector<u8>  _gradient;
+    };
+
+    //-----------------------------------------------------------------
+    inline int
+    EllipseTable::getRadiusX() const
+    {
+        return _radiusX;
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    EllipseTable::getRadiusY() const
+    {
+        return _radiusY;
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    EllipseTable::getSpan(int row) const
+    {
+        return _spans[row];
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    EllipseTable::getGradientSpan(int row) const
+    {
+        return _gradientSpans[row];
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    EllipseTable::getInnerSpan(int row) const
+    {
+        return _innerSpans[row];
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    EllipseTable::getOuterSpan(int row) const
+    {
+        return _outerSpans[row];
+    }
+
+    //-----------------------------------------------------------------
+    inline const u8*
+    EllipseTable::getCoverage(int row) const
+    {
+        return &_coverage[0] + _coverageRows[row];
+    }
+
+    //-----------------------------------------------------------------
+    inline bool
+    EllipseTable::hasGradient() const
+    {
+        return !_gradientRows.empty();
+    }
+
+    //-----------------------------------------------------------------
+    inline const u8*
+    EllipseTable::getGradient(int row) const
+    {
+        return &_gradient[0] + _gradientRows[row];
+    }
+
+} // namespace sphere
+
+
+#endif
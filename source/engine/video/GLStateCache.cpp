@@ -0,0 +1,174 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "GLStateCache.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    GLStateCache::GLStateCache()
+        : _blendEquationFunc(0)
+    {
+        invalidate();
+        _stats.issued = 0;
+        _stats.filtered = 0;
+        _frameStats = _stats;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    GLStateCache::invalidate()
+    {
+        _textureValid = false;
+        for (int i = 0; i < NUM_CAPS; ++i) {
+            _caps[i] = -1;
+        }
+        _blendFuncValid = false;
+        _blendEquationValid = false;
+        _scissorValid = false;
+        _colorValid = false;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    GLStateCache::setBlendEquationFunc(BLENDEQUATIONFUNC blendEquation)
+    {
+        _blendEquationFunc = blendEquation;
+        _blendEquationValid = false;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    GLStateCache::deleteTexture(GLuint texture)
+    {
+        glDeleteTextures(1, &texture);
+
+        // deleting the bound texture binds the default texture
+        if (_textureValid && _texture == texture) {
+            _texture = 0;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    int
+    GLStateCache::GetCapIndex(GLenum cap)
+    {
+        switch (cap) {
+            case GL_TEXTURE_2D:   return CAP_TEXTURE_2D;
+            case GL_BLEND:        return CAP_BLEND;
+            case GL_SCISSOR_TEST: return CAP_SCISSOR_TEST;
+            default:              return -1;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    GLStateCache::setCap(GLenum cap, bool enabled)
+    {
+        // caps which aren't shadowed are always passed on
+        int i = GetCapIndex(cap);
+        if (i >= 0) {
+            if (_caps[i] == (enabled ? 1 : 0)) {
+                ++_stats.filtered;
+                return;
+            }
+            _caps[i] = (enabled ? 1 : 0);
+        }
+        if (enabled) {
+            glEnable(cap);
+        } else {
+            glDisable(cap);
+        }
+        ++_stats.issued;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    GLStateCache::blendFunc(GLenum src, GLenum dst)
+    {
+        if (_blendFuncValid && _blendSrc == src && _blendDst == dst) {
+            ++_stats.filtered;
+            return;
+        }
+        glBlendFunc(src, dst);
+        _blendFuncValid = true;
+        _blendSrc = src;
+        _blendDst = dst;
+        ++_stats.issued;
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    GLStateCache::blendEquation(GLenum mode)
+    {
+        if (!_blendEquationFunc) {
+            return false;
+        }
+        if (_blendEquationValid && _blendEquation == mode) {
+            ++_stats.filtered;
+            return true;
+        }
+        _blendEquationFunc(mode);
+        _blendEquationValid = true;
+        _blendEquation = mode;
+        ++_stats.issued;
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    GLStateCache::scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        if (_scissorValid &&
+            _scissor[0] == x && _scissor[1] == y &&
+            _scissor[2] == width && _scissor[3] == height)
+        {
+            ++_stats.filtered;
+            return;
+        }
+        glScissor(x, y, width, height);
+        _scissorValid = true;
+        _scissor[0] = x;
+        _scissor[1] = y;
+        _scissor[2] = width;
+        _scissor[3] = height;
+        ++_stats.issued;
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    GLStateCache::getScissor(GLint box[4]) const
+    {
+        if (!_scissorValid) {
+            return false;
+        }
+        for (int i = 0; i < 4; ++i) {
+            box[i] = _scissor[i];
+        }
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    GLStateCache::endFrame()
+    {
+        _frameStats = _stats;
+        _stats.issued = 0;
+        _stats.filtered = 0;
+    }
+
+} // namespace sphere
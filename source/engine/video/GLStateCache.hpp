@@ -0,0 +1,178 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SPHERE_GLSTATECACHE_HPP
+#define SPHERE_GLSTATECACHE_HPP
+
+#ifdef _WIN32
+#  include <windows.h>
+#endif
+#include <GL/gl.h>
+#include "../common/types.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    // Shadows the GL state the video backend changes and filters out the
+    // calls which wouldn't change it. Nothing is known about the state
+    // initially, so the first call of each kind is always issued, and
+    // invalidate() forgets everything again, e.g. after other code
+    // changed the state. The state must only be changed through the
+    // cache while it is known.
+    class GLStateCache {
+    public:
+        typedef void (APIENTRY *BLENDEQUATIONFUNC)(GLenum);
+
+        struct Stats {
+            u64 issued;    // state calls passed on to GL
+            u64 filtered;  // state calls dropped as no-ops
+        };
+
+        GLStateCache();
+
+        void  invalidate();
+        void  setBlendEquationFunc(BLENDEQUATIONFUNC blendEquation);
+        bool  hasBlendEquation() const;
+
+        void  bindTexture(GLuint texture);
+        void  deleteTexture(GLuint texture);
+        void  enable(GLenum cap);
+        void  disable(GLenum cap);
+        void  blendFunc(GLenum src, GLenum dst);
+        bool  blendEquation(GLenum mode);
+        void  scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+        bool  getScissor(GLint box[4]) const;
+        void  color(const RGBA& color);
+        void  invalidateColor();
+
+        // the counts of the current frame and of the one before it
+        const Stats& getStats() const;
+        const Stats& getFrameStats() const;
+        void  endFrame();
+
+    private:
+        enum {
+            CAP_TEXTURE_2D = 0,
+            CAP_BLEND,
+            CAP_SCISSOR_TEST,
+            NUM_CAPS,
+        };
+
+        static int GetCapIndex(GLenum cap);
+
+        void setCap(GLenum cap, bool enabled);
+
+    private:
+        BLENDEQUATIONFUNC _blendEquationFunc;
+
+        // unknown state has a valid flag of false, or a cap of -1
+        bool    _textureValid;
+        GLuint  _texture;
+        int     _caps[NUM_CAPS];
+        bool    _blendFuncValid;
+        GLenum  _blendSrc;
+        GLenum  _blendDst;
+        bool    _blendEquationValid;
+        GLenum  _blendEquation;
+        bool    _scissorValid;
+        GLint   _scissor[4];
+        bool    _colorValid;
+        RGBA    _color;
+
+        Stats   _stats;
+        Stats   _frameStats;
+    };
+
+    //-----------------------------------------------------------------
+    inline bool
+    GLStateCache::hasBlendEquation() const
+    {
+        return _blendEquationFunc != 0;
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    GLStateCache::invalidateColor()
+    {
+        _colorValid = false;
+    }
+
+    //-----------------------------------------------------------------
+    inline const GLStateCache::Stats&
+    GLStateCache::getStats() const
+    {
+        return _stats;
+    }
+
+    //-----------------------------------------------------------------
+    inline const GLStateCache::Stats&
+    GLStateCache::getFrameStats() const
+    {
+        return _frameStats;
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    GLStateCache::bindTexture(GLuint texture)
+    {
+        if (_textureValid && _texture == texture) {
+            ++_stats.filtered;
+            return;
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        _textureValid = true;
+        _texture = texture;
+        ++_stats.issued;
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    GLStateCache::enable(GLenum cap)
+    {
+        setCap(cap, true);
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    GLStateCache::disable(GLenum cap)
+    {
+        setCap(cap, false);
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    GLStateCache::color(const RGBA& color)
+    {
+        if (_colorValid &&
+            _color.red   == color.red   &&
+            _color.green == color.green &&
+            _color.blue  == color.blue  &&
+            _color.alpha == color.alpha)
+        {
+            ++_stats.filtered;
+            return;
+        }
+        glColor4ubv((const GLubyte*)&color);
+        _colorValid = true;
+        _color = color;
+        ++_stats.issued;
+    }
+
+} // namespace sphere
+
+
+#endif
@@ -0,0 +1,42 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_IPIXELALLOCATOR_HPP
+#define SPHERE_IPIXELALLOCATOR_HPP
+
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    // Provides the pixel storage of canvases. The contents of allocated
+    // blocks are undefined. A block is released with the allocator that
+    // returned it, possibly on another thread, so the allocator has to be
+    // thread-safe and outlive the blocks it hands out.
+    class IPixelAllocator {
+    public:
+        virtual RGBA* allocate(int numPixels) = 0;
+        virtual void  deallocate(RGBA* pixels, int numPixels) = 0;
+
+    protected:
+        virtual ~IPixelAllocator() { }
+    };
+
+} // namespace sphere
+
+
+#endif
@@ -15,3 +15,28 @@
     along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef SPHERE_ITEXTURE_HPP
+#define SPHERE_ITEXTURE_HPP
+
+#include "../common/RefPtr.hpp"
+#include "../common/IRefCounted.hpp"
+#include "../base/Dim2.hpp"
+
+
+namespace sphere {
+
+    // An image uploaded to a video device. getSize() is the size of the
+    // image, getTextureSize() the size of the storage holding it, which
+    // may be larger if the device pads textures.
+    class ITexture : public IRefCounted {
+    public:
+        virtual const Dim2i& getTextureSize() const = 0;
+        virtual const Dim2i& getSize() const = 0;
+    };
+
+    typedef RefPtr<ITexture> TexturePtr;
+
+} // namespace sphere
+
+
+#endif
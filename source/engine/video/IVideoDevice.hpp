@@ -15,3 +15,69 @@
     along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef SPHERE_IVIDEODEVICE_HPP
+#define SPHERE_IVIDEODEVICE_HPP
+
+#include <string>
+#include <vector>
+#include "../common/RefPtr.hpp"
+#include "../common/IRefCounted.hpp"
+#include "../base/Dim2.hpp"
+#include "../base/Rect.hpp"
+#include "Canvas.hpp"
+#include "ITexture.hpp"
+
+
+namespace sphere {
+
+    // The video function set as an interface, so the backend can be
+    // chosen at runtime. Blend modes are those of Canvas::BlendMode,
+    // points and rectangles are inclusive like those of Canvas and the
+    // corners of quads and textured triangles lie on pixel corners.
+    // Textures may only be used with the device that created them.
+    class IVideoDevice : public IRefCounted {
+    public:
+        virtual const Dim2i& getDefaultDisplayMode() = 0;
+        virtual const std::vector<Dim2i>& getDisplayModes() = 0;
+        virtual bool  setWindowMode(int width, int height, bool fullScreen) = 0;
+        virtual const Dim2i& getWindowSize() = 0;
+        virtual bool  isWindowFullScreen() = 0;
+        virtual bool  isWindowActive() = 0;
+        virtual const std::string& getWindowTitle() = 0;
+        virtual void  setWindowTitle(const std::string& title) = 0;
+        virtual void  setWindowIcon(Canvas* icon) = 0;
+        virtual void  swapWindowBuffers() = 0;
+        virtual const Recti& getFrameScissor() = 0;
+        virtual bool  setFrameScissor(const Recti& scissor) = 0;
+        virtual Canvas* cloneFrame(Recti* section = 0) = 0;
+        virtual int   getBlendMode() = 0;
+        virtual bool  setBlendMode(int blendMode) = 0;
+        virtual ITexture* createTexture(int width, int height, const RGBA* pixels = 0) = 0;
+        virtual ITexture* createTexture(Canvas* canvas) = 0;
+        virtual bool  updateTexturePixels(ITexture* texture, Canvas* newPixels, Recti* rect = 0) = 0;
+        virtual bool  updateTextureDirtyPixels(ITexture* texture, Canvas* canvas) = 0;
+        virtual Canvas* grabTexturePixels(ITexture* texture) = 0;
+        virtual bool  captureFrame(const Recti& rect) = 0;
+        virtual void  drawCaptureQuad(const Recti& rect, Vec2i pos[4], const RGBA& mask) = 0;
+        virtual void  drawPoint(const Vec2i& pos, const RGBA& color) = 0;
+        virtual void  drawLine(Vec2i pos[2], RGBA col[2]) = 0;
+        virtual void  drawTriangle(Vec2i pos[3], RGBA col[3]) = 0;
+        virtual void  drawRect(const Recti& rect, RGBA col[4]) = 0;
+        virtual void  drawImage(ITexture* image, const Vec2i& pos, const RGBA& mask) = 0;
+        virtual void  drawSubImage(ITexture* image, const Recti& rect, const Vec2i& pos, const RGBA& mask) = 0;
+        virtual void  drawImageQuad(ITexture* image, Vec2i pos[4], const RGBA& mask) = 0;
+        virtual void  drawSubImageQuad(ITexture* image, const Recti& rect, Vec2i pos[4], const RGBA& mask) = 0;
+        virtual void  drawTexturedTriangle(ITexture* image, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask) = 0;
+    };
+
+    typedef RefPtr<IVideoDevice> VideoDevicePtr;
+
+    // Creates the video device of the named backend, or returns 0 if
+    // there is no such backend. Only "software" is implemented, the
+    // OpenGL backend in win_video.cpp isn't ported to IVideoDevice yet.
+    IVideoDevice* CreateVideoDevice(const std::string& name);
+
+} // namespace sphere
+
+
+#endif
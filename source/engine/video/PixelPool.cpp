@@ -0,0 +1,504 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <cstdlib>
+#include "../common/platform.hpp"
+#include "PixelPool.hpp"
+
+#if defined(SPHERE_WINDOWS)
+#  include <windows.h>
+#  include <malloc.h>
+#else
+#  include <pthread.h>
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Size classes: 64, 128, 192 and 256 bytes, then four steps for
+    // every power of two up to MAX_BLOCK_SIZE
+    static const int NUM_SIZE_CLASSES = 4 + 4 * (22 - 8);
+
+    //-----------------------------------------------------------------
+    static inline int get_size_class(size_t size)
+    {
+        if (size <= 256) {
+            return size == 0 ? 0 : (int)((size - 1) / 64);
+        }
+        int p = 8;
+        while (((size_t)2 << p) < size) {
+            p++;
+        }
+        return 4 + (p - 8) * 4 + (int)((size - 1 - ((size_t)1 << p)) >> (p - 2));
+    }
+
+    //-----------------------------------------------------------------
+    static inline size_t get_class_size(int index)
+    {
+        if (index < 4) {
+            return (size_t)64 * (index + 1);
+        }
+        int p = 8 + (index - 4) / 4;
+        int k = (index - 4) % 4 + 1;
+        return ((size_t)1 << p) + k * ((size_t)1 << (p - 2));
+    }
+
+    //-----------------------------------------------------------------
+    static inline void* aligned_alloc_block(size_t size)
+    {
+#if defined(SPHERE_WINDOWS)
+        return _aligned_malloc(size, PixelPool::ALIGNMENT);
+#else
+        void* p = 0;
+        if (posix_memalign(&p, PixelPool::ALIGNMENT, size) != 0) {
+            return 0;
+        }
+        return p;
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    static inline void aligned_free_block(void* p)
+    {
+#if defined(SPHERE_WINDOWS)
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+#if defined(SPHERE_WINDOWS)
+    typedef CRITICAL_SECTION Mutex;
+#else
+    typedef pthread_mutex_t Mutex;
+#endif
+
+    //-----------------------------------------------------------------
+    static inline void init_mutex(Mutex& mutex)
+    {
+#if defined(SPHERE_WINDOWS)
+        InitializeCriticalSection(&mutex);
+#else
+        pthread_mutex_init(&mutex, 0);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    static inline void destroy_mutex(Mutex& mutex)
+    {
+#if defined(SPHERE_WINDOWS)
+        DeleteCriticalSection(&mutex);
+#else
+        pthread_mutex_destroy(&mutex);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    static inline void lock_mutex(Mutex& mutex)
+    {
+#if defined(SPHERE_WINDOWS)
+        EnterCriticalSection(&mutex);
+#else
+        pthread_mutex_lock(&mutex);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    static inline void unlock_mutex(Mutex& mutex)
+    {
+#if defined(SPHERE_WINDOWS)
+        LeaveCriticalSection(&mutex);
+#else
+        pthread_mutex_unlock(&mutex);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    // Free blocks are linked through their first bytes
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    //-----------------------------------------------------------------
+    static inline void free_blocks(FreeBlock* lists[NUM_SIZE_CLASSES])
+    {
+        for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+            while (lists[i]) {
+                FreeBlock* block = lists[i];
+                lists[i] = block->next;
+                aligned_free_block(block);
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // A thread cache is only used by its thread, its lock is there for
+    // getStats() and trim(), so it is hardly ever contended. The lock of
+    // the pool may be held while locking a cache, not the other way.
+    struct PixelPool::Impl {
+        struct ThreadCache {
+            Impl*        pool;
+            ThreadCache* prev;
+            ThreadCache* next;
+            Mutex        mutex;
+            FreeBlock*   lists[NUM_SIZE_CLASSES];
+            size_t       bytes;
+            size_t       maxBytes;  // set aside of maxPooledBytes
+            u64          hits;
+        };
+
+        Mutex        mutex;
+#if defined(SPHERE_WINDOWS)
+        DWORD        key;
+#else
+        pthread_key_t key;
+#endif
+        FreeBlock*   lists[NUM_SIZE_CLASSES];
+        size_t       maxPooledBytes;
+        size_t       pooledBytes;
+        size_t       reservedBytes;  // of the thread caches
+        ThreadCache* caches;
+        u64          hits;     // of the pool and the exited threads
+        u64          misses;
+
+        Impl(size_t maxPooledBytes);
+        ~Impl();
+
+        void lock();
+        void unlock();
+
+        ThreadCache* getThreadCache();
+        void releaseThreadCache(ThreadCache* cache);
+
+        FreeBlock* popShared(int sizeClass);
+        void pushShared(FreeBlock* block, int sizeClass);
+        void countMiss();
+
+#if defined(SPHERE_WINDOWS)
+        static VOID WINAPI ThreadExit(PVOID arg);
+#else
+        static void ThreadExit(void* arg);
+#endif
+    };
+
+    //-----------------------------------------------------------------
+    PixelPool::Impl::Impl(size_t maxPooledBytes_)
+        : maxPooledBytes(maxPooledBytes_)
+        , pooledBytes(0)
+        , reservedBytes(0)
+        , caches(0)
+        , hits(0)
+        , misses(0)
+    {
+        for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+            lists[i] = 0;
+        }
+        init_mutex(mutex);
+#if defined(SPHERE_WINDOWS)
+        key = FlsAlloc(ThreadExit);
+#else
+        pthread_key_create(&key, ThreadExit);
+#endif
+    }
+
+    //-----------------------------------------------------------------
+    PixelPool::Impl::~Impl()
+    {
+#if defined(SPHERE_WINDOWS)
+        FlsFree(key);
+#else
+        pthread_key_delete(key);
+#endif
+        while (caches) {
+            ThreadCache* cache = caches;
+            caches = cache->next;
+            free_blocks(cache->lists);
+            destroy_mutex(cache->mutex);
+            delete cache;
+        }
+        free_blocks(lists);
+        destroy_mutex(mutex);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    PixelPool::Impl::lock()
+    {
+        lock_mutex(mutex);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    PixelPool::Impl::unlock()
+    {
+        unlock_mutex(mutex);
+    }
+
+    //-----------------------------------------------------------------
+    PixelPool::Impl::ThreadCache*
+    PixelPool::Impl::getThreadCache()
+    {
+#if defined(SPHERE_WINDOWS)
+        ThreadCache* cache = (ThreadCache*)FlsGetValue(key);
+#else
+        ThreadCache* cache = (ThreadCache*)pthread_getspecific(key);
+#endif
+        if (cache) {
+            return cache;
+        }
+
+        cache = new ThreadCache();
+        cache->pool  = this;
+        cache->prev  = 0;
+        cache->bytes = 0;
+        cache->hits  = 0;
+        for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+            cache->lists[i] = 0;
+        }
+        init_mutex(cache->mutex);
+
+        // threads beyond what maxPooledBytes has room for don't cache
+        lock();
+        cache->maxBytes = (reservedBytes + THREAD_CACHE_SIZE <= maxPooledBytes) ? THREAD_CACHE_SIZE : 0;
+        reservedBytes += cache->maxBytes;
+        cache->next = caches;
+        if (caches) {
+            caches->prev = cache;
+        }
+        caches = cache;
+        unlock();
+
+#if defined(SPHERE_WINDOWS)
+        FlsSetValue(key, cache);
+#else
+        pthread_setspecific(key, cache);
+#endif
+        return cache;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    PixelPool::Impl::releaseThreadCache(ThreadCache* cache)
+    {
+        lock();
+        hits += cache->hits;
+        reservedBytes -= cache->maxBytes;
+        if (cache->prev) {
+            cache->prev->next = cache->next;
+        } else {
+            caches = cache->next;
+        }
+        if (cache->next) {
+            cache->next->prev = cache->prev;
+        }
+        unlock();
+
+        // unlinked, so no other thread can reach the cache anymore
+        for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+            while (cache->lists[i]) {
+                FreeBlock* block = cache->lists[i];
+                cache->lists[i] = block->next;
+                pushShared(block, i);
+            }
+        }
+        destroy_mutex(cache->mutex);
+        delete cache;
+    }
+
+    //-----------------------------------------------------------------
+    // Pops a block of the shared pool, counting the hit or the miss
+    FreeBlock*
+    PixelPool::Impl::popShared(int sizeClass)
+    {
+        lock();
+        FreeBlock* block = lists[sizeClass];
+        if (block) {
+            lists[sizeClass] = block->next;
+            pooledBytes -= get_class_size(sizeClass);
+            hits++;
+        } else {
+            misses++;
+        }
+        unlock();
+        return block;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    PixelPool::Impl::pushShared(FreeBlock* block, int sizeClass)
+    {
+        size_t size = get_class_size(sizeClass);
+        lock();
+        bool pooled = (pooledBytes + reservedBytes + size <= maxPooledBytes);
+        if (pooled) {
+            block->next = lists[sizeClass];
+            lists[sizeClass] = block;
+            pooledBytes += size;
+        }
+        unlock();
+        if (!pooled) {
+            aligned_free_block(block);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    PixelPool::Impl::countMiss()
+    {
+        lock();
+        misses++;
+        unlock();
+    }
+
+    //-----------------------------------------------------------------
+#if defined(SPHERE_WINDOWS)
+    VOID WINAPI
+    PixelPool::Impl::ThreadExit(PVOID arg)
+#else
+    void
+    PixelPool::Impl::ThreadExit(void* arg)
+#endif
+    {
+        if (arg) {
+            ThreadCache* cache = (ThreadCache*)arg;
+            cache->pool->releaseThreadCache(cache);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    PixelPool*
+    PixelPool::GetDefault()
+    {
+        static PixelPool* pool = new PixelPool();
+        return pool;
+    }
+
+    //-----------------------------------------------------------------
+    PixelPool::PixelPool(size_t maxPooledBytes)
+        : _impl(new Impl(maxPooledBytes))
+    {
+    }
+
+    //-----------------------------------------------------------------
+    PixelPool::~PixelPool()
+    {
+        delete _impl;
+    }
+
+    //-----------------------------------------------------------------
+    RGBA*
+    PixelPool::allocate(int numPixels)
+    {
+        assert(numPixels > 0);
+        size_t size = (size_t)numPixels * sizeof(RGBA);
+
+        if (size > MAX_BLOCK_SIZE) {
+            _impl->countMiss();
+            return (RGBA*)aligned_alloc_block(size);
+        }
+
+        int sizeClass = get_size_class(size);
+        Impl::ThreadCache* cache = _impl->getThreadCache();
+        lock_mutex(cache->mutex);
+        FreeBlock* block = cache->lists[sizeClass];
+        if (block) {
+            cache->lists[sizeClass] = block->next;
+            cache->bytes -= get_class_size(sizeClass);
+            cache->hits++;
+        }
+        unlock_mutex(cache->mutex);
+
+        if (!block) {
+            block = _impl->popShared(sizeClass);
+        }
+        if (block) {
+            return (RGBA*)block;
+        }
+        return (RGBA*)aligned_alloc_block(get_class_size(sizeClass));
+    }
+
+    //-----------------------------------------------------------------
+    void
+    PixelPool::deallocate(RGBA* pixels, int numPixels)
+    {
+        if (!pixels) {
+            return;
+        }
+        size_t size = (size_t)numPixels * sizeof(RGBA);
+        if (size > MAX_BLOCK_SIZE) {
+            aligned_free_block(pixels);
+            return;
+        }
+
+        int sizeClass = get_size_class(size);
+        size_t classSize = get_class_size(sizeClass);
+        Impl::ThreadCache* cache = _impl->getThreadCache();
+        FreeBlock* block = (FreeBlock*)pixels;
+
+        lock_mutex(cache->mutex);
+        bool cached = (cache->bytes + classSize <= cache->maxBytes);
+        if (cached) {
+            block->next = cache->lists[sizeClass];
+            cache->lists[sizeClass] = block;
+            cache->bytes += classSize;
+        }
+        unlock_mutex(cache->mutex);
+
+        if (!cached) {
+            _impl->pushShared(block, sizeClass);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    PixelPool::Stats
+    PixelPool::getStats() const
+    {
+        Stats stats;
+        _impl->lock();
+        stats.hits        = _impl->hits;
+        stats.misses      = _impl->misses;
+        stats.pooledBytes = _impl->pooledBytes;
+        for (Impl::ThreadCache* cache = _impl->caches; cache; cache = cache->next) {
+            lock_mutex(cache->mutex);
+            stats.hits        += cache->hits;
+            stats.pooledBytes += cache->bytes;
+            unlock_mutex(cache->mutex);
+        }
+        _impl->unlock();
+        return stats;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    PixelPool::trim()
+    {
+        _impl->lock();
+        free_blocks(_impl->lists);
+        _impl->pooledBytes = 0;
+        for (Impl::ThreadCache* cache = _impl->caches; cache; cache = cache->next) {
+            lock_mutex(cache->mutex);
+            free_blocks(cache->lists);
+            cache->bytes = 0;
+            unlock_mutex(cache->mutex);
+        }
+        _impl->unlock();
+    }
+
+} // namespace sphere
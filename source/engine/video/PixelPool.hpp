@@ -0,0 +1,77 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_PIXELPOOL_HPP
+#define SPHERE_PIXELPOOL_HPP
+
+#include <cstddef>
+#include "../common/types.hpp"
+#include "IPixelAllocator.hpp"
+
+
+namespace sphere {
+
+    // The default pixel allocator. Blocks are ALIGNMENT aligned and
+    // rounded up to size classes, four per power of two. Released blocks
+    // go to a small cache of the releasing thread first and to a shared
+    // pool next, from where they are reused by allocations of the same
+    // class. Both hold up to maxPooledBytes together: every thread cache
+    // sets aside THREAD_CACHE_SIZE of them while there is room, the
+    // shared pool gets the rest. Blocks larger than MAX_BLOCK_SIZE
+    // always come from and go back to the system.
+    class PixelPool : public IPixelAllocator {
+    public:
+        enum {
+            ALIGNMENT          = 64,
+            MAX_BLOCK_SIZE     = 4 * 1024 * 1024,
+            THREAD_CACHE_SIZE  = 1024 * 1024,
+            DEFAULT_POOL_SIZE  = 64 * 1024 * 1024,
+        };
+
+        struct Stats {
+            u64 hits;          // allocations served by a cache or the pool
+            u64 misses;        // allocations served by the system
+            u64 pooledBytes;   // bytes held by the pool and the caches
+        };
+
+        // never destroyed, so canvases can outlive static destruction
+        static PixelPool* GetDefault();
+
+        // may only be destroyed once no other thread uses it anymore
+        explicit PixelPool(size_t maxPooledBytes = DEFAULT_POOL_SIZE);
+        virtual ~PixelPool();
+
+        virtual RGBA* allocate(int numPixels);
+        virtual void  deallocate(RGBA* pixels, int numPixels);
+
+        Stats getStats() const;
+        void  trim();
+
+    private:
+        struct Impl;
+
+        PixelPool(const PixelPool&);
+        PixelPool& operator=(const PixelPool&);
+
+    private:
+        Impl* _impl;
+    };
+
+} // namespace sphere
+
+
+#endif
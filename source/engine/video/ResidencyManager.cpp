@@ -0,0 +1,107 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <cassert>
+#include "ResidencyManager.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    ResidencyManager::ResidencyManager(IEvictor* evictor, u64 budget)
+        : _evictor(evictor)
+        , _budget(budget)
+        , _first(0)
+        , _last(0)
+    {
+        assert(evictor);
+        _stats.residentBytes = 0;
+        _stats.pinnedBytes   = 0;
+        _stats.evictions     = 0;
+        _stats.evictedBytes  = 0;
+        _stats.reloads       = 0;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ResidencyManager::setBudget(u64 budget)
+    {
+        _budget = budget;
+        enforceBudget(0);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ResidencyManager::addPinnedBytes(u64 bytes)
+    {
+        _stats.pinnedBytes   += bytes;
+        _stats.residentBytes += bytes;
+        enforceBudget(0);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ResidencyManager::removePinnedBytes(u64 bytes)
+    {
+        assert(bytes <= _stats.pinnedBytes);
+        _stats.pinnedBytes   -= bytes;
+        _stats.residentBytes -= bytes;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ResidencyManager::add(Entry* entry, u64 bytes, bool reload)
+    {
+        assert(entry);
+        assert(!entry->resident);
+        entry->bytes = bytes;
+        entry->resident = true;
+        link(entry);
+        _stats.residentBytes += bytes;
+        if (reload) {
+            ++_stats.reloads;
+        }
+
+        // the new entry stays even if it alone exceeds the budget
+        enforceBudget(entry);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ResidencyManager::remove(Entry* entry)
+    {
+        assert(entry);
+        if (entry->resident) {
+            unlink(entry);
+            entry->resident = false;
+            _stats.residentBytes -= entry->bytes;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    ResidencyManager::enforceBudget(Entry* keep)
+    {
+        while (_budget > 0 && _stats.residentBytes > _budget && _last && _last != keep) {
+            Entry* entry = _last;
+            remove(entry);
+            ++_stats.evictions;
+            _stats.evictedBytes += entry->bytes;
+            _evictor->evict(entry);
+        }
+    }
+
+} // namespace sphere
@@ -0,0 +1,145 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SPHERE_RESIDENCYMANAGER_HPP
+#define SPHERE_RESIDENCYMANAGER_HPP
+
+#include "../common/types.hpp"
+
+
+namespace sphere {
+
+    // Keeps the bytes of resident entries, e.g. textures in video memory,
+    // within a budget by evicting the least recently used ones. Entries
+    // are embedded in the objects they account for, so that touching an
+    // entry on every use is cheap. Pinned bytes count towards the budget
+    // but can't be evicted. A budget of 0 means unlimited.
+    class ResidencyManager {
+    public:
+        struct Entry {
+            Entry* prev;
+            Entry* next;
+            u64    bytes;
+            bool   resident;
+
+            Entry() : prev(0), next(0), bytes(0), resident(false) { }
+        };
+
+        // Evicts an entry on behalf of the manager, which has already
+        // removed it, so the evictor must not call back into the manager
+        class IEvictor {
+        public:
+            virtual void evict(Entry* entry) = 0;
+
+        protected:
+            virtual ~IEvictor() { }
+        };
+
+        struct Stats {
+            u64 residentBytes;  // including the pinned bytes
+            u64 pinnedBytes;
+            u64 evictions;
+            u64 evictedBytes;
+            u64 reloads;        // entries which had to be made resident again on use
+        };
+
+        explicit ResidencyManager(IEvictor* evictor, u64 budget = 0);
+
+        u64   getBudget() const;
+        void  setBudget(u64 budget);
+        const Stats& getStats() const;
+        void  addPinnedBytes(u64 bytes);
+        void  removePinnedBytes(u64 bytes);
+        void  add(Entry* entry, u64 bytes, bool reload = false);
+        void  remove(Entry* entry);
+        void  touch(Entry* entry);
+
+    private:
+        ResidencyManager(const ResidencyManager&);
+        ResidencyManager& operator=(const ResidencyManager&);
+
+        void  link(Entry* entry);
+        void  unlink(Entry* entry);
+        void  enforceBudget(Entry* keep);
+
+    private:
+        IEvictor* _evictor;
+        u64       _budget;
+        Stats     _stats;
+        Entry*    _first;  // the most recently used
+        Entry*    _last;
+    };
+
+    //-----------------------------------------------------------------
+    inline u64
+    ResidencyManager::getBudget() const
+    {
+        return _budget;
+    }
+
+    //-----------------------------------------------------------------
+    inline const ResidencyManager::Stats&
+    ResidencyManager::getStats() const
+    {
+        return _stats;
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    ResidencyManager::link(Entry* entry)
+    {
+        entry->prev = 0;
+        entry->next = _first;
+        if (_first) {
+            _first->prev = entry;
+        } else {
+            _last = entry;
+        }
+        _first = entry;
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    ResidencyManager::unlink(Entry* entry)
+    {
+        if (entry->prev) {
+            entry->prev->next = entry->next;
+        } else {
+            _first = entry->next;
+        }
+        if (entry->next) {
+            entry->next->prev = entry->prev;
+        } else {
+            _last = entry->prev;
+        }
+        entry->prev = 0;
+        entry->next = 0;
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    ResidencyManager::touch(Entry* entry)
+    {
+        if (entry->resident && entry != _first) {
+            unlink(entry);
+            link(entry);
+        }
+    }
+
+} // namespace sphere
+
+
+#endif
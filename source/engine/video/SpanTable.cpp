@@ -0,0 +1,91 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include "SpanTable.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    static inline int get_span_type(const RGBA& c, bool premultiplied)
+    {
+        if (c.alpha == 255) {
+            return SpanTable::ST_OPAQUE;
+        }
+        // premultiplied pixels without alpha still add their color
+        if (c.alpha == 0 && (!premultiplied || (c.red == 0 && c.green == 0 && c.blue == 0))) {
+            return SpanTable::ST_TRANSPARENT;
+        }
+        return SpanTable::ST_TRANSLUCENT;
+    }
+
+    //-----------------------------------------------------------------
+    SpanTable::SpanTable()
+    {
+    }
+
+    //-----------------------------------------------------------------
+    void
+    SpanTable::clear()
+    {
+        _spans.clear();
+        _rows.clear();
+    }
+
+    //-----------------------------------------------------------------
+    void
+    SpanTable::build(const RGBA* pixels, int width, int height, int pitch, bool premultiplied)
+    {
+        assert(pixels);
+        assert(width > 0);
+        assert(height > 0);
+
+        _spans.clear();
+        _rows.resize(height + 1);
+
+        for (int iy = 0; iy < height; ++iy) {
+            _rows[iy] = (int)_spans.size();
+
+            int ix = 0;
+            while (ix < width) {
+                int type   = get_span_type(pixels[ix], premultiplied);
+                int length = 1;
+                while (ix + length < width && get_span_type(pixels[ix + length], premultiplied) == type) {
+                    length++;
+                }
+
+                // short runs cost more to dispatch than to blend
+                if (length < MIN_SPAN_LENGTH) {
+                    type = ST_TRANSLUCENT;
+                }
+
+                int n = (int)_spans.size();
+                if (n > _rows[iy] && GetSpanType(_spans[n - 1]) == type) {
+                    _spans[n - 1] += (u32)length << 2;
+                } else {
+                    _spans.push_back(((u32)length << 2) | type);
+                }
+                ix += length;
+            }
+
+            pixels += pitch;
+        }
+        _rows[height] = (int)_spans.size();
+    }
+
+} // namespace sphere
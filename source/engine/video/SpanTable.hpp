@@ -0,0 +1,97 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_SPANTABLE_HPP
+#define SPHERE_SPANTABLE_HPP
+
+#include <vector>
+#include "../common/types.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    // Runs of fully transparent, fully opaque and translucent pixels
+    // in each row of an image. A run is stored as (length << 2) | type.
+    // Runs shorter than MIN_SPAN_LENGTH are counted as translucent.
+    class SpanTable {
+    public:
+        enum {
+            MIN_SPAN_LENGTH = 8,
+        };
+
+        enum SpanType {
+            ST_TRANSPARENT = 0,
+            ST_OPAQUE,
+            ST_TRANSLUCENT,
+        };
+
+        static int GetSpanLength(u32 span);
+        static int GetSpanType(u32 span);
+
+        SpanTable();
+
+        bool  isEmpty() const;
+        void  clear();
+        void  build(const RGBA* pixels, int width, int height, int pitch, bool premultiplied);
+        int   getNumSpans(int y) const;
+        const u32* getSpans(int y) const;
+
+    private:
+        std::vector<u32> _spans;
+        std::vector<int> _rows;
+    };
+
+    //-----------------------------------------------------------------
+    inline int
+    SpanTable::GetSpanLength(u32 span)
+    {
+        return (int)(span >> 2);
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    SpanTable::GetSpanType(u32 span)
+    {
+        return (int)(span & 3);
+    }
+
+    //-----------------------------------------------------------------
+    inline bool
+    SpanTable::isEmpty() const
+    {
+        return _rows.empty();
+    }
+
+    //-----------------------------------------------------------------
+    inline int
+    SpanTable::getNumSpans(int y) const
+    {
+        return _rows[y + 1] - _rows[y];
+    }
+
+    //-----------------------------------------------------------------
+    inline const u32*
+    SpanTable::getSpans(int y) const
+    {
+        return &_spans[_rows[y]];
+    }
+
+} // namespace sphere
+
+
+#endif
@@ -0,0 +1,52 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <cassert>
+#include "SpriteBatch.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    SpriteBatch::SpriteBatch(IRenderer* renderer, int capacity)
+        : _renderer(renderer)
+        , _vertices(0)
+        , _capacity(capacity)
+        , _numVertices(0)
+        , _texture(0)
+    {
+        assert(renderer);
+        assert(capacity >= 6 && capacity % 3 == 0);
+        _vertices = new Vertex[capacity];
+    }
+
+    //-----------------------------------------------------------------
+    SpriteBatch::~SpriteBatch()
+    {
+        delete[] _vertices;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    SpriteBatch::flush()
+    {
+        if (_numVertices > 0) {
+            _renderer->drawTriangles(_texture, _vertices, _numVertices);
+            _numVertices = 0;
+        }
+    }
+
+} // namespace sphere
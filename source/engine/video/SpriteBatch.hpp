@@ -0,0 +1,138 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SPHERE_SPRITEBATCH_HPP
+#define SPHERE_SPRITEBATCH_HPP
+
+#include "../common/types.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    // Collects textured and colored triangles in a vertex array and
+    // hands them to the renderer in as few draw calls as possible: the
+    // batch is only flushed when the texture changes or the array is
+    // full. Other state the renderer depends on (blend mode, scissor,
+    // the pixels of the textures) must not change while triangles are
+    // queued, so whoever changes it calls flush() first. Texture 0
+    // means untextured.
+    class SpriteBatch {
+    public:
+        struct Vertex {
+            f32  x, y;
+            f32  u, v;
+            RGBA color;
+        };
+
+        // draws a flushed batch, the vertices are only valid during the call
+        class IRenderer {
+        public:
+            virtual void drawTriangles(u32 texture, const Vertex* vertices, int numVertices) = 0;
+
+        protected:
+            virtual ~IRenderer() { }
+        };
+
+        enum {
+            DEFAULT_CAPACITY = 6 * 1024, // vertices
+        };
+
+        explicit SpriteBatch(IRenderer* renderer, int capacity = DEFAULT_CAPACITY);
+        ~SpriteBatch();
+
+        // quads are split into the triangles 0-1-2 and 0-2-3
+        void addQuad(u32 texture, const Vertex quad[4]);
+        void addTriangle(u32 texture, const Vertex triangle[3]);
+        void flush();
+        int  getNumVertices() const;
+
+        static Vertex MakeVertex(f32 x, f32 y, f32 u, f32 v, const RGBA& color);
+
+    private:
+        SpriteBatch(const SpriteBatch&);
+        SpriteBatch& operator=(const SpriteBatch&);
+
+        Vertex* reserve(u32 texture, int numVertices);
+
+    private:
+        IRenderer* _renderer;
+        Vertex*    _vertices;
+        int        _capacity;
+        int        _numVertices;
+        u32        _texture;
+    };
+
+    //-----------------------------------------------------------------
+    inline int
+    SpriteBatch::getNumVertices() const
+    {
+        return _numVertices;
+    }
+
+    //-----------------------------------------------------------------
+    inline SpriteBatch::Vertex
+    SpriteBatch::MakeVertex(f32 x, f32 y, f32 u, f32 v, const RGBA& color)
+    {
+        Vertex vertex;
+        vertex.x = x;
+        vertex.y = y;
+        vertex.u = u;
+        vertex.v = v;
+        vertex.color = color;
+        return vertex;
+    }
+
+    //-----------------------------------------------------------------
+    inline SpriteBatch::Vertex*
+    SpriteBatch::reserve(u32 texture, int numVertices)
+    {
+        if (_numVertices > 0 && (texture != _texture || _numVertices + numVertices > _capacity)) {
+            flush();
+        }
+        _texture = texture;
+        Vertex* vertices = _vertices + _numVertices;
+        _numVertices += numVertices;
+        return vertices;
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    SpriteBatch::addQuad(u32 texture, const Vertex quad[4])
+    {
+        Vertex* v = reserve(texture, 6);
+        v[0] = quad[0];
+        v[1] = quad[1];
+        v[2] = quad[2];
+        v[3] = quad[0];
+        v[4] = quad[2];
+        v[5] = quad[3];
+    }
+
+    //-----------------------------------------------------------------
+    inline void
+    SpriteBatch::addTriangle(u32 texture, const Vertex triangle[3])
+    {
+        Vertex* v = reserve(texture, 3);
+        v[0] = triangle[0];
+        v[1] = triangle[1];
+        v[2] = triangle[2];
+    }
+
+} // namespace sphere
+
+
+#endif
@@ -15,3 +15,42 @@
     along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cassert>
+#include "Texture.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    Texture*
+    Texture::Create(Canvas* pixels)
+    {
+        assert(pixels);
+        return new Texture(pixels);
+    }
+
+    //-----------------------------------------------------------------
+    Texture::Texture(Canvas* pixels)
+        : _size(pixels->getWidth(), pixels->getHeight())
+    {
+        pixels->grab();
+        _canvas = pixels;
+    }
+
+    //-----------------------------------------------------------------
+    Texture::~Texture()
+    {
+    }
+
+    //-----------------------------------------------------------------
+    void
+    Texture::setCanvas(Canvas* pixels)
+    {
+        assert(pixels);
+        assert(pixels->getWidth()  == _size.width);
+        assert(pixels->getHeight() == _size.height);
+        pixels->grab();
+        _canvas = pixels;
+    }
+
+} // namespace sphere
@@ -15,3 +15,62 @@
     along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef SPHERE_TEXTURE_HPP
+#define SPHERE_TEXTURE_HPP
+
+#include "../common/RefImpl.hpp"
+#include "ITexture.hpp"
+#include "Canvas.hpp"
+
+
+namespace sphere {
+
+    // A texture of the software video device, which keeps its pixels in
+    // a canvas of the texture size. The canvas is never modified once it
+    // has been set, updates replace it, so draw calls still queued on a
+    // deferred frame keep the pixels they were made with.
+    class Texture : public RefImpl<ITexture> {
+    public:
+        static Texture* Create(Canvas* pixels);
+
+        Canvas* getCanvas() const;
+        void    setCanvas(Canvas* pixels);
+
+        // ITexture implementation
+        const Dim2i& getTextureSize() const;
+        const Dim2i& getSize() const;
+
+    private:
+        Texture(Canvas* pixels);
+        virtual ~Texture();
+
+    private:
+        CanvasPtr _canvas;
+        Dim2i     _size;
+    };
+
+    //-----------------------------------------------------------------
+    inline Canvas*
+    Texture::getCanvas() const
+    {
+        return _canvas.get();
+    }
+
+    //-----------------------------------------------------------------
+    inline const Dim2i&
+    Texture::getTextureSize() const
+    {
+        return _size;
+    }
+
+    //-----------------------------------------------------------------
+    inline const Dim2i&
+    Texture::getSize() const
+    {
+        return _size;
+    }
+
+} // namespace sphere
+
+
+#endif
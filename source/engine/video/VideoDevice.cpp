@@ -15,3 +15,421 @@
     along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cassert>
+#include "VideoDevice.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    static inline bool is_white(const RGBA& c)
+    {
+        return c.red == 255 && c.green == 255 && c.blue == 255 && c.alpha == 255;
+    }
+
+    //-----------------------------------------------------------------
+    static inline Canvas* get_canvas(ITexture* texture)
+    {
+        assert(texture);
+        return static_cast<Texture*>(texture)->getCanvas();
+    }
+
+    //-----------------------------------------------------------------
+    // shares the pixels of a whole canvas, trimmed for BM_ALPHA blits
+    static inline Canvas* create_texture_view(Canvas* canvas, bool trim)
+    {
+        Canvas* view = canvas->createView(Recti(0, 0, canvas->getWidth() - 1, canvas->getHeight() - 1));
+        if (trim) {
+            view->trim();
+        }
+        return view;
+    }
+
+    //-----------------------------------------------------------------
+    VideoDevice*
+    VideoDevice::Create()
+    {
+        return new VideoDevice();
+    }
+
+    //-----------------------------------------------------------------
+    VideoDevice::VideoDevice()
+        : _defaultDisplayMode(640, 480)
+        , _windowSize(640, 480)
+        , _fullScreen(false)
+        , _blendMode(Canvas::BM_ALPHA)
+    {
+        _displayModes.push_back(_defaultDisplayMode);
+        _frame = createFrame();
+        _frontBuffer = createFrame();
+    }
+
+    //-----------------------------------------------------------------
+    VideoDevice::~VideoDevice()
+    {
+    }
+
+    //-----------------------------------------------------------------
+    Canvas*
+    VideoDevice::createFrame() const
+    {
+        Canvas* frame = Canvas::Create(_windowSize.width, _windowSize.height);
+        frame->fill(RGBA(0, 0, 0, 255));
+        frame->setBlendMode(_blendMode);
+        frame->setDeferred(true);
+        return frame;
+    }
+
+    //-----------------------------------------------------------------
+    Canvas*
+    VideoDevice::getFrontBuffer()
+    {
+        return _frontBuffer.get();
+    }
+
+    //-----------------------------------------------------------------
+    const Dim2i&
+    VideoDevice::getDefaultDisplayMode()
+    {
+        return _defaultDisplayMode;
+    }
+
+    //-----------------------------------------------------------------
+    const std::vector<Dim2i>&
+    VideoDevice::getDisplayModes()
+    {
+        return _displayModes;
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    VideoDevice::setWindowMode(int width, int height, bool fullScreen)
+    {
+        if (width <= 0 || height <= 0) {
+            return false;
+        }
+        if (width != _windowSize.width || height != _windowSize.height) {
+            _windowSize = Dim2i(width, height);
+            _frame = createFrame();
+            _frontBuffer = createFrame();
+            _capture.reset();
+        }
+        _fullScreen = fullScreen;
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    const Dim2i&
+    VideoDevice::getWindowSize()
+    {
+        return _windowSize;
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    VideoDevice::isWindowFullScreen()
+    {
+        return _fullScreen;
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    VideoDevice::isWindowActive()
+    {
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    const std::string&
+    VideoDevice::getWindowTitle()
+    {
+        return _windowTitle;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::setWindowTitle(const std::string& title)
+    {
+        _windowTitle = title;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::setWindowIcon(Canvas* icon)
+    {
+        assert(icon);
+        // there is no window to show it
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::swapWindowBuffers()
+    {
+        Recti scissor = _frame->getScissor();
+        _frame->flush();
+        _frontBuffer = _frame;
+        _frame = createFrame();
+        _frame->setScissor(scissor);
+    }
+
+    //-----------------------------------------------------------------
+    const Recti&
+    VideoDevice::getFrameScissor()
+    {
+        return _frame->getScissor();
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    VideoDevice::setFrameScissor(const Recti& scissor)
+    {
+        if (!scissor.isValid() || !scissor.isInside(0, 0, _windowSize.width - 1, _windowSize.height - 1)) {
+            return false;
+        }
+        return _frame->setScissor(scissor);
+    }
+
+    //-----------------------------------------------------------------
+    Canvas*
+    VideoDevice::cloneFrame(Recti* section)
+    {
+        // cloneSection() flushes the pending draw calls
+        if (section) {
+            return _frame->cloneSection(*section);
+        }
+        return _frame->cloneSection(Recti(0, 0, _windowSize.width - 1, _windowSize.height - 1));
+    }
+
+    //-----------------------------------------------------------------
+    int
+    VideoDevice::getBlendMode()
+    {
+        return _blendMode;
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    VideoDevice::setBlendMode(int blendMode)
+    {
+        if (!_frame->setBlendMode(blendMode)) {
+            return false;
+        }
+        _blendMode = blendMode;
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    ITexture*
+    VideoDevice::createTexture(int width, int height, const RGBA* pixels)
+    {
+        if (width <= 0 || height <= 0) {
+            return 0;
+        }
+        CanvasPtr canvas = Canvas::Create(width, height, pixels);
+        return Texture::Create(canvas.get());
+    }
+
+    //-----------------------------------------------------------------
+    ITexture*
+    VideoDevice::createTexture(Canvas* canvas)
+    {
+        assert(canvas);
+        CanvasPtr view = create_texture_view(canvas, true);
+        return Texture::Create(view.get());
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    VideoDevice::updateTexturePixels(ITexture* texture, Canvas* newPixels, Recti* rect)
+    {
+        assert(texture);
+        assert(newPixels);
+        Texture* t = static_cast<Texture*>(texture);
+        const Dim2i& size = t->getSize();
+        int x = 0;
+        int y = 0;
+        if (rect) {
+            if (!rect->isValid() ||
+                !rect->isInside(0, 0, size.width - 1, size.height - 1) ||
+                rect->getWidth()  != newPixels->getWidth() ||
+                rect->getHeight() != newPixels->getHeight())
+            {
+                return false;
+            }
+            x = rect->getX();
+            y = rect->getY();
+        } else if (newPixels->getWidth() != size.width || newPixels->getHeight() != size.height) {
+            return false;
+        }
+        CanvasPtr pixels;
+        if (newPixels->getWidth() == size.width && newPixels->getHeight() == size.height) {
+            pixels = create_texture_view(newPixels, true);
+        } else {
+            // copy the old pixels, queued draw calls may still use them
+            pixels = create_texture_view(t->getCanvas(), false);
+            pixels->setBlendMode(Canvas::BM_REPLACE);
+            pixels->drawImage(newPixels, Vec2i(x, y));
+            pixels->trim();
+        }
+        t->setCanvas(pixels.get());
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    VideoDevice::updateTextureDirtyPixels(ITexture* texture, Canvas* canvas)
+    {
+        assert(texture);
+        assert(canvas);
+        Texture* t = static_cast<Texture*>(texture);
+        if (canvas->getWidth()  != t->getSize().width ||
+            canvas->getHeight() != t->getSize().height)
+        {
+            return false;
+        }
+        canvas->flush();
+        const DirtyRegion& dirty = canvas->getDirtyRegion();
+        if (!dirty.isEmpty()) {
+            // copy the old pixels, queued draw calls may still use them
+            CanvasPtr pixels = create_texture_view(t->getCanvas(), false);
+            pixels->setBlendMode(Canvas::BM_REPLACE);
+            for (int i = 0; i < dirty.getNumRects(); ++i) {
+                const Recti& rect = dirty.getRect(i);
+                pixels->drawSubImage(canvas, rect, rect.ul);
+            }
+            pixels->trim();
+            t->setCanvas(pixels.get());
+            canvas->clearDirtyRegion();
+        }
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    Canvas*
+    VideoDevice::grabTexturePixels(ITexture* texture)
+    {
+        return create_texture_view(get_canvas(texture), false);
+    }
+
+    //-----------------------------------------------------------------
+    bool
+    VideoDevice::captureFrame(const Recti& rect)
+    {
+        Canvas* capture = _frame->cloneSection(rect);
+        if (!capture) {
+            return false;
+        }
+        _capture = capture;
+        return true;
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::drawCaptureQuad(const Recti& rect, Vec2i pos[4], const RGBA& mask)
+    {
+        if (_capture) {
+            _frame->drawSubImageQuad(_capture.get(), rect, pos, mask);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::drawPoint(const Vec2i& pos, const RGBA& color)
+    {
+        RGBA col[4] = { color, color, color, color };
+        _frame->drawRect(Recti(pos.x, pos.y, pos.x, pos.y), col);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::drawLine(Vec2i pos[2], RGBA col[2])
+    {
+        _frame->drawLine(pos, col);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::drawTriangle(Vec2i pos[3], RGBA col[3])
+    {
+        _frame->drawTriangle(pos, col);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::drawRect(const Recti& rect, RGBA col[4])
+    {
+        _frame->drawRect(rect, col);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::drawImage(ITexture* image, const Vec2i& pos, const RGBA& mask)
+    {
+        Canvas* canvas = get_canvas(image);
+        if (is_white(mask)) {
+            _frame->drawImage(canvas, pos);
+            return;
+        }
+        int x2 = pos.x + canvas->getWidth();
+        int y2 = pos.y + canvas->getHeight();
+        Vec2i quad[4] = {
+            pos,
+            Vec2i(x2, pos.y),
+            Vec2i(x2, y2),
+            Vec2i(pos.x, y2),
+        };
+        _frame->drawImageQuad(canvas, quad, mask);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::drawSubImage(ITexture* image, const Recti& rect, const Vec2i& pos, const RGBA& mask)
+    {
+        Canvas* canvas = get_canvas(image);
+        if (is_white(mask)) {
+            _frame->drawSubImage(canvas, rect, pos);
+            return;
+        }
+        int x2 = pos.x + rect.getWidth();
+        int y2 = pos.y + rect.getHeight();
+        Vec2i quad[4] = {
+            pos,
+            Vec2i(x2, pos.y),
+            Vec2i(x2, y2),
+            Vec2i(pos.x, y2),
+        };
+        _frame->drawSubImageQuad(canvas, rect, quad, mask);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::drawImageQuad(ITexture* image, Vec2i pos[4], const RGBA& mask)
+    {
+        _frame->drawImageQuad(get_canvas(image), pos, mask);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::drawSubImageQuad(ITexture* image, const Recti& rect, Vec2i pos[4], const RGBA& mask)
+    {
+        _frame->drawSubImageQuad(get_canvas(image), rect, pos, mask);
+    }
+
+    //-----------------------------------------------------------------
+    void
+    VideoDevice::drawTexturedTriangle(ITexture* image, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask)
+    {
+        _frame->drawTexturedTriangle(get_canvas(image), texcoord, pos, mask);
+    }
+
+    //-----------------------------------------------------------------
+    IVideoDevice*
+    CreateVideoDevice(const std::string& name)
+    {
+        if (name == "software") {
+            return VideoDevice::Create();
+        }
+        return 0;
+    }
+
+} // namespace sphere
@@ -15,3 +15,81 @@
     along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef SPHERE_VIDEODEVICE_HPP
+#define SPHERE_VIDEODEVICE_HPP
+
+#include <string>
+#include <vector>
+#include "../common/RefImpl.hpp"
+#include "IVideoDevice.hpp"
+#include "Texture.hpp"
+
+
+namespace sphere {
+
+    // A video device without a window, which renders into a canvas in
+    // memory (e.g. for servers, tests and frame capture on Linux). The
+    // frame is a deferred canvas, so the draw calls of a frame are
+    // rasterized on the thread pool when the frame is read or presented.
+    // swapWindowBuffers() presents the frame as the front buffer and
+    // starts a new black one. Any window mode is accepted.
+    class VideoDevice : public RefImpl<IVideoDevice> {
+    public:
+        static VideoDevice* Create();
+
+        Canvas* getFrontBuffer();
+
+        // IVideoDevice implementation
+        const Dim2i& getDefaultDisplayMode();
+        const std::vector<Dim2i>& getDisplayModes();
+        bool  setWindowMode(int width, int height, bool fullScreen);
+        const Dim2i& getWindowSize();
+        bool  isWindowFullScreen();
+        bool  isWindowActive();
+        const std::string& getWindowTitle();
+        void  setWindowTitle(const std::string& title);
+        void  setWindowIcon(Canvas* icon);
+        void  swapWindowBuffers();
+        const Recti& getFrameScissor();
+        bool  setFrameScissor(const Recti& scissor);
+        Canvas* cloneFrame(Recti* section = 0);
+        int   getBlendMode();
+        bool  setBlendMode(int blendMode);
+        ITexture* createTexture(int width, int height, const RGBA* pixels = 0);
+        ITexture* createTexture(Canvas* canvas);
+        bool  updateTexturePixels(ITexture* texture, Canvas* newPixels, Recti* rect = 0);
+        bool  updateTextureDirtyPixels(ITexture* texture, Canvas* canvas);
+        Canvas* grabTexturePixels(ITexture* texture);
+        bool  captureFrame(const Recti& rect);
+        void  drawCaptureQuad(const Recti& rect, Vec2i pos[4], const RGBA& mask);
+        void  drawPoint(const Vec2i& pos, const RGBA& color);
+        void  drawLine(Vec2i pos[2], RGBA col[2]);
+        void  drawTriangle(Vec2i pos[3], RGBA col[3]);
+        void  drawRect(const Recti& rect, RGBA col[4]);
+        void  drawImage(ITexture* image, const Vec2i& pos, const RGBA& mask);
+        void  drawSubImage(ITexture* image, const Recti& rect, const Vec2i& pos, const RGBA& mask);
+        void  drawImageQuad(ITexture* image, Vec2i pos[4], const RGBA& mask);
+        void  drawSubImageQuad(ITexture* image, const Recti& rect, Vec2i pos[4], const RGBA& mask);
+        void  drawTexturedTriangle(ITexture* image, Vec2i texcoord[3], Vec2i pos[3], const RGBA& mask);
+
+    private:
+        VideoDevice();
+        virtual ~VideoDevice();
+        Canvas* createFrame() const;
+
+    private:
+        Dim2i _defaultDisplayMode;
+        std::vector<Dim2i> _displayModes;
+        Dim2i _windowSize;
+        bool  _fullScreen;
+        std::string _windowTitle;
+        int   _blendMode;
+        CanvasPtr _frame;
+        CanvasPtr _frontBuffer;
+        CanvasPtr _capture;
+    };
+
+} // namespace sphere
+
+
+#endif
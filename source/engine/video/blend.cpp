@@ -0,0 +1,258 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include "../common/platform.hpp"
+#include "../core/cpu.hpp"
+#include "blend.hpp"
+#include "srgb.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNC_T blenderT>
+    static void blend_span(RGBA* dst, const RGBA* src, int n)
+    {
+        while (n > 0) {
+            blenderT(dst, *src);
+            dst++;
+            src++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNC_T blenderT>
+    static void blend_span_premultiply(RGBA* dst, const RGBA* src, int n)
+    {
+        while (n > 0) {
+            blenderT(dst, rgba_premultiply(*src));
+            dst++;
+            src++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    template<BLENDFUNC_T blenderT>
+    static void blend_span_unpremultiply(RGBA* dst, const RGBA* src, int n)
+    {
+        while (n > 0) {
+            blenderT(dst, rgba_unpremultiply(*src));
+            dst++;
+            src++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static const int NUM_BLEND_MODES = 5;
+
+    // indexed by (srcPremultiplied | dstPremultiplied << 1) and blend mode
+    static const BLENDSPANFUNC_T g_ScalarBlendSpanFuncs[4][NUM_BLEND_MODES] = {
+        {
+            blend_span<rgba_replace>,
+            blend_span<rgba_alpha>,
+            blend_span<rgba_add>,
+            blend_span<rgba_subtract>,
+            blend_span<rgba_multiply>,
+        },
+        {
+            blend_span_unpremultiply<rgba_replace>,
+            blend_span_unpremultiply<rgba_alpha>,
+            blend_span_unpremultiply<rgba_add>,
+            blend_span_unpremultiply<rgba_subtract>,
+            blend_span_unpremultiply<rgba_multiply>,
+        },
+        {
+            blend_span_premultiply<rgba_replace>,
+            blend_span_premultiply<rgba_alpha_pre>,
+            blend_span_premultiply<rgba_add_pre>,
+            blend_span_premultiply<rgba_subtract>,
+            blend_span_premultiply<rgba_multiply>,
+        },
+        {
+            blend_span<rgba_replace>,
+            blend_span<rgba_alpha_pre>,
+            blend_span<rgba_add_pre>,
+            blend_span<rgba_subtract>,
+            blend_span<rgba_multiply>,
+        },
+    };
+
+#if defined(SPHERE_X86)
+    // defined in blend_x86.cpp, indexed by premultiplied and blend mode
+    extern const BLENDSPANFUNC_T g_SSE2BlendSpanFuncs[2][NUM_BLEND_MODES];
+    extern const BLENDSPANFUNC_T g_SSSE3BlendSpanFuncs[2][NUM_BLEND_MODES];
+    extern const BLENDSPANFUNC_T g_AVX2BlendSpanFuncs[2][NUM_BLEND_MODES];
+#endif
+
+    //-----------------------------------------------------------------
+    typedef const BLENDSPANFUNC_T (*BLENDSPANTABLE_T)[NUM_BLEND_MODES];
+
+    static BLENDSPANTABLE_T select_blend_span_funcs()
+    {
+#if defined(SPHERE_X86)
+        if (cpu::HasAVX2()) {
+            return g_AVX2BlendSpanFuncs;
+        }
+        if (cpu::HasSSSE3()) {
+            return g_SSSE3BlendSpanFuncs;
+        }
+        if (cpu::HasSSE2()) {
+            return g_SSE2BlendSpanFuncs;
+        }
+#endif
+        return 0;
+    }
+
+    //-----------------------------------------------------------------
+    BLENDSPANFUNC_T GetBlendSpanFunc(int blendMode, bool srcPremultiplied, bool dstPremultiplied)
+    {
+        static const BLENDSPANTABLE_T funcs = select_blend_span_funcs();
+        assert(blendMode >= 0 && blendMode < NUM_BLEND_MODES);
+        if (funcs && srcPremultiplied == dstPremultiplied) {
+            return funcs[srcPremultiplied ? 1 : 0][blendMode];
+        }
+        return GetScalarBlendSpanFunc(blendMode, srcPremultiplied, dstPremultiplied);
+    }
+
+    //-----------------------------------------------------------------
+    BLENDSPANFUNC_T GetScalarBlendSpanFunc(int blendMode, bool srcPremultiplied, bool dstPremultiplied)
+    {
+        assert(blendMode >= 0 && blendMode < NUM_BLEND_MODES);
+        return g_ScalarBlendSpanFuncs[(srcPremultiplied ? 1 : 0) | (dstPremultiplied ? 2 : 0)][blendMode];
+    }
+
+    //-----------------------------------------------------------------
+    // The linear light blenders get a decoded destination and source
+    // channel and the source alpha and return the new destination
+    typedef int (*LINEARBLENDFUNC_T)(int d, int s, int a);
+
+    static inline int linear_alpha(int d, int s, int a)
+    {
+        a += a >> 7; // 0..256
+        return (s * a + d * (256 - a) + 128) >> 8;
+    }
+
+    static inline int linear_add(int d, int s, int)
+    {
+        return std::min(d + s, (int)LINEAR_MAX);
+    }
+
+    static inline int linear_subtract(int d, int s, int)
+    {
+        return std::max(d - s, 0);
+    }
+
+    static inline int linear_multiply(int d, int s, int)
+    {
+        return (d * (s + 1)) >> LINEAR_PRECISION;
+    }
+
+    //-----------------------------------------------------------------
+    // Straight alpha destinations keep their alpha, like the sRGB
+    // blenders. Source pixels which leave the destination unchanged
+    // (transparent ones when alpha blending) are skipped.
+    template<LINEARBLENDFUNC_T blenderT, bool alphaT, bool premultipliedT>
+    static void blend_span_linear(RGBA* dst, const RGBA* src, int n)
+    {
+        const u16* to_linear = GetSrgbToLinearTable();
+        const u8*  to_srgb   = GetLinearToSrgbTable();
+        while (n > 0) {
+            RGBA s = premultipliedT ? rgba_unpremultiply(*src) : *src;
+            if (!alphaT || s.alpha != 0) {
+                dst->red   = to_srgb[blenderT(to_linear[dst->red],   to_linear[s.red],   s.alpha)];
+                dst->green = to_srgb[blenderT(to_linear[dst->green], to_linear[s.green], s.alpha)];
+                dst->blue  = to_srgb[blenderT(to_linear[dst->blue],  to_linear[s.blue],  s.alpha)];
+            }
+            dst++;
+            src++;
+            n--;
+        }
+    }
+
+    // indexed by srcPremultiplied and blend mode
+    static const BLENDSPANFUNC_T g_LinearBlendSpanFuncs[2][NUM_BLEND_MODES] = {
+        {
+            blend_span<rgba_replace>,
+            blend_span_linear<linear_alpha,    true,  false>,
+            blend_span_linear<linear_add,      false, false>,
+            blend_span_linear<linear_subtract, false, false>,
+            blend_span_linear<linear_multiply, false, false>,
+        },
+        {
+            blend_span_unpremultiply<rgba_replace>,
+            blend_span_linear<linear_alpha,    true,  true>,
+            blend_span_linear<linear_add,      false, true>,
+            blend_span_linear<linear_subtract, false, true>,
+            blend_span_linear<linear_multiply, false, true>,
+        },
+    };
+
+    //-----------------------------------------------------------------
+    BLENDSPANFUNC_T GetLinearBlendSpanFunc(int blendMode, bool srcPremultiplied)
+    {
+        assert(blendMode >= 0 && blendMode < NUM_BLEND_MODES);
+        return g_LinearBlendSpanFuncs[srcPremultiplied ? 1 : 0][blendMode];
+    }
+
+    //-----------------------------------------------------------------
+    // ceil(2^32 / a), multiplying by it and shifting right by 32 bits
+    // divides exactly by a for all numerators below 2^16
+    struct ReciprocalTable {
+        u64 values[256];
+
+        ReciprocalTable() {
+            values[0] = 0;
+            for (int a = 1; a < 256; ++a) {
+                values[a] = (((u64)1 << 32) + a - 1) / a;
+            }
+        }
+    };
+
+    static const ReciprocalTable g_Reciprocals;
+
+    //-----------------------------------------------------------------
+    void PremultiplySpan(RGBA* pixels, int n)
+    {
+        while (n > 0) {
+            *pixels = rgba_premultiply(*pixels);
+            pixels++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void UnpremultiplySpan(RGBA* pixels, int n)
+    {
+        while (n > 0) {
+            int a = pixels->alpha;
+            if (a != 255) {
+                u64 r = g_Reciprocals.values[a];
+                int h = a / 2;
+                pixels->red   = (u8)std::min((int)(((pixels->red   * 255 + h) * r) >> 32), 255);
+                pixels->green = (u8)std::min((int)(((pixels->green * 255 + h) * r) >> 32), 255);
+                pixels->blue  = (u8)std::min((int)(((pixels->blue  * 255 + h) * r) >> 32), 255);
+            }
+            pixels++;
+            n--;
+        }
+    }
+
+} // namespace sphere
@@ -0,0 +1,208 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_BLEND_HPP
+#define SPHERE_BLEND_HPP
+
+#include <algorithm>
+#include "../common/types.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    typedef void (*BLENDFUNC_T)(RGBA*, const RGBA&);
+
+    static inline void rgba_replace(RGBA* dst, const RGBA& src)
+    {
+        dst->red   = src.red;
+        dst->green = src.green;
+        dst->blue  = src.blue;
+        dst->alpha = src.alpha;
+    }
+
+    static inline void rgba_alpha(RGBA* dst, const RGBA& src)
+    {
+        int sa =        src.alpha  + 1;
+        int da = (255 - src.alpha) + 1;
+        dst->red   = (dst->red   * da + src.red   * sa) >> 8;
+        dst->green = (dst->green * da + src.green * sa) >> 8;
+        dst->blue  = (dst->blue  * da + src.blue  * sa) >> 8;
+    }
+
+    static inline void rgba_add(RGBA* dst, const RGBA& src)
+    {
+        dst->red   = std::min(dst->red   + src.red,   255);
+        dst->green = std::min(dst->green + src.green, 255);
+        dst->blue  = std::min(dst->blue  + src.blue,  255);
+    }
+
+    static inline void rgba_subtract(RGBA* dst, const RGBA& src)
+    {
+        dst->red   = std::max(dst->red   - src.red,   0);
+        dst->green = std::max(dst->green - src.green, 0);
+        dst->blue  = std::max(dst->blue  - src.blue,  0);
+    }
+
+    static inline void rgba_multiply(RGBA* dst, const RGBA& src)
+    {
+        dst->red   = dst->red   * (src.red   + 1) >> 8;
+        dst->green = dst->green * (src.green + 1) >> 8;
+        dst->blue  = dst->blue  * (src.blue  + 1) >> 8;
+    }
+
+    //-----------------------------------------------------------------
+    typedef void (*BLENDFUNCFIX_T)(RGBA*, u32, u32, u32, u32);
+
+    static inline void rgba_replace_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        dst->red   = r >> 12;
+        dst->green = g >> 12;
+        dst->blue  = b >> 12;
+        dst->alpha = a >> 12;
+    }
+
+    static inline void rgba_alpha_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        int sa =        (a >> 12)  + 1;
+        int da = (255 - (a >> 12)) + 1;
+        dst->red   = (dst->red   * da + (r >> 12) * sa) >> 8;
+        dst->green = (dst->green * da + (g >> 12) * sa) >> 8;
+        dst->blue  = (dst->blue  * da + (b >> 12) * sa) >> 8;
+    }
+
+    static inline void rgba_add_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        dst->red   = std::min(dst->red   + (u8)(r >> 12), 255);
+        dst->green = std::min(dst->green + (u8)(g >> 12), 255);
+        dst->blue  = std::min(dst->blue  + (u8)(b >> 12), 255);
+    }
+
+    static inline void rgba_subtract_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        dst->red   = std::max(dst->red   - (u8)(r >> 12), 0);
+        dst->green = std::max(dst->green - (u8)(g >> 12), 0);
+        dst->blue  = std::max(dst->blue  - (u8)(b >> 12), 0);
+    }
+
+    static inline void rgba_multiply_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        dst->red   = dst->red   * ((r >> 12) + 1) >> 8;
+        dst->green = dst->green * ((g >> 12) + 1) >> 8;
+        dst->blue  = dst->blue  * ((b >> 12) + 1) >> 8;
+    }
+
+    //-----------------------------------------------------------------
+    // premultiplied alpha
+    static inline u8 premultiply(int c, int a)
+    {
+        int t = c * a + 128; // round(c * a / 255)
+        return (u8)((t + (t >> 8)) >> 8);
+    }
+
+    static inline u8 unpremultiply(int c, int a)
+    {
+        if (a == 0) {
+            return 0;
+        }
+        return (u8)std::min((c * 255 + a / 2) / a, 255);
+    }
+
+    static inline RGBA rgba_premultiply(const RGBA& c)
+    {
+        return RGBA(premultiply(c.red,   c.alpha),
+                    premultiply(c.green, c.alpha),
+                    premultiply(c.blue,  c.alpha),
+                    c.alpha);
+    }
+
+    static inline RGBA rgba_unpremultiply(const RGBA& c)
+    {
+        return RGBA(unpremultiply(c.red,   c.alpha),
+                    unpremultiply(c.green, c.alpha),
+                    unpremultiply(c.blue,  c.alpha),
+                    c.alpha);
+    }
+
+    //-----------------------------------------------------------------
+    // Convert n pixels in place, with the same results as
+    // rgba_premultiply and rgba_unpremultiply
+    void PremultiplySpan(RGBA* pixels, int n);
+    void UnpremultiplySpan(RGBA* pixels, int n);
+
+    //-----------------------------------------------------------------
+    // Blenders for premultiplied destinations and sources. BM_ALPHA is
+    // dst = src + dst * (1 - sa) and BM_ADD adds all four channels;
+    // rgba_replace, rgba_subtract and rgba_multiply (and their _fix
+    // versions) keep premultiplied values valid and are shared.
+    static inline void rgba_alpha_pre(RGBA* dst, const RGBA& src)
+    {
+        int da = 256 - src.alpha;
+        dst->red   = std::min(src.red   + ((dst->red   * da) >> 8), 255);
+        dst->green = std::min(src.green + ((dst->green * da) >> 8), 255);
+        dst->blue  = std::min(src.blue  + ((dst->blue  * da) >> 8), 255);
+        dst->alpha = std::min(src.alpha + ((dst->alpha * da) >> 8), 255);
+    }
+
+    static inline void rgba_add_pre(RGBA* dst, const RGBA& src)
+    {
+        dst->red   = std::min(dst->red   + src.red,   255);
+        dst->green = std::min(dst->green + src.green, 255);
+        dst->blue  = std::min(dst->blue  + src.blue,  255);
+        dst->alpha = std::min(dst->alpha + src.alpha, 255);
+    }
+
+    static inline void rgba_alpha_pre_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        int da = 256 - (a >> 12);
+        dst->red   = std::min((int)(r >> 12) + ((dst->red   * da) >> 8), 255);
+        dst->green = std::min((int)(g >> 12) + ((dst->green * da) >> 8), 255);
+        dst->blue  = std::min((int)(b >> 12) + ((dst->blue  * da) >> 8), 255);
+        dst->alpha = std::min((int)(a >> 12) + ((dst->alpha * da) >> 8), 255);
+    }
+
+    static inline void rgba_add_pre_fix(RGBA* dst, u32 r, u32 g, u32 b, u32 a)
+    {
+        dst->red   = std::min(dst->red   + (u8)(r >> 12), 255);
+        dst->green = std::min(dst->green + (u8)(g >> 12), 255);
+        dst->blue  = std::min(dst->blue  + (u8)(b >> 12), 255);
+        dst->alpha = std::min(dst->alpha + (u8)(a >> 12), 255);
+    }
+
+    //-----------------------------------------------------------------
+    // Span blenders blend n source pixels onto n destination pixels.
+    // They are indexed by Canvas::BlendMode and by whether source and
+    // destination store premultiplied alpha; mixed formats convert each
+    // source pixel to the destination format first. GetBlendSpanFunc
+    // returns the fastest kernel the CPU supports, which always produces
+    // the same result as the scalar reference kernel.
+    typedef void (*BLENDSPANFUNC_T)(RGBA* dst, const RGBA* src, int n);
+
+    BLENDSPANFUNC_T GetBlendSpanFunc(int blendMode, bool srcPremultiplied = false, bool dstPremultiplied = false);
+    BLENDSPANFUNC_T GetScalarBlendSpanFunc(int blendMode, bool srcPremultiplied = false, bool dstPremultiplied = false);
+
+    // Span blenders for straight alpha destinations which blend in
+    // linear light instead of on the sRGB encoded channels, with the
+    // same formulas at LINEAR_PRECISION bits. They decode and encode
+    // through the tables of srgb.hpp, the replacing one just copies.
+    BLENDSPANFUNC_T GetLinearBlendSpanFunc(int blendMode, bool srcPremultiplied = false);
+
+} // namespace sphere
+
+
+#endif
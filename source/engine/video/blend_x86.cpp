@@ -0,0 +1,477 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include "../common/platform.hpp"
+#include "blend.hpp"
+
+#if defined(SPHERE_X86)
+
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#if defined(__GNUC__) || (defined(_MSC_VER) && _MSC_VER >= 1700)
+#  include <immintrin.h>
+#  define SPHERE_HAVE_AVX2_INTRINSICS
+#endif
+
+// GCC and Clang only emit instructions for the ISA the function is
+// compiled for, so the kernels are tagged individually instead of
+// compiling the whole file with -mavx2
+#if defined(__GNUC__)
+#  define TARGET_SSE2  __attribute__((target("sse2")))
+#  define TARGET_SSSE3 __attribute__((target("ssse3")))
+#  define TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#  define TARGET_SSE2
+#  define TARGET_SSSE3
+#  define TARGET_AVX2
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // All kernels are bit-exact with the scalar rgba_* blenders in
+    // blend.hpp: channels are widened to 16 bit, where none of the
+    // intermediate results can overflow (e.g. d * (256 - a) + s * (a + 1)
+    // is at most 255 * 257), and the destination alpha is handled
+    // exactly like the scalar code does for each mode.
+
+    //-----------------------------------------------------------------
+    static void blend_span_replace(RGBA* dst, const RGBA* src, int n)
+    {
+        memcpy(dst, src, n * sizeof(RGBA));
+    }
+
+    //-----------------------------------------------------------------
+    // SSE2 (4 pixels per iteration)
+
+    TARGET_SSE2
+    static inline __m128i keep_alpha_sse2(__m128i result, __m128i d)
+    {
+        const __m128i amask = _mm_set1_epi32((int)0xFF000000);
+        return _mm_or_si128(_mm_andnot_si128(amask, result), _mm_and_si128(amask, d));
+    }
+
+    TARGET_SSE2
+    static inline bool is_transparent_sse2(__m128i s)
+    {
+        const __m128i amask = _mm_set1_epi32((int)0xFF000000);
+        __m128i eq = _mm_cmpeq_epi32(_mm_and_si128(s, amask), _mm_setzero_si128());
+        return _mm_movemask_epi8(eq) == 0xFFFF;
+    }
+
+    TARGET_SSE2
+    static inline __m128i lerp_alpha_sse2(__m128i d, __m128i s, __m128i a)
+    {
+        const __m128i one  = _mm_set1_epi16(1);
+        const __m128i c256 = _mm_set1_epi16(256);
+        __m128i sa = _mm_add_epi16(a, one);
+        __m128i da = _mm_sub_epi16(c256, a);
+        __m128i r  = _mm_add_epi16(_mm_mullo_epi16(d, da), _mm_mullo_epi16(s, sa));
+        return _mm_srli_epi16(r, 8);
+    }
+
+    TARGET_SSE2
+    static inline __m128i alpha4_sse2(__m128i d, __m128i s)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i d_lo = _mm_unpacklo_epi8(d, zero);
+        __m128i d_hi = _mm_unpackhi_epi8(d, zero);
+        __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xFF), 0xFF);
+        __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xFF), 0xFF);
+        __m128i r    = _mm_packus_epi16(lerp_alpha_sse2(d_lo, s_lo, a_lo), lerp_alpha_sse2(d_hi, s_hi, a_hi));
+        return keep_alpha_sse2(r, d);
+    }
+
+    TARGET_SSE2
+    static inline __m128i add4_sse2(__m128i d, __m128i s)
+    {
+        return keep_alpha_sse2(_mm_adds_epu8(d, s), d);
+    }
+
+    TARGET_SSE2
+    static inline __m128i subtract4_sse2(__m128i d, __m128i s)
+    {
+        return keep_alpha_sse2(_mm_subs_epu8(d, s), d);
+    }
+
+    TARGET_SSE2
+    static inline __m128i multiply4_sse2(__m128i d, __m128i s)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i one  = _mm_set1_epi16(1);
+        __m128i s_lo = _mm_add_epi16(_mm_unpacklo_epi8(s, zero), one);
+        __m128i s_hi = _mm_add_epi16(_mm_unpackhi_epi8(s, zero), one);
+        __m128i r_lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), s_lo), 8);
+        __m128i r_hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), s_hi), 8);
+        return keep_alpha_sse2(_mm_packus_epi16(r_lo, r_hi), d);
+    }
+
+    TARGET_SSE2
+    static inline __m128i scale_inv_alpha_sse2(__m128i d, __m128i a)
+    {
+        const __m128i c256 = _mm_set1_epi16(256);
+        return _mm_srli_epi16(_mm_mullo_epi16(d, _mm_sub_epi16(c256, a)), 8);
+    }
+
+    TARGET_SSE2
+    static inline __m128i alpha_pre4_sse2(__m128i d, __m128i s)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero);
+        __m128i s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xFF), 0xFF);
+        __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xFF), 0xFF);
+        __m128i r_lo = scale_inv_alpha_sse2(_mm_unpacklo_epi8(d, zero), a_lo);
+        __m128i r_hi = scale_inv_alpha_sse2(_mm_unpackhi_epi8(d, zero), a_hi);
+        return _mm_adds_epu8(s, _mm_packus_epi16(r_lo, r_hi));
+    }
+
+    TARGET_SSE2
+    static inline __m128i add_pre4_sse2(__m128i d, __m128i s)
+    {
+        return _mm_adds_epu8(d, s);
+    }
+
+    TARGET_SSE2
+    static inline bool is_never_skipped_sse2(__m128i)
+    {
+        return false;
+    }
+
+    // premultiplied sources can only be skipped if they are all zero,
+    // a zero alpha with non-zero colors still adds light
+    TARGET_SSE2
+    static inline bool is_zero_sse2(__m128i s)
+    {
+        __m128i eq = _mm_cmpeq_epi32(s, _mm_setzero_si128());
+        return _mm_movemask_epi8(eq) == 0xFFFF;
+    }
+
+    template<BLENDFUNC_T blenderT, __m128i (*kernelT)(__m128i, __m128i), bool (*skipT)(__m128i)>
+    TARGET_SSE2
+    static void blend_span_sse2(RGBA* dst, const RGBA* src, int n)
+    {
+        // scalar head until dst is 16 byte aligned
+        while (n > 0 && ((size_t)dst & 15) != 0) {
+            blenderT(dst, *src);
+            dst++;
+            src++;
+            n--;
+        }
+
+        while (n >= 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)src);
+            if (!skipT(s)) {
+                __m128i d = _mm_load_si128((const __m128i*)dst);
+                _mm_store_si128((__m128i*)dst, kernelT(d, s));
+            }
+            dst += 4;
+            src += 4;
+            n   -= 4;
+        }
+
+        // scalar tail
+        while (n > 0) {
+            blenderT(dst, *src);
+            dst++;
+            src++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // SSSE3 (4 pixels per iteration, alpha broadcast with pshufb)
+
+    TARGET_SSSE3
+    static inline __m128i alpha4_ssse3(__m128i d, __m128i s)
+    {
+        const __m128i zero     = _mm_setzero_si128();
+        const __m128i alo_mask = _mm_setr_epi8(3, -1, 3, -1, 3, -1, 3, -1,  7, -1,  7, -1,  7, -1,  7, -1);
+        const __m128i ahi_mask = _mm_setr_epi8(11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1);
+        __m128i a_lo = _mm_shuffle_epi8(s, alo_mask);
+        __m128i a_hi = _mm_shuffle_epi8(s, ahi_mask);
+        __m128i r_lo = lerp_alpha_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero), a_lo);
+        __m128i r_hi = lerp_alpha_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero), a_hi);
+        return keep_alpha_sse2(_mm_packus_epi16(r_lo, r_hi), d);
+    }
+
+    TARGET_SSSE3
+    static inline __m128i alpha_pre4_ssse3(__m128i d, __m128i s)
+    {
+        const __m128i zero     = _mm_setzero_si128();
+        const __m128i alo_mask = _mm_setr_epi8(3, -1, 3, -1, 3, -1, 3, -1,  7, -1,  7, -1,  7, -1,  7, -1);
+        const __m128i ahi_mask = _mm_setr_epi8(11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1);
+        __m128i r_lo = scale_inv_alpha_sse2(_mm_unpacklo_epi8(d, zero), _mm_shuffle_epi8(s, alo_mask));
+        __m128i r_hi = scale_inv_alpha_sse2(_mm_unpackhi_epi8(d, zero), _mm_shuffle_epi8(s, ahi_mask));
+        return _mm_adds_epu8(s, _mm_packus_epi16(r_lo, r_hi));
+    }
+
+    template<BLENDFUNC_T blenderT, __m128i (*kernelT)(__m128i, __m128i), bool (*skipT)(__m128i)>
+    TARGET_SSSE3
+    static void blend_span_ssse3(RGBA* dst, const RGBA* src, int n)
+    {
+        while (n > 0 && ((size_t)dst & 15) != 0) {
+            blenderT(dst, *src);
+            dst++;
+            src++;
+            n--;
+        }
+
+        while (n >= 4) {
+            __m128i s = _mm_loadu_si128((const __m128i*)src);
+            if (!skipT(s)) {
+                __m128i d = _mm_load_si128((const __m128i*)dst);
+                _mm_store_si128((__m128i*)dst, kernelT(d, s));
+            }
+            dst += 4;
+            src += 4;
+            n   -= 4;
+        }
+
+        while (n > 0) {
+            blenderT(dst, *src);
+            dst++;
+            src++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    extern const BLENDSPANFUNC_T g_SSE2BlendSpanFuncs[2][5] = {
+        {
+            blend_span_replace,
+            blend_span_sse2<rgba_alpha,     alpha4_sse2,       is_transparent_sse2>,
+            blend_span_sse2<rgba_add,       add4_sse2,         is_never_skipped_sse2>,
+            blend_span_sse2<rgba_subtract,  subtract4_sse2,    is_never_skipped_sse2>,
+            blend_span_sse2<rgba_multiply,  multiply4_sse2,    is_never_skipped_sse2>,
+        },
+        {
+            blend_span_replace,
+            blend_span_sse2<rgba_alpha_pre, alpha_pre4_sse2,   is_zero_sse2>,
+            blend_span_sse2<rgba_add_pre,   add_pre4_sse2,     is_never_skipped_sse2>,
+            blend_span_sse2<rgba_subtract,  subtract4_sse2,    is_never_skipped_sse2>,
+            blend_span_sse2<rgba_multiply,  multiply4_sse2,    is_never_skipped_sse2>,
+        },
+    };
+
+    extern const BLENDSPANFUNC_T g_SSSE3BlendSpanFuncs[2][5] = {
+        {
+            blend_span_replace,
+            blend_span_ssse3<rgba_alpha,     alpha4_ssse3,      is_transparent_sse2>,
+            blend_span_ssse3<rgba_add,       add4_sse2,         is_never_skipped_sse2>,
+            blend_span_ssse3<rgba_subtract,  subtract4_sse2,    is_never_skipped_sse2>,
+            blend_span_ssse3<rgba_multiply,  multiply4_sse2,    is_never_skipped_sse2>,
+        },
+        {
+            blend_span_replace,
+            blend_span_ssse3<rgba_alpha_pre, alpha_pre4_ssse3,  is_zero_sse2>,
+            blend_span_ssse3<rgba_add_pre,   add_pre4_sse2,     is_never_skipped_sse2>,
+            blend_span_ssse3<rgba_subtract,  subtract4_sse2,    is_never_skipped_sse2>,
+            blend_span_ssse3<rgba_multiply,  multiply4_sse2,    is_never_skipped_sse2>,
+        },
+    };
+
+#if defined(SPHERE_HAVE_AVX2_INTRINSICS)
+
+    //-----------------------------------------------------------------
+    // AVX2 (8 pixels per iteration)
+
+    TARGET_AVX2
+    static inline __m256i keep_alpha_avx2(__m256i result, __m256i d)
+    {
+        const __m256i amask = _mm256_set1_epi32((int)0xFF000000);
+        return _mm256_or_si256(_mm256_andnot_si256(amask, result), _mm256_and_si256(amask, d));
+    }
+
+    TARGET_AVX2
+    static inline bool is_transparent_avx2(__m256i s)
+    {
+        const __m256i amask = _mm256_set1_epi32((int)0xFF000000);
+        return _mm256_testz_si256(s, amask) != 0;
+    }
+
+    TARGET_AVX2
+    static inline __m256i lerp_alpha_avx2(__m256i d, __m256i s, __m256i a)
+    {
+        const __m256i one  = _mm256_set1_epi16(1);
+        const __m256i c256 = _mm256_set1_epi16(256);
+        __m256i sa = _mm256_add_epi16(a, one);
+        __m256i da = _mm256_sub_epi16(c256, a);
+        __m256i r  = _mm256_add_epi16(_mm256_mullo_epi16(d, da), _mm256_mullo_epi16(s, sa));
+        return _mm256_srli_epi16(r, 8);
+    }
+
+    TARGET_AVX2
+    static inline __m256i alpha8_avx2(__m256i d, __m256i s)
+    {
+        // unpack and pshufb both work within 128 bit lanes, so the
+        // lane-local masks line up with the unpacked pixels
+        const __m256i zero     = _mm256_setzero_si256();
+        const __m256i alo_mask = _mm256_setr_epi8(
+            3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1,
+            3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1);
+        const __m256i ahi_mask = _mm256_setr_epi8(
+            11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1,
+            11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1);
+        __m256i a_lo = _mm256_shuffle_epi8(s, alo_mask);
+        __m256i a_hi = _mm256_shuffle_epi8(s, ahi_mask);
+        __m256i r_lo = lerp_alpha_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero), a_lo);
+        __m256i r_hi = lerp_alpha_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero), a_hi);
+        return keep_alpha_avx2(_mm256_packus_epi16(r_lo, r_hi), d);
+    }
+
+    TARGET_AVX2
+    static inline __m256i add8_avx2(__m256i d, __m256i s)
+    {
+        return keep_alpha_avx2(_mm256_adds_epu8(d, s), d);
+    }
+
+    TARGET_AVX2
+    static inline __m256i subtract8_avx2(__m256i d, __m256i s)
+    {
+        return keep_alpha_avx2(_mm256_subs_epu8(d, s), d);
+    }
+
+    TARGET_AVX2
+    static inline __m256i multiply8_avx2(__m256i d, __m256i s)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i one  = _mm256_set1_epi16(1);
+        __m256i s_lo = _mm256_add_epi16(_mm256_unpacklo_epi8(s, zero), one);
+        __m256i s_hi = _mm256_add_epi16(_mm256_unpackhi_epi8(s, zero), one);
+        __m256i r_lo = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), s_lo), 8);
+        __m256i r_hi = _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), s_hi), 8);
+        return keep_alpha_avx2(_mm256_packus_epi16(r_lo, r_hi), d);
+    }
+
+    TARGET_AVX2
+    static inline __m256i scale_inv_alpha_avx2(__m256i d, __m256i a)
+    {
+        const __m256i c256 = _mm256_set1_epi16(256);
+        return _mm256_srli_epi16(_mm256_mullo_epi16(d, _mm256_sub_epi16(c256, a)), 8);
+    }
+
+    TARGET_AVX2
+    static inline __m256i alpha_pre8_avx2(__m256i d, __m256i s)
+    {
+        const __m256i zero     = _mm256_setzero_si256();
+        const __m256i alo_mask = _mm256_setr_epi8(
+            3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1,
+            3, -1, 3, -1, 3, -1, 3, -1, 7, -1, 7, -1, 7, -1, 7, -1);
+        const __m256i ahi_mask = _mm256_setr_epi8(
+            11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1,
+            11, -1, 11, -1, 11, -1, 11, -1, 15, -1, 15, -1, 15, -1, 15, -1);
+        __m256i r_lo = scale_inv_alpha_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_shuffle_epi8(s, alo_mask));
+        __m256i r_hi = scale_inv_alpha_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_shuffle_epi8(s, ahi_mask));
+        return _mm256_adds_epu8(s, _mm256_packus_epi16(r_lo, r_hi));
+    }
+
+    TARGET_AVX2
+    static inline __m256i add_pre8_avx2(__m256i d, __m256i s)
+    {
+        return _mm256_adds_epu8(d, s);
+    }
+
+    TARGET_AVX2
+    static inline bool is_never_skipped_avx2(__m256i)
+    {
+        return false;
+    }
+
+    TARGET_AVX2
+    static inline bool is_zero_avx2(__m256i s)
+    {
+        return _mm256_testz_si256(s, s) != 0;
+    }
+
+    template<BLENDFUNC_T blenderT, __m256i (*kernelT)(__m256i, __m256i), bool (*skipT)(__m256i)>
+    TARGET_AVX2
+    static void blend_span_avx2(RGBA* dst, const RGBA* src, int n)
+    {
+        while (n > 0 && ((size_t)dst & 31) != 0) {
+            blenderT(dst, *src);
+            dst++;
+            src++;
+            n--;
+        }
+
+        while (n >= 8) {
+            __m256i s = _mm256_loadu_si256((const __m256i*)src);
+            if (!skipT(s)) {
+                __m256i d = _mm256_load_si256((const __m256i*)dst);
+                _mm256_store_si256((__m256i*)dst, kernelT(d, s));
+            }
+            dst += 8;
+            src += 8;
+            n   -= 8;
+        }
+
+        while (n > 0) {
+            blenderT(dst, *src);
+            dst++;
+            src++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    extern const BLENDSPANFUNC_T g_AVX2BlendSpanFuncs[2][5] = {
+        {
+            blend_span_replace,
+            blend_span_avx2<rgba_alpha,     alpha8_avx2,       is_transparent_avx2>,
+            blend_span_avx2<rgba_add,       add8_avx2,         is_never_skipped_avx2>,
+            blend_span_avx2<rgba_subtract,  subtract8_avx2,    is_never_skipped_avx2>,
+            blend_span_avx2<rgba_multiply,  multiply8_avx2,    is_never_skipped_avx2>,
+        },
+        {
+            blend_span_replace,
+            blend_span_avx2<rgba_alpha_pre, alpha_pre8_avx2,   is_zero_avx2>,
+            blend_span_avx2<rgba_add_pre,   add_pre8_avx2,     is_never_skipped_avx2>,
+            blend_span_avx2<rgba_subtract,  subtract8_avx2,    is_never_skipped_avx2>,
+            blend_span_avx2<rgba_multiply,  multiply8_avx2,    is_never_skipped_avx2>,
+        },
+    };
+
+#else
+
+    // no AVX2 intrinsics available, fall back to SSSE3
+    extern const BLENDSPANFUNC_T g_AVX2BlendSpanFuncs[2][5] = {
+        {
+            blend_span_replace,
+            blend_span_ssse3<rgba_alpha,     alpha4_ssse3,      is_transparent_sse2>,
+            blend_span_ssse3<rgba_add,       add4_sse2,         is_never_skipped_sse2>,
+            blend_span_ssse3<rgba_subtract,  subtract4_sse2,    is_never_skipped_sse2>,
+            blend_span_ssse3<rgba_multiply,  multiply4_sse2,    is_never_skipped_sse2>,
+        },
+        {
+            blend_span_replace,
+            blend_span_ssse3<rgba_alpha_pre, alpha_pre4_ssse3,  is_zero_sse2>,
+            blend_span_ssse3<rgba_add_pre,   add_pre4_sse2,     is_never_skipped_sse2>,
+            blend_span_ssse3<rgba_subtract,  subtract4_sse2,    is_never_skipped_sse2>,
+            blend_span_ssse3<rgba_multiply,  multiply4_sse2,    is_never_skipped_sse2>,
+        },
+    };
+
+#endif
+
+} // namespace sphere
+
+#endif // SPHERE_X86
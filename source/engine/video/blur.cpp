@@ -0,0 +1,100 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <algorithm>
+#include "../common/platform.hpp"
+#include "../core/cpu.hpp"
+#include "blur.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Rounds sum / size in the same way as the SIMD kernels
+    static inline u8 get_box_average(int sum, float scale)
+    {
+        return (u8)(int)((float)sum * scale + 0.5f);
+    }
+
+    //-----------------------------------------------------------------
+    static void box_blur(const RGBA* src, int srcStride, RGBA* dst, int dstStride, int length, int numLines, int radius, bool alphaOnly)
+    {
+        assert(numLines <= BLUR_MAX_LINES);
+
+        float scale = 1.0f / (radius * 2 + 1);
+        int sums[BLUR_MAX_LINES][4];
+
+        // the window of the first pixel
+        for (int l = 0; l < numLines; ++l) {
+            std::fill(sums[l], sums[l] + 4, 0);
+            for (int j = -radius; j <= radius; ++j) {
+                const RGBA& p = src[std::min(std::max(j, 0), length - 1) * srcStride + l];
+                sums[l][0] += p.red;
+                sums[l][1] += p.green;
+                sums[l][2] += p.blue;
+                sums[l][3] += p.alpha;
+            }
+        }
+
+        for (int i = 0; i < length; ++i) {
+            const RGBA* s = src + i * srcStride;
+            const RGBA* a = src + std::min(i + radius + 1, length - 1) * srcStride;
+            const RGBA* b = src + std::max(i - radius, 0) * srcStride;
+            RGBA* d = dst + i * dstStride;
+            for (int l = 0; l < numLines; ++l) {
+                int* sum = sums[l];
+                if (alphaOnly) {
+                    d[l] = s[l];
+                } else {
+                    d[l].red   = get_box_average(sum[0], scale);
+                    d[l].green = get_box_average(sum[1], scale);
+                    d[l].blue  = get_box_average(sum[2], scale);
+                }
+                d[l].alpha = get_box_average(sum[3], scale);
+                sum[0] += a[l].red   - b[l].red;
+                sum[1] += a[l].green - b[l].green;
+                sum[2] += a[l].blue  - b[l].blue;
+                sum[3] += a[l].alpha - b[l].alpha;
+            }
+        }
+    }
+
+#if defined(SPHERE_X86)
+    // defined in blur_x86.cpp
+    void box_blur_sse2(const RGBA* src, int srcStride, RGBA* dst, int dstStride, int length, int numLines, int radius, bool alphaOnly);
+#endif
+
+    //-----------------------------------------------------------------
+    BOXBLURFUNC_T GetBoxBlurFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return box_blur_sse2;
+        }
+#endif
+        return box_blur;
+    }
+
+    //-----------------------------------------------------------------
+    BOXBLURFUNC_T GetScalarBoxBlurFunc()
+    {
+        return box_blur;
+    }
+
+} // namespace sphere
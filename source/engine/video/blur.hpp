@@ -0,0 +1,48 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_BLUR_HPP
+#define SPHERE_BLUR_HPP
+
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Box blurs write numLines lines of length pixels to dst, each
+    // pixel the average of the 2 * radius + 1 source pixels around it,
+    // with the edge pixels repeated beyond the ends. The lines are next
+    // to each other, consecutive pixels of a line are srcStride and
+    // dstStride pixels apart, so the same kernel blurs rows and strips
+    // of columns. They keep running sums, which makes them cost the same
+    // for every radius. If alphaOnly is set, the colors are copied from
+    // src instead. GetBoxBlurFunc returns the fastest kernel the CPU
+    // supports, which produces the same result as the scalar one.
+    enum {
+        BLUR_MAX_LINES = 16,
+    };
+
+    typedef void (*BOXBLURFUNC_T)(const RGBA* src, int srcStride, RGBA* dst, int dstStride, int length, int numLines, int radius, bool alphaOnly);
+
+    BOXBLURFUNC_T GetBoxBlurFunc();
+    BOXBLURFUNC_T GetScalarBoxBlurFunc();
+
+} // namespace sphere
+
+
+#endif
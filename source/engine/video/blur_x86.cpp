@@ -0,0 +1,190 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <algorithm>
+#include "../common/platform.hpp"
+#include "blur.hpp"
+
+#if defined(SPHERE_X86)
+
+#include <emmintrin.h>
+
+#if defined(__GNUC__)
+#  define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#  define TARGET_SSE2
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // The channels of a pixel as 32 bit integers
+    TARGET_SSE2
+    static inline __m128i load_pixel_sse2(const RGBA* p)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i x = _mm_cvtsi32_si128(*(const int*)p);
+        return _mm_unpacklo_epi16(_mm_unpacklo_epi8(x, zero), zero);
+    }
+
+    //-----------------------------------------------------------------
+    // The channels of four pixels as 32 bit integers
+    TARGET_SSE2
+    static inline void load_pixels_sse2(const RGBA* p, __m128i x[4])
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i v  = _mm_loadu_si128((const __m128i*)p);
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        x[0] = _mm_unpacklo_epi16(lo, zero);
+        x[1] = _mm_unpackhi_epi16(lo, zero);
+        x[2] = _mm_unpacklo_epi16(hi, zero);
+        x[3] = _mm_unpackhi_epi16(hi, zero);
+    }
+
+    //-----------------------------------------------------------------
+    // sum / size, rounded the same way as the scalar kernel
+    TARGET_SSE2
+    static inline __m128i get_box_average_sse2(__m128i sum, __m128 scale)
+    {
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), scale), _mm_set1_ps(0.5f)));
+    }
+
+    //-----------------------------------------------------------------
+    // Packs the channels of four pixels, with the colors of s instead
+    // for alpha only blurs
+    TARGET_SSE2
+    static inline __m128i pack_pixels_sse2(__m128i x0, __m128i x1, __m128i x2, __m128i x3, const RGBA* s, bool alphaOnly)
+    {
+        __m128i x = _mm_packus_epi16(_mm_packs_epi32(x0, x1), _mm_packs_epi32(x2, x3));
+        if (alphaOnly) {
+            const __m128i keep = _mm_set1_epi32(0x00FFFFFF);
+            x = _mm_or_si128(_mm_andnot_si128(keep, x), _mm_and_si128(_mm_loadu_si128((const __m128i*)s), keep));
+        }
+        return x;
+    }
+
+    //-----------------------------------------------------------------
+    // Writes the averages of one pixel of each line and moves the
+    // windows on by adding the pixels at a and removing the ones at b
+    TARGET_SSE2
+    static inline void box_blur_step_sse2(__m128i* sums, int numLines, const RGBA* s, const RGBA* a, const RGBA* b, RGBA* d, __m128 scale, bool alphaOnly)
+    {
+        int l = 0;
+        for (; l + 4 <= numLines; l += 4) {
+            __m128i* sum = sums + l;
+            __m128i x = pack_pixels_sse2(get_box_average_sse2(sum[0], scale),
+                                         get_box_average_sse2(sum[1], scale),
+                                         get_box_average_sse2(sum[2], scale),
+                                         get_box_average_sse2(sum[3], scale), s + l, alphaOnly);
+            _mm_storeu_si128((__m128i*)(d + l), x);
+            __m128i pa[4];
+            __m128i pb[4];
+            load_pixels_sse2(a + l, pa);
+            load_pixels_sse2(b + l, pb);
+            for (int k = 0; k < 4; ++k) {
+                sum[k] = _mm_add_epi32(sum[k], _mm_sub_epi32(pa[k], pb[k]));
+            }
+        }
+        for (; l < numLines; ++l) {
+            __m128i x = get_box_average_sse2(sums[l], scale);
+            x = _mm_packs_epi32(x, x);
+            x = _mm_packus_epi16(x, x);
+            RGBA c;
+            *(int*)&c = _mm_cvtsi128_si32(x);
+            if (alphaOnly) {
+                d[l] = s[l];
+                d[l].alpha = c.alpha;
+            } else {
+                d[l] = c;
+            }
+            sums[l] = _mm_add_epi32(sums[l], _mm_sub_epi32(load_pixel_sse2(a + l), load_pixel_sse2(b + l)));
+        }
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void box_blur_sse2(const RGBA* src, int srcStride, RGBA* dst, int dstStride, int length, int numLines, int radius, bool alphaOnly)
+    {
+        assert(numLines <= BLUR_MAX_LINES);
+
+        const __m128 scale = _mm_set1_ps(1.0f / (radius * 2 + 1));
+        __m128i sums[BLUR_MAX_LINES];
+
+        // the window of the first pixel
+        for (int l = 0; l < numLines; ++l) {
+            sums[l] = _mm_setzero_si128();
+            for (int j = -radius; j <= radius; ++j) {
+                sums[l] = _mm_add_epi32(sums[l], load_pixel_sse2(src + std::min(std::max(j, 0), length - 1) * srcStride + l));
+            }
+        }
+
+        // the windows of the pixels from i1 to i2 lie within the line
+        int i1 = std::min(radius, length);
+        int i2 = std::max(length - radius - 1, i1);
+
+        for (int i = 0; i < i1; ++i) {
+            const RGBA* a = src + std::min(i + radius + 1, length - 1) * srcStride;
+            box_blur_step_sse2(sums, numLines, src + i * srcStride, a, src, dst + i * dstStride, scale, alphaOnly);
+        }
+
+        int i = i1;
+        const RGBA* s = src + i1 * srcStride;
+        const RGBA* a = src + (i1 + radius + 1) * srcStride;
+        const RGBA* b = src + (i1 - radius) * srcStride;
+        RGBA* d = dst + i1 * dstStride;
+        if (numLines == 1 && srcStride == 1 && dstStride == 1) {
+            // a row, four pixels at a time
+            __m128i sum = sums[0];
+            for (; i + 4 <= i2; i += 4) {
+                __m128i pa[4];
+                __m128i pb[4];
+                load_pixels_sse2(a, pa);
+                load_pixels_sse2(b, pb);
+                __m128i x[4];
+                for (int k = 0; k < 4; ++k) {
+                    x[k] = get_box_average_sse2(sum, scale);
+                    sum = _mm_add_epi32(sum, _mm_sub_epi32(pa[k], pb[k]));
+                }
+                _mm_storeu_si128((__m128i*)d, pack_pixels_sse2(x[0], x[1], x[2], x[3], s, alphaOnly));
+                s += 4;
+                a += 4;
+                b += 4;
+                d += 4;
+            }
+            sums[0] = sum;
+        }
+        for (; i < i2; ++i) {
+            box_blur_step_sse2(sums, numLines, s, a, b, d, scale, alphaOnly);
+            s += srcStride;
+            a += srcStride;
+            b += srcStride;
+            d += dstStride;
+        }
+
+        for (i = i2; i < length; ++i) {
+            const RGBA* a = src + std::min(i + radius + 1, length - 1) * srcStride;
+            const RGBA* b = src + std::max(i - radius, 0) * srcStride;
+            box_blur_step_sse2(sums, numLines, src + i * srcStride, a, b, dst + i * dstStride, scale, alphaOnly);
+        }
+    }
+
+} // namespace sphere
+
+#endif
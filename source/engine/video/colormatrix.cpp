@@ -0,0 +1,112 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "../common/platform.hpp"
+#include "../core/cpu.hpp"
+#include "colormatrix.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // The products are added up in the same order as in the SIMD kernels
+    static inline u8 transform_channel(const float* m, float r, float g, float b, float a)
+    {
+        float x = m[0] * r;
+        x = x + m[1] * g;
+        x = x + m[2] * b;
+        x = x + m[3] * a;
+        x = x + m[4];
+        x = std::max(std::min(x, 255.0f), 0.0f);
+        return (u8)(int)(x + 0.5f);
+    }
+
+    //-----------------------------------------------------------------
+    static void color_matrix_span(RGBA* pixels, int n, const float matrix[20])
+    {
+        while (n > 0) {
+            float r = pixels->red;
+            float g = pixels->green;
+            float b = pixels->blue;
+            float a = pixels->alpha;
+            pixels->red   = transform_channel(matrix,      r, g, b, a);
+            pixels->green = transform_channel(matrix + 5,  r, g, b, a);
+            pixels->blue  = transform_channel(matrix + 10, r, g, b, a);
+            pixels->alpha = transform_channel(matrix + 15, r, g, b, a);
+            pixels++;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // x * 21846 >> 16 equals x / 3 for all sums of three channels
+    static void grey_span(RGBA* pixels, int n)
+    {
+        while (n > 0) {
+            u8 grey = (u8)(((pixels->red + pixels->green + pixels->blue) * 21846) >> 16);
+            pixels->red   = grey;
+            pixels->green = grey;
+            pixels->blue  = grey;
+            pixels++;
+            n--;
+        }
+    }
+
+#if defined(SPHERE_X86)
+    // defined in colormatrix_x86.cpp
+    void color_matrix_span_sse2(RGBA* pixels, int n, const float matrix[20]);
+    void grey_span_sse2(RGBA* pixels, int n);
+#endif
+
+    //-----------------------------------------------------------------
+    COLORMATRIXSPANFUNC_T GetColorMatrixSpanFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return color_matrix_span_sse2;
+        }
+#endif
+        return color_matrix_span;
+    }
+
+    //-----------------------------------------------------------------
+    COLORMATRIXSPANFUNC_T GetScalarColorMatrixSpanFunc()
+    {
+        return color_matrix_span;
+    }
+
+    //-----------------------------------------------------------------
+    GREYSPANFUNC_T GetGreySpanFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return grey_span_sse2;
+        }
+#endif
+        return grey_span;
+    }
+
+    //-----------------------------------------------------------------
+    GREYSPANFUNC_T GetScalarGreySpanFunc()
+    {
+        return grey_span;
+    }
+
+} // namespace sphere
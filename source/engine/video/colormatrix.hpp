@@ -0,0 +1,47 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_COLORMATRIX_HPP
+#define SPHERE_COLORMATRIX_HPP
+
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Color matrix spans transform n pixels in place by the 4x5 row
+    // major matrix, i.e. red = m[0] * r + m[1] * g + m[2] * b + m[3] * a
+    // + m[4], with channels from 0 to 255. Results are clamped and
+    // rounded.
+    typedef void (*COLORMATRIXSPANFUNC_T)(RGBA* pixels, int n, const float matrix[20]);
+
+    // Grey spans set the color channels of n pixels to their average,
+    // (r + g + b) / 3 rounded down
+    typedef void (*GREYSPANFUNC_T)(RGBA* pixels, int n);
+
+    // The Get*Func functions return the fastest kernel the CPU supports,
+    // which produces the same result as the scalar one
+    COLORMATRIXSPANFUNC_T GetColorMatrixSpanFunc();
+    COLORMATRIXSPANFUNC_T GetScalarColorMatrixSpanFunc();
+    GREYSPANFUNC_T        GetGreySpanFunc();
+    GREYSPANFUNC_T        GetScalarGreySpanFunc();
+
+} // namespace sphere
+
+
+#endif
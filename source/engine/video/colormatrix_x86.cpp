@@ -0,0 +1,126 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/platform.hpp"
+#include "colormatrix.hpp"
+
+#if defined(SPHERE_X86)
+
+#include <emmintrin.h>
+
+#if defined(__GNUC__)
+#  define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#  define TARGET_SSE2
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Computes one output channel of four pixels, whose input channels
+    // are in r, g, b and a
+    TARGET_SSE2
+    static inline __m128i transform_channel_sse2(const __m128 m[5], __m128 r, __m128 g, __m128 b, __m128 a)
+    {
+        __m128 x = _mm_mul_ps(m[0], r);
+        x = _mm_add_ps(x, _mm_mul_ps(m[1], g));
+        x = _mm_add_ps(x, _mm_mul_ps(m[2], b));
+        x = _mm_add_ps(x, _mm_mul_ps(m[3], a));
+        x = _mm_add_ps(x, m[4]);
+        x = _mm_max_ps(_mm_min_ps(x, _mm_set1_ps(255.0f)), _mm_setzero_ps());
+        return _mm_cvttps_epi32(_mm_add_ps(x, _mm_set1_ps(0.5f)));
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void color_matrix_span_sse2(RGBA* pixels, int n, const float matrix[20])
+    {
+        // each matrix entry broadcast, the pixels are split into one
+        // vector per channel
+        __m128 m[4][5];
+        for (int i = 0; i < 4; ++i) {
+            for (int j = 0; j < 5; ++j) {
+                m[i][j] = _mm_set1_ps(matrix[i * 5 + j]);
+            }
+        }
+
+        const __m128i mask = _mm_set1_epi32(0xFF);
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i*)(pixels + i));
+            __m128 r = _mm_cvtepi32_ps(_mm_and_si128(p, mask));
+            __m128 g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 8), mask));
+            __m128 b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 16), mask));
+            __m128 a = _mm_cvtepi32_ps(_mm_srli_epi32(p, 24));
+            __m128i x = transform_channel_sse2(m[0], r, g, b, a);
+            x = _mm_or_si128(x, _mm_slli_epi32(transform_channel_sse2(m[1], r, g, b, a), 8));
+            x = _mm_or_si128(x, _mm_slli_epi32(transform_channel_sse2(m[2], r, g, b, a), 16));
+            x = _mm_or_si128(x, _mm_slli_epi32(transform_channel_sse2(m[3], r, g, b, a), 24));
+            _mm_storeu_si128((__m128i*)(pixels + i), x);
+        }
+        if (i < n) {
+            // the last pixels through a temporary vector
+            RGBA tail[4];
+            for (int k = 0; k < n - i; ++k) {
+                tail[k] = pixels[i + k];
+            }
+            color_matrix_span_sse2(tail, 4, matrix);
+            for (int k = 0; k < n - i; ++k) {
+                pixels[i + k] = tail[k];
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void grey_span_sse2(RGBA* pixels, int n)
+    {
+        const __m128i mask  = _mm_set1_epi32(0xFF);
+        const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+        const __m128i third = _mm_set1_epi16(21846);
+        int i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i p0 = _mm_loadu_si128((const __m128i*)(pixels + i));
+            __m128i p1 = _mm_loadu_si128((const __m128i*)(pixels + i + 4));
+            __m128i s0 = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(p0, mask),
+                                                     _mm_and_si128(_mm_srli_epi32(p0, 8), mask)),
+                                       _mm_and_si128(_mm_srli_epi32(p0, 16), mask));
+            __m128i s1 = _mm_add_epi32(_mm_add_epi32(_mm_and_si128(p1, mask),
+                                                     _mm_and_si128(_mm_srli_epi32(p1, 8), mask)),
+                                       _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+            // the sums fit into 16 bits, and so does the grey level
+            __m128i g  = _mm_mulhi_epu16(_mm_packs_epi32(s0, s1), third);
+            __m128i g0 = _mm_unpacklo_epi16(g, _mm_setzero_si128());
+            __m128i g1 = _mm_unpackhi_epi16(g, _mm_setzero_si128());
+            g0 = _mm_or_si128(g0, _mm_or_si128(_mm_slli_epi32(g0, 8), _mm_slli_epi32(g0, 16)));
+            g1 = _mm_or_si128(g1, _mm_or_si128(_mm_slli_epi32(g1, 8), _mm_slli_epi32(g1, 16)));
+            _mm_storeu_si128((__m128i*)(pixels + i),     _mm_or_si128(g0, _mm_and_si128(p0, alpha)));
+            _mm_storeu_si128((__m128i*)(pixels + i + 4), _mm_or_si128(g1, _mm_and_si128(p1, alpha)));
+        }
+        for (; i < n; ++i) {
+            RGBA& p = pixels[i];
+            u8 grey = (u8)(((p.red + p.green + p.blue) * 21846) >> 16);
+            p.red   = grey;
+            p.green = grey;
+            p.blue  = grey;
+        }
+    }
+
+} // namespace sphere
+
+#endif
@@ -0,0 +1,176 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <cstring>
+#include "../common/platform.hpp"
+#include "../core/cpu.hpp"
+#include "convert.hpp"
+
+
+namespace sphere {
+
+    // RGBA, BGRA, RGB and A8
+    static const int NUM_BUFFER_FORMATS = 4;
+
+    //-----------------------------------------------------------------
+    static void pack_rgba(const RGBA* src, u8* dst, int n)
+    {
+        memcpy(dst, src, n * sizeof(RGBA));
+    }
+
+    //-----------------------------------------------------------------
+    static void pack_bgra(const RGBA* src, u8* dst, int n)
+    {
+        for (int i = 0; i < n; ++i) {
+            dst[0] = src[i].blue;
+            dst[1] = src[i].green;
+            dst[2] = src[i].red;
+            dst[3] = src[i].alpha;
+            dst += 4;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void pack_rgb(const RGBA* src, u8* dst, int n)
+    {
+        for (int i = 0; i < n; ++i) {
+            dst[0] = src[i].red;
+            dst[1] = src[i].green;
+            dst[2] = src[i].blue;
+            dst += 3;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void pack_a8(const RGBA* src, u8* dst, int n)
+    {
+        for (int i = 0; i < n; ++i) {
+            dst[i] = src[i].alpha;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void unpack_rgba(const u8* src, RGBA* dst, int n)
+    {
+        memcpy(dst, src, n * sizeof(RGBA));
+    }
+
+    //-----------------------------------------------------------------
+    static void unpack_bgra(const u8* src, RGBA* dst, int n)
+    {
+        for (int i = 0; i < n; ++i) {
+            dst[i] = RGBA(src[2], src[1], src[0], src[3]);
+            src += 4;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void unpack_rgb(const u8* src, RGBA* dst, int n)
+    {
+        for (int i = 0; i < n; ++i) {
+            dst[i] = RGBA(src[0], src[1], src[2], 255);
+            src += 3;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    template<bool premultipliedT>
+    static void unpack_a8(const u8* src, RGBA* dst, int n)
+    {
+        for (int i = 0; i < n; ++i) {
+            u8 c = premultipliedT ? src[i] : 255;
+            dst[i] = RGBA(c, c, c, src[i]);
+        }
+    }
+
+    static const PACKSPANFUNC_T g_ScalarPackSpanFuncs[NUM_BUFFER_FORMATS] = {
+        pack_rgba,
+        pack_bgra,
+        pack_rgb,
+        pack_a8,
+    };
+
+    // indexed by premultiplied and format
+    static const UNPACKSPANFUNC_T g_ScalarUnpackSpanFuncs[2][NUM_BUFFER_FORMATS] = {
+        { unpack_rgba, unpack_bgra, unpack_rgb, unpack_a8<false> },
+        { unpack_rgba, unpack_bgra, unpack_rgb, unpack_a8<true>  },
+    };
+
+#if defined(SPHERE_X86)
+    // defined in convert_x86.cpp
+    void pack_bgra_sse2(const RGBA* src, u8* dst, int n);
+    void pack_a8_sse2(const RGBA* src, u8* dst, int n);
+    void unpack_bgra_sse2(const u8* src, RGBA* dst, int n);
+    void unpack_a8_sse2(const u8* src, RGBA* dst, int n);
+    void unpack_a8_pre_sse2(const u8* src, RGBA* dst, int n);
+
+    // RGB needs byte shuffles, which SSE2 doesn't have
+    static const PACKSPANFUNC_T g_SSE2PackSpanFuncs[NUM_BUFFER_FORMATS] = {
+        pack_rgba,
+        pack_bgra_sse2,
+        pack_rgb,
+        pack_a8_sse2,
+    };
+
+    static const UNPACKSPANFUNC_T g_SSE2UnpackSpanFuncs[2][NUM_BUFFER_FORMATS] = {
+        { unpack_rgba, unpack_bgra_sse2, unpack_rgb, unpack_a8_sse2     },
+        { unpack_rgba, unpack_bgra_sse2, unpack_rgb, unpack_a8_pre_sse2 },
+    };
+#endif
+
+    //-----------------------------------------------------------------
+    PACKSPANFUNC_T GetPackSpanFunc(int format)
+    {
+        assert(format >= 0 && format < NUM_BUFFER_FORMATS);
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return g_SSE2PackSpanFuncs[format];
+        }
+#endif
+        return g_ScalarPackSpanFuncs[format];
+    }
+
+    //-----------------------------------------------------------------
+    PACKSPANFUNC_T GetScalarPackSpanFunc(int format)
+    {
+        assert(format >= 0 && format < NUM_BUFFER_FORMATS);
+        return g_ScalarPackSpanFuncs[format];
+    }
+
+    //-----------------------------------------------------------------
+    UNPACKSPANFUNC_T GetUnpackSpanFunc(int format, bool premultiplied)
+    {
+        assert(format >= 0 && format < NUM_BUFFER_FORMATS);
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return g_SSE2UnpackSpanFuncs[premultiplied ? 1 : 0][format];
+        }
+#endif
+        return g_ScalarUnpackSpanFuncs[premultiplied ? 1 : 0][format];
+    }
+
+    //-----------------------------------------------------------------
+    UNPACKSPANFUNC_T GetScalarUnpackSpanFunc(int format, bool premultiplied)
+    {
+        assert(format >= 0 && format < NUM_BUFFER_FORMATS);
+        return g_ScalarUnpackSpanFuncs[premultiplied ? 1 : 0][format];
+    }
+
+} // namespace sphere
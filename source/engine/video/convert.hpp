@@ -0,0 +1,44 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_CONVERT_HPP
+#define SPHERE_CONVERT_HPP
+
+#include "../common/types.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Pack functions convert n canvas pixels to an external pixel
+    // format, unpack functions convert back, both indexed by
+    // Canvas::BufferFormat. Unpacking A8 gives white pixels of the
+    // given alpha, premultiplied if premultiplied is set. The Get
+    // functions return the fastest kernels the CPU supports.
+    typedef void (*PACKSPANFUNC_T)(const RGBA* src, u8* dst, int n);
+    typedef void (*UNPACKSPANFUNC_T)(const u8* src, RGBA* dst, int n);
+
+    PACKSPANFUNC_T   GetPackSpanFunc(int format);
+    PACKSPANFUNC_T   GetScalarPackSpanFunc(int format);
+    UNPACKSPANFUNC_T GetUnpackSpanFunc(int format, bool premultiplied);
+    UNPACKSPANFUNC_T GetScalarUnpackSpanFunc(int format, bool premultiplied);
+
+} // namespace sphere
+
+
+#endif
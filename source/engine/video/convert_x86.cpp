@@ -0,0 +1,136 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/platform.hpp"
+#include "convert.hpp"
+
+#if defined(SPHERE_X86)
+
+#include <emmintrin.h>
+
+#if defined(__GNUC__)
+#  define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#  define TARGET_SSE2
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Swaps the first and third byte of each of the four pixels in v
+    TARGET_SSE2
+    static inline __m128i swap_red_blue_sse2(__m128i v)
+    {
+        const __m128i ga = _mm_set1_epi32(0xFF00FF00);
+        const __m128i rb = _mm_set1_epi32(0x000000FF);
+        __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), rb);
+        __m128i b = _mm_slli_epi32(_mm_and_si128(v, rb), 16);
+        return _mm_or_si128(_mm_and_si128(v, ga), _mm_or_si128(r, b));
+    }
+
+    //-----------------------------------------------------------------
+    // The swap is its own inverse, so packing and unpacking are alike
+    TARGET_SSE2
+    static inline void swap_span_sse2(const u8* src, u8* dst, int n)
+    {
+        int i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+            _mm_storeu_si128((__m128i*)(dst + i * 4), swap_red_blue_sse2(v));
+        }
+        for (; i < n; ++i) {
+            u8 r = src[i * 4];
+            dst[i * 4 + 0] = src[i * 4 + 2];
+            dst[i * 4 + 1] = src[i * 4 + 1];
+            dst[i * 4 + 2] = r;
+            dst[i * 4 + 3] = src[i * 4 + 3];
+        }
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void pack_bgra_sse2(const RGBA* src, u8* dst, int n)
+    {
+        swap_span_sse2((const u8*)src, dst, n);
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void unpack_bgra_sse2(const u8* src, RGBA* dst, int n)
+    {
+        swap_span_sse2(src, (u8*)dst, n);
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void pack_a8_sse2(const RGBA* src, u8* dst, int n)
+    {
+        int i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i a0 = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)(src + i)),      24);
+            __m128i a1 = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)(src + i + 4)),  24);
+            __m128i a2 = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)(src + i + 8)),  24);
+            __m128i a3 = _mm_srli_epi32(_mm_loadu_si128((const __m128i*)(src + i + 12)), 24);
+            __m128i a  = _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(a2, a3));
+            _mm_storeu_si128((__m128i*)(dst + i), a);
+        }
+        for (; i < n; ++i) {
+            dst[i] = src[i].alpha;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // Spreads each of 16 alpha values to all four bytes of a pixel,
+    // which gives premultiplied white, and or's in white if straight
+    TARGET_SSE2
+    static inline void unpack_a8_span_sse2(const u8* src, RGBA* dst, int n, bool premultiplied)
+    {
+        const __m128i white = premultiplied ? _mm_setzero_si128() : _mm_set1_epi32(0x00FFFFFF);
+        int i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i a  = _mm_loadu_si128((const __m128i*)(src + i));
+            __m128i lo = _mm_unpacklo_epi8(a, a);
+            __m128i hi = _mm_unpackhi_epi8(a, a);
+            _mm_storeu_si128((__m128i*)(dst + i),      _mm_or_si128(_mm_unpacklo_epi16(lo, lo), white));
+            _mm_storeu_si128((__m128i*)(dst + i + 4),  _mm_or_si128(_mm_unpackhi_epi16(lo, lo), white));
+            _mm_storeu_si128((__m128i*)(dst + i + 8),  _mm_or_si128(_mm_unpacklo_epi16(hi, hi), white));
+            _mm_storeu_si128((__m128i*)(dst + i + 12), _mm_or_si128(_mm_unpackhi_epi16(hi, hi), white));
+        }
+        for (; i < n; ++i) {
+            u8 c = premultiplied ? src[i] : 255;
+            dst[i] = RGBA(c, c, c, src[i]);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void unpack_a8_sse2(const u8* src, RGBA* dst, int n)
+    {
+        unpack_a8_span_sse2(src, dst, n, false);
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void unpack_a8_pre_sse2(const u8* src, RGBA* dst, int n)
+    {
+        unpack_a8_span_sse2(src, dst, n, true);
+    }
+
+} // namespace sphere
+
+#endif
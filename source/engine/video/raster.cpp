@@ -0,0 +1,68 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/platform.hpp"
+#include "../core/cpu.hpp"
+#include "raster.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    static void block_coverage(const i32* e, const i32* a, const i32* b, int numEdges, int width, int height, u8* masks)
+    {
+        for (int iy = 0; iy < height; ++iy) {
+            u8 mask = 0;
+            for (int ix = 0; ix < width; ++ix) {
+                bool inside = true;
+                for (int i = 0; i < numEdges; ++i) {
+                    if (e[i] + ix * a[i] + iy * b[i] < 0) {
+                        inside = false;
+                    }
+                }
+                if (inside) {
+                    mask |= (u8)(1 << ix);
+                }
+            }
+            masks[iy] = mask;
+        }
+    }
+
+#if defined(SPHERE_X86)
+    // defined in raster_x86.cpp
+    void block_coverage_sse2(const i32* e, const i32* a, const i32* b, int numEdges, int width, int height, u8* masks);
+#endif
+
+    //-----------------------------------------------------------------
+    BLOCKCOVERAGEFUNC_T GetBlockCoverageFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return block_coverage_sse2;
+        }
+#endif
+        return block_coverage;
+    }
+
+    //-----------------------------------------------------------------
+    BLOCKCOVERAGEFUNC_T GetScalarBlockCoverageFunc()
+    {
+        return block_coverage;
+    }
+
+} // namespace sphere
@@ -0,0 +1,48 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_RASTER_HPP
+#define SPHERE_RASTER_HPP
+
+#include "../common/types.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Triangles are rasterized in blocks of RASTER_BLOCK_SIZE squared
+    // pixels, aligned to the canvas origin
+    enum {
+        RASTER_BLOCK_SIZE = 8,
+    };
+
+    //-----------------------------------------------------------------
+    // Block coverage functions test the pixels of a width x height block
+    // (at most RASTER_BLOCK_SIZE on each side) against numEdges edge
+    // functions, where e[i] is the value of edge i at the top left pixel
+    // and a[i] and b[i] are its steps in x and y. A pixel is covered if
+    // every edge is >= 0, and bit x of masks[y] is set for it. The values
+    // have to fit into 32 bits anywhere in the block.
+    typedef void (*BLOCKCOVERAGEFUNC_T)(const i32* e, const i32* a, const i32* b, int numEdges, int width, int height, u8* masks);
+
+    BLOCKCOVERAGEFUNC_T GetBlockCoverageFunc();
+    BLOCKCOVERAGEFUNC_T GetScalarBlockCoverageFunc();
+
+} // namespace sphere
+
+
+#endif
@@ -0,0 +1,67 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/platform.hpp"
+#include "raster.hpp"
+
+#if defined(SPHERE_X86)
+
+#include <emmintrin.h>
+
+#if defined(__GNUC__)
+#  define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#  define TARGET_SSE2
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Evaluates the edges for a row of eight pixels at once, the sign
+    // bits of the edge values ORed together flag the uncovered pixels
+    TARGET_SSE2
+    void block_coverage_sse2(const i32* e, const i32* a, const i32* b, int numEdges, int width, int height, u8* masks)
+    {
+        __m128i lo[3];
+        __m128i hi[3];
+        __m128i step[3];
+        for (int i = 0; i < numEdges; ++i) {
+            lo[i]   = _mm_set_epi32(e[i] + 3 * a[i], e[i] + 2 * a[i], e[i] + a[i], e[i]);
+            hi[i]   = _mm_add_epi32(lo[i], _mm_set1_epi32(4 * a[i]));
+            step[i] = _mm_set1_epi32(b[i]);
+        }
+
+        int widthMask = (1 << width) - 1;
+        for (int iy = 0; iy < height; ++iy) {
+            __m128i outLo = _mm_setzero_si128();
+            __m128i outHi = _mm_setzero_si128();
+            for (int i = 0; i < numEdges; ++i) {
+                outLo = _mm_or_si128(outLo, lo[i]);
+                outHi = _mm_or_si128(outHi, hi[i]);
+                lo[i] = _mm_add_epi32(lo[i], step[i]);
+                hi[i] = _mm_add_epi32(hi[i], step[i]);
+            }
+            int outside = _mm_movemask_ps(_mm_castsi128_ps(outLo)) |
+                         (_mm_movemask_ps(_mm_castsi128_ps(outHi)) << 4);
+            masks[iy] = (u8)(~outside & widthMask);
+        }
+    }
+
+} // namespace sphere
+
+#endif
@@ -0,0 +1,329 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include "../common/platform.hpp"
+#include "../core/cpu.hpp"
+#include "Canvas.hpp"
+#include "resample.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    static const double PI = 3.14159265358979323846;
+
+    //-----------------------------------------------------------------
+    static inline double sinc(double x)
+    {
+        if (x == 0.0) {
+            return 1.0;
+        }
+        x *= PI;
+        return sin(x) / x;
+    }
+
+    //-----------------------------------------------------------------
+    // Radius of the filter kernels at a scale of 1, in source pixels
+    static double get_filter_support(int filter)
+    {
+        switch (filter) {
+            case Canvas::FILTER_BOX:      return 0.5;
+            case Canvas::FILTER_BILINEAR: return 1.0;
+            case Canvas::FILTER_BICUBIC:  return 2.0;
+            case Canvas::FILTER_LANCZOS:  return 3.0;
+            default:                      return 0.0;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static double get_filter_weight(int filter, double x)
+    {
+        x = fabs(x);
+        switch (filter) {
+            case Canvas::FILTER_BOX:
+                return (x <= 0.5) ? 1.0 : 0.0;
+
+            case Canvas::FILTER_BILINEAR:
+                return (x < 1.0) ? 1.0 - x : 0.0;
+
+            case Canvas::FILTER_BICUBIC: {
+                // Catmull-Rom (Keys, a = -0.5)
+                const double a = -0.5;
+                if (x < 1.0) {
+                    return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+                } else if (x < 2.0) {
+                    return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+                }
+                return 0.0;
+            }
+
+            case Canvas::FILTER_LANCZOS:
+                return (x < 3.0) ? sinc(x) * sinc(x / 3.0) : 0.0;
+
+            default:
+                return 0.0;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void BuildResampleWeights(int filter, int srcSize, int dstSize, ResampleWeights& weights)
+    {
+        assert(srcSize > 0);
+        assert(dstSize > 0);
+
+        const int one = 1 << RESAMPLE_PRECISION;
+
+        double scale        = (double)srcSize / dstSize;
+        double filter_scale = std::max(scale, 1.0);
+        double support      = get_filter_support(filter) * filter_scale;
+
+        int num_taps = 1;
+        if (filter != Canvas::FILTER_NEAREST) {
+            num_taps = std::min((int)ceil(support) * 2 + 1, srcSize);
+        }
+
+        weights.numTaps = num_taps;
+        weights.start.resize(dstSize);
+        weights.weights.resize(dstSize * num_taps);
+
+        std::vector<double> w(num_taps);
+        for (int i = 0; i < dstSize; ++i) {
+            double center = (i + 0.5) * scale;
+            i16* q = &weights.weights[i * num_taps];
+
+            if (filter == Canvas::FILTER_NEAREST) {
+                weights.start[i] = std::min((int)center, srcSize - 1);
+                q[0] = (i16)one;
+                continue;
+            }
+
+            // the source pixels whose centers lie within the support
+            int lo = (int)floor(center - support + 0.5);
+            int hi = (int)floor(center + support + 0.5);
+            int start = std::min(std::max(lo, 0), srcSize - num_taps);
+            weights.start[i] = start;
+
+            std::fill(w.begin(), w.end(), 0.0);
+            double total = 0.0;
+            for (int j = lo; j < hi; ++j) {
+                double f = get_filter_weight(filter, (j + 0.5 - center) / filter_scale);
+                w[std::min(std::max(j, 0), srcSize - 1) - start] += f;
+                total += f;
+            }
+            if (total == 0.0) {
+                w[std::min((int)center, srcSize - 1) - start] = 1.0;
+                total = 1.0;
+            }
+
+            // quantize, and put the rounding error on the largest weight
+            // so that the weights add up to exactly one
+            int sum     = 0;
+            int largest = 0;
+            for (int k = 0; k < num_taps; ++k) {
+                q[k] = (i16)floor(w[k] / total * one + 0.5);
+                sum += q[k];
+                if (abs(q[k]) > abs(q[largest])) {
+                    largest = k;
+                }
+            }
+            q[largest] = (i16)(q[largest] + one - sum);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    void BuildConvolutionWeights(const float* kernel, int numTaps, int size, ResampleWeights& weights)
+    {
+        assert(numTaps > 0);
+        assert(size > 0);
+
+        const int one = 1 << RESAMPLE_PRECISION;
+
+        int num_taps = std::min(numTaps, size);
+        int center   = numTaps / 2;
+
+        weights.numTaps = num_taps;
+        weights.start.resize(size);
+        weights.weights.resize(size * num_taps);
+
+        std::vector<double> w(num_taps);
+        for (int i = 0; i < size; ++i) {
+            int start = std::min(std::max(i - center, 0), size - num_taps);
+            weights.start[i] = start;
+
+            std::fill(w.begin(), w.end(), 0.0);
+            for (int k = 0; k < numTaps; ++k) {
+                int j = std::min(std::max(i - center + k, 0), size - 1);
+                w[j - start] += kernel[k];
+            }
+
+            i16* q = &weights.weights[i * num_taps];
+            for (int k = 0; k < num_taps; ++k) {
+                double x = floor(w[k] * one + 0.5);
+                q[k] = (i16)std::min(std::max(x, -32768.0), 32767.0);
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // Accumulators start out at one half for rounding
+    static const int RESAMPLE_ROUNDING = 1 << (RESAMPLE_PRECISION - 1);
+
+    //-----------------------------------------------------------------
+    template<int maxT>
+    static inline int clamp_channel(int acc)
+    {
+        if (acc < 0) {
+            return 0;
+        }
+        acc >>= RESAMPLE_PRECISION;
+        return acc > maxT ? maxT : acc;
+    }
+
+    //-----------------------------------------------------------------
+    // RGBA with maxT 255 or LinearRGBA with maxT LINEAR_MAX
+    template<typename PixelT, typename ChannelT, int maxT>
+    static void resample_row(const PixelT* src, PixelT* dst, int n, const int* start, const i16* weights, int numTaps)
+    {
+        for (int i = 0; i < n; ++i) {
+            const PixelT* s = src + start[i];
+            const i16*    w = weights + i * numTaps;
+            int r = RESAMPLE_ROUNDING;
+            int g = RESAMPLE_ROUNDING;
+            int b = RESAMPLE_ROUNDING;
+            int a = RESAMPLE_ROUNDING;
+            for (int k = 0; k < numTaps; ++k) {
+                r += s[k].red   * w[k];
+                g += s[k].green * w[k];
+                b += s[k].blue  * w[k];
+                a += s[k].alpha * w[k];
+            }
+            dst[i].red   = (ChannelT)clamp_channel<maxT>(r);
+            dst[i].green = (ChannelT)clamp_channel<maxT>(g);
+            dst[i].blue  = (ChannelT)clamp_channel<maxT>(b);
+            dst[i].alpha = (ChannelT)clamp_channel<maxT>(a);
+        }
+    }
+
+    //-----------------------------------------------------------------
+    template<typename PixelT, typename ChannelT, int maxT>
+    static void resample_column(const PixelT* src, int pitch, PixelT* dst, int n, const i16* weights, int numTaps)
+    {
+        for (int i = 0; i < n; ++i) {
+            const PixelT* s = src + i;
+            int r = RESAMPLE_ROUNDING;
+            int g = RESAMPLE_ROUNDING;
+            int b = RESAMPLE_ROUNDING;
+            int a = RESAMPLE_ROUNDING;
+            for (int k = 0; k < numTaps; ++k) {
+                r += s->red   * weights[k];
+                g += s->green * weights[k];
+                b += s->blue  * weights[k];
+                a += s->alpha * weights[k];
+                s += pitch;
+            }
+            dst[i].red   = (ChannelT)clamp_channel<maxT>(r);
+            dst[i].green = (ChannelT)clamp_channel<maxT>(g);
+            dst[i].blue  = (ChannelT)clamp_channel<maxT>(b);
+            dst[i].alpha = (ChannelT)clamp_channel<maxT>(a);
+        }
+    }
+
+#if defined(SPHERE_X86)
+    // defined in resample_x86.cpp
+    void resample_row_sse2(const RGBA* src, RGBA* dst, int n, const int* start, const i16* weights, int numTaps);
+    void resample_column_sse2(const RGBA* src, int pitch, RGBA* dst, int n, const i16* weights, int numTaps);
+    void resample_linear_row_sse2(const LinearRGBA* src, LinearRGBA* dst, int n, const int* start, const i16* weights, int numTaps);
+    void resample_linear_column_sse2(const LinearRGBA* src, int pitch, LinearRGBA* dst, int n, const i16* weights, int numTaps);
+#endif
+
+    //-----------------------------------------------------------------
+    RESAMPLEROWFUNC_T GetResampleRowFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return resample_row_sse2;
+        }
+#endif
+        return GetScalarResampleRowFunc();
+    }
+
+    //-----------------------------------------------------------------
+    RESAMPLEROWFUNC_T GetScalarResampleRowFunc()
+    {
+        return resample_row<RGBA, u8, 255>;
+    }
+
+    //-----------------------------------------------------------------
+    RESAMPLECOLUMNFUNC_T GetResampleColumnFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return resample_column_sse2;
+        }
+#endif
+        return GetScalarResampleColumnFunc();
+    }
+
+    //-----------------------------------------------------------------
+    RESAMPLECOLUMNFUNC_T GetScalarResampleColumnFunc()
+    {
+        return resample_column<RGBA, u8, 255>;
+    }
+
+    //-----------------------------------------------------------------
+    RESAMPLELINEARROWFUNC_T GetResampleLinearRowFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return resample_linear_row_sse2;
+        }
+#endif
+        return GetScalarResampleLinearRowFunc();
+    }
+
+    //-----------------------------------------------------------------
+    RESAMPLELINEARROWFUNC_T GetScalarResampleLinearRowFunc()
+    {
+        return resample_row<LinearRGBA, u16, LINEAR_MAX>;
+    }
+
+    //-----------------------------------------------------------------
+    RESAMPLELINEARCOLUMNFUNC_T GetResampleLinearColumnFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return resample_linear_column_sse2;
+        }
+#endif
+        return GetScalarResampleLinearColumnFunc();
+    }
+
+    //-----------------------------------------------------------------
+    RESAMPLELINEARCOLUMNFUNC_T GetScalarResampleLinearColumnFunc()
+    {
+        return resample_column<LinearRGBA, u16, LINEAR_MAX>;
+    }
+
+} // namespace sphere
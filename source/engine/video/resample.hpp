@@ -0,0 +1,85 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_RESAMPLE_HPP
+#define SPHERE_RESAMPLE_HPP
+
+#include <vector>
+#include "../common/types.hpp"
+#include "RGBA.hpp"
+#include "srgb.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Weights of a one-dimensional resampling pass from srcSize to
+    // dstSize pixels. Destination pixel i is the sum of the numTaps
+    // source pixels from start[i] on, each multiplied by its weight in
+    // weights[i * numTaps + k]. Weights are fixed point with
+    // RESAMPLE_PRECISION fraction bits and add up to exactly one for
+    // every pixel; taps beyond the edges are folded onto the edge
+    // pixels, so start[i] + numTaps never exceeds srcSize.
+    enum {
+        RESAMPLE_PRECISION = 14,
+    };
+
+    struct ResampleWeights {
+        int numTaps;
+        std::vector<int> start;
+        std::vector<i16> weights;
+    };
+
+    // filter is a Canvas::Filter; the kernel is widened by the scale
+    // factor when downscaling, so every source pixel contributes
+    void BuildResampleWeights(int filter, int srcSize, int dstSize, ResampleWeights& weights);
+
+    // Weights of a convolution of size pixels with the given kernel,
+    // centered on kernel[numTaps / 2]. The weights are not normalized.
+    void BuildConvolutionWeights(const float* kernel, int numTaps, int size, ResampleWeights& weights);
+
+    //-----------------------------------------------------------------
+    // Row resamplers write n pixels of a horizontal pass over the
+    // source row src to dst, with start and weights as above.
+    typedef void (*RESAMPLEROWFUNC_T)(const RGBA* src, RGBA* dst, int n, const int* start, const i16* weights, int numTaps);
+
+    // Column resamplers write one row of n pixels of a vertical pass
+    // to dst. src points to the first of the numTaps source rows,
+    // which are pitch pixels apart.
+    typedef void (*RESAMPLECOLUMNFUNC_T)(const RGBA* src, int pitch, RGBA* dst, int n, const i16* weights, int numTaps);
+
+    // The Get*Func functions return the fastest kernel the CPU supports,
+    // which produces the same result as the scalar one
+    RESAMPLEROWFUNC_T    GetResampleRowFunc();
+    RESAMPLEROWFUNC_T    GetScalarResampleRowFunc();
+    RESAMPLECOLUMNFUNC_T GetResampleColumnFunc();
+    RESAMPLECOLUMNFUNC_T GetScalarResampleColumnFunc();
+
+    // The same for linear light pixels, whose channels are clamped to
+    // 0..LINEAR_MAX instead of 0..255
+    typedef void (*RESAMPLELINEARROWFUNC_T)(const LinearRGBA* src, LinearRGBA* dst, int n, const int* start, const i16* weights, int numTaps);
+    typedef void (*RESAMPLELINEARCOLUMNFUNC_T)(const LinearRGBA* src, int pitch, LinearRGBA* dst, int n, const i16* weights, int numTaps);
+
+    RESAMPLELINEARROWFUNC_T    GetResampleLinearRowFunc();
+    RESAMPLELINEARROWFUNC_T    GetScalarResampleLinearRowFunc();
+    RESAMPLELINEARCOLUMNFUNC_T GetResampleLinearColumnFunc();
+    RESAMPLELINEARCOLUMNFUNC_T GetScalarResampleLinearColumnFunc();
+
+} // namespace sphere
+
+
+#endif
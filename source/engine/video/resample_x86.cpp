@@ -0,0 +1,241 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/platform.hpp"
+#include "resample.hpp"
+
+#if defined(SPHERE_X86)
+
+#include <emmintrin.h>
+
+#if defined(__GNUC__)
+#  define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#  define TARGET_SSE2
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // The kernels pair up taps so that _mm_madd_epi16 multiplies and
+    // adds two of them per channel. The products are exact and the sums
+    // fit into 32 bits, so the result equals the scalar one.
+    static const int RESAMPLE_ROUNDING = 1 << (RESAMPLE_PRECISION - 1);
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    static inline __m128i get_weight_pair_sse2(int w0, int w1)
+    {
+        return _mm_set1_epi32((int)((u32)(u16)w0 | ((u32)(u16)w1 << 16)));
+    }
+
+    //-----------------------------------------------------------------
+    // Saturates the accumulated channels to 0..255
+    TARGET_SSE2
+    static inline __m128i pack_channels_sse2(__m128i a, __m128i b)
+    {
+        a = _mm_srai_epi32(a, RESAMPLE_PRECISION);
+        b = _mm_srai_epi32(b, RESAMPLE_PRECISION);
+        return _mm_packs_epi32(a, b);
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void resample_row_sse2(const RGBA* src, RGBA* dst, int n, const int* start, const i16* weights, int numTaps)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        for (int i = 0; i < n; ++i) {
+            const RGBA* s = src + start[i];
+            const i16*  w = weights + i * numTaps;
+            __m128i acc = _mm_set1_epi32(RESAMPLE_ROUNDING);
+            int k = 0;
+            for (; k + 4 <= numTaps; k += 4) {
+                __m128i p  = _mm_loadu_si128((const __m128i*)(s + k));
+                __m128i lo = _mm_unpacklo_epi8(p, zero);  // r0 g0 b0 a0 r1 g1 b1 a1
+                __m128i hi = _mm_unpackhi_epi8(p, zero);  // r2 g2 b2 a2 r3 g3 b3 a3
+                lo = _mm_unpacklo_epi16(lo, _mm_srli_si128(lo, 8));  // r0 r1 g0 g1 ...
+                hi = _mm_unpacklo_epi16(hi, _mm_srli_si128(hi, 8));  // r2 r3 g2 g3 ...
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, get_weight_pair_sse2(w[k],     w[k + 1])));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, get_weight_pair_sse2(w[k + 2], w[k + 3])));
+            }
+            if (k + 2 <= numTaps) {
+                __m128i p = _mm_loadl_epi64((const __m128i*)(s + k));
+                p = _mm_unpacklo_epi8(p, zero);
+                p = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(p, get_weight_pair_sse2(w[k], w[k + 1])));
+                k += 2;
+            }
+            if (k < numTaps) {
+                __m128i p = _mm_cvtsi32_si128(*(const int*)(s + k));
+                p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero);
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(p, get_weight_pair_sse2(w[k], 0)));
+            }
+            __m128i c = pack_channels_sse2(acc, acc);
+            *(int*)(dst + i) = _mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+        }
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void resample_column_sse2(const RGBA* src, int pitch, RGBA* dst, int n, const i16* weights, int numTaps)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        int i = 0;
+
+        // four pixels at a time, two rows per step
+        for (; i + 4 <= n; i += 4) {
+            __m128i acc0 = _mm_set1_epi32(RESAMPLE_ROUNDING);
+            __m128i acc1 = acc0;
+            __m128i acc2 = acc0;
+            __m128i acc3 = acc0;
+            const RGBA* s = src + i;
+            for (int k = 0; k < numTaps; k += 2) {
+                __m128i a = _mm_loadu_si128((const __m128i*)s);
+                __m128i b = zero;
+                __m128i w;
+                if (k + 1 < numTaps) {
+                    b = _mm_loadu_si128((const __m128i*)(s + pitch));
+                    w = get_weight_pair_sse2(weights[k], weights[k + 1]);
+                } else {
+                    w = get_weight_pair_sse2(weights[k], 0);
+                }
+                __m128i alo = _mm_unpacklo_epi8(a, zero);
+                __m128i ahi = _mm_unpackhi_epi8(a, zero);
+                __m128i blo = _mm_unpacklo_epi8(b, zero);
+                __m128i bhi = _mm_unpackhi_epi8(b, zero);
+                acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(alo, blo), w));
+                acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(alo, blo), w));
+                acc2 = _mm_add_epi32(acc2, _mm_madd_epi16(_mm_unpacklo_epi16(ahi, bhi), w));
+                acc3 = _mm_add_epi32(acc3, _mm_madd_epi16(_mm_unpackhi_epi16(ahi, bhi), w));
+                s += pitch * 2;
+            }
+            __m128i c = _mm_packus_epi16(pack_channels_sse2(acc0, acc1), pack_channels_sse2(acc2, acc3));
+            _mm_storeu_si128((__m128i*)(dst + i), c);
+        }
+
+        // the remaining pixels one at a time
+        for (; i < n; ++i) {
+            __m128i acc = _mm_set1_epi32(RESAMPLE_ROUNDING);
+            const RGBA* s = src + i;
+            for (int k = 0; k < numTaps; k += 2) {
+                __m128i a = _mm_cvtsi32_si128(*(const int*)s);
+                __m128i b = zero;
+                __m128i w;
+                if (k + 1 < numTaps) {
+                    b = _mm_cvtsi32_si128(*(const int*)(s + pitch));
+                    w = get_weight_pair_sse2(weights[k], weights[k + 1]);
+                } else {
+                    w = get_weight_pair_sse2(weights[k], 0);
+                }
+                __m128i p = _mm_unpacklo_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(p, w));
+                s += pitch * 2;
+            }
+            __m128i c = pack_channels_sse2(acc, acc);
+            *(int*)(dst + i) = _mm_cvtsi128_si32(_mm_packus_epi16(c, c));
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // Saturates the accumulated channels to 0..LINEAR_MAX
+    TARGET_SSE2
+    static inline __m128i pack_linear_channels_sse2(__m128i a, __m128i b)
+    {
+        __m128i c = pack_channels_sse2(a, b);
+        c = _mm_max_epi16(c, _mm_setzero_si128());
+        return _mm_min_epi16(c, _mm_set1_epi16(LINEAR_MAX));
+    }
+
+    //-----------------------------------------------------------------
+    // Linear light pixels already have 16 bit channels, so they only
+    // need to be interleaved before the multiply-add
+    TARGET_SSE2
+    void resample_linear_row_sse2(const LinearRGBA* src, LinearRGBA* dst, int n, const int* start, const i16* weights, int numTaps)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        for (int i = 0; i < n; ++i) {
+            const LinearRGBA* s = src + start[i];
+            const i16*        w = weights + i * numTaps;
+            __m128i acc = _mm_set1_epi32(RESAMPLE_ROUNDING);
+            int k = 0;
+            for (; k + 2 <= numTaps; k += 2) {
+                __m128i p = _mm_loadu_si128((const __m128i*)(s + k));  // r0 g0 b0 a0 r1 g1 b1 a1
+                p = _mm_unpacklo_epi16(p, _mm_srli_si128(p, 8));        // r0 r1 g0 g1 ...
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(p, get_weight_pair_sse2(w[k], w[k + 1])));
+            }
+            if (k < numTaps) {
+                __m128i p = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(s + k)), zero);
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(p, get_weight_pair_sse2(w[k], 0)));
+            }
+            _mm_storel_epi64((__m128i*)(dst + i), pack_linear_channels_sse2(acc, acc));
+        }
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void resample_linear_column_sse2(const LinearRGBA* src, int pitch, LinearRGBA* dst, int n, const i16* weights, int numTaps)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        int i = 0;
+
+        // two pixels at a time, two rows per step
+        for (; i + 2 <= n; i += 2) {
+            __m128i acc0 = _mm_set1_epi32(RESAMPLE_ROUNDING);
+            __m128i acc1 = acc0;
+            const LinearRGBA* s = src + i;
+            for (int k = 0; k < numTaps; k += 2) {
+                __m128i a = _mm_loadu_si128((const __m128i*)s);
+                __m128i b = zero;
+                __m128i w;
+                if (k + 1 < numTaps) {
+                    b = _mm_loadu_si128((const __m128i*)(s + pitch));
+                    w = get_weight_pair_sse2(weights[k], weights[k + 1]);
+                } else {
+                    w = get_weight_pair_sse2(weights[k], 0);
+                }
+                acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+                acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+                s += pitch * 2;
+            }
+            _mm_storeu_si128((__m128i*)(dst + i), pack_linear_channels_sse2(acc0, acc1));
+        }
+
+        // the last pixel if n is odd
+        if (i < n) {
+            __m128i acc = _mm_set1_epi32(RESAMPLE_ROUNDING);
+            const LinearRGBA* s = src + i;
+            for (int k = 0; k < numTaps; k += 2) {
+                __m128i a = _mm_loadl_epi64((const __m128i*)s);
+                __m128i b = zero;
+                __m128i w;
+                if (k + 1 < numTaps) {
+                    b = _mm_loadl_epi64((const __m128i*)(s + pitch));
+                    w = get_weight_pair_sse2(weights[k], weights[k + 1]);
+                } else {
+                    w = get_weight_pair_sse2(weights[k], 0);
+                }
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+                s += pitch * 2;
+            }
+            _mm_storel_epi64((__m128i*)(dst + i), pack_linear_channels_sse2(acc, acc));
+        }
+    }
+
+} // namespace sphere
+
+#endif
@@ -0,0 +1,132 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cassert>
+#include "../common/platform.hpp"
+#include "../core/cpu.hpp"
+#include "sample.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    static inline int clamp_texel(int x, int min, int max)
+    {
+        return (x < min) ? min : ((x > max) ? max : x);
+    }
+
+    //-----------------------------------------------------------------
+    static void sample_span_nearest(RGBA* dst, int n, const RGBA* src, int pitch, const Recti& clamp, i32 u, i32 v, i32 du, i32 dv)
+    {
+        while (n > 0) {
+            int tx = clamp_texel(u >> 16, clamp.ul.x, clamp.lr.x);
+            int ty = clamp_texel(v >> 16, clamp.ul.y, clamp.lr.y);
+            *dst = src[ty * pitch + tx];
+            dst++;
+            u += du;
+            v += dv;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // The texels are weighted with 8 bit fractions, horizontally first,
+    // and each pass is truncated to 8 bit (the SIMD kernels do the same)
+    static void sample_span_bilinear(RGBA* dst, int n, const RGBA* src, int pitch, const Recti& clamp, i32 u, i32 v, i32 du, i32 dv)
+    {
+        // relative to texel centers
+        u -= 0x8000;
+        v -= 0x8000;
+
+        while (n > 0) {
+            int x0 = clamp_texel( u >> 16,      clamp.ul.x, clamp.lr.x);
+            int x1 = clamp_texel((u >> 16) + 1, clamp.ul.x, clamp.lr.x);
+            int y0 = clamp_texel( v >> 16,      clamp.ul.y, clamp.lr.y);
+            int y1 = clamp_texel((v >> 16) + 1, clamp.ul.y, clamp.lr.y);
+            int fx = (u >> 8) & 0xFF;
+            int fy = (v >> 8) & 0xFF;
+
+            const u8* p00 = (const u8*)&src[y0 * pitch + x0];
+            const u8* p01 = (const u8*)&src[y0 * pitch + x1];
+            const u8* p10 = (const u8*)&src[y1 * pitch + x0];
+            const u8* p11 = (const u8*)&src[y1 * pitch + x1];
+            u8* d = (u8*)dst;
+
+            for (int i = 0; i < 4; ++i) {
+                int t = (p00[i] * (256 - fx) + p01[i] * fx) >> 8;
+                int b = (p10[i] * (256 - fx) + p11[i] * fx) >> 8;
+                d[i] = (u8)((t * (256 - fy) + b * fy) >> 8);
+            }
+
+            dst++;
+            u += du;
+            v += dv;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static const int NUM_FILTERS = 2;
+
+    static const SAMPLESPANFUNC_T g_ScalarSampleSpanFuncs[NUM_FILTERS] = {
+        sample_span_nearest,
+        sample_span_bilinear,
+    };
+
+#if defined(SPHERE_X86)
+    // defined in sample_x86.cpp, indexed by filter, 0 if there is none
+    extern const SAMPLESPANFUNC_T g_SSE2SampleSpanFuncs[NUM_FILTERS];
+#endif
+
+    //-----------------------------------------------------------------
+    SAMPLESPANFUNC_T GetSampleSpanFunc(int filter)
+    {
+        static const bool sse2 = cpu::HasSSE2();
+        assert(filter >= 0 && filter < NUM_FILTERS);
+#if defined(SPHERE_X86)
+        if (sse2 && g_SSE2SampleSpanFuncs[filter]) {
+            return g_SSE2SampleSpanFuncs[filter];
+        }
+#endif
+        return g_ScalarSampleSpanFuncs[filter];
+    }
+
+    //-----------------------------------------------------------------
+    SAMPLESPANFUNC_T GetScalarSampleSpanFunc(int filter)
+    {
+        assert(filter >= 0 && filter < NUM_FILTERS);
+        return g_ScalarSampleSpanFuncs[filter];
+    }
+
+    //-----------------------------------------------------------------
+    void ModulateSpan(RGBA* dst, int n, const RGBA& mask)
+    {
+        int r = mask.red   + 1;
+        int g = mask.green + 1;
+        int b = mask.blue  + 1;
+        int a = mask.alpha + 1;
+        while (n > 0) {
+            dst->red   = (dst->red   * r) >> 8;
+            dst->green = (dst->green * g) >> 8;
+            dst->blue  = (dst->blue  * b) >> 8;
+            dst->alpha = (dst->alpha * a) >> 8;
+            dst++;
+            n--;
+        }
+    }
+
+} // namespace sphere
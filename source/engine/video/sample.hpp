@@ -0,0 +1,48 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_SAMPLE_HPP
+#define SPHERE_SAMPLE_HPP
+
+#include "../common/types.hpp"
+#include "../base/Rect.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Span samplers fill dst with n texels of the image src, starting at
+    // the texture coordinate (u, v) and stepping by (du, dv) per pixel.
+    // Coordinates are 16.16 fixed point in texels, with texel centers at
+    // half texels. Samples outside the section clamp are clamped to its
+    // edge. They are indexed by Canvas::Filter; GetSampleSpanFunc returns
+    // the fastest kernel the CPU supports, which always produces the same
+    // result as the scalar reference kernel.
+    typedef void (*SAMPLESPANFUNC_T)(RGBA* dst, int n, const RGBA* src, int pitch, const Recti& clamp, i32 u, i32 v, i32 du, i32 dv);
+
+    SAMPLESPANFUNC_T GetSampleSpanFunc(int filter);
+    SAMPLESPANFUNC_T GetScalarSampleSpanFunc(int filter);
+
+    //-----------------------------------------------------------------
+    // Multiplies each channel of n pixels by (mask + 1) / 256
+    void ModulateSpan(RGBA* dst, int n, const RGBA& mask);
+
+} // namespace sphere
+
+
+#endif
@@ -0,0 +1,96 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/platform.hpp"
+#include "sample.hpp"
+
+#if defined(SPHERE_X86)
+
+#include <emmintrin.h>
+
+#if defined(__GNUC__)
+#  define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#  define TARGET_SSE2
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    static inline int clamp_texel(int x, int min, int max)
+    {
+        return (x < min) ? min : ((x > max) ? max : x);
+    }
+
+    //-----------------------------------------------------------------
+    // Bit-exact with sample_span_bilinear in sample.cpp: the two texels
+    // of a row share a register as 16 bit lanes, where p0 * (256 - f) +
+    // p1 * f is at most 255 * 256 and can't overflow
+    TARGET_SSE2
+    static void sample_span_bilinear_sse2(RGBA* dst, int n, const RGBA* src, int pitch, const Recti& clamp, i32 u, i32 v, i32 du, i32 dv)
+    {
+        const __m128i zero = _mm_setzero_si128();
+
+        u -= 0x8000;
+        v -= 0x8000;
+
+        while (n > 0) {
+            int x0 = clamp_texel( u >> 16,      clamp.ul.x, clamp.lr.x);
+            int x1 = clamp_texel((u >> 16) + 1, clamp.ul.x, clamp.lr.x);
+            int y0 = clamp_texel( v >> 16,      clamp.ul.y, clamp.lr.y);
+            int y1 = clamp_texel((v >> 16) + 1, clamp.ul.y, clamp.lr.y);
+            int fx = (u >> 8) & 0xFF;
+            int fy = (v >> 8) & 0xFF;
+
+            const RGBA* r0 = src + y0 * pitch;
+            const RGBA* r1 = src + y1 * pitch;
+
+            // [p00 | p01] and [p10 | p11] as 16 bit channels
+            __m128i t = _mm_unpacklo_epi32(_mm_cvtsi32_si128(*(const int*)&r0[x0]), _mm_cvtsi32_si128(*(const int*)&r0[x1]));
+            __m128i b = _mm_unpacklo_epi32(_mm_cvtsi32_si128(*(const int*)&r1[x0]), _mm_cvtsi32_si128(*(const int*)&r1[x1]));
+            t = _mm_unpacklo_epi8(t, zero);
+            b = _mm_unpacklo_epi8(b, zero);
+
+            __m128i wx = _mm_set_epi16(fx, fx, fx, fx, 256 - fx, 256 - fx, 256 - fx, 256 - fx);
+            t = _mm_mullo_epi16(t, wx);
+            b = _mm_mullo_epi16(b, wx);
+            t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_si128(t, 8)), 8);
+            b = _mm_srli_epi16(_mm_add_epi16(b, _mm_srli_si128(b, 8)), 8);
+
+            __m128i c = _mm_add_epi16(_mm_mullo_epi16(t, _mm_set1_epi16((short)(256 - fy))),
+                                      _mm_mullo_epi16(b, _mm_set1_epi16((short)fy)));
+            c = _mm_srli_epi16(c, 8);
+            *(int*)dst = _mm_cvtsi128_si32(_mm_packus_epi16(c, zero));
+
+            dst++;
+            u += du;
+            v += dv;
+            n--;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    // nearest sampling is a plain gather, the scalar kernel is used
+    extern const SAMPLESPANFUNC_T g_SSE2SampleSpanFuncs[2] = {
+        0,
+        sample_span_bilinear_sse2,
+    };
+
+} // namespace sphere
+
+#endif
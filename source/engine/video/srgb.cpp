@@ -0,0 +1,108 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <algorithm>
+#include "blend.hpp"
+#include "srgb.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    struct SrgbTables {
+        u16 toLinear[256];
+        u8  toSrgb[LINEAR_MAX + 1];
+
+        SrgbTables() {
+            for (int i = 0; i < 256; ++i) {
+                double c = i / 255.0;
+                c = (c <= 0.04045) ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+                toLinear[i] = (u16)floor(c * LINEAR_MAX + 0.5);
+            }
+
+            // the nearest sRGB value, the lower one on ties
+            int c = 0;
+            for (int i = 0; i <= LINEAR_MAX; ++i) {
+                while (c < 255 && i * 2 > toLinear[c] + toLinear[c + 1]) {
+                    c++;
+                }
+                toSrgb[i] = (u8)c;
+            }
+        }
+    };
+
+    static const SrgbTables g_SrgbTables;
+
+    //-----------------------------------------------------------------
+    const u16* GetSrgbToLinearTable()
+    {
+        return g_SrgbTables.toLinear;
+    }
+
+    //-----------------------------------------------------------------
+    const u8* GetLinearToSrgbTable()
+    {
+        return g_SrgbTables.toSrgb;
+    }
+
+    //-----------------------------------------------------------------
+    void DecodeLinearSpan(const RGBA* src, LinearRGBA* dst, int n, bool premultiplied)
+    {
+        const u16* to_linear = g_SrgbTables.toLinear;
+        for (int i = 0; i < n; ++i) {
+            RGBA c = premultiplied ? rgba_unpremultiply(src[i]) : src[i];
+            int  a = c.alpha;
+            if (a == 255) {
+                dst[i].red   = to_linear[c.red];
+                dst[i].green = to_linear[c.green];
+                dst[i].blue  = to_linear[c.blue];
+            } else {
+                dst[i].red   = (u16)((to_linear[c.red]   * a + 127) / 255);
+                dst[i].green = (u16)((to_linear[c.green] * a + 127) / 255);
+                dst[i].blue  = (u16)((to_linear[c.blue]  * a + 127) / 255);
+            }
+            dst[i].alpha = (u16)a;
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static inline u8 encode_linear(int c, int a, const u8* to_srgb)
+    {
+        c = (a == 255) ? c : (c * 255 + a / 2) / a;
+        return to_srgb[std::min(c, (int)LINEAR_MAX)];
+    }
+
+    //-----------------------------------------------------------------
+    void EncodeLinearSpan(const LinearRGBA* src, RGBA* dst, int n, bool premultiplied)
+    {
+        const u8* to_srgb = g_SrgbTables.toSrgb;
+        for (int i = 0; i < n; ++i) {
+            int a = std::min((int)src[i].alpha, 255);
+            if (a == 0) {
+                dst[i] = RGBA(0, 0, 0, 0);
+                continue;
+            }
+            RGBA c(encode_linear(src[i].red,   a, to_srgb),
+                   encode_linear(src[i].green, a, to_srgb),
+                   encode_linear(src[i].blue,  a, to_srgb),
+                   (u8)a);
+            dst[i] = premultiplied ? rgba_premultiply(c) : c;
+        }
+    }
+
+} // namespace sphere
@@ -0,0 +1,59 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_SRGB_HPP
+#define SPHERE_SRGB_HPP
+
+#include "../common/types.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Linear light intensities have LINEAR_PRECISION bits. The sRGB to
+    // linear table has 256 entries, the linear to sRGB table one per
+    // intensity, which maps to the nearest sRGB value, so decoding and
+    // encoding again gives back the same sRGB value.
+    enum {
+        LINEAR_PRECISION = 12,
+        LINEAR_MAX       = (1 << LINEAR_PRECISION) - 1,
+    };
+
+    const u16* GetSrgbToLinearTable();
+    const u8*  GetLinearToSrgbTable();
+
+    //-----------------------------------------------------------------
+    // A pixel in linear light, with the color channels premultiplied
+    // by alpha, which keeps its 0..255 range
+    struct LinearRGBA {
+        u16 red;
+        u16 green;
+        u16 blue;
+        u16 alpha;
+    };
+
+    // Converts n pixels, premultiplied says whether the RGBA pixels
+    // store premultiplied alpha. Encoding clamps the channels to their
+    // ranges and the colors to alpha.
+    void DecodeLinearSpan(const RGBA* src, LinearRGBA* dst, int n, bool premultiplied);
+    void EncodeLinearSpan(const LinearRGBA* src, RGBA* dst, int n, bool premultiplied);
+
+} // namespace sphere
+
+
+#endif
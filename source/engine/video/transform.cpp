@@ -0,0 +1,132 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "../common/platform.hpp"
+#include "../core/cpu.hpp"
+#include "transform.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // 32 x 32 pixels are 4 KB, so a source and a destination block fit
+    // into the L1 cache together
+    static const int TRANSPOSE_BLOCK_SIZE = 32;
+
+    //-----------------------------------------------------------------
+    static void transpose(const RGBA* src, int srcPitch, RGBA* dst, int dstPitch, int width, int height)
+    {
+        for (int by = 0; by < height; by += TRANSPOSE_BLOCK_SIZE) {
+            int ey = std::min(by + TRANSPOSE_BLOCK_SIZE, height);
+            for (int bx = 0; bx < width; bx += TRANSPOSE_BLOCK_SIZE) {
+                int ex = std::min(bx + TRANSPOSE_BLOCK_SIZE, width);
+                for (int y = by; y < ey; ++y) {
+                    const RGBA* s = src + y * srcPitch;
+                    for (int x = bx; x < ex; ++x) {
+                        dst[x * dstPitch + y] = s[x];
+                    }
+                }
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void transpose_square(RGBA* pixels, int size)
+    {
+        // swap the blocks above the diagonal with the ones below it
+        for (int by = 0; by < size; by += TRANSPOSE_BLOCK_SIZE) {
+            int ey = std::min(by + TRANSPOSE_BLOCK_SIZE, size);
+            for (int bx = by; bx < size; bx += TRANSPOSE_BLOCK_SIZE) {
+                int ex = std::min(bx + TRANSPOSE_BLOCK_SIZE, size);
+                for (int y = by; y < ey; ++y) {
+                    for (int x = std::max(bx, y + 1); x < ex; ++x) {
+                        std::swap(pixels[y * size + x], pixels[x * size + y]);
+                    }
+                }
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    static void reverse_span(RGBA* pixels, int n)
+    {
+        std::reverse(pixels, pixels + n);
+    }
+
+#if defined(SPHERE_X86)
+    // defined in transform_x86.cpp
+    void transpose_sse2(const RGBA* src, int srcPitch, RGBA* dst, int dstPitch, int width, int height);
+    void transpose_square_sse2(RGBA* pixels, int size);
+    void reverse_span_sse2(RGBA* pixels, int n);
+#endif
+
+    //-----------------------------------------------------------------
+    TRANSPOSEFUNC_T GetTransposeFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return transpose_sse2;
+        }
+#endif
+        return transpose;
+    }
+
+    //-----------------------------------------------------------------
+    TRANSPOSEFUNC_T GetScalarTransposeFunc()
+    {
+        return transpose;
+    }
+
+    //-----------------------------------------------------------------
+    TRANSPOSESQUAREFUNC_T GetTransposeSquareFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return transpose_square_sse2;
+        }
+#endif
+        return transpose_square;
+    }
+
+    //-----------------------------------------------------------------
+    TRANSPOSESQUAREFUNC_T GetScalarTransposeSquareFunc()
+    {
+        return transpose_square;
+    }
+
+    //-----------------------------------------------------------------
+    REVERSESPANFUNC_T GetReverseSpanFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return reverse_span_sse2;
+        }
+#endif
+        return reverse_span;
+    }
+
+    //-----------------------------------------------------------------
+    REVERSESPANFUNC_T GetScalarReverseSpanFunc()
+    {
+        return reverse_span;
+    }
+
+} // namespace sphere
@@ -0,0 +1,52 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_TRANSFORM_HPP
+#define SPHERE_TRANSFORM_HPP
+
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Transposers write the width x height image src transposed to dst,
+    // i.e. dst[x * dstPitch + y] = src[y * srcPitch + x]. They work on
+    // cache-sized blocks so that neither side is walked across rows one
+    // pixel at a time. Pitches are in pixels and may be negative, which
+    // mirrors the image and turns the transpose into a 90 degree turn.
+    typedef void (*TRANSPOSEFUNC_T)(const RGBA* src, int srcPitch, RGBA* dst, int dstPitch, int width, int height);
+
+    // Transposes the size x size image pixels in place
+    typedef void (*TRANSPOSESQUAREFUNC_T)(RGBA* pixels, int size);
+
+    // Reverses the order of n pixels
+    typedef void (*REVERSESPANFUNC_T)(RGBA* pixels, int n);
+
+    // The Get*Func functions return the fastest kernel the CPU supports,
+    // which produces the same result as the scalar one
+    TRANSPOSEFUNC_T       GetTransposeFunc();
+    TRANSPOSEFUNC_T       GetScalarTransposeFunc();
+    TRANSPOSESQUAREFUNC_T GetTransposeSquareFunc();
+    TRANSPOSESQUAREFUNC_T GetScalarTransposeSquareFunc();
+    REVERSESPANFUNC_T     GetReverseSpanFunc();
+    REVERSESPANFUNC_T     GetScalarReverseSpanFunc();
+
+} // namespace sphere
+
+
+#endif
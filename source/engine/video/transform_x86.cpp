@@ -0,0 +1,148 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "../common/platform.hpp"
+#include "transform.hpp"
+
+#if defined(SPHERE_X86)
+
+#include <emmintrin.h>
+
+#if defined(__GNUC__)
+#  define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#  define TARGET_SSE2
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Must match TRANSPOSE_BLOCK_SIZE in transform.cpp, and be a
+    // multiple of 4
+    static const int BLOCK_SIZE = 32;
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    static inline void load_4x4_sse2(const RGBA* src, int pitch, __m128i r[4])
+    {
+        r[0] = _mm_loadu_si128((const __m128i*)(src));
+        r[1] = _mm_loadu_si128((const __m128i*)(src + pitch));
+        r[2] = _mm_loadu_si128((const __m128i*)(src + pitch * 2));
+        r[3] = _mm_loadu_si128((const __m128i*)(src + pitch * 3));
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    static inline void store_4x4_transposed_sse2(RGBA* dst, int pitch, const __m128i r[4])
+    {
+        __m128i t0 = _mm_unpacklo_epi32(r[0], r[1]);  // a0 b0 a1 b1
+        __m128i t1 = _mm_unpacklo_epi32(r[2], r[3]);  // c0 d0 c1 d1
+        __m128i t2 = _mm_unpackhi_epi32(r[0], r[1]);  // a2 b2 a3 b3
+        __m128i t3 = _mm_unpackhi_epi32(r[2], r[3]);  // c2 d2 c3 d3
+        _mm_storeu_si128((__m128i*)(dst),             _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128((__m128i*)(dst + pitch),     _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128((__m128i*)(dst + pitch * 2), _mm_unpacklo_epi64(t2, t3));
+        _mm_storeu_si128((__m128i*)(dst + pitch * 3), _mm_unpackhi_epi64(t2, t3));
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void transpose_sse2(const RGBA* src, int srcPitch, RGBA* dst, int dstPitch, int width, int height)
+    {
+        for (int by = 0; by < height; by += BLOCK_SIZE) {
+            int ey  = std::min(by + BLOCK_SIZE, height);
+            int ey4 = by + ((ey - by) & ~3);
+            for (int bx = 0; bx < width; bx += BLOCK_SIZE) {
+                int ex  = std::min(bx + BLOCK_SIZE, width);
+                int ex4 = bx + ((ex - bx) & ~3);
+
+                for (int y = by; y < ey4; y += 4) {
+                    for (int x = bx; x < ex4; x += 4) {
+                        __m128i r[4];
+                        load_4x4_sse2(src + y * srcPitch + x, srcPitch, r);
+                        store_4x4_transposed_sse2(dst + x * dstPitch + y, dstPitch, r);
+                    }
+                }
+
+                // the right and bottom edges of the block
+                for (int y = by; y < ey; ++y) {
+                    const RGBA* s = src + y * srcPitch;
+                    for (int x = (y < ey4 ? ex4 : bx); x < ex; ++x) {
+                        dst[x * dstPitch + y] = s[x];
+                    }
+                }
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void transpose_square_sse2(RGBA* pixels, int size)
+    {
+        int size4 = size & ~3;
+
+        // swap the 4x4 tiles above the diagonal with the ones below it,
+        // the tiles on the diagonal are swapped with themselves
+        for (int by = 0; by < size4; by += BLOCK_SIZE) {
+            int ey = std::min(by + BLOCK_SIZE, size4);
+            for (int bx = by; bx < size4; bx += BLOCK_SIZE) {
+                int ex = std::min(bx + BLOCK_SIZE, size4);
+                for (int y = by; y < ey; y += 4) {
+                    for (int x = std::max(bx, y); x < ex; x += 4) {
+                        RGBA* a = pixels + y * size + x;
+                        RGBA* b = pixels + x * size + y;
+                        __m128i ra[4];
+                        __m128i rb[4];
+                        load_4x4_sse2(a, size, ra);
+                        load_4x4_sse2(b, size, rb);
+                        store_4x4_transposed_sse2(b, size, ra);
+                        store_4x4_transposed_sse2(a, size, rb);
+                    }
+                }
+            }
+        }
+
+        // the last size % 4 columns and their mirrored rows
+        for (int y = 0; y < size; ++y) {
+            for (int x = std::max(size4, y + 1); x < size; ++x) {
+                std::swap(pixels[y * size + x], pixels[x * size + y]);
+            }
+        }
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    void reverse_span_sse2(RGBA* pixels, int n)
+    {
+        RGBA* l = pixels;
+        RGBA* r = pixels + n;
+        while (r - l >= 8) {
+            r -= 4;
+            __m128i a = _mm_loadu_si128((const __m128i*)l);
+            __m128i b = _mm_loadu_si128((const __m128i*)r);
+            _mm_storeu_si128((__m128i*)l, _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 1, 2, 3)));
+            _mm_storeu_si128((__m128i*)r, _mm_shuffle_epi32(a, _MM_SHUFFLE(0, 1, 2, 3)));
+            l += 4;
+        }
+        std::reverse(l, r);
+    }
+
+} // namespace sphere
+
+#endif
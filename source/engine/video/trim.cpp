@@ -0,0 +1,91 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/platform.hpp"
+#include "../core/cpu.hpp"
+#include "trim.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    static int find_first_pixel(const RGBA* pixels, int n, u32 mask)
+    {
+        const u32* p = (const u32*)pixels;
+        for (int i = 0; i < n; ++i) {
+            if (p[i] & mask) {
+                return i;
+            }
+        }
+        return n;
+    }
+
+    //-----------------------------------------------------------------
+    static int find_last_pixel(const RGBA* pixels, int n, u32 mask)
+    {
+        const u32* p = (const u32*)pixels;
+        for (int i = n - 1; i >= 0; --i) {
+            if (p[i] & mask) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+#if defined(SPHERE_X86)
+    // defined in trim_x86.cpp
+    int find_first_pixel_sse2(const RGBA* pixels, int n, u32 mask);
+    int find_last_pixel_sse2(const RGBA* pixels, int n, u32 mask);
+#endif
+
+    //-----------------------------------------------------------------
+    FINDPIXELFUNC_T GetFindFirstPixelFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return find_first_pixel_sse2;
+        }
+#endif
+        return find_first_pixel;
+    }
+
+    //-----------------------------------------------------------------
+    FINDPIXELFUNC_T GetFindLastPixelFunc()
+    {
+#if defined(SPHERE_X86)
+        static const bool sse2 = cpu::HasSSE2();
+        if (sse2) {
+            return find_last_pixel_sse2;
+        }
+#endif
+        return find_last_pixel;
+    }
+
+    //-----------------------------------------------------------------
+    FINDPIXELFUNC_T GetScalarFindFirstPixelFunc()
+    {
+        return find_first_pixel;
+    }
+
+    //-----------------------------------------------------------------
+    FINDPIXELFUNC_T GetScalarFindLastPixelFunc()
+    {
+        return find_last_pixel;
+    }
+
+} // namespace sphere
@@ -0,0 +1,43 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPHERE_TRIM_HPP
+#define SPHERE_TRIM_HPP
+
+#include "../common/types.hpp"
+#include "RGBA.hpp"
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // Scans for the pixels which have any of the bits of mask set, to
+    // find the part of an image that isn't transparent. The first pixel
+    // function returns the index of the first such pixel, or n if there
+    // is none, the last pixel function the index of the last one, or -1.
+    // The Get functions return the fastest kernels the CPU supports.
+    typedef int (*FINDPIXELFUNC_T)(const RGBA* pixels, int n, u32 mask);
+
+    FINDPIXELFUNC_T GetFindFirstPixelFunc();
+    FINDPIXELFUNC_T GetFindLastPixelFunc();
+    FINDPIXELFUNC_T GetScalarFindFirstPixelFunc();
+    FINDPIXELFUNC_T GetScalarFindLastPixelFunc();
+
+} // namespace sphere
+
+
+#endif
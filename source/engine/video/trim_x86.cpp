@@ -0,0 +1,114 @@
+/*
+    This file is part of GameGears.
+
+    GameGears is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GameGears is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GameGears.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../common/platform.hpp"
+#include "trim.hpp"
+
+#if defined(SPHERE_X86)
+
+#include <emmintrin.h>
+
+#if defined(__GNUC__)
+#  define TARGET_SSE2 __attribute__((target("sse2")))
+#else
+#  define TARGET_SSE2
+#endif
+
+
+namespace sphere {
+
+    //-----------------------------------------------------------------
+    // A bit per byte of the 16 bytes at p, set for the zero bytes of
+    // p & mask
+    TARGET_SSE2
+    static inline int get_zero_mask_sse2(const RGBA* p, __m128i mask)
+    {
+        __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)p), mask);
+        return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128()));
+    }
+
+    //-----------------------------------------------------------------
+    // Whether any of the 16 pixels at p has a bit of mask set
+    TARGET_SSE2
+    static inline bool any_pixel_sse2(const RGBA* p, __m128i mask)
+    {
+        __m128i v = _mm_or_si128(
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)p),       _mm_loadu_si128((const __m128i*)(p + 4))),
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(p + 8)), _mm_loadu_si128((const __m128i*)(p + 12))));
+        v = _mm_and_si128(v, mask);
+        return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) != 0xFFFF;
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    int find_first_pixel_sse2(const RGBA* pixels, int n, u32 mask)
+    {
+        __m128i m = _mm_set1_epi32((int)mask);
+        int i = 0;
+        while (i + 16 <= n && !any_pixel_sse2(pixels + i, m)) {
+            i += 16;
+        }
+        for (; i + 4 <= n; i += 4) {
+            int zero = get_zero_mask_sse2(pixels + i, m);
+            if (zero != 0xFFFF) {
+                for (int k = 0; k < 4; ++k, zero >>= 4) {
+                    if (!(zero & 1)) {
+                        return i + k;
+                    }
+                }
+            }
+        }
+        const u32* p = (const u32*)pixels;
+        for (; i < n; ++i) {
+            if (p[i] & mask) {
+                return i;
+            }
+        }
+        return n;
+    }
+
+    //-----------------------------------------------------------------
+    TARGET_SSE2
+    int find_last_pixel_sse2(const RGBA* pixels, int n, u32 mask)
+    {
+        __m128i m = _mm_set1_epi32((int)mask);
+        int i = n;
+        while (i >= 16 && !any_pixel_sse2(pixels + i - 16, m)) {
+            i -= 16;
+        }
+        for (; i >= 4; i -= 4) {
+            int zero = get_zero_mask_sse2(pixels + i - 4, m);
+            if (zero != 0xFFFF) {
+                for (int k = 3; k >= 0; --k) {
+                    if (!(zero & (1 << (k * 4)))) {
+                        return i - 4 + k;
+                    }
+                }
+            }
+        }
+        const u32* p = (const u32*)pixels;
+        for (--i; i >= 0; --i) {
+            if (p[i] & mask) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+} // namespace sphere
+
+#endif
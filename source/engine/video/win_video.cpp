@@ -17,6 +17,7 @@
 
 #include <cassert>
 #include <cmath>
+#include <algorithm>
 #include <deque>
 #include <sstream>
 #include <windows.h>
@@ -34,6 +35,10 @@
 #include "../../io/numio.hpp"
 #include "../../io/imageio.hpp"
 #include "../video.hpp"
+#include "../SpriteBatch.hpp"
+#include "../GLStateCache.hpp"
+#include "../AtlasPacker.hpp"
+#include "../ResidencyManager.hpp"
 
 #ifndef GL_FUNC_ADD_EXT
 #  define GL_FUNC_ADD_EXT 0x8006
@@ -55,6 +60,10 @@
 
 #define EVENT_QUEUE_MAX_SIZE 1024
 
+#define ATLAS_PAGE_SIZE      1024
+#define ATLAS_MAX_IMAGE_SIZE 128 // including the border
+#define ATLAS_BORDER         1
+
 
 //-----------------------------------------------------------------
 // GL extension function pointers
@@ -64,15 +73,20 @@ void (APIENTRY *glBlendEquationEXT)(GLenum) = 0;
 namespace sphere {
     namespace video {
 
+        struct AtlasPage;
+
         //-----------------------------------------------------------------
-        struct Texture : public RefImpl<ITexture> {
+        // Textures of their own are managed by the residency manager, which
+        // may evict them to their pixels in a canvas
+        struct Texture : public RefImpl<ITexture>, public ResidencyManager::Entry {
             GLuint textureName;
             Dim2i  textureSize;
             Dim2i  size;
+            Vec2i  offset; // where the image starts in the texture
+            AtlasPage* page; // the atlas page holding the image, or 0
+            CanvasPtr  evicted; // the image while the texture isn't resident
 
-            ~Texture() {
-                glDeleteTextures(1, &textureName);
-            }
+            ~Texture();
 
             // ITexture implementation
             const Dim2i& getTextureSize() const {
@@ -105,6 +119,128 @@ namespace sphere {
         int         g_CaptureWidth = 0;
         int         g_CaptureHeight = 0;
 
+        // all changes of the GL state the backend tracks go through it
+        GLStateCache g_GLState;
+
+        //-----------------------------------------------------------------
+        // Draws the batches of the sprite batch from client-side vertex
+        // arrays, whose client states are enabled by InitVideo()
+        class GLSpriteRenderer : public SpriteBatch::IRenderer {
+        public:
+            void drawTriangles(u32 texture, const SpriteBatch::Vertex* vertices, int numVertices) {
+                const GLsizei stride = sizeof(SpriteBatch::Vertex);
+                glVertexPointer(2, GL_FLOAT, stride, &vertices->x);
+                glTexCoordPointer(2, GL_FLOAT, stride, &vertices->u);
+                glColorPointer(4, GL_UNSIGNED_BYTE, stride, &vertices->color);
+                if (texture) {
+                    g_GLState.bindTexture(texture);
+                    g_GLState.enable(GL_TEXTURE_2D);
+                } else {
+                    g_GLState.disable(GL_TEXTURE_2D);
+                }
+                glDrawArrays(GL_TRIANGLES, 0, numVertices);
+
+                // the color array leaves the current color undefined
+                g_GLState.invalidateColor();
+            }
+        };
+
+        // The textured quads and rectangles are batched, so anything that
+        // changes the blend mode, the scissor or a texture, or reads the
+        // frame, has to flush the batch first
+        GLSpriteRenderer g_SpriteRenderer;
+        SpriteBatch      g_SpriteBatch(&g_SpriteRenderer);
+
+        //-----------------------------------------------------------------
+        // Moves the image of an evicted texture out of video memory, the
+        // padding of the texture is transparent and needn't be kept
+        class GLTextureEvictor : public ResidencyManager::IEvictor {
+        public:
+            void evict(ResidencyManager::Entry* entry) {
+                Texture* t = static_cast<Texture*>(entry);
+
+                // queued sprites may still use the texture
+                g_SpriteBatch.flush();
+
+                CanvasPtr pixels = Canvas::Create(t->textureSize.width, t->textureSize.height);
+                g_GLState.bindTexture(t->textureName);
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels->getPixels());
+                if (t->textureSize.width  != t->size.width ||
+                    t->textureSize.height != t->size.height)
+                {
+                    pixels = pixels->cloneSection(Recti(0, 0, t->size.width - 1, t->size.height - 1));
+                }
+                t->evicted = pixels;
+
+                g_GLState.deleteTexture(t->textureName);
+                t->textureName = 0;
+            }
+        };
+
+        // Accounts the video memory of all textures, no budget by default
+        GLTextureEvictor g_TextureEvictor;
+        ResidencyManager g_TextureResidency(&g_TextureEvictor);
+
+        //-----------------------------------------------------------------
+        static inline u64 GetTextureBytes(int width, int height)
+        {
+            return (u64)width * (u64)height * sizeof(RGBA);
+        }
+
+        //-----------------------------------------------------------------
+        // A shared texture holding the pixels of many small textures,
+        // each surrounded by a transparent border of ATLAS_BORDER pixels
+        // so that sampling at their edges doesn't pick up the neighbours
+        struct AtlasPage {
+            GLuint      textureName;
+            AtlasPacker packer;
+            std::vector<Texture*> textures;
+
+            explicit AtlasPage(int size) : textureName(0), packer(size, size) { }
+        };
+
+        std::vector<AtlasPage*> g_AtlasPages;
+
+        //-----------------------------------------------------------------
+        // Returns the rectangle allocated for an atlas texture, border included
+        static inline Recti GetAtlasRect(const Texture* t)
+        {
+            return Recti(t->offset.x - ATLAS_BORDER,
+                         t->offset.y - ATLAS_BORDER,
+                         t->offset.x + t->size.width  - 1 + ATLAS_BORDER,
+                         t->offset.y + t->size.height - 1 + ATLAS_BORDER);
+        }
+
+        //-----------------------------------------------------------------
+        static void DeleteAtlasPage(AtlasPage* page)
+        {
+            int size = page->packer.getWidth();
+            g_TextureResidency.removePinnedBytes(GetTextureBytes(size, size));
+            g_GLState.deleteTexture(page->textureName);
+            g_AtlasPages.erase(std::find(g_AtlasPages.begin(), g_AtlasPages.end(), page));
+            delete page;
+        }
+
+        //-----------------------------------------------------------------
+        Texture::~Texture()
+        {
+            // queued sprites may still use the texture
+            g_SpriteBatch.flush();
+
+            if (page) {
+                page->textures.erase(std::find(page->textures.begin(), page->textures.end(), this));
+                page->packer.release(GetAtlasRect(this));
+
+                // an empty page is cleared, keep one for the next textures
+                if (page->textures.empty() && g_AtlasPages.size() > 1) {
+                    DeleteAtlasPage(page);
+                }
+            } else if (resident) {
+                g_TextureResidency.remove(this);
+                g_GLState.deleteTexture(textureName);
+            }
+        }
+
         static int WinKeyToSphereKey[256] = {
             /* 0x00 */ -1,
             /* 0x01 */ -1,
@@ -383,6 +519,8 @@ namespace sphere {
             assert(width > 0);
             assert(height > 0);
 
+            g_SpriteBatch.flush();
+
             if (g_WindowSize.width != width || g_WindowSize.height != height) {
                 if (g_WindowIsFullScreen) {
                     // restore display mode to defaults
@@ -422,7 +560,7 @@ namespace sphere {
                 glTranslatef(0.375, 0.375, 0.0);
 
                 // reset clipping rectangle
-                glScissor(0, 0, width, height);
+                g_GLState.scissor(0, 0, width, height);
             }
 
             if (fullScreen && !g_WindowIsFullScreen) {
@@ -571,8 +709,19 @@ namespace sphere {
         void SwapWindowBuffers()
         {
             assert(g_Window);
+            g_SpriteBatch.flush();
             SwapBuffers(g_DeviceContext);
             glClear(GL_COLOR_BUFFER_BIT);
+            g_GLState.endFrame();
+        }
+
+        //-----------------------------------------------------------------
+        // The GL state calls of the last frame, those passed on to GL and
+        // those the state cache dropped
+        void GetFrameStateStats(u64& issued, u64& filtered)
+        {
+            issued   = g_GLState.getFrameStats().issued;
+            filtered = g_GLState.getFrameStats().filtered;
         }
 
         //-----------------------------------------------------------------
@@ -609,8 +758,11 @@ namespace sphere {
         //-----------------------------------------------------------------
         void GetFrameScissor(Recti& scissor)
         {
+            // the shadowed box saves a pipeline stall
             GLint rect[4];
-            glGetIntegerv(GL_SCISSOR_BOX, rect);
+            if (!g_GLState.getScissor(rect)) {
+                glGetIntegerv(GL_SCISSOR_BOX, rect);
+            }
 
             scissor.ul.x = rect[0];
             scissor.ul.y = rect[1] - g_WindowSize.height + rect[3];
@@ -624,12 +776,23 @@ namespace sphere {
             if (!Recti(0, 0, g_WindowSize.width - 1, g_WindowSize.height - 1).contains(scissor)) {
                 return false;
             }
-            glScissor(
+            GLint box[4] = {
                 scissor.ul.x,
                 (g_WindowSize.height - scissor.getY()) - scissor.getHeight(),
                 scissor.getWidth(),
-                scissor.getHeight()
-            );
+                scissor.getHeight(),
+            };
+
+            // setting the same box again doesn't break the sprite batch
+            GLint current[4];
+            if (g_GLState.getScissor(current) &&
+                current[0] == box[0] && current[1] == box[1] &&
+                current[2] == box[2] && current[3] == box[3])
+            {
+                return true;
+            }
+            g_SpriteBatch.flush();
+            g_GLState.scissor(box[0], box[1], box[2], box[3]);
             return true;
         }
 
@@ -651,6 +814,8 @@ namespace sphere {
                 h = section->getHeight();
             }
 
+            g_SpriteBatch.flush();
+
             // create canvas
             CanvasPtr canvas = Canvas::Create(w, h);
 
@@ -672,48 +837,49 @@ namespace sphere {
         //-----------------------------------------------------------------
         bool SetBlendMode(int blendMode)
         {
+            // setting the same mode again doesn't break the sprite batch
+            if (blendMode == g_BlendMode) {
+                return true;
+            }
+            if (blendMode == BM_SUBTRACT && !g_GLState.hasBlendEquation()) {
+                // subtractive blending needs glBlendEquationEXT
+                return false;
+            }
+            if (blendMode < BM_REPLACE || blendMode > BM_MULTIPLY) {
+                return false;
+            }
+            g_SpriteBatch.flush();
             switch (blendMode) {
                 case BM_REPLACE:
-                    if (glBlendEquationEXT) {
-                        glBlendEquationEXT(GL_FUNC_ADD_EXT);
-                    }
-                    glBlendFunc(GL_ONE, GL_ZERO);
+                    g_GLState.blendEquation(GL_FUNC_ADD_EXT);
+                    g_GLState.blendFunc(GL_ONE, GL_ZERO);
                     break;
                 case BM_ALPHA:
-                    if (glBlendEquationEXT) {
-                        glBlendEquationEXT(GL_FUNC_ADD_EXT);
-                    }
-                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                    g_GLState.blendEquation(GL_FUNC_ADD_EXT);
+                    g_GLState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
                     break;
                 case BM_ADD:
-                    if (glBlendEquationEXT) {
-                        glBlendEquationEXT(GL_FUNC_ADD_EXT);
-                    }
-                    glBlendFunc(GL_ONE, GL_ONE);
+                    g_GLState.blendEquation(GL_FUNC_ADD_EXT);
+                    g_GLState.blendFunc(GL_ONE, GL_ONE);
                     break;
                 case BM_SUBTRACT:
-                    if (!glBlendEquationEXT) {
-                        // subtractive blending needs glBlendEquationEXT
-                        return false;
-                    }
-                    glBlendEquationEXT(GL_FUNC_REVERSE_SUBTRACT_EXT);
-                    glBlendFunc(GL_ONE, GL_ONE);
+                    g_GLState.blendEquation(GL_FUNC_REVERSE_SUBTRACT_EXT);
+                    g_GLState.blendFunc(GL_ONE, GL_ONE);
                     break;
                 case BM_MULTIPLY:
-                    if (glBlendEquationEXT) {
-                        glBlendEquationEXT(GL_FUNC_ADD_EXT);
-                    }
-                    glBlendFunc(GL_DST_COLOR, GL_ZERO);
+                    g_GLState.blendEquation(GL_FUNC_ADD_EXT);
+                    g_GLState.blendFunc(GL_DST_COLOR, GL_ZERO);
                     break;
-                default:
-                    return false;
             }
             g_BlendMode = blendMode;
             return true;
         }
 
         //-----------------------------------------------------------------
-        ITexture* CreateTexture(int width, int height, const RGBA* pixels)
+        // Uploads width x height pixels, whose rows are pitch pixels apart,
+        // into a new GL texture of textureSize. Returns 0 if the texture
+        // would be too large.
+        static GLuint UploadGLTexture(int width, int height, const RGBA* pixels, int pitch, Dim2i& textureSize)
         {
             assert(width  > 0);
             assert(height > 0);
@@ -747,13 +913,15 @@ namespace sphere {
             if (pixels) {
                 tex_p = (RGBA*)pixels;
 
-                if (tex_w != width || tex_h != height) {
-                    // allocate a new pixel buffer
+                if (tex_w != width || tex_h != height || pitch != width) {
+                    // allocate a new pixel buffer, the padding is transparent
+                    // as the draw functions may sample it beyond the image
                     tex_p = new RGBA[tex_w * tex_h];
+                    std::fill(tex_p, tex_p + tex_w * tex_h, RGBA(0, 0, 0, 0));
 
                     // copy the pixels into the new buffer
                     for (int i = 0; i < height; i++) {
-                        memcpy(tex_p + i * tex_w, pixels + i * width, width * sizeof(RGBA));
+                        memcpy(tex_p + i * tex_w, pixels + i * pitch, width * sizeof(RGBA));
                     }
                 }
             }
@@ -763,7 +931,7 @@ namespace sphere {
             glGenTextures(1, &tex_n);
 
             // bind texture
-            glBindTexture(GL_TEXTURE_2D, tex_n);
+            g_GLState.bindTexture(tex_n);
 
             // set up wrap parameters
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
@@ -776,22 +944,268 @@ namespace sphere {
             // define pixels
             glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex_w, tex_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, tex_p);
 
-            // unbind texture
-            glBindTexture(GL_TEXTURE_2D, 0);
-
             // if we allocated a buffer, delete it
             if (tex_p && tex_p != pixels) {
                 delete[] tex_p;
             }
 
+            textureSize = Dim2i(tex_w, tex_h);
+            return tex_n;
+        }
+
+        //-----------------------------------------------------------------
+        // Creates a texture of width x height pixels, whose rows are pitch
+        // pixels apart
+        static Texture* CreateGLTexture(int width, int height, const RGBA* pixels, int pitch)
+        {
+            Dim2i  tex_size;
+            GLuint tex_n = UploadGLTexture(width, height, pixels, pitch, tex_size);
+            if (tex_n == 0) {
+                return 0;
+            }
+
             Texture* t = new Texture;
             t->textureName = tex_n;
-            t->textureSize = Dim2i(tex_w, tex_h);
+            t->textureSize = tex_size;
             t->size        = Dim2i(width, height);
+            t->offset      = Vec2i(0, 0);
+            t->page        = 0;
 
+            g_TextureResidency.add(t, GetTextureBytes(tex_size.width, tex_size.height));
             return t;
         }
 
+        //-----------------------------------------------------------------
+        // Makes an evicted texture resident again, which stalls until its
+        // pixels are uploaded, or marks a resident one as recently used
+        static inline void UseTexture(Texture* t)
+        {
+            if (t->page) {
+                return;
+            }
+            if (t->resident) {
+                g_TextureResidency.touch(t);
+                return;
+            }
+
+            const Canvas* pixels = t->evicted.get();
+            assert(pixels);
+            t->textureName = UploadGLTexture(pixels->getWidth(), pixels->getHeight(), pixels->getPixels(), pixels->getStride(), t->textureSize);
+            assert(t->textureName);
+            t->evicted.reset();
+            g_TextureResidency.add(t, GetTextureBytes(t->textureSize.width, t->textureSize.height), true);
+        }
+
+        //-----------------------------------------------------------------
+        // Limits the video memory of the textures to budget bytes, evicting
+        // the least recently drawn ones if needed. 0 means unlimited.
+        void SetTextureBudget(u64 budget)
+        {
+            g_TextureResidency.setBudget(budget);
+        }
+
+        //-----------------------------------------------------------------
+        // The resident bytes, atlas pages included, the evictions and the
+        // reloads of evicted textures, each of which stalled a draw call
+        const ResidencyManager::Stats& GetTextureStats()
+        {
+            return g_TextureResidency.getStats();
+        }
+
+        //-----------------------------------------------------------------
+        static AtlasPage* CreateAtlasPage()
+        {
+            int size = std::min(ATLAS_PAGE_SIZE, g_MaxTextureSize);
+
+            // the borders have to be transparent
+            std::vector<RGBA> pixels(size * size, RGBA(0, 0, 0, 0));
+
+            AtlasPage* page = new AtlasPage(size);
+            glGenTextures(1, &page->textureName);
+            g_GLState.bindTexture(page->textureName);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+
+            // atlas pages are never evicted
+            g_AtlasPages.push_back(page);
+            g_TextureResidency.addPinnedBytes(GetTextureBytes(size, size));
+            return page;
+        }
+
+        //-----------------------------------------------------------------
+        // Allocates width x height pixels in an atlas page, adding a page
+        // if none of them has enough room
+        static AtlasPage* AllocateAtlasRect(int width, int height, Recti& rect)
+        {
+            for (size_t i = 0; i < g_AtlasPages.size(); ++i) {
+                if (g_AtlasPages[i]->packer.insert(width, height, rect)) {
+                    return g_AtlasPages[i];
+                }
+            }
+            AtlasPage* page = CreateAtlasPage();
+            if (!page->packer.insert(width, height, rect)) {
+                return 0;
+            }
+            return page;
+        }
+
+        //-----------------------------------------------------------------
+        // Puts the texture into an atlas region, whose pixels are at offset
+        static void AttachAtlasRect(Texture* t, AtlasPage* page, const Recti& rect)
+        {
+            t->textureName = page->textureName;
+            t->textureSize = Dim2i(page->packer.getWidth(), page->packer.getHeight());
+            t->offset      = Vec2i(rect.ul.x + ATLAS_BORDER, rect.ul.y + ATLAS_BORDER);
+            t->page        = page;
+            page->textures.push_back(t);
+        }
+
+        //-----------------------------------------------------------------
+        // Uploads the pixels of an atlas texture along with its border,
+        // as the page may still hold those of a released texture there
+        static void UploadAtlasRect(const Texture* t, const RGBA* pixels, int pitch)
+        {
+            Recti rect = GetAtlasRect(t);
+            std::vector<RGBA> buffer(rect.getWidth() * rect.getHeight(), RGBA(0, 0, 0, 0));
+            if (pixels) {
+                for (int iy = 0; iy < t->size.height; ++iy) {
+                    memcpy(&buffer[(iy + ATLAS_BORDER) * rect.getWidth() + ATLAS_BORDER], pixels + iy * pitch, t->size.width * sizeof(RGBA));
+                }
+            }
+            g_GLState.bindTexture(t->textureName);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, rect.ul.x, rect.ul.y, rect.getWidth(), rect.getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, &buffer[0]);
+        }
+
+        //-----------------------------------------------------------------
+        static bool IsTallerTexture(const Texture* a, const Texture* b)
+        {
+            if (a->size.height != b->size.height) {
+                return a->size.height > b->size.height;
+            }
+            return a->size.width > b->size.width;
+        }
+
+        //-----------------------------------------------------------------
+        // Repacks the textures of all atlas pages into as few new pages as
+        // possible, reclaiming the area of released textures. The texture
+        // handles stay valid.
+        void DefragmentAtlas()
+        {
+            if (g_AtlasPages.empty()) {
+                return;
+            }
+
+            // queued sprites use the old pages
+            g_SpriteBatch.flush();
+
+            std::vector<AtlasPage*> old_pages;
+            old_pages.swap(g_AtlasPages);
+
+            // read back the old pages
+            int size = old_pages[0]->packer.getWidth();
+            std::vector<RGBA> pixels(old_pages.size() * size * size);
+            std::vector<Texture*> textures;
+            for (size_t i = 0; i < old_pages.size(); ++i) {
+                g_GLState.bindTexture(old_pages[i]->textureName);
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[i * size * size]);
+                textures.insert(textures.end(), old_pages[i]->textures.begin(), old_pages[i]->textures.end());
+            }
+
+            // the tallest first packs tightest
+            std::sort(textures.begin(), textures.end(), IsTallerTexture);
+
+            for (size_t i = 0; i < textures.size(); ++i) {
+                Texture* t = textures[i];
+                size_t old_index = std::find(old_pages.begin(), old_pages.end(), t->page) - old_pages.begin();
+                const RGBA* src = &pixels[old_index * size * size + t->offset.y * size + t->offset.x];
+
+                Recti rect = GetAtlasRect(t);
+                AtlasPage* page = AllocateAtlasRect(rect.getWidth(), rect.getHeight(), rect);
+                assert(page);
+                AttachAtlasRect(t, page, rect);
+                UploadAtlasRect(t, src, size);
+            }
+
+            for (size_t i = 0; i < old_pages.size(); ++i) {
+                g_TextureResidency.removePinnedBytes(GetTextureBytes(size, size));
+                g_GLState.deleteTexture(old_pages[i]->textureName);
+                delete old_pages[i];
+            }
+        }
+
+        //-----------------------------------------------------------------
+        // Creates a texture in an atlas page, so that it shares the GL
+        // texture, and the sprite batches, with other small textures.
+        // Returns 0 if the image is too large for the atlas.
+        static Texture* CreateAtlasTexture(int width, int height, const RGBA* pixels, int pitch)
+        {
+            assert(width  > 0);
+            assert(height > 0);
+
+            if (width  + 2 * ATLAS_BORDER > ATLAS_MAX_IMAGE_SIZE ||
+                height + 2 * ATLAS_BORDER > ATLAS_MAX_IMAGE_SIZE ||
+                g_MaxTextureSize < ATLAS_MAX_IMAGE_SIZE)
+            {
+                return 0;
+            }
+
+            // released textures leave dead area behind, which only
+            // repacking reclaims, do so once it adds up to a whole page
+            int dead_area = 0;
+            for (size_t i = 0; i < g_AtlasPages.size(); ++i) {
+                dead_area += g_AtlasPages[i]->packer.getDeadArea();
+            }
+            if (!g_AtlasPages.empty() && dead_area >= g_AtlasPages[0]->packer.getWidth() * g_AtlasPages[0]->packer.getHeight()) {
+                DefragmentAtlas();
+            }
+
+            Recti rect;
+            AtlasPage* page = AllocateAtlasRect(width + 2 * ATLAS_BORDER, height + 2 * ATLAS_BORDER, rect);
+            if (!page) {
+                return 0;
+            }
+
+            // the whole image is kept, as quads sample it up to its corners
+            Texture* t = new Texture;
+            t->size = Dim2i(width, height);
+            AttachAtlasRect(t, page, rect);
+
+            // no queued sprite uses the allocated region
+            UploadAtlasRect(t, pixels, pitch);
+
+            return t;
+        }
+
+        //-----------------------------------------------------------------
+        ITexture* CreateTexture(int width, int height, const RGBA* pixels)
+        {
+            Texture* t = CreateAtlasTexture(width, height, pixels, width);
+            if (t) {
+                return t;
+            }
+            return CreateGLTexture(width, height, pixels, width);
+        }
+
+        //-----------------------------------------------------------------
+        // Creates a texture of the canvas, small images go to an atlas
+        // page. The transparent borders aren't trimmed, as they still
+        // matter in the other blend modes and may be updated later.
+        ITexture* CreateTexture(Canvas* canvas)
+        {
+            assert(canvas);
+
+            // const access doesn't copy the pixels of views
+            const Canvas* image = canvas;
+            Texture* t = CreateAtlasTexture(image->getWidth(), image->getHeight(), image->getPixels(), image->getStride());
+            if (t) {
+                return t;
+            }
+            return CreateGLTexture(image->getWidth(), image->getHeight(), image->getPixels(), image->getStride());
+        }
+
         //-----------------------------------------------------------------
         bool UpdateTexturePixels(ITexture* texture, Canvas* newPixels, Recti* rect)
         {
@@ -799,6 +1213,7 @@ namespace sphere {
             assert(newPixels);
 
             Texture* t = (Texture*)texture;
+            UseTexture(t);
 
             int x = 0;
             int y = 0;
@@ -822,15 +1237,65 @@ namespace sphere {
                 return false;
             }
 
+            x += t->offset.x;
+            y += t->offset.y;
+
+            // queued sprites have to be drawn with the old pixels
+            g_SpriteBatch.flush();
+
             // bind texture
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
+            g_GLState.bindTexture(t->textureName);
 
-            // update texture pixels
-            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, newPixels->getPixels());
+            // update texture pixels, const access doesn't copy the pixels of views
+            const Canvas* src = newPixels;
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, src->getStride());
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, src->getPixels());
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
-            // unbind texture
-            glBindTexture(GL_TEXTURE_2D, 0);
+            return true;
+        }
+
+        //-----------------------------------------------------------------
+        bool UpdateTextureDirtyPixels(ITexture* texture, Canvas* canvas)
+        {
+            assert(texture);
+            assert(canvas);
+
+            Texture* t = (Texture*)texture;
+            UseTexture(t);
+
+            if (canvas->getWidth()  != t->getSize().width ||
+                canvas->getHeight() != t->getSize().height)
+            {
+                return false;
+            }
+
+            canvas->flush();
 
+            const DirtyRegion& dirty = canvas->getDirtyRegion();
+            if (dirty.isEmpty()) {
+                return true;
+            }
+
+            // const access, so reading the pixels doesn't dirty them all
+            const RGBA* pixels = ((const Canvas*)canvas)->getPixels();
+
+            // queued sprites have to be drawn with the old pixels
+            g_SpriteBatch.flush();
+
+            // bind texture
+            g_GLState.bindTexture(t->textureName);
+
+            // upload the dirty rectangles straight out of the canvas
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, canvas->getStride());
+            for (int i = 0; i < dirty.getNumRects(); ++i) {
+                const Recti& r = dirty.getRect(i);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, r.ul.x + t->offset.x, r.ul.y + t->offset.y, r.getWidth(), r.getHeight(), GL_RGBA, GL_UNSIGNED_BYTE,
+                                pixels + r.ul.y * canvas->getStride() + r.ul.x);
+            }
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+            canvas->clearDirtyRegion();
             return true;
         }
 
@@ -840,18 +1305,21 @@ namespace sphere {
             assert(texture);
 
             Texture* t = (Texture*)texture;
+            UseTexture(t);
 
             // create canvas
             CanvasPtr canvas = Canvas::Create(t->textureSize.width, t->textureSize.height);
 
             // bind texture
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
+            g_GLState.bindTexture(t->textureName);
 
             // copy texture pixels into canvas
             glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, canvas->getPixels());
 
-            // unbind texture
-            glBindTexture(GL_TEXTURE_2D, 0);
+            // cut the image of an atlas texture out of the page
+            if (t->page) {
+                return canvas->cloneSection(Recti(t->offset.x, t->offset.y, t->offset.x + t->size.width - 1, t->offset.y + t->size.height - 1));
+            }
 
             // resize canvas to the real image dimensions
             canvas->resize(t->size.width, t->size.height);
@@ -872,13 +1340,17 @@ namespace sphere {
             int w = rect.getWidth();
             int h = rect.getHeight();
 
+            // the capture has to include the queued sprites, which may
+            // also still use the old capture
+            g_SpriteBatch.flush();
+
             // if not yet created, create the capture texture
             if (g_Capture == 0) {
                 // create texture name
                 glGenTextures(1, &g_Capture);
 
                 // bind texture
-                glBindTexture(GL_TEXTURE_2D, g_Capture);
+                g_GLState.bindTexture(g_Capture);
 
                 // set up wrap parameters
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
@@ -916,7 +1388,7 @@ namespace sphere {
                 }
 
                 // bind texture
-                glBindTexture(GL_TEXTURE_2D, g_Capture);
+                g_GLState.bindTexture(g_Capture);
 
                 // allocate new texture buffer
                 glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tex_w, tex_h, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
@@ -926,7 +1398,7 @@ namespace sphere {
             }
 
             // bind the capture texture
-            glBindTexture(GL_TEXTURE_2D, g_Capture);
+            g_GLState.bindTexture(g_Capture);
 
             // copy pixels from frame buffer into the capture texture
             glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, x, y, w, h);
@@ -934,6 +1406,30 @@ namespace sphere {
             return true;
         }
 
+        //-----------------------------------------------------------------
+        static inline void AddSpriteQuad(GLuint texture, Vec2i pos[4], GLfloat x1, GLfloat y1, GLfloat x2, GLfloat y2, const RGBA& mask)
+        {
+            SpriteBatch::Vertex quad[4] = {
+                SpriteBatch::MakeVertex(pos[0].x, pos[0].y, x1, y1, mask),
+                SpriteBatch::MakeVertex(pos[1].x, pos[1].y, x2, y1, mask),
+                SpriteBatch::MakeVertex(pos[2].x, pos[2].y, x2, y2, mask),
+                SpriteBatch::MakeVertex(pos[3].x, pos[3].y, x1, y2, mask),
+            };
+            g_SpriteBatch.addQuad(texture, quad);
+        }
+
+        //-----------------------------------------------------------------
+        static inline void AddSpriteRect(GLuint texture, int x, int y, int w, int h, GLfloat tx, GLfloat ty, GLfloat tw, GLfloat th, const RGBA& mask)
+        {
+            Vec2i pos[4] = {
+                Vec2i(x,     y),
+                Vec2i(x + w, y),
+                Vec2i(x + w, y + h),
+                Vec2i(x,     y + h),
+            };
+            AddSpriteQuad(texture, pos, tx, ty, tx + tw, ty + th, mask);
+        }
+
         //-----------------------------------------------------------------
         void DrawCaptureQuad(const Recti& rect, Vec2i pos[4], const RGBA& mask)
         {
@@ -951,34 +1447,19 @@ namespace sphere {
             GLfloat  w = (GLfloat)rect.getWidth()  / (GLfloat)g_CaptureWidth;
             GLfloat  h = (GLfloat)rect.getHeight() / (GLfloat)g_CaptureHeight;
 
-            glBindTexture(GL_TEXTURE_2D, g_Capture);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_QUADS);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(x, y+h);
-            glVertex2i(pos[0].x, pos[0].y);
-
-            glTexCoord2f(x+w, y+h);
-            glVertex2i(pos[1].x, pos[1].y);
-
-            glTexCoord2f(x+w, y);
-            glVertex2i(pos[2].x, pos[2].y);
-
-            glTexCoord2f(x, y);
-            glVertex2i(pos[3].x, pos[3].y);
-
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            // the capture is upside down
+            AddSpriteQuad(g_Capture, pos, x, y + h, x + w, y, mask);
         }
 
         //-----------------------------------------------------------------
         void DrawPoint(const Vec2i& pos, const RGBA& color)
         {
+            g_SpriteBatch.flush();
+            g_GLState.disable(GL_TEXTURE_2D);
+
             glBegin(GL_POINTS);
 
-            glColor4ubv((GLubyte*)&color);
+            g_GLState.color(color);
             glVertex2i(pos.x, pos.y);
 
             glEnd();
@@ -987,12 +1468,15 @@ namespace sphere {
         //-----------------------------------------------------------------
         void DrawLine(Vec2i pos[2], RGBA col[2])
         {
+            g_SpriteBatch.flush();
+            g_GLState.disable(GL_TEXTURE_2D);
+
             glBegin(GL_LINES);
 
-            glColor4ubv((GLubyte*)&col[0]);
+            g_GLState.color(col[0]);
             glVertex2i(pos[0].x, pos[0].y);
 
-            glColor4ubv((GLubyte*)&col[1]);
+            g_GLState.color(col[1]);
             glVertex2i(pos[1].x, pos[1].y);
 
             glEnd();
@@ -1001,18 +1485,12 @@ namespace sphere {
         //-----------------------------------------------------------------
         void DrawTriangle(Vec2i pos[3], RGBA col[3])
         {
-            glBegin(GL_TRIANGLES);
-
-            glColor4ubv((GLubyte*)&col[0]);
-            glVertex2i(pos[0].x, pos[0].y);
-
-            glColor4ubv((GLubyte*)&col[1]);
-            glVertex2i(pos[1].x, pos[1].y);
-
-            glColor4ubv((GLubyte*)&col[2]);
-            glVertex2i(pos[2].x, pos[2].y);
-
-            glEnd();
+            SpriteBatch::Vertex triangle[3] = {
+                SpriteBatch::MakeVertex(pos[0].x, pos[0].y, 0, 0, col[0]),
+                SpriteBatch::MakeVertex(pos[1].x, pos[1].y, 0, 0, col[1]),
+                SpriteBatch::MakeVertex(pos[2].x, pos[2].y, 0, 0, col[2]),
+            };
+            g_SpriteBatch.addTriangle(0, triangle);
         }
 
         //-----------------------------------------------------------------
@@ -1022,21 +1500,13 @@ namespace sphere {
                 return;
             }
 
-            glBegin(GL_QUADS);
-
-            glColor4ubv((GLubyte*)&col[0]);
-            glVertex2i(rect.ul.x, rect.ul.y);
-
-            glColor4ubv((GLubyte*)&col[1]);
-            glVertex2i(rect.lr.x + 1, rect.ul.y);
-
-            glColor4ubv((GLubyte*)&col[2]);
-            glVertex2i(rect.lr.x + 1, rect.lr.y + 1);
-
-            glColor4ubv((GLubyte*)&col[3]);
-            glVertex2i(rect.ul.x, rect.lr.y + 1);
-
-            glEnd();
+            SpriteBatch::Vertex quad[4] = {
+                SpriteBatch::MakeVertex(rect.ul.x,     rect.ul.y,     0, 0, col[0]),
+                SpriteBatch::MakeVertex(rect.lr.x + 1, rect.ul.y,     0, 0, col[1]),
+                SpriteBatch::MakeVertex(rect.lr.x + 1, rect.lr.y + 1, 0, 0, col[2]),
+                SpriteBatch::MakeVertex(rect.ul.x,     rect.lr.y + 1, 0, 0, col[3]),
+            };
+            g_SpriteBatch.addQuad(0, quad);
         }
 
         //-----------------------------------------------------------------
@@ -1045,29 +1515,13 @@ namespace sphere {
             assert(image);
 
             Texture* t = (Texture*)image;
+            UseTexture(t);
+            GLfloat  u = (GLfloat)t->offset.x    / (GLfloat)t->textureSize.width;
+            GLfloat  v = (GLfloat)t->offset.y    / (GLfloat)t->textureSize.height;
             GLfloat  w = (GLfloat)t->size.width  / (GLfloat)t->textureSize.width;
             GLfloat  h = (GLfloat)t->size.height / (GLfloat)t->textureSize.height;
 
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_QUADS);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(0, 0);
-            glVertex2i(pos.x, pos.y);
-
-            glTexCoord2f(w, 0);
-            glVertex2i(pos.x + t->size.width, pos.y);
-
-            glTexCoord2f(w, h);
-            glVertex2i(pos.x + t->size.width, pos.y + t->size.height);
-
-            glTexCoord2f(0, h);
-            glVertex2i(pos.x, pos.y + t->size.height);
-
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            AddSpriteRect(t->textureName, pos.x, pos.y, t->size.width, t->size.height, u, v, w, h, mask);
         }
 
         //-----------------------------------------------------------------
@@ -1081,31 +1535,13 @@ namespace sphere {
             }
 
             Texture* t = (Texture*)image;
-            GLfloat  x = (GLfloat)rect.getX()      / (GLfloat)t->textureSize.width;
-            GLfloat  y = (GLfloat)rect.getY()      / (GLfloat)t->textureSize.height;
+            UseTexture(t);
+            GLfloat  x = (GLfloat)(rect.getX() + t->offset.x) / (GLfloat)t->textureSize.width;
+            GLfloat  y = (GLfloat)(rect.getY() + t->offset.y) / (GLfloat)t->textureSize.height;
             GLfloat  w = (GLfloat)rect.getWidth()  / (GLfloat)t->textureSize.width;
             GLfloat  h = (GLfloat)rect.getHeight() / (GLfloat)t->textureSize.height;
 
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_QUADS);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(x, y);
-            glVertex2i(pos.x, pos.y);
-
-            glTexCoord2f(x + w, y);
-            glVertex2i(pos.x + rect.getWidth(), pos.y);
-
-            glTexCoord2f(x + w, y + h);
-            glVertex2i(pos.x + rect.getWidth(), pos.y + rect.getHeight());
-
-            glTexCoord2f(x, y + h);
-            glVertex2i(pos.x, pos.y + rect.getHeight());
-
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            AddSpriteRect(t->textureName, pos.x, pos.y, rect.getWidth(), rect.getHeight(), x, y, w, h, mask);
         }
 
         //-----------------------------------------------------------------
@@ -1113,36 +1549,20 @@ namespace sphere {
         {
             assert(texture);
 
-            Texture* t = (Texture*)texture;
-            GLfloat  w = (GLfloat)t->size.width  / (GLfloat)t->textureSize.width;
-            GLfloat  h = (GLfloat)t->size.height / (GLfloat)t->textureSize.height;
-
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_QUADS);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(0, 0);
-            glVertex2i(pos[0].x, pos[0].y);
-
-            glTexCoord2f(w, 0);
-            glVertex2i(pos[1].x, pos[1].y);
-
-            glTexCoord2f(w, h);
-            glVertex2i(pos[2].x, pos[2].y);
-
-            glTexCoord2f(0, h);
-            glVertex2i(pos[3].x, pos[3].y);
+            Texture* t  = (Texture*)texture;
+            UseTexture(t);
+            GLfloat  x1 = (GLfloat)t->offset.x                   / (GLfloat)t->textureSize.width;
+            GLfloat  y1 = (GLfloat)t->offset.y                   / (GLfloat)t->textureSize.height;
+            GLfloat  x2 = (GLfloat)(t->offset.x + t->size.width)  / (GLfloat)t->textureSize.width;
+            GLfloat  y2 = (GLfloat)(t->offset.y + t->size.height) / (GLfloat)t->textureSize.height;
 
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            AddSpriteQuad(t->textureName, pos, x1, y1, x2, y2, mask);
         }
 
         //-----------------------------------------------------------------
         void DrawSubImageQuad(ITexture* image, const Recti& rect, Vec2i pos[4], const RGBA& mask)
         {
-            assert(texture);
+            assert(image);
 
             Recti image_rect(0, 0, image->getSize().width-1, image->getSize().height-1);
             if (!rect.isValid() || !image_rect.contains(rect)) {
@@ -1150,31 +1570,13 @@ namespace sphere {
             }
 
             Texture* t = (Texture*)image;
-            GLfloat  x = (GLfloat)rect.getX()      / (GLfloat)t->textureSize.width;
-            GLfloat  y = (GLfloat)rect.getY()      / (GLfloat)t->textureSize.height;
+            UseTexture(t);
+            GLfloat  x = (GLfloat)(rect.getX() + t->offset.x) / (GLfloat)t->textureSize.width;
+            GLfloat  y = (GLfloat)(rect.getY() + t->offset.y) / (GLfloat)t->textureSize.height;
             GLfloat  w = (GLfloat)rect.getWidth()  / (GLfloat)t->textureSize.width;
             GLfloat  h = (GLfloat)rect.getHeight() / (GLfloat)t->textureSize.height;
 
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_QUADS);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(x, y);
-            glVertex2i(pos[0].x, pos[0].y);
-
-            glTexCoord2f(x + w, y);
-            glVertex2i(pos[1].x, pos[1].y);
-
-            glTexCoord2f(x + w, y + h);
-            glVertex2i(pos[2].x, pos[2].y);
-
-            glTexCoord2f(x, y + h);
-            glVertex2i(pos[3].x, pos[3].y);
-
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            AddSpriteQuad(t->textureName, pos, x, y, x + w, y + h, mask);
         }
 
         //-----------------------------------------------------------------
@@ -1182,27 +1584,17 @@ namespace sphere {
         {
             assert(texture);
 
+            // texcoord is in image coordinates, the image starts at offset
             Texture* t  = (Texture*)texture;
+            UseTexture(t);
             GLfloat  tw = (GLfloat)t->textureSize.width;
             GLfloat  th = (GLfloat)t->textureSize.height;
 
-            glBindTexture(GL_TEXTURE_2D, t->textureName);
-            glEnable(GL_TEXTURE_2D);
-
-            glBegin(GL_TRIANGLES);
-            glColor4ubv((GLubyte*)&mask);
-
-            glTexCoord2f(texcoord[0].x / tw, texcoord[0].y / th);
-            glVertex2i(pos[0].x, pos[0].y);
-
-            glTexCoord2f(texcoord[1].x / tw, texcoord[1].y / th);
-            glVertex2i(pos[1].x, pos[1].y);
-
-            glTexCoord2f(texcoord[2].x / tw, texcoord[2].y / th);
-            glVertex2i(pos[2].x, pos[2].y);
-
-            glEnd();
-            glDisable(GL_TEXTURE_2D);
+            SpriteBatch::Vertex triangle[3];
+            for (int i = 0; i < 3; ++i) {
+                triangle[i] = SpriteBatch::MakeVertex(pos[i].x, pos[i].y, (texcoord[i].x + t->offset.x) / tw, (texcoord[i].y + t->offset.y) / th, mask);
+            }
+            g_SpriteBatch.addTriangle(t->textureName, triangle);
         }
 
         namespace internal {
@@ -1579,6 +1971,7 @@ namespace sphere {
                 // get subtractive blending support
                 if (strstr((const char*)glGetString(GL_EXTENSIONS), "GL_EXT_blend_subtract")) {
                     *((void**)&glBlendEquationEXT) = wglGetProcAddress("glBlendEquationEXT");
+                    g_GLState.setBlendEquationFunc(glBlendEquationEXT);
                     log.info() << "Subtractive blending supported";
                 } else {
                     log.info() << "Subtractive blending not supported";
@@ -1606,17 +1999,23 @@ namespace sphere {
                 glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
                 // set up clipping
-                glEnable(GL_SCISSOR_TEST);
-                glScissor(0, 0, DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
+                g_GLState.enable(GL_SCISSOR_TEST);
+                g_GLState.scissor(0, 0, DEFAULT_WINDOW_WIDTH, DEFAULT_WINDOW_HEIGHT);
 
                 // set up blending
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                g_GLState.enable(GL_BLEND);
+                g_GLState.blendEquation(GL_FUNC_ADD_EXT);
+                g_GLState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
                 g_BlendMode = BM_ALPHA;
 
                 // disable depth testing
                 glDisable(GL_DEPTH_TEST);
 
+                // set up the vertex arrays of the sprite batch
+                glEnableClientState(GL_VERTEX_ARRAY);
+                glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+                glEnableClientState(GL_COLOR_ARRAY);
+
                 return true;
 
             init_video_failed:
@@ -1659,9 +2058,11 @@ namespace sphere {
                     }
 
                     if (g_DeviceContext) {
+                        g_SpriteBatch.flush();
+
                         // delete capture
                         if (g_Capture > 0) {
-                            glDeleteTextures(1, &g_Capture);
+                            g_GLState.deleteTexture(g_Capture);
                             g_Capture = 0;
                             g_CaptureWidth = 0;
                             g_CaptureHeight = 0;
@@ -1686,6 +2087,9 @@ namespace sphere {
                     g_Window = 0;
                 }
 
+                // the state belonged to the destroyed context
+                g_GLState.invalidate();
+
                 // unregister window class
                 UnregisterClass("SphereWindowClass", GetModuleHandle(NULL));
                 memset(&g_WindowClass, 0, sizeof(g_WindowClass));